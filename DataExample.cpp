@@ -1,18 +1,74 @@
 // FOVE Data Example
 // This shows how to fetch and output data from the FOVE service in a console program
+//
+// Usage: FoveDataExample [--record session.csv|session.eyz] [--heatmap prefix] [--share] [--stream udp|tcp host:port [--batch N]]
+// With --record, every eye frame is also written to a CSV file, which the eye data tools (eg. FoveGazePredictionBenchmark) can replay
+// Recordings named *.eyz are compressed instead (see EyeFrameCodec.h), which makes them about 40 times smaller than CSV
+// With --heatmap, a gaze heatmap and the dwell time on each object are accumulated (see GazeHeatmap.h),
+// and written to prefix.ppm and prefix_objects.csv every few seconds
+//
+// Eye frames are captured once, by the main loop, and broadcast to the recording and the heatmap through an EyeFrameChannel,
+// which they each read on their own thread. More consumers (renderer, UI, etc.) can be added the same way.
+// With --share, the frames are also published to other processes, through shared memory (see EyeFrameSharedMemory.h, Linux only)
+// With --stream, the frames are also streamed to another machine, in batches of N frames (4 by default) per packet (see GazeStream.h)
 
+#include "EyeData.h"
+#include "EyeFrameChannel.h"
+#include "EyeFrameCodec.h"
+#include "EyeFrameSharedMemory.h"
 #include "FoveAPI.h"
+#include "GazeHeatmap.h"
+#include "GazeStream.h"
 #include "Util.h"
 #include <chrono>
 #include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 // Use std namespace for convenience
 using namespace std;
 
+// Threads reading every frame of an eye frame channel
+// On destruction, the channel is closed, and the threads finish processing what was already published
+class ChannelConsumers
+{
+public:
+	explicit ChannelConsumers(EyeFrameChannel& channel) : m_channel(channel) {}
+	~ChannelConsumers()
+	{
+		m_channel.close();
+		for (thread& consumer : m_threads)
+			consumer.join();
+	}
+
+	void add(function<void(const EyeFrame&)> consumer)
+	{
+		// The subscriber is created here rather than on the new thread, so it doesn't miss the frames published while the thread starts
+		m_threads.emplace_back([subscriber = EyeFrameChannel::Subscriber(m_channel), consumer = move(consumer), &channel = m_channel]() mutable {
+			EyeFrame frame;
+			while (true)
+			{
+				if (subscriber.waitNext(frame, chrono::milliseconds{100}))
+					consumer(frame);
+				else if (channel.isClosed())
+					break;
+			}
+			if (subscriber.missed() > 0)
+				cerr << "An eye frame consumer fell behind and missed " << subscriber.missed() << " frames" << endl;
+		});
+	}
+
+private:
+	EyeFrameChannel& m_channel;
+	vector<thread> m_threads;
+};
+
 // Helper function to check error responses from the FOVE API
 bool checkError(const Fove::ErrorCode errorCode)
 {
@@ -52,12 +108,117 @@ bool checkError(const Fove::ErrorCode errorCode)
 	return false;
 }
 
-int main()
+int main(const int argc, char** const argv)
 try
 {
+	// Open the recording file if requested
+	ofstream recording;
+	unique_ptr<EyeFrameRecordingWriter> compressedRecording;
+	string heatmapPrefix;
+	bool share = false;
+	string streamTransport;
+	string streamDestination;
+	size_t streamBatch = 4;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc)
+		{
+			const string path = argv[++i];
+			if (path.size() > 4 && path.compare(path.size() - 4, 4, ".eyz") == 0)
+			{
+				compressedRecording = make_unique<EyeFrameRecordingWriter>(path);
+			}
+			else
+			{
+				recording.open(path);
+				if (!recording)
+					throw "Unable to open " + path;
+				writeEyeFrameCsvHeader(recording);
+			}
+		}
+		else if (arg == "--heatmap" && i + 1 < argc)
+		{
+			heatmapPrefix = argv[++i];
+		}
+		else if (arg == "--share")
+		{
+			share = true;
+		}
+		else if (arg == "--stream" && i + 2 < argc)
+		{
+			streamTransport = argv[++i];
+			streamDestination = argv[++i];
+		}
+		else if (arg == "--batch" && i + 1 < argc)
+		{
+			streamBatch = stoul(argv[++i]);
+		}
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--record session.csv|session.eyz] [--heatmap prefix] [--share] [--stream udp|tcp host:port [--batch N]]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Start the consumers of the captured frames
+	// The heatmap is exported from yet another thread, which takes snapshots without ever pausing the accumulation
+	EyeFrameChannel channel;
+	ChannelConsumers consumers(channel);
+	if (recording.is_open())
+		consumers.add([&recording](const EyeFrame& frame) { writeEyeFrameCsv(recording, frame); });
+	if (compressedRecording)
+		consumers.add([&compressedRecording](const EyeFrame& frame) { compressedRecording->write(frame); });
+	shared_ptr<GazeHeatmap> heatmap;
+	if (!heatmapPrefix.empty())
+	{
+		heatmap = make_shared<GazeHeatmap>();
+		consumers.add([heatmap, producer = make_shared<GazeHeatmap::Producer>(*heatmap)](const EyeFrame& frame) { producer->addFrame(frame); });
+		thread([heatmap, heatmapPrefix] {
+			while (true)
+			{
+				this_thread::sleep_for(chrono::seconds{5});
+				try
+				{
+					const GazeHeatmapSnapshot snapshot = heatmap->snapshot();
+					writeHeatmapPpm(snapshot, heatmapPrefix + ".ppm");
+					writeObjectDwellCsv(snapshot, heatmapPrefix + "_objects.csv");
+				}
+				catch (...)
+				{
+					cerr << "Heatmap export failed: " << currentExceptionMessage() << endl;
+				}
+			}
+		}).detach();
+	}
+
+	// Stream the frames if requested
+	// The sender blocks on the network at times (eg. TCP reconnections), which only delays its own consumer thread
+	if (!streamTransport.empty())
+	{
+		const size_t colon = streamDestination.rfind(':');
+		if (colon == string::npos)
+			throw "Expected host:port, got " + streamDestination;
+		const auto sender = make_shared<GazeStreamSender>(parseGazeStreamTransport(streamTransport), streamDestination.substr(0, colon),
+														  static_cast<uint16_t>(stoul(streamDestination.substr(colon + 1))), streamBatch);
+		consumers.add([sender](const EyeFrame& frame) { sender->send(frame); });
+		cout << "Streaming eye frames to " << streamDestination << " over " << streamTransport << endl;
+	}
+
+	// Publish the frames to other processes if requested
+	// They are published straight from the capture loop, which is the lowest latency, and only costs a copy into the shared memory
+	unique_ptr<EyeFramePublisher> sharedPublisher;
+	if (share)
+	{
+		sharedPublisher = make_unique<EyeFramePublisher>();
+		cout << "Sharing eye frames at " << defaultEyeFrameSharedMemoryName << endl;
+	}
+
 	// Create the Headset object, taking the capabilities we need in our program
 	// Different capabilities may enable different hardware or software, so use only the capabilities that are needed
-	Fove::Headset headset = Fove::Headset::create(Fove::ClientCapabilities::EyeTracking).getValue();
+	// Recordings and heatmaps use more fields of EyeFrame, which needs a few more capabilities
+	const bool captureFrames = recording.is_open() || compressedRecording || heatmap || sharedPublisher || !streamTransport.empty();
+	Fove::Headset headset = Fove::Headset::create(captureFrames ? eyeFrameCapabilities() : Fove::ClientCapabilities::EyeTracking).getValue();
 
 	// Loop indefinitely
 	while (true)
@@ -76,6 +237,14 @@ try
 			continue; // Skip getting the gaze vectors
 		}
 
+		if (captureFrames)
+		{
+			const EyeFrame frame = captureEyeFrame(headset, fetchResult.getValue());
+			if (sharedPublisher)
+				sharedPublisher->publish(frame);
+			channel.publish(frame);
+		}
+
 		// Below we print data
 		// Feel free to mess around and call other data query functions,
 		// but remember to add the capabilities as needed
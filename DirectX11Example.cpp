@@ -482,5 +482,5 @@ try
 catch (...)
 {
 	// Display any error as a popup box then exit the program
-	showErrorBox("Error: " + currentExceptionMessage());
+	showErrorBox(currentExceptionMessage());
 }
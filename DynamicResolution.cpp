@@ -0,0 +1,109 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+EyeViewport scaledEyeViewport(const Fove::Vec2i fullSize, const float scale)
+{
+	// Shrink each side by an even number of pixels, so that the viewport can be exactly centered
+	const auto Scale = [scale](const int full) {
+		const int margin = static_cast<int>(lround(full * (1 - clamp(scale, 0.0f, 1.0f)) / 2));
+		return max(1, full - 2 * margin);
+	};
+
+	EyeViewport ret;
+	ret.size = Fove::Vec2i{Scale(fullSize.x), Scale(fullSize.y)};
+	ret.offset = Fove::Vec2i{(fullSize.x - ret.size.x) / 2, (fullSize.y - ret.size.y) / 2};
+	return ret;
+}
+
+Fove::TextureBounds eyeTextureBounds(const EyeViewport& viewport, const Fove::Vec2i fullSize, const bool isLeft)
+{
+	// The texture is two eyes wide, with the right eye starting half way
+	const float textureWidth = 2.0f * fullSize.x;
+	const float eyeStart = isLeft ? 0.0f : static_cast<float>(fullSize.x);
+
+	Fove::TextureBounds bounds;
+	bounds.left = (eyeStart + viewport.offset.x) / textureWidth;
+	bounds.right = (eyeStart + viewport.offset.x + viewport.size.x) / textureWidth;
+	bounds.top = static_cast<float>(viewport.offset.y) / fullSize.y;
+	bounds.bottom = static_cast<float>(viewport.offset.y + viewport.size.y) / fullSize.y;
+	return bounds;
+}
+
+ViewportRect uvRectToViewport(const ViewportRect& uvRect, const ViewportRect& destRect)
+{
+	// The quad maps uv 0 to the viewport origin and uv 1 to the far side, so scale the viewport up by the inverse of the uv range,
+	// then move it back so that the start of the uv range lands on the start of the destination
+	ViewportRect ret;
+	ret.width = destRect.width / uvRect.width;
+	ret.height = destRect.height / uvRect.height;
+	ret.x = destRect.x - uvRect.x * ret.width;
+	ret.y = destRect.y - uvRect.y * ret.height;
+	return ret;
+}
+
+DynamicResolution::DynamicResolution()
+	: DynamicResolution(Settings())
+{
+}
+
+DynamicResolution::DynamicResolution(const Settings& settings)
+	: m_settings(settings)
+	, m_scale(settings.maxScale)
+{
+}
+
+float DynamicResolution::update(const float gpuTimeMs)
+{
+	// Samples taken right after a change were likely rendered (at least partly) at the previous scale
+	if (m_framesToSettle > 0)
+	{
+		--m_framesToSettle;
+		return m_scale;
+	}
+
+	// Smooth out the noise of individual frames
+	m_smoothedGpuTimeMs = m_hasSample ? m_smoothedGpuTimeMs + (gpuTimeMs - m_smoothedGpuTimeMs) * m_settings.smoothing : gpuTimeMs;
+	m_hasSample = true;
+
+	const float targetMs = m_settings.frameBudgetMs * m_settings.targetUtilization;
+	if (m_smoothedGpuTimeMs > targetMs)
+	{
+		// Over budget, scale down right away
+		// The cost is roughly proportional to the number of pixels, so to the square of the scale
+		m_framesUnderThreshold = 0;
+		setScale(min(m_scale - m_settings.step, m_scale * sqrt(targetMs / m_smoothedGpuTimeMs)));
+	}
+	else if (m_smoothedGpuTimeMs < targetMs * m_settings.increaseThreshold)
+	{
+		// Well under budget, scale up one step once this has held for a while
+		if (++m_framesUnderThreshold >= m_settings.framesBeforeIncrease)
+		{
+			m_framesUnderThreshold = 0;
+			setScale(m_scale + m_settings.step);
+		}
+	}
+	else
+	{
+		// In between the thresholds, this is where we want to stay
+		m_framesUnderThreshold = 0;
+	}
+
+	return m_scale;
+}
+
+void DynamicResolution::setScale(float scale)
+{
+	scale = round(scale / m_settings.step) * m_settings.step;
+	scale = clamp(scale, m_settings.minScale, m_settings.maxScale);
+	if (scale == m_scale)
+		return;
+
+	m_scale = scale;
+	m_framesToSettle = m_settings.framesToSettle;
+
+	// The old average no longer represents the cost at the new scale
+	m_hasSample = false;
+}
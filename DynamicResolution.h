@@ -0,0 +1,87 @@
+#pragma once
+#include "FoveAPI.h"
+
+// This header implements dynamic resolution scaling, shared by the graphical examples
+// Render targets stay allocated at full size, and only the area we render to (the viewport) shrinks or grows
+// The compositor is told which part of the texture to use via Fove::TextureBounds, so nothing needs to be reallocated
+
+// Sub-rectangle of one eye's area in the render texture, in pixels
+struct EyeViewport
+{
+	Fove::Vec2i offset; // From the corner of the eye's area
+	Fove::Vec2i size;
+};
+
+inline bool operator==(const EyeViewport& a, const EyeViewport& b)
+{
+	return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.size.x == b.size.x && a.size.y == b.size.y;
+}
+
+inline bool operator!=(const EyeViewport& a, const EyeViewport& b) { return !(a == b); }
+
+// Returns the viewport to render an eye with, given the full size of the eye area and a scale from 0 to 1
+// The viewport is centered in the eye area, so the result doesn't depend on whether the API puts row 0 at the top or bottom
+EyeViewport scaledEyeViewport(Fove::Vec2i fullSize, float scale);
+
+// Returns the bounds to submit to the compositor for an eye rendered with the given viewport
+// The render texture is expected to hold the left eye on its left half and the right eye on its right half
+Fove::TextureBounds eyeTextureBounds(const EyeViewport& viewport, Fove::Vec2i fullSize, bool isLeft);
+
+// Generic floating point rectangle
+struct ViewportRect
+{
+	float x = 0;
+	float y = 0;
+	float width = 0;
+	float height = 0;
+};
+
+// Returns the viewport to draw a full screen quad with (uvs from 0 to 1), such that
+// the part of the texture within uvRect exactly covers destRect, and the rest falls outside of it
+// This is used to copy only the rendered part of the texture to the window, without needing new shaders
+// The caller should set a scissor to destRect, as the rest of the texture is drawn outside of it
+ViewportRect uvRectToViewport(const ViewportRect& uvRect, const ViewportRect& destRect);
+
+// Picks a resolution scale each frame based on how long the GPU took to render previous frames
+//
+// When the GPU time goes over budget, the scale goes down right away, by the amount that should bring it back in budget.
+// The scale only goes back up after the GPU time has been comfortably under budget for a while.
+// The gap between those two thresholds, and the wait, prevent the resolution from bouncing up and down every frame.
+class DynamicResolution
+{
+public:
+	struct Settings
+	{
+		float frameBudgetMs = 1000.0f / 70.0f; // Time between two frames of the HMD (the FOVE0 displays at 70Hz)
+		float targetUtilization = 0.8f;        // Fraction of the budget the scene rendering may use (the rest is for the compositor and other work)
+		float increaseThreshold = 0.85f;       // The scale only increases while below this fraction of the target GPU time
+		float minScale = 0.5f;
+		float maxScale = 1.0f;
+		float step = 0.05f;            // The scale is a multiple of this, so that the viewport doesn't change for tiny differences
+		float smoothing = 0.2f;        // Weight of each new sample in the moving average of the GPU time
+		int framesBeforeIncrease = 45; // Number of consecutive frames under the increase threshold before scaling up
+		int framesToSettle = 4;        // Samples to ignore after a change, since they may still have been rendered at the old scale
+	};
+
+	DynamicResolution();
+	explicit DynamicResolution(const Settings& settings);
+
+	// Feeds in the GPU time of a rendered frame, and returns the new scale
+	float update(float gpuTimeMs);
+
+	// Current scale to apply to each side of the eye viewports
+	float scale() const { return m_scale; }
+
+	// Moving average of the GPU time, as used for the decisions
+	float smoothedGpuTimeMs() const { return m_smoothedGpuTimeMs; }
+
+private:
+	void setScale(float scale);
+
+	Settings m_settings;
+	float m_scale = 1;
+	float m_smoothedGpuTimeMs = 0;
+	bool m_hasSample = false;
+	int m_framesUnderThreshold = 0;
+	int m_framesToSettle = 0;
+};
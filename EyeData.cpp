@@ -0,0 +1,285 @@
+#include "EyeData.h"
+#include "EyeFrameCodec.h"
+#include "Util.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+
+constexpr float pi = 3.14159265f;
+constexpr float degreesToRadians = pi / 180;
+
+// Horizontal and vertical half field of view used to compute the synthetic screen positions
+constexpr float syntheticHalfFovDegrees = 50.0f;
+
+// Minimum jerk profile, which is a close approximation of the shape of a saccade, from 0 to 1 as t goes from 0 to 1
+float minimumJerk(const float t)
+{
+	return t * t * t * (10 + t * (-15 + t * 6));
+}
+
+} // namespace
+
+Fove::ClientCapabilities eyeFrameCapabilities()
+{
+	return Fove::ClientCapabilities::EyeTracking | Fove::ClientCapabilities::PupilRadius | Fove::ClientCapabilities::GazedObjectDetection;
+}
+
+EyeFrame captureEyeFrame(Fove::Headset& headset, const Fove::FrameTimestamp& timestamp)
+{
+	EyeFrame frame;
+	frame.id = timestamp.id;
+	frame.timestamp = timestamp.timestamp;
+
+	const Fove::Result<Fove::Ray> rayOrError = headset.getCombinedGazeRay();
+	frame.gazeValid = rayOrError.isValid();
+	if (rayOrError.isValid())
+		frame.combinedGaze = rayOrError->direction;
+	if (const Fove::Result<Fove::Vec3> gazeOrError = headset.getGazeVector(Fove::Eye::Left))
+		frame.gaze.l = gazeOrError.getValue();
+	if (const Fove::Result<Fove::Vec3> gazeOrError = headset.getGazeVector(Fove::Eye::Right))
+		frame.gaze.r = gazeOrError.getValue();
+	if (const Fove::Result<Fove::Vec2> positionOrError = headset.getGazeScreenPositionCombined())
+		frame.screenPosition = positionOrError.getValue();
+	if (const Fove::Result<float> radiusOrError = headset.getPupilRadius(Fove::Eye::Left))
+		frame.pupilRadius.l = radiusOrError.getValue();
+	if (const Fove::Result<float> radiusOrError = headset.getPupilRadius(Fove::Eye::Right))
+		frame.pupilRadius.r = radiusOrError.getValue();
+	if (const Fove::Result<Fove::EyeState> stateOrError = headset.getEyeState(Fove::Eye::Left))
+		frame.eyeState.l = stateOrError.getValue();
+	if (const Fove::Result<Fove::EyeState> stateOrError = headset.getEyeState(Fove::Eye::Right))
+		frame.eyeState.r = stateOrError.getValue();
+	if (const Fove::Result<int> idOrError = headset.getGazedObjectId())
+		frame.gazedObjectId = idOrError.getValue();
+	return frame;
+}
+
+void writeEyeFrameCsvHeader(ostream& out)
+{
+	out << "id,timestamp_us,gaze_valid,gx,gy,gz,lx,ly,lz,rx,ry,rz,screen_x,screen_y,pupil_l,pupil_r,state_l,state_r,object_id\n";
+}
+
+void writeEyeFrameCsv(ostream& out, const EyeFrame& frame)
+{
+	const auto WriteVec3 = [&out](const Fove::Vec3 v) { out << ',' << v.x << ',' << v.y << ',' << v.z; };
+	out << frame.id << ',' << frame.timestamp << ',' << (frame.gazeValid ? 1 : 0);
+	WriteVec3(frame.combinedGaze);
+	WriteVec3(frame.gaze.l);
+	WriteVec3(frame.gaze.r);
+	out << ',' << frame.screenPosition.x << ',' << frame.screenPosition.y
+		<< ',' << frame.pupilRadius.l << ',' << frame.pupilRadius.r
+		<< ',' << enumToUnderlyingValue(frame.eyeState.l) << ',' << enumToUnderlyingValue(frame.eyeState.r)
+		<< ',' << frame.gazedObjectId << '\n';
+}
+
+bool parseEyeFrameCsv(const string& line, EyeFrame& frame)
+{
+	const char* const end = parseEyeFrameCsv(line.c_str(), frame);
+	return end && *end == '\0';
+}
+
+const char* parseEyeFrameCsv(const char* text, EyeFrame& frame)
+{
+	// from_chars is used instead of streams or strto*, which are several times slower and depend on the locale
+	const char* const end = text + strcspn(text, "\n");
+	const char* p = text;
+	bool ok = true;
+	const auto Read = [&](auto& value) {
+		if (!ok)
+			return;
+		const from_chars_result result = from_chars(p, end, value);
+		ok = result.ec == errc();
+		p = result.ptr;
+		if (p != end && *p == ',')
+			++p;
+	};
+	const auto ReadVec3 = [&](Fove::Vec3& v) { Read(v.x); Read(v.y); Read(v.z); };
+
+	EyeFrame ret;
+	int valid = 0;
+	int stateL = 0;
+	int stateR = 0;
+	Read(ret.id);
+	Read(ret.timestamp);
+	Read(valid);
+	ReadVec3(ret.combinedGaze);
+	ReadVec3(ret.gaze.l);
+	ReadVec3(ret.gaze.r);
+	Read(ret.screenPosition.x);
+	Read(ret.screenPosition.y);
+	Read(ret.pupilRadius.l);
+	Read(ret.pupilRadius.r);
+	Read(stateL);
+	Read(stateR);
+	Read(ret.gazedObjectId);
+	while (p != end && (*p == '\r' || *p == ' '))
+		++p;
+	if (!ok || p != end)
+		return nullptr;
+
+	ret.gazeValid = valid != 0;
+	ret.eyeState.l = static_cast<Fove::EyeState>(stateL);
+	ret.eyeState.r = static_cast<Fove::EyeState>(stateR);
+	frame = ret;
+	return p;
+}
+
+vector<EyeFrame> readEyeSession(const string& path)
+{
+	// Read the whole file at once, recordings are a few MB per minute
+	ifstream in(path, ios::binary);
+	if (!in)
+		throw "Unable to open " + path;
+	string text;
+	in.seekg(0, ios::end);
+	text.resize(static_cast<size_t>(max<streamoff>(in.tellg(), 0)));
+	in.seekg(0, ios::beg);
+	in.read(text.data(), static_cast<streamsize>(text.size()));
+	if (!in)
+		throw "Unable to read " + path;
+
+	// Compressed recordings (see EyeFrameCodec.h) are recognized by their first bytes
+	if (isEyeFrameBlock(reinterpret_cast<const uint8_t*>(text.data()), text.size()))
+		return decodeEyeFrameBlocks(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+
+	// Skip the header, then parse each line in place
+	vector<EyeFrame> frames;
+	frames.reserve(count(text.begin(), text.end(), '\n'));
+	size_t lineStart = text.find('\n');
+	while (lineStart != string::npos && lineStart + 1 < text.size())
+	{
+		++lineStart;
+		EyeFrame frame;
+		if (parseEyeFrameCsv(text.c_str() + lineStart, frame))
+			frames.push_back(frame);
+		lineStart = text.find('\n', lineStart);
+	}
+	return frames;
+}
+
+EyeFrame sessionFrame(const vector<EyeFrame>& session, const uint64_t sequence)
+{
+	EyeFrame frame = session[(sequence - 1) % session.size()];
+	frame.id = sequence;
+	return frame;
+}
+
+double percentile(vector<double> values, const double p)
+{
+	if (values.empty())
+		return 0;
+	const size_t i = min(values.size() - 1, static_cast<size_t>(p * values.size()));
+	nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i];
+}
+
+vector<EyeFrame> generateEyeSession(const uint32_t seed, const float seconds, const SyntheticSessionSettings& settings)
+{
+	mt19937 rng(seed);
+	uniform_real_distribution<float> targetYaw(-settings.fieldYawDegrees, settings.fieldYawDegrees);
+	uniform_real_distribution<float> targetPitch(-settings.fieldPitchDegrees, settings.fieldPitchDegrees);
+	uniform_real_distribution<float> fixationSeconds(0.15f, 0.45f);
+	uniform_real_distribution<float> blinkSeconds(0.1f, 0.2f);
+	exponential_distribution<float> secondsToBlink(max(settings.blinksPerMinute, 1e-3f) / 60);
+	normal_distribution<float> noise(0, settings.noiseDegrees);
+
+	const float dt = 1 / settings.rateHz;
+	const size_t frameCount = static_cast<size_t>(seconds * settings.rateHz);
+	vector<EyeFrame> frames;
+	frames.reserve(frameCount);
+
+	// The session is a sequence of fixations on random targets, each one followed by a saccade to the next target
+	Fove::Vec2 from{targetYaw(rng), targetPitch(rng)};
+	Fove::Vec2 to = from;
+	float phaseStart = 0;
+	float phaseDuration = fixationSeconds(rng);
+	bool inSaccade = false;
+	float nextBlink = secondsToBlink(rng);
+	float blinkEnd = -1;
+	for (size_t i = 0; i < frameCount; ++i)
+	{
+		const float t = i * dt;
+		if (t >= phaseStart + phaseDuration)
+		{
+			phaseStart += phaseDuration;
+			if (inSaccade)
+			{
+				from = to;
+				phaseDuration = fixationSeconds(rng);
+			}
+			else
+			{
+				// Main sequence: the duration grows linearly with the amplitude
+				to = Fove::Vec2{targetYaw(rng), targetPitch(rng)};
+				const float amplitude = hypot(to.x - from.x, to.y - from.y);
+				phaseDuration = (2.2f * amplitude + 21) / 1000;
+			}
+			inSaccade = !inSaccade;
+		}
+
+		Fove::Vec2 angles = from;
+		if (inSaccade)
+		{
+			const float s = minimumJerk(min((t - phaseStart) / phaseDuration, 1.0f));
+			angles = Fove::Vec2{from.x + (to.x - from.x) * s, from.y + (to.y - from.y) * s};
+		}
+		angles.x += noise(rng);
+		angles.y += noise(rng);
+
+		// Blinks don't interrupt the eye movement, they only hide it
+		if (t >= nextBlink)
+		{
+			blinkEnd = t + blinkSeconds(rng);
+			nextBlink = blinkEnd + secondsToBlink(rng);
+		}
+		const bool blinking = t < blinkEnd;
+
+		EyeFrame frame;
+		frame.id = i + 1;
+		frame.timestamp = static_cast<uint64_t>(llround(t * 1e6));
+		frame.gazeValid = !blinking;
+		frame.eyeState.l = frame.eyeState.r = blinking ? Fove::EyeState::Closed : Fove::EyeState::Opened;
+		frame.pupilRadius.l = frame.pupilRadius.r = 0.002f + 0.0003f * sin(t * 0.5f + seed); // Slow variations around 2mm
+		if (!blinking)
+		{
+			frame.combinedGaze = yawPitchToDirection(angles.x, angles.y);
+			frame.gaze.l = frame.gaze.r = frame.combinedGaze;
+			const float screenScale = 1 / tan(syntheticHalfFovDegrees * degreesToRadians);
+			frame.screenPosition = Fove::Vec2{tan(angles.x * degreesToRadians) * screenScale, tan(angles.y * degreesToRadians) * screenScale};
+
+			const int column = clamp(static_cast<int>((angles.x + settings.fieldYawDegrees) / (2 * settings.fieldYawDegrees) * settings.objectGridSize), 0, settings.objectGridSize - 1);
+			const int row = clamp(static_cast<int>((angles.y + settings.fieldPitchDegrees) / (2 * settings.fieldPitchDegrees) * settings.objectGridSize), 0, settings.objectGridSize - 1);
+			frame.gazedObjectId = row * settings.objectGridSize + column;
+		}
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+float angleBetweenDirections(const Fove::Vec3 a, const Fove::Vec3 b)
+{
+	// atan2 is accurate for tiny angles, unlike acos of the dot product
+	const Fove::Vec3 cross{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	return atan2(magnitude(cross), dot(a, b)) / degreesToRadians;
+}
+
+Fove::Vec3 yawPitchToDirection(const float yawDegrees, const float pitchDegrees)
+{
+	const float yaw = yawDegrees * degreesToRadians;
+	const float pitch = pitchDegrees * degreesToRadians;
+	return Fove::Vec3{sin(yaw) * cos(pitch), sin(pitch), cos(yaw) * cos(pitch)};
+}
+
+Fove::Vec2 directionToYawPitch(const Fove::Vec3 direction)
+{
+	const Fove::Vec3 d = normalize(direction);
+	return Fove::Vec2{atan2(d.x, d.z) / degreesToRadians, asin(clamp(d.y, -1.0f, 1.0f)) / degreesToRadians};
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "FoveAPI.h"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// This header defines the eye tracking data captured by the DataExample, and shared by the eye data tools
+// A session is a sequence of frames, one per eye camera frame, which can be recorded to and read back from CSV
+// Synthetic sessions can also be generated, so the tools can be tried out and benchmarked without a headset
+
+// The data of one eye tracking frame
+struct EyeFrame
+{
+	uint64_t id = 0;        // Frame counter from the service
+	uint64_t timestamp = 0; // Capture time in microseconds since an unspecified epoch
+	bool gazeValid = false; // Whether the gaze fields are valid (they aren't while blinking, or if the eyes are lost)
+	Fove::Vec3 combinedGaze{0, 0, 1};                       // Direction of the combined gaze ray, in head space
+	Fove::Stereo<Fove::Vec3> gaze{{0, 0, 1}, {0, 0, 1}};    // Gaze vector of each eye, in head space
+	Fove::Vec2 screenPosition{};                            // Combined gaze position on the screen, from -1 to 1
+	Fove::Stereo<float> pupilRadius{};                      // In meters, or 0 if unknown
+	Fove::Stereo<Fove::EyeState> eyeState{Fove::EyeState::NotDetected, Fove::EyeState::NotDetected};
+	int gazedObjectId = fove_ObjectIdInvalid;
+};
+
+// Capabilities the headset needs for captureEyeFrame() to fill every field
+Fove::ClientCapabilities eyeFrameCapabilities();
+
+// Reads the data cached by the last Headset::fetchEyeTrackingData() call
+// Fields whose query fails keep their default value
+EyeFrame captureEyeFrame(Fove::Headset& headset, const Fove::FrameTimestamp& timestamp);
+
+// CSV recording, one frame per line after a header line
+void writeEyeFrameCsvHeader(std::ostream& out);
+void writeEyeFrameCsv(std::ostream& out, const EyeFrame& frame);
+bool parseEyeFrameCsv(const std::string& line, EyeFrame& frame); // Returns false if the line isn't a valid frame
+const char* parseEyeFrameCsv(const char* text, EyeFrame& frame); // Parses one line, returns the end of it, or nullptr if it isn't a valid frame
+
+// Reads a whole recording, either CSV or compressed with EyeFrameRecordingWriter of EyeFrameCodec.h, throws if the file can't be read
+std::vector<EyeFrame> readEyeSession(const std::string& path);
+
+// Returns the frame a benchmark sends as its sequence-th (from 1), looping over the session with the id replaced by the sequence number
+// Readers can thus rebuild what they should have received from the id alone
+EyeFrame sessionFrame(const std::vector<EyeFrame>& session, uint64_t sequence);
+
+// Returns the value below which a fraction p (0 to 1) of the values lie, or 0 if there are none
+double percentile(std::vector<double> values, double p);
+
+// Settings of the synthetic sessions
+struct SyntheticSessionSettings
+{
+	float rateHz = 120.0f;            // Eye camera frame rate
+	float fieldYawDegrees = 20.0f;    // Fixation targets are picked within +/- this angle horizontally
+	float fieldPitchDegrees = 15.0f;  // And vertically
+	float noiseDegrees = 0.1f;        // Tracking noise, as a standard deviation
+	float blinksPerMinute = 15.0f;    // Average blink rate
+	int objectGridSize = 3;           // The field is split in a grid of gazable objects, with ids from 0 to objectGridSize^2 - 1
+};
+
+// Generates a deterministic (given the seed) session alternating fixations and saccades, with blinks
+// Saccade durations and velocity profiles follow the main sequence of human saccades, so the velocity based algorithms see realistic data
+std::vector<EyeFrame> generateEyeSession(uint32_t seed, float seconds, const SyntheticSessionSettings& settings = {});
+
+// Returns the angle between two gaze directions, in degrees
+float angleBetweenDirections(Fove::Vec3 a, Fove::Vec3 b);
+
+// Conversions between gaze directions (head space, +z forward, +y up) and yaw/pitch angles in degrees
+Fove::Vec3 yawPitchToDirection(float yawDegrees, float pitchDegrees);
+Fove::Vec2 directionToYawPitch(Fove::Vec3 direction);
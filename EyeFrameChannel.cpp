@@ -0,0 +1,109 @@
+#include "EyeFrameChannel.h"
+#include <algorithm>
+
+using namespace std;
+
+EyeFrameChannel::EyeFrameChannel(const size_t historySize)
+{
+	size_t size = 1;
+	while (size < max<size_t>(historySize, 2))
+		size *= 2;
+	m_slots.reset(new SeqlockSlot<EyeFrame>[size]);
+	m_mask = size - 1;
+}
+
+uint64_t EyeFrameChannel::publish(const EyeFrame& frame)
+{
+	const uint64_t sequence = m_latest.load(memory_order_relaxed) + 1;
+	m_slots[sequence & m_mask].write(sequence, frame);
+	m_latest.store(sequence, memory_order_release);
+
+	// Waiting readers check the sequence number under the lock, so taking it here means none can miss this frame
+	// This is a store then load of two variables, mirrored in waitForNewer(): without a full fence on both sides,
+	// the load of m_waiters could be ordered before the store of m_latest, and both threads miss each other's update
+	atomic_thread_fence(memory_order_seq_cst);
+	if (m_waiters.load(memory_order_relaxed) > 0)
+	{
+		lock_guard<mutex> lock(m_waitMutex);
+		m_waitCondition.notify_all();
+	}
+	return sequence;
+}
+
+void EyeFrameChannel::close()
+{
+	m_closed = true;
+	lock_guard<mutex> lock(m_waitMutex);
+	m_waitCondition.notify_all();
+}
+
+bool EyeFrameChannel::read(const uint64_t sequence, EyeFrame& frame) const
+{
+	return sequence != 0 && sequence <= latestSequence() && m_slots[sequence & m_mask].read(sequence, frame);
+}
+
+uint64_t EyeFrameChannel::readLatest(EyeFrame& frame) const
+{
+	// This only fails if the producer went around the whole ring during the copy, so it's retried with the new latest frame
+	while (true)
+	{
+		const uint64_t sequence = latestSequence();
+		if (sequence == 0 || read(sequence, frame))
+			return sequence;
+	}
+}
+
+size_t EyeFrameChannel::readHistory(EyeFrame* const frames, const size_t count) const
+{
+	const uint64_t latest = latestSequence();
+	const uint64_t available = min<uint64_t>({latest, count, historySize()});
+	size_t copied = 0;
+	for (uint64_t sequence = latest - available + 1; sequence <= latest; ++sequence)
+	{
+		if (read(sequence, frames[copied]))
+			++copied;
+	}
+	return copied;
+}
+
+bool EyeFrameChannel::waitForNewer(const uint64_t sequence, const chrono::milliseconds timeout) const
+{
+	if (latestSequence() > sequence)
+		return true;
+
+	++m_waiters;
+	atomic_thread_fence(memory_order_seq_cst); // Pairs with the one in publish(), see there
+	unique_lock<mutex> lock(m_waitMutex);
+	m_waitCondition.wait_for(lock, timeout, [&] { return latestSequence() > sequence || isClosed(); });
+	--m_waiters;
+	return latestSequence() > sequence;
+}
+
+EyeFrameChannel::Subscriber::Subscriber(const EyeFrameChannel& channel)
+	: m_channel(&channel)
+	, m_next(channel.latestSequence() + 1)
+{
+}
+
+bool EyeFrameChannel::Subscriber::next(EyeFrame& frame)
+{
+	while (m_next <= m_channel->latestSequence())
+	{
+		if (m_channel->read(m_next, frame))
+		{
+			++m_next;
+			return true;
+		}
+
+		// The frame was overwritten: skip to the oldest one still in the ring
+		const uint64_t oldest = m_channel->latestSequence() - m_channel->m_mask;
+		m_missed += max(oldest, m_next + 1) - m_next;
+		m_next = max(oldest, m_next + 1);
+	}
+	return false;
+}
+
+bool EyeFrameChannel::Subscriber::waitNext(EyeFrame& frame, const chrono::milliseconds timeout)
+{
+	return next(frame) || (m_channel->waitForNewer(m_next - 1, timeout) && next(frame));
+}
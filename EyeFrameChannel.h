@@ -0,0 +1,89 @@
+#pragma once
+#include "EyeData.h"
+#include "Seqlock.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// This header implements a broadcast channel of eye frames, from one producer to any number of in-process readers
+//
+// Instead of each part of an application calling Headset::fetchEyeTrackingData() on its own thread, one thread captures the frames
+// and publishes them here, and the renderer, loggers, analytics, etc. read them back. Every reader sees the same frames, with the same sequence numbers.
+//
+// The frames are kept in a ring of the last historySize frames, each slot protected by a sequence lock (see Seqlock.h):
+// the producer never waits for readers, and readers never write to shared memory, so they don't slow each other or the producer down.
+// A read copies the frame out of its slot (about 100 bytes) and checks the slot wasn't rewritten meanwhile, retrying if needed.
+
+class EyeFrameChannel
+{
+public:
+	// The history size is rounded up to a power of two
+	explicit EyeFrameChannel(size_t historySize = 256);
+
+	size_t historySize() const { return m_mask + 1; }
+
+	// Publishes the next frame and returns its sequence number, starting from 1
+	// Only one thread may publish
+	uint64_t publish(const EyeFrame& frame);
+
+	// Wakes the readers waiting in waitForNewer(), which then return false once they've read everything
+	void close();
+	bool isClosed() const { return m_closed.load(); }
+
+	// Sequence number of the latest frame, or 0 if none was published yet
+	uint64_t latestSequence() const { return m_latest.load(std::memory_order_acquire); }
+
+	// Copies the frame of the given sequence number
+	// Returns false if it wasn't published yet, or was already overwritten by a newer frame
+	bool read(uint64_t sequence, EyeFrame& frame) const;
+
+	// Copies the latest frame, returns its sequence number, or 0 if there is none yet
+	uint64_t readLatest(EyeFrame& frame) const;
+
+	// Copies the latest frames, up to count (and historySize()), oldest first, and returns how many were copied
+	// The oldest ones may be missing if the producer overwrote them during the copy
+	size_t readHistory(EyeFrame* frames, size_t count) const;
+
+	// Waits until a frame newer than the given sequence number is published
+	// Returns false on timeout, or when the channel is closed with nothing newer
+	// Only the readers that wait take a lock: the producer only touches it when someone is waiting
+	bool waitForNewer(uint64_t sequence, std::chrono::milliseconds timeout) const;
+
+	// Reads every frame in order, for the readers that need all of them (eg. recording)
+	// Frames overwritten before the subscriber got to them are skipped, and counted
+	class Subscriber
+	{
+	public:
+		// Starts with the next frame to be published
+		explicit Subscriber(const EyeFrameChannel& channel);
+
+		// Copies the next frame, returns false if there is none yet
+		bool next(EyeFrame& frame);
+
+		// Same, but waits up to timeout for the next frame
+		bool waitNext(EyeFrame& frame, std::chrono::milliseconds timeout);
+
+		uint64_t lastSequence() const { return m_next - 1; } // Sequence number of the last frame returned
+		uint64_t missed() const { return m_missed; }         // Number of frames skipped because the subscriber fell behind
+
+	private:
+		const EyeFrameChannel* m_channel = nullptr;
+		uint64_t m_next = 0;
+		uint64_t m_missed = 0;
+	};
+
+private:
+	std::unique_ptr<SeqlockSlot<EyeFrame>[]> m_slots;
+	size_t m_mask = 0;
+	alignas(64) std::atomic<uint64_t> m_latest{0};
+	std::atomic<bool> m_closed{false};
+
+	// Only used to block waiting readers
+	mutable std::atomic<int> m_waiters{0};
+	mutable std::mutex m_waitMutex;
+	mutable std::condition_variable m_waitCondition;
+};
@@ -0,0 +1,208 @@
+// FOVE Eye Frame Channel Benchmark
+// This publishes eye frames through an EyeFrameChannel to several subscribers reading every frame and several readers polling the latest frames,
+// checks that every reader got intact frames in order, and measures the publication cost and the latency to the readers
+//
+// Usage: FoveEyeFrameChannelBenchmark [--subscribers N] [--pollers N] [--rate Hz] [session.csv]
+// Sessions are recorded with `FoveDataExample --record session.csv`. Without a session, a synthetic session is used instead.
+//
+// Two runs are made:
+// - Flat out: frames are published as fast as possible, which measures the cost of publishing, and stresses the torn read detection.
+//   Readers can't keep up, so subscribers skip frames.
+// - Paced: frames are published at the given rate (1000Hz by default, several times the eye camera rate), which every subscriber should keep up with
+
+#include "EyeData.h"
+#include "EyeFrameChannel.h"
+#include "Util.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+using Clock = chrono::steady_clock;
+
+struct ReaderResult
+{
+	uint64_t frames = 0;
+	uint64_t missed = 0;
+	uint64_t corrupt = 0;    // Frames that differ from what was published: must be 0
+	uint64_t outOfOrder = 0; // Frames not newer than the previous one: must be 0
+	vector<double> latencies; // Microseconds from publication to read, paced run only
+};
+
+struct RunResult
+{
+	uint64_t frames = 0;
+	double seconds = 0;
+	vector<ReaderResult> subscribers;
+	vector<ReaderResult> pollers;
+};
+
+bool operator==(const Fove::Vec3 a, const Fove::Vec3 b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+bool sameFrame(const EyeFrame& a, const EyeFrame& b)
+{
+	return a.id == b.id && a.timestamp == b.timestamp && a.gazeValid == b.gazeValid && a.combinedGaze == b.combinedGaze && a.gaze.l == b.gaze.l
+		   && a.gaze.r == b.gaze.r && a.screenPosition.x == b.screenPosition.x && a.screenPosition.y == b.screenPosition.y && a.pupilRadius.l == b.pupilRadius.l
+		   && a.pupilRadius.r == b.pupilRadius.r && a.eyeState.l == b.eyeState.l && a.eyeState.r == b.eyeState.r && a.gazedObjectId == b.gazedObjectId;
+}
+
+void check(const vector<EyeFrame>& session, const EyeFrame& frame, uint64_t& previousId, ReaderResult& result)
+{
+	result.corrupt += sameFrame(frame, sessionFrame(session, max<uint64_t>(frame.id, 1))) ? 0 : 1;
+	result.outOfOrder += frame.id > previousId ? 0 : 1;
+	previousId = frame.id;
+	++result.frames;
+}
+
+RunResult run(const vector<EyeFrame>& session, const size_t subscriberCount, const size_t pollerCount, const uint64_t frameCount, const double rateHz)
+{
+	EyeFrameChannel channel;
+	RunResult result;
+	result.frames = frameCount;
+	result.subscribers.resize(subscriberCount);
+	result.pollers.resize(pollerCount);
+	vector<Clock::time_point> publishTimes(frameCount + 1); // Written before each frame is published, so readers see it once they see the frame
+	vector<thread> readers;
+	atomic<size_t> ready{0};
+
+	// Subscribers read every frame, waiting for new ones when they have caught up
+	for (ReaderResult& r : result.subscribers)
+	{
+		readers.emplace_back([&] {
+			EyeFrameChannel::Subscriber subscriber(channel);
+			++ready;
+			EyeFrame frame;
+			uint64_t previousId = 0;
+			while (subscriber.waitNext(frame, chrono::milliseconds{100}) || !channel.isClosed())
+			{
+				if (subscriber.lastSequence() <= previousId)
+					continue; // Timed out
+				check(session, frame, previousId, r);
+				if (rateHz > 0)
+					r.latencies.push_back(chrono::duration<double, micro>(Clock::now() - publishTimes[frame.id]).count());
+			}
+			r.missed = subscriber.missed();
+		});
+	}
+
+	// Pollers read the latest frame and a short history window, like a renderer would once per frame
+	for (ReaderResult& r : result.pollers)
+	{
+		readers.emplace_back([&] {
+			++ready;
+			array<EyeFrame, 8> history;
+			uint64_t previousId = 0;
+			while (!channel.isClosed())
+			{
+				EyeFrame frame;
+				if (channel.readLatest(frame) != 0 && frame.id != previousId)
+					check(session, frame, previousId, r);
+
+				ReaderResult historyResult;
+				uint64_t previousHistoryId = 0;
+				const size_t count = channel.readHistory(history.data(), history.size());
+				for (size_t i = 0; i < count; ++i)
+					check(session, history[i], previousHistoryId, historyResult);
+				r.corrupt += historyResult.corrupt;
+				r.outOfOrder += historyResult.outOfOrder;
+				this_thread::sleep_for(chrono::microseconds{500});
+			}
+		});
+	}
+	while (ready.load() < readers.size())
+		this_thread::yield();
+
+	const Clock::time_point start = Clock::now();
+	for (uint64_t sequence = 1; sequence <= frameCount; ++sequence)
+	{
+		if (rateHz > 0)
+			this_thread::sleep_until(start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(sequence / rateHz)));
+		publishTimes[sequence] = Clock::now();
+		channel.publish(sessionFrame(session, sequence));
+	}
+	result.seconds = chrono::duration<double>(Clock::now() - start).count();
+	channel.close();
+	for (thread& reader : readers)
+		reader.join();
+	return result;
+}
+
+// Prints the table of readers, and returns whether they all got intact frames in order
+bool printReaders(const RunResult& result, const bool latency)
+{
+	cout << "Reader           Frames    Missed  Corrupt  Out of order" << (latency ? "  Latency p50 (us)  p99 (us)" : "") << '\n';
+	bool ok = true;
+	const auto Print = [&](const string& name, const ReaderResult& r, const bool everyFrame) {
+		cout << left << setw(13) << name << right << setw(10) << r.frames << setw(10) << r.missed << setw(9) << r.corrupt << setw(14) << r.outOfOrder;
+		if (latency && everyFrame)
+			cout << setw(18) << percentile(r.latencies, 0.5) << setw(10) << percentile(r.latencies, 0.99);
+		cout << '\n';
+		ok = ok && r.corrupt == 0 && r.outOfOrder == 0 && (!everyFrame || r.frames + r.missed == result.frames);
+	};
+	for (size_t i = 0; i < result.subscribers.size(); ++i)
+		Print("subscriber " + to_string(i), result.subscribers[i], true);
+	for (size_t i = 0; i < result.pollers.size(); ++i)
+		Print("poller " + to_string(i), result.pollers[i], false);
+	return ok;
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	size_t subscriberCount = 3;
+	size_t pollerCount = 1;
+	double rateHz = 1000;
+	vector<EyeFrame> session;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--subscribers" && i + 1 < argc)
+			subscriberCount = stoul(argv[++i]);
+		else if (arg == "--pollers" && i + 1 < argc)
+			pollerCount = stoul(argv[++i]);
+		else if (arg == "--rate" && i + 1 < argc)
+			rateHz = max(stod(argv[++i]), 1.0);
+		else
+			session = readEyeSession(arg);
+	}
+	if (session.empty())
+	{
+		cout << "No session given, using a synthetic session\n";
+		session = generateEyeSession(1, 60.0f);
+	}
+	cout << fixed << setprecision(2) << "Hardware threads: " << thread::hardware_concurrency() << "\n\n";
+
+	const RunResult flatOut = run(session, subscriberCount, pollerCount, 2'000'000, 0);
+	cout << "Flat out: " << flatOut.frames << " frames in " << flatOut.seconds << "s, " << 1e9 * flatOut.seconds / flatOut.frames << "ns per publication\n";
+	bool ok = printReaders(flatOut, false);
+
+	const RunResult paced = run(session, subscriberCount, pollerCount, static_cast<uint64_t>(2 * rateHz), rateHz);
+	cout << "\nPaced: " << paced.frames << " frames at " << rateHz << "Hz\n";
+	ok = printReaders(paced, true) && ok;
+
+	cout << '\n' << (ok ? "All frames intact and in order" : "ERROR: some readers got corrupt or reordered frames") << '\n';
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,678 @@
+#include "EyeFrameCodec.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+
+// Block format:
+// - Magic "FZ", version, flags (reset block or not)
+// - Block number and frame count, as variable length integers
+// - Reset blocks only: the quantization steps, as 32 bit floats
+// - Size of the rANS payload as a variable length integer, and the payload
+constexpr uint8_t blockMagic[2] = {'F', 'Z'};
+constexpr uint8_t blockVersion = 1;
+constexpr uint8_t resetBlockFlag = 1;
+constexpr uint64_t maxBlockFrames = 1 << 20;
+
+// rANS with a 32 bit state, renormalized byte by byte, and probabilities in 1/4096ths
+constexpr uint32_t probabilityBits = 12;
+constexpr uint32_t probabilityScale = 1 << probabilityBits;
+constexpr uint32_t ransLow = 1u << 23;
+constexpr int maxRawBits = 8; // Raw bits are coded by chunks of up to this many bits, with a uniform probability
+
+// Each value is coded as a token, its bit length, whose frequencies are adaptive, followed by the bits below its leading 1, which are raw
+constexpr int tokenCount = 65;
+
+struct Symbol
+{
+	uint16_t start;
+	uint16_t frequency;
+};
+
+// Adaptive frequencies of the tokens of one field
+// Counts are increased as tokens are coded, and halved once they grow too large, so the frequencies follow changes in the data.
+// The frequencies used for coding are rebuilt from the counts every few tokens, identically by the encoder and the decoder.
+class TokenModel
+{
+public:
+	void reset()
+	{
+		// Start out favoring small tokens, which helps the first frames after a reset
+		m_total = 0;
+		for (int token = 0; token < tokenCount; ++token)
+		{
+			m_counts[token] = token < 16 ? 16 - token : 1;
+			m_total += m_counts[token];
+		}
+		m_rebuildPeriod = 1;
+		rebuild();
+	}
+
+	Symbol symbol(const int token) const { return Symbol{m_starts[token], m_frequencies[token]}; }
+
+	int find(const uint32_t slot) const
+	{
+		// Linear search, as the frequent tokens are the small ones
+		int token = 0;
+		while (m_starts[token + 1] <= slot)
+			++token;
+		return token;
+	}
+
+	void update(const int token)
+	{
+		m_counts[token] += countIncrement;
+		m_total += countIncrement;
+		if (m_total > maxTotal)
+		{
+			m_total = 0;
+			for (uint32_t& count : m_counts)
+			{
+				count = (count + 1) / 2;
+				m_total += count;
+			}
+		}
+		if (--m_untilRebuild == 0)
+			rebuild();
+	}
+
+private:
+	static constexpr uint32_t countIncrement = 16;
+	static constexpr uint32_t maxTotal = 1 << 13;
+	static constexpr uint32_t maxRebuildPeriod = 16;
+
+	void rebuild()
+	{
+		// Every token keeps a frequency of at least 1, and the remainder of the rounding goes to the most frequent one
+		uint32_t sum = 0;
+		int mostFrequent = 0;
+		for (int token = 0; token < tokenCount; ++token)
+		{
+			m_frequencies[token] = static_cast<uint16_t>(1 + m_counts[token] * (probabilityScale - tokenCount) / m_total);
+			sum += m_frequencies[token];
+			if (m_frequencies[token] > m_frequencies[mostFrequent])
+				mostFrequent = token;
+		}
+		m_frequencies[mostFrequent] = static_cast<uint16_t>(m_frequencies[mostFrequent] + probabilityScale - sum);
+		m_starts[0] = 0;
+		for (int token = 0; token < tokenCount; ++token)
+			m_starts[token + 1] = static_cast<uint16_t>(m_starts[token] + m_frequencies[token]);
+
+		// Rebuild often while the model learns, then less often
+		m_rebuildPeriod = min(m_rebuildPeriod * 2, maxRebuildPeriod);
+		m_untilRebuild = m_rebuildPeriod;
+	}
+
+	uint32_t m_counts[tokenCount];
+	uint32_t m_total = 0;
+	uint32_t m_rebuildPeriod = 1;
+	uint32_t m_untilRebuild = 1;
+	uint16_t m_frequencies[tokenCount];
+	uint16_t m_starts[tokenCount + 1]; // m_starts[tokenCount] is probabilityScale, which ends the search of find()
+};
+
+int tokenOf(uint64_t value)
+{
+	int token = 0;
+	while (value)
+	{
+		++token;
+		value >>= 1;
+	}
+	return token;
+}
+
+// Signed values are zigzag encoded, so that small negative values stay small
+uint64_t zigzag(const int64_t value)
+{
+	return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(const uint64_t value)
+{
+	return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Wrapping arithmetic, as ids and timestamps use the full 64 bits
+int64_t wrappingAdd(const int64_t a, const int64_t b)
+{
+	return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+int64_t wrappingSubtract(const int64_t a, const int64_t b)
+{
+	return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+
+// Collects the symbols of a block, which are then written in reverse, as rANS decodes in the opposite order it encodes
+struct SymbolWriter
+{
+	vector<Symbol> symbols;
+
+	void value(TokenModel& model, const uint64_t value)
+	{
+		const int token = tokenOf(value);
+		symbols.push_back(model.symbol(token));
+		model.update(token);
+		for (int bits = token - 1; bits > 0;)
+		{
+			const int chunk = min(bits, maxRawBits);
+			bits -= chunk;
+			const uint32_t raw = static_cast<uint32_t>(value >> bits) & ((1u << chunk) - 1);
+			symbols.push_back(Symbol{static_cast<uint16_t>(raw << (probabilityBits - chunk)), static_cast<uint16_t>(1u << (probabilityBits - chunk))});
+		}
+	}
+
+	// Encodes the symbols at the end of the buffer, and returns where the encoding starts
+	size_t encode(vector<uint8_t>& buffer) const
+	{
+		// Each symbol adds at most 2 bytes, as the state is under 2^31 and a symbol takes at most 12 bits
+		buffer.resize(symbols.size() * 2 + 4);
+		uint8_t* p = buffer.data() + buffer.size();
+		uint32_t x = ransLow;
+		for (auto s = symbols.rbegin(); s != symbols.rend(); ++s)
+		{
+			const uint32_t xMax = ((ransLow >> probabilityBits) << 8) * s->frequency;
+			while (x >= xMax)
+			{
+				*--p = static_cast<uint8_t>(x);
+				x >>= 8;
+			}
+			x = ((x / s->frequency) << probabilityBits) + (x % s->frequency) + s->start;
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			*--p = static_cast<uint8_t>(x);
+			x >>= 8;
+		}
+		return static_cast<size_t>(p - buffer.data());
+	}
+};
+
+// Bounds checked rANS decoding
+// Once every symbol is decoded, a valid payload is fully read, and the state is back to where the encoder started
+struct SymbolReader
+{
+	const uint8_t* data;
+	const uint8_t* end;
+	uint32_t x = 0;
+	bool valid = true;
+
+	SymbolReader(const uint8_t* const payload, const size_t size)
+		: data(payload)
+		, end(payload + size)
+	{
+		for (int i = 0; i < 4; ++i)
+			x = (x << 8) | byte();
+	}
+
+	uint8_t byte()
+	{
+		if (data >= end)
+		{
+			valid = false;
+			return 0;
+		}
+		return *data++;
+	}
+
+	void advance(const Symbol s, const uint32_t slot)
+	{
+		x = s.frequency * (x >> probabilityBits) + slot - s.start;
+		while (x < ransLow && valid)
+			x = (x << 8) | byte();
+	}
+
+	uint64_t value(TokenModel& model)
+	{
+		const int token = model.find(x & (probabilityScale - 1));
+		advance(model.symbol(token), x & (probabilityScale - 1));
+		model.update(token);
+		if (token == 0)
+			return 0;
+		uint64_t value = 1;
+		for (int bits = token - 1; bits > 0;)
+		{
+			const int chunk = min(bits, maxRawBits);
+			bits -= chunk;
+			const uint32_t slot = x & (probabilityScale - 1);
+			const uint32_t raw = slot >> (probabilityBits - chunk);
+			advance(Symbol{static_cast<uint16_t>(raw << (probabilityBits - chunk)), static_cast<uint16_t>(1u << (probabilityBits - chunk))}, slot);
+			value = (value << chunk) | raw;
+		}
+		return value;
+	}
+
+	bool finished() const { return valid && data == end && x == ransLow; }
+};
+
+// Fields of the frames, in the order they're coded, as a field can only be predicted from the fields coded before it
+enum FieldIndex
+{
+	IdField,
+	TimestampField,
+	YawField,
+	PitchField,
+	LeftYawField,
+	LeftPitchField,
+	RightYawField,
+	RightPitchField,
+	ScreenXField,
+	ScreenYField,
+	LeftPupilField,
+	RightPupilField,
+	ObjectField,
+	FieldCount,
+};
+
+// Field whose motion also predicts the motion of each field, or -1
+constexpr int relatedFields[FieldCount] = {-1, -1, -1, -1, YawField, PitchField, YawField, PitchField, YawField, PitchField, -1, LeftPupilField, -1};
+
+constexpr int64_t maxMotion = 1 << 18;       // Motions are clamped to this for the gain estimation, so its sums can't overflow
+constexpr uint32_t maxPredictionError = 1 << 20; // Same for the error of the predictions
+constexpr int gainBits = 16;
+constexpr int predictionCount = 3;
+
+// Prediction state of one field
+// Three predictions are made, and whichever was the most accurate over the last frames is used:
+// 0. The previous value, which is the best for noisy values that barely move (eg. fixations)
+// 1. The linear extrapolation of the last two values, which is the best for smooth motions (eg. timestamps, saccades)
+// 2. The previous value, moved by the motion of the related field times a gain, which is the best for values that move together,
+//    like the gaze of each eye with the combined gaze. The gain is the least squares fit of the recent motions.
+// This only uses integer arithmetic, so the encoder and the decoder make the exact same predictions on every platform.
+struct Field
+{
+	int64_t previous = 0;
+	int64_t beforePrevious = 0;
+	uint32_t errors[predictionCount] = {}; // Exponentially decaying sums of the absolute errors
+	int64_t covariance = 0;                // Exponentially decaying sums of the motions of this field times the related field
+	int64_t variance = 0;                  // And of the squared motions of the related field
+	TokenModel model;
+};
+
+int64_t clampedMotion(const Field& field)
+{
+	return clamp<int64_t>(wrappingSubtract(field.previous, field.beforePrevious), -maxMotion, maxMotion);
+}
+
+// Prediction state of all the fields, identical in the encoder and the decoder
+struct CodecState
+{
+	EyeFrameCodecSettings steps;
+	Field fields[FieldCount];
+	uint64_t flags = 0;
+	TokenModel flagsModel;
+	int64_t predictions[predictionCount] = {};
+
+	void reset(const EyeFrameCodecSettings& settings)
+	{
+		steps = settings;
+		for (Field& field : fields)
+		{
+			field = Field();
+			field.model.reset();
+		}
+		flags = 0;
+		flagsModel.reset();
+	}
+
+	int64_t predict(const int index)
+	{
+		const Field& field = fields[index];
+		predictions[0] = field.previous;
+		predictions[1] = wrappingAdd(field.previous, wrappingSubtract(field.previous, field.beforePrevious));
+		predictions[2] = predictions[1];
+		if (relatedFields[index] >= 0 && field.variance > 0)
+		{
+			// The related field was already updated with the current frame
+			const int64_t gain = clamp<int64_t>(field.covariance * (int64_t{1} << gainBits) / field.variance, -(int64_t{4} << gainBits), int64_t{4} << gainBits);
+			predictions[2] = wrappingAdd(field.previous, (clampedMotion(fields[relatedFields[index]]) * gain) >> gainBits);
+		}
+		return predictions[min_element(begin(field.errors), end(field.errors)) - begin(field.errors)];
+	}
+
+	void update(const int index, const int64_t value)
+	{
+		Field& field = fields[index];
+		for (int i = 0; i < predictionCount; ++i)
+		{
+			const uint64_t error = static_cast<uint64_t>(wrappingSubtract(value, predictions[i]));
+			const uint64_t absoluteError = min<uint64_t>(static_cast<int64_t>(error) < 0 ? 0 - error : error, maxPredictionError);
+			field.errors[i] = field.errors[i] - (field.errors[i] >> 3) + static_cast<uint32_t>(absoluteError);
+		}
+		field.beforePrevious = field.previous;
+		field.previous = value;
+		if (relatedFields[index] >= 0)
+		{
+			const int64_t motion = clampedMotion(field);
+			const int64_t relatedMotion = clampedMotion(fields[relatedFields[index]]);
+			field.covariance += motion * relatedMotion - (field.covariance >> 4);
+			field.variance += relatedMotion * relatedMotion - (field.variance >> 4);
+		}
+	}
+};
+
+int64_t quantize(const float value, const float step)
+{
+	if (!isfinite(value))
+		return 0;
+	return llround(clamp(static_cast<double>(value) / step, -1e15, 1e15));
+}
+
+float dequantize(const int64_t value, const float step)
+{
+	return static_cast<float>(value * static_cast<double>(step));
+}
+
+void frameValues(const EyeFrame& frame, const EyeFrameCodecSettings& steps, int64_t (&values)[FieldCount])
+{
+	const auto SetDirection = [&](const Fove::Vec3 direction, const int yawField) {
+		const Fove::Vec2 angles = directionToYawPitch(direction);
+		values[yawField] = quantize(angles.x, steps.angleStepDegrees);
+		values[yawField + 1] = quantize(angles.y, steps.angleStepDegrees);
+	};
+	values[IdField] = static_cast<int64_t>(frame.id);
+	values[TimestampField] = static_cast<int64_t>(frame.timestamp);
+	SetDirection(frame.combinedGaze, YawField);
+	SetDirection(frame.gaze.l, LeftYawField);
+	SetDirection(frame.gaze.r, RightYawField);
+	values[ScreenXField] = quantize(frame.screenPosition.x, steps.screenStep);
+	values[ScreenYField] = quantize(frame.screenPosition.y, steps.screenStep);
+	values[LeftPupilField] = quantize(frame.pupilRadius.l, steps.pupilStepMeters);
+	values[RightPupilField] = quantize(frame.pupilRadius.r, steps.pupilStepMeters);
+	values[ObjectField] = frame.gazedObjectId;
+}
+
+EyeFrame frameFromValues(const int64_t (&values)[FieldCount], const uint64_t flags, const EyeFrameCodecSettings& steps)
+{
+	const auto Direction = [&](const int yawField) {
+		return yawPitchToDirection(dequantize(values[yawField], steps.angleStepDegrees), dequantize(values[yawField + 1], steps.angleStepDegrees));
+	};
+	EyeFrame frame;
+	frame.id = static_cast<uint64_t>(values[IdField]);
+	frame.timestamp = static_cast<uint64_t>(values[TimestampField]);
+	frame.gazeValid = (flags & 1) != 0;
+	frame.combinedGaze = Direction(YawField);
+	frame.gaze.l = Direction(LeftYawField);
+	frame.gaze.r = Direction(RightYawField);
+	frame.screenPosition = Fove::Vec2{dequantize(values[ScreenXField], steps.screenStep), dequantize(values[ScreenYField], steps.screenStep)};
+	frame.pupilRadius.l = dequantize(values[LeftPupilField], steps.pupilStepMeters);
+	frame.pupilRadius.r = dequantize(values[RightPupilField], steps.pupilStepMeters);
+	frame.eyeState.l = static_cast<Fove::EyeState>((flags >> 1) & 0xff);
+	frame.eyeState.r = static_cast<Fove::EyeState>((flags >> 9) & 0xff);
+	frame.gazedObjectId = static_cast<int>(values[ObjectField]);
+	return frame;
+}
+
+// Validity and eye states, which are coded as their changes from the previous frame
+uint64_t frameFlags(const EyeFrame& frame)
+{
+	return (frame.gazeValid ? 1 : 0) | (static_cast<uint64_t>(enumToUnderlyingValue(frame.eyeState.l) & 0xff) << 1)
+		   | (static_cast<uint64_t>(enumToUnderlyingValue(frame.eyeState.r) & 0xff) << 9);
+}
+
+void writeVarint(vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+void writeFloat(vector<uint8_t>& out, const float value)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 4; ++i)
+		out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+}
+
+// Bounds checked reading of a block header
+struct HeaderReader
+{
+	const uint8_t* data;
+	const uint8_t* end;
+	bool valid = true;
+
+	uint8_t byte()
+	{
+		if (data >= end)
+		{
+			valid = false;
+			return 0;
+		}
+		return *data++;
+	}
+
+	uint64_t varint()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			const uint8_t b = byte();
+			value |= static_cast<uint64_t>(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+				return value;
+		}
+		valid = false;
+		return 0;
+	}
+
+	float float32()
+	{
+		uint32_t bits = 0;
+		for (int i = 0; i < 4; ++i)
+			bits |= static_cast<uint32_t>(byte()) << (8 * i);
+		float value = 0;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+};
+
+bool isValidStep(const float step)
+{
+	return isfinite(step) && step > 0;
+}
+
+} // namespace
+
+struct EyeFrameEncoder::State : CodecState
+{
+	SymbolWriter writer;
+	vector<uint8_t> payload;
+};
+
+EyeFrameEncoder::EyeFrameEncoder(const EyeFrameCodecSettings& settings)
+	: m_settings(settings)
+	, m_state(make_unique<State>())
+{
+	if (!isValidStep(settings.angleStepDegrees) || !isValidStep(settings.screenStep) || !isValidStep(settings.pupilStepMeters))
+		throw "The quantization steps of the eye frame codec must be positive";
+	m_settings.resetInterval = max(settings.resetInterval, 1u);
+}
+
+EyeFrameEncoder::~EyeFrameEncoder() = default;
+
+void EyeFrameEncoder::reset()
+{
+	m_blocksUntilReset = 0;
+}
+
+void EyeFrameEncoder::encodeBlock(const EyeFrame* const frames, const size_t count, vector<uint8_t>& out)
+{
+	if (count > maxBlockFrames)
+		throw "Too many frames for one block: " + to_string(count);
+
+	const bool reset = m_blocksUntilReset == 0;
+	if (reset)
+	{
+		m_state->reset(m_settings);
+		m_blocksUntilReset = m_settings.resetInterval;
+	}
+	--m_blocksUntilReset;
+
+	out.insert(out.end(), begin(blockMagic), end(blockMagic));
+	out.push_back(blockVersion);
+	out.push_back(reset ? resetBlockFlag : 0);
+	writeVarint(out, m_nextBlock++);
+	writeVarint(out, count);
+	if (reset)
+	{
+		writeFloat(out, m_settings.angleStepDegrees);
+		writeFloat(out, m_settings.screenStep);
+		writeFloat(out, m_settings.pupilStepMeters);
+	}
+
+	State& state = *m_state;
+	state.writer.symbols.clear();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint64_t flags = frameFlags(frames[i]);
+		state.writer.value(state.flagsModel, flags ^ state.flags);
+		state.flags = flags;
+
+		int64_t values[FieldCount];
+		frameValues(frames[i], state.steps, values);
+		for (int field = 0; field < FieldCount; ++field)
+		{
+			state.writer.value(state.fields[field].model, zigzag(wrappingSubtract(values[field], state.predict(field))));
+			state.update(field, values[field]);
+		}
+	}
+
+	const size_t payloadStart = state.writer.encode(state.payload);
+	writeVarint(out, state.payload.size() - payloadStart);
+	out.insert(out.end(), state.payload.begin() + static_cast<ptrdiff_t>(payloadStart), state.payload.end());
+}
+
+struct EyeFrameDecoder::State : CodecState
+{
+	vector<EyeFrame> frames;
+};
+
+EyeFrameDecoder::EyeFrameDecoder()
+	: m_state(make_unique<State>())
+{
+}
+
+EyeFrameDecoder::~EyeFrameDecoder() = default;
+
+size_t EyeFrameDecoder::decodeBlock(const uint8_t* const data, const size_t size, vector<EyeFrame>& frames)
+{
+	if (!isEyeFrameBlock(data, size))
+		return 0;
+	HeaderReader header{data + sizeof(blockMagic) + 1, data + size};
+	const bool reset = (header.byte() & resetBlockFlag) != 0;
+	const uint64_t blockNumber = header.varint();
+	const uint64_t count = header.varint();
+	EyeFrameCodecSettings steps;
+	if (reset)
+	{
+		steps.angleStepDegrees = header.float32();
+		steps.screenStep = header.float32();
+		steps.pupilStepMeters = header.float32();
+	}
+	const uint64_t payloadSize = header.varint();
+	if (!header.valid || count > maxBlockFrames || payloadSize > static_cast<uint64_t>(header.end - header.data)
+		|| (reset && (!isValidStep(steps.angleStepDegrees) || !isValidStep(steps.screenStep) || !isValidStep(steps.pupilStepMeters))))
+		return 0;
+	const size_t blockSize = static_cast<size_t>(header.data - data + payloadSize);
+
+	// Blocks can only be decoded in order from a reset block
+	if (!reset && (!m_synchronized || blockNumber != m_nextBlock))
+	{
+		m_synchronized = false;
+		++m_blocksSkipped;
+		return blockSize;
+	}
+
+	State& state = *m_state;
+	if (reset)
+		state.reset(steps);
+	state.frames.clear();
+	SymbolReader reader(header.data, static_cast<size_t>(payloadSize));
+	for (uint64_t i = 0; i < count && reader.valid; ++i)
+	{
+		state.flags ^= reader.value(state.flagsModel);
+
+		int64_t values[FieldCount];
+		for (int field = 0; field < FieldCount; ++field)
+		{
+			values[field] = wrappingAdd(state.predict(field), unzigzag(reader.value(state.fields[field].model)));
+			state.update(field, values[field]);
+		}
+		state.frames.push_back(frameFromValues(values, state.flags, state.steps));
+	}
+	if (!reader.finished())
+	{
+		m_synchronized = false;
+		return 0;
+	}
+
+	frames.insert(frames.end(), state.frames.begin(), state.frames.end());
+	m_synchronized = true;
+	m_nextBlock = blockNumber + 1;
+	return blockSize;
+}
+
+bool isEyeFrameBlock(const uint8_t* const data, const size_t size)
+{
+	return size >= sizeof(blockMagic) + 1 && memcmp(data, blockMagic, sizeof(blockMagic)) == 0 && data[sizeof(blockMagic)] == blockVersion;
+}
+
+vector<EyeFrame> decodeEyeFrameBlocks(const uint8_t* const data, const size_t size)
+{
+	EyeFrameDecoder decoder;
+	vector<EyeFrame> frames;
+	size_t offset = 0;
+	while (offset < size)
+	{
+		const size_t blockSize = decoder.decodeBlock(data + offset, size - offset, frames);
+		if (blockSize == 0)
+			break;
+		offset += blockSize;
+	}
+	return frames;
+}
+
+EyeFrameRecordingWriter::EyeFrameRecordingWriter(const string& path, const EyeFrameCodecSettings& settings, const size_t blockSize)
+	: m_out(path, ios::binary)
+	, m_encoder(settings)
+	, m_blockSize(clamp<size_t>(blockSize, 1, maxBlockFrames))
+{
+	if (!m_out)
+		throw "Unable to open " + path;
+	m_pending.reserve(m_blockSize);
+}
+
+EyeFrameRecordingWriter::~EyeFrameRecordingWriter()
+{
+	flush();
+}
+
+void EyeFrameRecordingWriter::write(const EyeFrame& frame)
+{
+	m_pending.push_back(frame);
+	if (m_pending.size() >= m_blockSize)
+		flush();
+}
+
+void EyeFrameRecordingWriter::flush()
+{
+	if (m_pending.empty())
+		return;
+
+	// Whole blocks are written at once, so a recording that's cut short only loses its last block
+	m_buffer.clear();
+	m_encoder.encodeBlock(m_pending.data(), m_pending.size(), m_buffer);
+	m_out.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<streamsize>(m_buffer.size()));
+	m_out.flush();
+	m_pending.clear();
+}
@@ -0,0 +1,210 @@
+// FOVE Eye Frame Codec Benchmark
+// This compresses sessions with the codec of EyeFrameCodec.h, in the block sizes of a recording and of a network stream,
+// and reports the compression ratios, the encoding and decoding throughput, and the precision lost by the quantization
+//
+// Usage: FoveEyeFrameCodecBenchmark [--angle-step degrees] [--screen-step step] [--pupil-step meters] [session.csv|session.eyz...]
+// Sessions are recorded with `FoveDataExample --record session.csv` (or session.eyz, compressed). Synthetic sessions are always included.
+//
+// The modes are:
+// - Recording: blocks of 120 frames (one second at 120Hz), with a reset block every 10 blocks, as written by EyeFrameRecordingWriter
+// - Stream: blocks of 4 frames, with a reset block every 250 blocks, for a reliable transport like TCP
+// - Datagrams: blocks of 4 frames, all of them reset blocks, so each one decodes on its own, for UDP
+// Sizes are compared to the frames in memory, as CSV, and as GazeStream.h packets of 4 frames.
+
+#include "EyeData.h"
+#include "EyeFrameCodec.h"
+#include "GazeStream.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+struct Mode
+{
+	const char* name;
+	size_t blockSize;
+	uint32_t resetInterval;
+};
+
+const Mode modes[] = {
+	{"Recording", 120, 10},
+	{"Stream", 4, 250},
+	{"Datagrams", 4, 1},
+};
+
+struct Precision
+{
+	float maxGazeErrorDegrees = 0; // Largest error on the combined and per eye gaze directions
+	float maxScreenError = 0;      // Largest error on the screen positions
+	float maxPupilErrorMm = 0;     // Largest error on the pupil radii
+	bool identical = true;         // Whether the fields that are kept exactly (ids, timestamps, states, objects) were
+};
+
+vector<uint8_t> encode(const vector<EyeFrame>& session, const EyeFrameCodecSettings& settings, const Mode& mode)
+{
+	EyeFrameCodecSettings modeSettings = settings;
+	modeSettings.resetInterval = mode.resetInterval;
+	EyeFrameEncoder encoder(modeSettings);
+	vector<uint8_t> encoded;
+	encoded.reserve(session.size() * 8);
+	for (size_t i = 0; i < session.size(); i += mode.blockSize)
+		encoder.encodeBlock(session.data() + i, min(mode.blockSize, session.size() - i), encoded);
+	return encoded;
+}
+
+Precision compare(const vector<EyeFrame>& session, const vector<EyeFrame>& decoded)
+{
+	Precision result;
+	result.identical = session.size() == decoded.size();
+	for (size_t i = 0; i < min(session.size(), decoded.size()); ++i)
+	{
+		const EyeFrame& expected = session[i];
+		const EyeFrame& frame = decoded[i];
+		result.identical = result.identical && frame.id == expected.id && frame.timestamp == expected.timestamp && frame.gazeValid == expected.gazeValid
+						   && frame.eyeState.l == expected.eyeState.l && frame.eyeState.r == expected.eyeState.r && frame.gazedObjectId == expected.gazedObjectId;
+		result.maxGazeErrorDegrees = max({result.maxGazeErrorDegrees, angleBetweenDirections(frame.combinedGaze, expected.combinedGaze),
+										  angleBetweenDirections(frame.gaze.l, expected.gaze.l), angleBetweenDirections(frame.gaze.r, expected.gaze.r)});
+		result.maxScreenError = max({result.maxScreenError, fabs(frame.screenPosition.x - expected.screenPosition.x), fabs(frame.screenPosition.y - expected.screenPosition.y)});
+		result.maxPupilErrorMm = max({result.maxPupilErrorMm, 1000 * fabs(frame.pupilRadius.l - expected.pupilRadius.l), 1000 * fabs(frame.pupilRadius.r - expected.pupilRadius.r)});
+	}
+	return result;
+}
+
+// Runs the function until it took at least a fifth of a second, and returns the average time of one run
+template <typename Function>
+double secondsPerRun(const Function& function)
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int runs = 0;
+	double seconds = 0;
+	do
+	{
+		function();
+		++runs;
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	} while (seconds < 0.2);
+	return seconds / runs;
+}
+
+size_t csvSize(const vector<EyeFrame>& session)
+{
+	ostringstream csv;
+	writeEyeFrameCsvHeader(csv);
+	for (const EyeFrame& frame : session)
+		writeEyeFrameCsv(csv, frame);
+	return csv.str().size();
+}
+
+size_t gazeStreamSize(const vector<EyeFrame>& session)
+{
+	size_t size = 0;
+	GazePacket packet;
+	vector<uint8_t> buffer(maxGazePacketSize);
+	for (size_t i = 0; i < session.size(); i += 4)
+	{
+		packet.frames.assign(session.begin() + i, session.begin() + min(i + 4, session.size()));
+		size += encodeGazePacket(packet, buffer.data());
+	}
+	return size;
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	EyeFrameCodecSettings settings;
+	vector<pair<string, vector<EyeFrame>>> sessions;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--angle-step" && i + 1 < argc)
+			settings.angleStepDegrees = stof(argv[++i]);
+		else if (arg == "--screen-step" && i + 1 < argc)
+			settings.screenStep = stof(argv[++i]);
+		else if (arg == "--pupil-step" && i + 1 < argc)
+			settings.pupilStepMeters = stof(argv[++i]);
+		else
+			sessions.emplace_back(filesystem::path(arg).filename().string(), readEyeSession(arg));
+	}
+
+	// Synthetic sessions of 5 minutes, with the default tracking noise, and with much less
+	SyntheticSessionSettings quiet;
+	quiet.noiseDegrees = 0.02f;
+	sessions.emplace(sessions.begin(), "Synthetic, 0.02 deg noise", generateEyeSession(2, 300.0f, quiet));
+	sessions.emplace(sessions.begin(), "Synthetic, 0.1 deg noise", generateEyeSession(1, 300.0f));
+
+	cout << fixed << "Steps: gaze " << setprecision(4) << settings.angleStepDegrees << " degrees, screen " << setprecision(6) << settings.screenStep
+		 << ", pupil " << setprecision(4) << settings.pupilStepMeters * 1000 << "mm\n";
+
+	bool ok = true;
+	for (const auto& [name, session] : sessions)
+	{
+		if (session.empty())
+			continue;
+
+		const double rawSize = static_cast<double>(session.size() * sizeof(EyeFrame));
+		const double csvBytes = static_cast<double>(csvSize(session));
+		const double gazeStreamBytes = static_cast<double>(gazeStreamSize(session));
+		cout << setprecision(1) << '\n' << name << ": " << session.size() << " frames, bytes per frame: " << sizeof(EyeFrame) << " in memory, "
+			 << csvBytes / session.size() << " as CSV, " << gazeStreamBytes / session.size() << " with GazeStream.h\n"
+			 << "Mode       Bytes/frame  Ratio  vs CSV  vs GazeStream  Encode Mframes/s  MB/s  Decode Mframes/s  MB/s\n";
+
+		Precision worst;
+		for (const Mode& mode : modes)
+		{
+			const vector<uint8_t> encoded = encode(session, settings, mode);
+			const vector<EyeFrame> decoded = decodeEyeFrameBlocks(encoded.data(), encoded.size());
+			const Precision precision = compare(session, decoded);
+			worst.maxGazeErrorDegrees = max(worst.maxGazeErrorDegrees, precision.maxGazeErrorDegrees);
+			worst.maxScreenError = max(worst.maxScreenError, precision.maxScreenError);
+			worst.maxPupilErrorMm = max(worst.maxPupilErrorMm, precision.maxPupilErrorMm);
+			worst.identical = worst.identical && precision.identical;
+
+			// Throughputs are in frames, and in MB of frames in memory
+			const double encodeSeconds = secondsPerRun([&] { encode(session, settings, mode); });
+			const double decodeSeconds = secondsPerRun([&] { decodeEyeFrameBlocks(encoded.data(), encoded.size()); });
+			const double size = static_cast<double>(encoded.size());
+			cout << left << setw(9) << mode.name << right << setprecision(2) << setw(13) << size / session.size() << setprecision(1) << setw(7) << rawSize / size
+				 << setw(8) << csvBytes / size << setw(15) << gazeStreamBytes / size << setprecision(2) << setw(18) << session.size() / encodeSeconds / 1e6
+				 << setprecision(0) << setw(6) << rawSize / encodeSeconds / 1e6 << setprecision(2) << setw(18) << session.size() / decodeSeconds / 1e6
+				 << setprecision(0) << setw(6) << rawSize / decodeSeconds / 1e6 << '\n';
+		}
+		cout << setprecision(4) << "Error: gaze " << worst.maxGazeErrorDegrees << " degrees, screen position " << worst.maxScreenError << ", pupil radius "
+			 << worst.maxPupilErrorMm << "mm. Ids, timestamps, eye states and object ids: " << (worst.identical ? "exact" : "ERROR: some differ") << '\n';
+		ok = ok && worst.identical;
+	}
+
+	// Check that compressed recordings read back like CSV ones
+	const filesystem::path path = filesystem::temp_directory_path() / "FoveEyeFrameCodecBenchmark.eyz";
+	{
+		EyeFrameRecordingWriter writer(path.string(), settings);
+		for (const EyeFrame& frame : sessions.front().second)
+			writer.write(frame);
+	}
+	const bool recordingOk = compare(sessions.front().second, readEyeSession(path.string())).identical;
+	filesystem::remove(path);
+	cout << "\nCompressed recording read back: " << (recordingOk ? "ok" : "ERROR: frames differ") << '\n';
+	return ok && recordingOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,302 @@
+#include "EyeFrameSharedMemory.h"
+#include "Seqlock.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// What each slot of the ring holds
+struct SharedEyeFrame
+{
+	EyeFrame frame;
+	uint64_t publishNanoseconds = 0; // See sharedEyeFrameClockNanoseconds()
+};
+using SharedEyeFrameSlot = SeqlockSlot<SharedEyeFrame>;
+
+// Header of the shared memory, followed by the slots
+// Only fixed size fields and lock free atomics, so that it means the same in every process
+struct alignas(64) SharedEyeFrameRing
+{
+	static constexpr uint32_t expectedMagic = 0x46455946; // "FEYF"
+	static constexpr uint32_t currentVersion = 1;
+
+	atomic<uint32_t> magic{0}; // Written last by the publisher, once the rest is ready
+	uint32_t version = currentVersion;
+	uint32_t slotSize = sizeof(SharedEyeFrameSlot); // Catches readers built with a different EyeFrame
+	uint32_t slotCount = 0;                          // Power of two
+	atomic<uint32_t> closed{0};
+	atomic<uint32_t> readers{0};
+
+	alignas(64) atomic<uint64_t> latest{0};
+	atomic<uint32_t> wakeCounter{0}; // Futex word, incremented after each frame
+	atomic<uint32_t> waiters{0};     // Readers sleeping on the futex
+
+	SharedEyeFrameSlot* slots() { return reinterpret_cast<SharedEyeFrameSlot*>(this + 1); }
+	const SharedEyeFrameSlot* slots() const { return reinterpret_cast<const SharedEyeFrameSlot*>(this + 1); }
+};
+
+static_assert(atomic<uint32_t>::is_always_lock_free && sizeof(atomic<uint32_t>) == sizeof(uint32_t), "The futex word must be a plain 32 bit integer");
+static_assert(sizeof(SharedEyeFrameRing) % alignof(SharedEyeFrameSlot) == 0, "The slots must be aligned");
+
+namespace
+{
+
+#ifdef __linux__
+
+string systemError(const string& what)
+{
+	return what + ": " + strerror(errno);
+}
+
+// Maps the shared memory of the given name, creating it with the given size, or reading back its size when opening it
+void* mapSharedMemory(const string& name, const bool create, size_t& size)
+{
+	int fd = -1;
+	if (create)
+	{
+		// Memory left over by a publisher which crashed is replaced, the readers which still map it keep their own copy
+		shm_unlink(name.c_str());
+		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600); // Only readable by the processes of the same user
+		if (fd < 0)
+			throw systemError("Unable to create shared memory " + name);
+		if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			const string error = systemError("Unable to size shared memory " + name);
+			close(fd);
+			shm_unlink(name.c_str());
+			throw error;
+		}
+	}
+	else
+	{
+		fd = shm_open(name.c_str(), O_RDWR, 0);
+		if (fd < 0)
+			throw systemError("No eye frame publisher at " + name);
+		struct stat info = {};
+		if (fstat(fd, &info) != 0)
+		{
+			const string error = systemError("Unable to read shared memory " + name);
+			close(fd);
+			throw error;
+		}
+		size = static_cast<size_t>(info.st_size);
+	}
+
+	void* const memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const int mapErrno = errno;
+	close(fd); // The mapping keeps the memory alive
+	if (memory == MAP_FAILED)
+	{
+		errno = mapErrno;
+		throw systemError("Unable to map shared memory " + name);
+	}
+	return memory;
+}
+
+void unmapSharedMemory(void* const memory, const size_t size)
+{
+	munmap(memory, size);
+}
+
+void unlinkSharedMemory(const string& name)
+{
+	shm_unlink(name.c_str());
+}
+
+// The futexes are shared between processes, so they don't use FUTEX_PRIVATE_FLAG
+void futexWait(atomic<uint32_t>& word, const uint32_t expected, const chrono::nanoseconds timeout)
+{
+	const timespec relative{static_cast<time_t>(timeout.count() / 1'000'000'000), static_cast<long>(timeout.count() % 1'000'000'000)};
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &relative, nullptr, 0); // Spurious and early wake ups are handled by the caller
+}
+
+void futexWakeAll(atomic<uint32_t>& word)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+void* mapSharedMemory(const string&, bool, size_t&)
+{
+	throw "Sharing eye frames between processes is only implemented on Linux";
+}
+
+void unmapSharedMemory(void*, size_t) {}
+void unlinkSharedMemory(const string&) {}
+void futexWait(atomic<uint32_t>&, uint32_t, chrono::nanoseconds) {}
+void futexWakeAll(atomic<uint32_t>&) {}
+
+#endif
+
+} // namespace
+
+uint64_t sharedEyeFrameClockNanoseconds()
+{
+	return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+EyeFramePublisher::EyeFramePublisher(const string& name, const size_t historySize)
+	: m_name(name)
+{
+	uint32_t slotCount = 2;
+	while (slotCount < historySize)
+		slotCount *= 2;
+	m_mappedSize = sizeof(SharedEyeFrameRing) + slotCount * sizeof(SharedEyeFrameSlot);
+
+	void* const memory = mapSharedMemory(name, true, m_mappedSize);
+	m_ring = new (memory) SharedEyeFrameRing();
+	for (uint32_t i = 0; i < slotCount; ++i)
+		new (&m_ring->slots()[i]) SharedEyeFrameSlot();
+	m_ring->slotCount = slotCount;
+	m_ring->magic.store(SharedEyeFrameRing::expectedMagic, memory_order_release);
+}
+
+EyeFramePublisher::~EyeFramePublisher()
+{
+	m_ring->closed = 1;
+	m_ring->wakeCounter.fetch_add(1);
+	futexWakeAll(m_ring->wakeCounter);
+	unlinkSharedMemory(m_name);
+	unmapSharedMemory(m_ring, m_mappedSize);
+}
+
+uint64_t EyeFramePublisher::publish(const EyeFrame& frame)
+{
+	const uint64_t sequence = m_ring->latest.load(memory_order_relaxed) + 1;
+	m_ring->slots()[sequence & (m_ring->slotCount - 1)].write(sequence, SharedEyeFrame{frame, sharedEyeFrameClockNanoseconds()});
+	m_ring->latest.store(sequence, memory_order_release);
+
+	// Waiting readers register before checking the wake counter, so either they see this frame, or we see them and wake them up
+	m_ring->wakeCounter.fetch_add(1);
+	if (m_ring->waiters.load() > 0)
+		futexWakeAll(m_ring->wakeCounter);
+	return sequence;
+}
+
+uint32_t EyeFramePublisher::readerCount() const
+{
+	return m_ring->readers.load();
+}
+
+EyeFrameReader::EyeFrameReader(const string& name)
+{
+	void* const memory = mapSharedMemory(name, false, m_mappedSize);
+	m_ring = static_cast<SharedEyeFrameRing*>(memory);
+
+	// Check the memory was fully set up by a compatible publisher before trusting any of it
+	const auto Check = [&](const bool condition, const char* const error) {
+		if (!condition)
+		{
+			unmapSharedMemory(memory, m_mappedSize);
+			throw name + ": " + error;
+		}
+	};
+	Check(m_mappedSize >= sizeof(SharedEyeFrameRing), "not an eye frame ring");
+	Check(m_ring->magic.load(memory_order_acquire) == SharedEyeFrameRing::expectedMagic, "not an eye frame ring, or not ready yet");
+	Check(m_ring->version == SharedEyeFrameRing::currentVersion && m_ring->slotSize == sizeof(SharedEyeFrameSlot), "published by an incompatible version");
+	Check(m_ring->slotCount >= 2 && (m_ring->slotCount & (m_ring->slotCount - 1)) == 0
+			  && m_mappedSize >= sizeof(SharedEyeFrameRing) + m_ring->slotCount * sizeof(SharedEyeFrameSlot),
+		  "invalid size");
+
+	m_ring->readers.fetch_add(1);
+	m_next = latestSequence() + 1;
+}
+
+EyeFrameReader::~EyeFrameReader()
+{
+	m_ring->readers.fetch_sub(1);
+	unmapSharedMemory(m_ring, m_mappedSize);
+}
+
+size_t EyeFrameReader::historySize() const
+{
+	return m_ring->slotCount;
+}
+
+bool EyeFrameReader::isClosed() const
+{
+	return m_ring->closed.load() != 0;
+}
+
+uint64_t EyeFrameReader::latestSequence() const
+{
+	return m_ring->latest.load(memory_order_acquire);
+}
+
+bool EyeFrameReader::read(const uint64_t sequence, EyeFrame& frame, uint64_t* const publishNanoseconds) const
+{
+	SharedEyeFrame shared;
+	if (sequence == 0 || sequence > latestSequence() || !m_ring->slots()[sequence & (m_ring->slotCount - 1)].read(sequence, shared))
+		return false;
+	frame = shared.frame;
+	if (publishNanoseconds)
+		*publishNanoseconds = shared.publishNanoseconds;
+	return true;
+}
+
+uint64_t EyeFrameReader::readLatest(EyeFrame& frame) const
+{
+	// This only fails if the publisher went around the whole ring during the copy, so it's retried with the new latest frame
+	while (true)
+	{
+		const uint64_t sequence = latestSequence();
+		if (sequence == 0 || read(sequence, frame))
+			return sequence;
+	}
+}
+
+bool EyeFrameReader::waitForNewer(const uint64_t sequence, const chrono::milliseconds timeout) const
+{
+	const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout;
+	while (latestSequence() <= sequence && !isClosed())
+	{
+		const chrono::steady_clock::duration remaining = deadline - chrono::steady_clock::now();
+		if (remaining <= chrono::steady_clock::duration::zero())
+			break;
+
+		// Register as a waiter before reading the wake counter, see EyeFramePublisher::publish()
+		m_ring->waiters.fetch_add(1);
+		const uint32_t counter = m_ring->wakeCounter.load();
+		if (latestSequence() <= sequence && !isClosed())
+			futexWait(m_ring->wakeCounter, counter, remaining);
+		m_ring->waiters.fetch_sub(1);
+	}
+	return latestSequence() > sequence;
+}
+
+bool EyeFrameReader::next(EyeFrame& frame, uint64_t* const publishNanoseconds)
+{
+	while (m_next <= latestSequence())
+	{
+		if (read(m_next, frame, publishNanoseconds))
+		{
+			++m_next;
+			return true;
+		}
+
+		// The frame was overwritten: skip to the oldest one still in the ring
+		const uint64_t oldest = latestSequence() - (m_ring->slotCount - 1);
+		m_missed += max(oldest, m_next + 1) - m_next;
+		m_next = max(oldest, m_next + 1);
+	}
+	return false;
+}
+
+bool EyeFrameReader::waitNext(EyeFrame& frame, const chrono::milliseconds timeout, uint64_t* const publishNanoseconds)
+{
+	return next(frame, publishNanoseconds) || (waitForNewer(m_next - 1, timeout) && next(frame, publishNanoseconds));
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "EyeData.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// This header implements the sharing of eye frames with other processes of the same machine, through a ring in shared memory
+//
+// One process captures the frames and publishes them (eg. `FoveDataExample --share`), and any number of other processes map the same memory
+// and read the frames, instead of each opening its own Fove::Headset client and adding to the load of the service.
+// This is the client library of such processes: it only needs this header and its source file, not the FOVE client library.
+//
+// The ring works like EyeFrameChannel (see EyeFrameChannel.h), each slot protected by a sequence lock (see Seqlock.h):
+// the publisher never waits for readers, and readers never write to the ring, so adding readers doesn't slow anything down.
+// Readers copy the frames straight out of the shared memory, without any system call, unless they want to sleep until the next frame:
+// they then wait on a futex, which the publisher only wakes when some reader is waiting.
+//
+// This is only implemented on Linux (POSIX shared memory and futexes), elsewhere the constructors throw.
+
+constexpr const char* defaultEyeFrameSharedMemoryName = "/fove_eye_frames";
+
+struct SharedEyeFrameRing; // Layout of the shared memory, see EyeFrameSharedMemory.cpp
+
+// Time base of the publication times, which is the same for all processes (steady_clock), in nanoseconds
+uint64_t sharedEyeFrameClockNanoseconds();
+
+class EyeFramePublisher
+{
+public:
+	// Creates the shared memory, replacing any left over by a previous publisher. The history size is rounded up to a power of two
+	explicit EyeFramePublisher(const std::string& name = defaultEyeFrameSharedMemoryName, size_t historySize = 256);
+
+	// Marks the ring as closed, waking up the waiting readers, and removes its name (the readers which mapped it keep it until they're done)
+	~EyeFramePublisher();
+
+	EyeFramePublisher(const EyeFramePublisher&) = delete;
+	EyeFramePublisher& operator=(const EyeFramePublisher&) = delete;
+
+	// Publishes the next frame and returns its sequence number, starting from 1
+	// Only one thread may publish
+	uint64_t publish(const EyeFrame& frame);
+
+	// Number of readers which currently have the ring mapped (readers which crashed are still counted)
+	uint32_t readerCount() const;
+
+private:
+	std::string m_name;
+	SharedEyeFrameRing* m_ring = nullptr;
+	size_t m_mappedSize = 0;
+};
+
+class EyeFrameReader
+{
+public:
+	// Maps the ring of a publisher, throws if there is none
+	// Reading with next() starts at the next frame to be published
+	explicit EyeFrameReader(const std::string& name = defaultEyeFrameSharedMemoryName);
+	~EyeFrameReader();
+
+	EyeFrameReader(const EyeFrameReader&) = delete;
+	EyeFrameReader& operator=(const EyeFrameReader&) = delete;
+
+	size_t historySize() const;
+
+	// Whether the publisher is gone, in which case no new frame will come
+	bool isClosed() const;
+
+	// Sequence number of the latest frame, or 0 if none was published yet
+	uint64_t latestSequence() const;
+
+	// Copies the frame of the given sequence number, and optionally the time it was published (see sharedEyeFrameClockNanoseconds())
+	// Returns false if it wasn't published yet, or was already overwritten by a newer frame
+	bool read(uint64_t sequence, EyeFrame& frame, uint64_t* publishNanoseconds = nullptr) const;
+
+	// Copies the latest frame, returns its sequence number, or 0 if there is none yet
+	uint64_t readLatest(EyeFrame& frame) const;
+
+	// Waits until a frame newer than the given sequence number is published
+	// Returns false on timeout, or when the publisher is gone with nothing newer
+	bool waitForNewer(uint64_t sequence, std::chrono::milliseconds timeout) const;
+
+	// Reads every frame in order, like EyeFrameChannel::Subscriber
+	// Frames overwritten before the reader got to them are skipped, and counted
+	bool next(EyeFrame& frame, uint64_t* publishNanoseconds = nullptr);
+	bool waitNext(EyeFrame& frame, std::chrono::milliseconds timeout, uint64_t* publishNanoseconds = nullptr);
+	uint64_t lastSequence() const { return m_next - 1; } // Sequence number of the last frame returned by next()
+	uint64_t missed() const { return m_missed; }         // Number of frames skipped by next()
+
+private:
+	SharedEyeFrameRing* m_ring = nullptr;
+	size_t m_mappedSize = 0;
+	uint64_t m_next = 0;
+	uint64_t m_missed = 0;
+};
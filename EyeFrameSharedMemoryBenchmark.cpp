@@ -0,0 +1,232 @@
+// FOVE Eye Frame Shared Memory Benchmark
+// This publishes eye frames through the shared memory ring of EyeFrameSharedMemory.h to 1 to 16 reader processes,
+// and measures the latency from publication to read in each of them
+//
+// Usage: FoveEyeFrameSharedMemoryBenchmark [--max-readers N] [--rate Hz] [--frames N] [--spin]
+// Readers sleep on the futex of the ring between frames, unless --spin is given, in which case they poll it continuously.
+// Spinning gives the lowest latency, but needs a free core per reader.
+// This is Linux only, like the shared memory ring.
+
+#include "EyeData.h"
+#include "EyeFrameSharedMemory.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+struct ReaderSummary
+{
+	uint64_t frames = 0;
+	uint64_t missed = 0;
+	uint64_t corrupt = 0; // Frames that differ from what was published: must be 0
+};
+
+void writeAll(const int fd, const void* data, size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		const ssize_t written = write(fd, bytes, size);
+		if (written <= 0)
+			return;
+		bytes += written;
+		size -= static_cast<size_t>(written);
+	}
+}
+
+bool readAll(const int fd, void* data, size_t size)
+{
+	char* bytes = static_cast<char*>(data);
+	while (size > 0)
+	{
+		const ssize_t got = read(fd, bytes, size);
+		if (got <= 0)
+			return false;
+		bytes += got;
+		size -= static_cast<size_t>(got);
+	}
+	return true;
+}
+
+// Body of the reader processes: reads every frame until the publisher is gone,
+// then sends its summary and the latency of each frame (in nanoseconds) to the parent through the pipe
+void readerProcess(const string& name, const vector<EyeFrame>& session, const bool spin, const int resultPipe)
+{
+	EyeFrameReader reader(name);
+	ReaderSummary summary;
+	vector<uint64_t> latencies;
+	EyeFrame frame;
+	uint64_t publishNanoseconds = 0;
+	while (true)
+	{
+		bool got = false;
+		if (spin)
+		{
+			while (!(got = reader.next(frame, &publishNanoseconds)) && !reader.isClosed())
+				this_thread::yield();
+		}
+		else
+		{
+			got = reader.waitNext(frame, chrono::milliseconds{100}, &publishNanoseconds);
+		}
+		if (!got)
+		{
+			if (reader.isClosed() && !reader.next(frame, &publishNanoseconds))
+				break;
+			continue;
+		}
+
+		latencies.push_back(sharedEyeFrameClockNanoseconds() - publishNanoseconds);
+		const EyeFrame expected = sessionFrame(session, max<uint64_t>(frame.id, 1));
+		summary.corrupt += frame.id == reader.lastSequence() && frame.timestamp == expected.timestamp && frame.gazedObjectId == expected.gazedObjectId
+								   && frame.screenPosition.x == expected.screenPosition.x && frame.pupilRadius.l == expected.pupilRadius.l
+							   ? 0
+							   : 1;
+		++summary.frames;
+	}
+	summary.missed = reader.missed();
+
+	const uint64_t count = latencies.size();
+	writeAll(resultPipe, &summary, sizeof(summary));
+	writeAll(resultPipe, &count, sizeof(count));
+	writeAll(resultPipe, latencies.data(), latencies.size() * sizeof(uint64_t));
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	size_t maxReaders = 16;
+	double rateHz = 1000;
+	uint64_t frameCount = 2000;
+	bool spin = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--max-readers" && i + 1 < argc)
+			maxReaders = max<size_t>(stoul(argv[++i]), 1);
+		else if (arg == "--rate" && i + 1 < argc)
+			rateHz = max(stod(argv[++i]), 1.0);
+		else if (arg == "--frames" && i + 1 < argc)
+			frameCount = max<uint64_t>(stoull(argv[++i]), 1);
+		else if (arg == "--spin")
+			spin = true;
+		else
+			throw "Usage: FoveEyeFrameSharedMemoryBenchmark [--max-readers N] [--rate Hz] [--frames N] [--spin]";
+	}
+
+	const vector<EyeFrame> session = generateEyeSession(1, 10.0f);
+	const string name = "/fove_eye_frames_benchmark_" + to_string(getpid());
+	cout << fixed << setprecision(2) << "Hardware threads: " << thread::hardware_concurrency() << '\n'
+		 << frameCount << " frames at " << rateHz << "Hz, readers " << (spin ? "spinning" : "sleeping on the futex") << "\n\n"
+		 << "Readers  Frames read  Missed  Corrupt  Latency p50 (us)  p99 (us)  max (us)\n";
+
+	bool ok = true;
+	for (size_t readerCount = 1; readerCount <= maxReaders; readerCount = readerCount * 2 > maxReaders && readerCount < maxReaders ? maxReaders : readerCount * 2)
+	{
+		ReaderSummary total;
+		vector<uint64_t> latencies;
+		{
+			optional<EyeFramePublisher> publisher;
+			publisher.emplace(name, 1024);
+
+			// Fork the readers, each with a pipe to send its results back
+			vector<pair<pid_t, int>> readers;
+			for (size_t i = 0; i < readerCount; ++i)
+			{
+				int fds[2];
+				if (pipe(fds) != 0)
+					throw "Unable to create a pipe";
+				const pid_t pid = fork();
+				if (pid < 0)
+					throw "Unable to fork";
+				if (pid == 0)
+				{
+					close(fds[0]);
+					int status = EXIT_SUCCESS;
+					try
+					{
+						readerProcess(name, session, spin, fds[1]);
+					}
+					catch (...)
+					{
+						cerr << "Reader error: " << currentExceptionMessage() << endl;
+						status = EXIT_FAILURE;
+					}
+					_exit(status); // Skip the destructors of the parent's objects, including the publisher
+				}
+				close(fds[1]);
+				readers.emplace_back(pid, fds[0]);
+			}
+
+			// Wait for the readers to map the ring, then publish at the given rate
+			const auto waitStart = chrono::steady_clock::now();
+			while (publisher->readerCount() < readerCount && chrono::steady_clock::now() - waitStart < chrono::seconds{10})
+				this_thread::sleep_for(chrono::milliseconds{1});
+			const auto start = chrono::steady_clock::now();
+			for (uint64_t sequence = 1; sequence <= frameCount; ++sequence)
+			{
+				this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(sequence / rateHz)));
+				publisher->publish(sessionFrame(session, sequence));
+			}
+
+			// Destroying the publisher closes the ring, which tells the readers to finish, and the pipes are read until they do
+			this_thread::sleep_for(chrono::milliseconds{50});
+			publisher.reset();
+			for (const auto& [pid, fd] : readers)
+			{
+				ReaderSummary summary;
+				uint64_t count = 0;
+				if (readAll(fd, &summary, sizeof(summary)) && readAll(fd, &count, sizeof(count)))
+				{
+					const size_t offset = latencies.size();
+					latencies.resize(offset + count);
+					if (!readAll(fd, latencies.data() + offset, count * sizeof(uint64_t)))
+						latencies.resize(offset);
+					total.frames += summary.frames;
+					total.missed += summary.missed;
+					total.corrupt += summary.corrupt;
+				}
+				else
+				{
+					ok = false;
+				}
+				close(fd);
+				int status = 0;
+				waitpid(pid, &status, 0);
+				ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+			}
+		}
+
+		ok = ok && total.corrupt == 0 && total.frames + total.missed == frameCount * readerCount;
+		vector<double> latenciesUs(latencies.size());
+		transform(latencies.begin(), latencies.end(), latenciesUs.begin(), [](const uint64_t ns) { return ns / 1000.0; });
+		cout << setw(7) << readerCount << setw(13) << total.frames << setw(8) << total.missed << setw(9) << total.corrupt << setw(18)
+			 << percentile(latenciesUs, 0.5) << setw(10) << percentile(latenciesUs, 0.99) << setw(10) << percentile(latenciesUs, 1.0) << '\n';
+	}
+
+	cout << '\n' << (ok ? "All readers got intact frames, in order" : "ERROR: some readers failed, or got corrupt frames") << '\n';
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
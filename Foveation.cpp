@@ -0,0 +1,69 @@
+#include "Foveation.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+
+int divideRoundingUp(const int value, const int divisor)
+{
+	return (value + divisor - 1) / divisor;
+}
+
+} // namespace
+
+Fove::Vec2 gazeToViewportPixel(const Fove::Vec2 gaze, const EyeViewport& viewport)
+{
+	// The gaze is relative to the full projection of the eye, which is what the viewport covers
+	Fove::Vec2 ret;
+	ret.x = viewport.offset.x + (gaze.x + 1) / 2 * viewport.size.x;
+	ret.y = viewport.offset.y + (1 - gaze.y) / 2 * viewport.size.y;
+	return ret;
+}
+
+int foveatedFragmentSize(const Fove::Vec2 pixel, const Fove::Vec2 gazePixel, const EyeViewport& viewport, const FoveationSettings& settings, const int maxFragmentSize)
+{
+	// Distances are relative to the viewport width so that the zones don't change with the resolution
+	const float distance = hypot(pixel.x - gazePixel.x, pixel.y - gazePixel.y) / viewport.size.x;
+
+	int size = 4;
+	if (distance < settings.foveaRadius)
+		size = 1;
+	else if (distance < settings.peripheryRadius)
+		size = 2;
+	return min(size, maxFragmentSize);
+}
+
+EyeViewport foveaInset(const Fove::Vec2 gazePixel, const EyeViewport& viewport, const FoveationSettings& settings)
+{
+	// Use a square (in pixels) centered on the gaze, and slide it back inside the viewport when the gaze is near the edge
+	const int halfSize = static_cast<int>(lround(settings.insetRadius * viewport.size.x));
+	const auto Place = [halfSize](const float gaze, const int offset, const int size, int& insetOffset, int& insetSize) {
+		insetSize = min(2 * halfSize, size);
+		insetOffset = clamp(static_cast<int>(lround(gaze)) - halfSize, offset, offset + size - insetSize);
+	};
+
+	EyeViewport ret;
+	Place(gazePixel.x, viewport.offset.x, viewport.size.x, ret.offset.x, ret.size.x);
+	Place(gazePixel.y, viewport.offset.y, viewport.size.y, ret.offset.y, ret.size.y);
+	return ret;
+}
+
+Fove::Vec2i peripheryEyeSize(const Fove::Vec2i eyeSize, const FoveationSettings& settings)
+{
+	return Fove::Vec2i{divideRoundingUp(eyeSize.x, settings.peripheryDivisor), divideRoundingUp(eyeSize.y, settings.peripheryDivisor)};
+}
+
+EyeViewport peripheryViewport(const EyeViewport& viewport, const FoveationSettings& settings)
+{
+	// Round outwards so that the low resolution viewport always covers the full resolution one
+	// The projection is stretched over whichever viewport is used, so the two still line up when upscaling one onto the other
+	const int divisor = settings.peripheryDivisor;
+	EyeViewport ret;
+	ret.offset = Fove::Vec2i{viewport.offset.x / divisor, viewport.offset.y / divisor};
+	ret.size.x = divideRoundingUp(viewport.offset.x + viewport.size.x, divisor) - ret.offset.x;
+	ret.size.y = divideRoundingUp(viewport.offset.y + viewport.size.y, divisor) - ret.offset.y;
+	return ret;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "DynamicResolution.h"
+#include "FoveAPI.h"
+
+// This header implements the API independent part of gaze-driven foveated rendering
+// The eye only sees sharply in a small area around the gaze point (the fovea), so the rest of the image can be rendered with less detail
+// How the detail is reduced depends on the graphics API and hardware, this file only decides where
+//
+// Two techniques are supported:
+// - Variable rate shading: each pixel block is shaded once for 1x1, 2x2 or 4x4 pixels, depending on the distance to the gaze point
+// - Multi-resolution inset: the whole eye is rendered at low resolution, upscaled, then a full resolution inset is rendered around the gaze point
+
+struct FoveationSettings
+{
+	float foveaRadius = 0.15f;     // Radius of the full rate area around the gaze, as a fraction of the eye viewport width
+	float peripheryRadius = 0.35f; // Beyond this radius, the coarsest rate is used. In between, pixels are shaded per 2x2 block
+	float insetRadius = 0.25f;     // Half the size of the full resolution inset of the multi-resolution technique, as a fraction of the viewport width
+	int peripheryDivisor = 2;      // The multi-resolution technique renders the periphery at 1/peripheryDivisor of the resolution
+};
+
+// Converts a gaze position from Headset::getGazeScreenPosition (-1 to 1, y up) to pixels in the same space as the viewport
+// That is, relative to the corner of the eye area, with rows counted from the top
+Fove::Vec2 gazeToViewportPixel(Fove::Vec2 gaze, const EyeViewport& viewport);
+
+// Returns the width and height of the pixel blocks shaded together (1, 2 or 4) at a given pixel
+// maxFragmentSize limits the result to what the hardware supports
+int foveatedFragmentSize(Fove::Vec2 pixel, Fove::Vec2 gazePixel, const EyeViewport& viewport, const FoveationSettings& settings, int maxFragmentSize);
+
+// Returns the area around the gaze rendered at full resolution by the multi-resolution technique, kept within the viewport
+EyeViewport foveaInset(Fove::Vec2 gazePixel, const EyeViewport& viewport, const FoveationSettings& settings);
+
+// Size of one eye of the low resolution target of the multi-resolution technique
+Fove::Vec2i peripheryEyeSize(Fove::Vec2i eyeSize, const FoveationSettings& settings);
+
+// Returns the viewport matching the given (full resolution) viewport in the low resolution target
+EyeViewport peripheryViewport(const EyeViewport& viewport, const FoveationSettings& settings);
@@ -0,0 +1,245 @@
+// FOVE Foveation Benchmark
+// This estimates how much fragment shading work the foveated rendering of the Vulkan example saves
+// The example scene is rasterized on the CPU from a range of view directions and gaze positions, and every fragment shader invocation is counted
+// This way the savings can be measured without a headset, a GPU, or any vendor specific performance counters
+
+#include "Foveation.h"
+#include "Model.h" // import levelModelVerts
+#include "Util.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+// Same values as the Vulkan example
+constexpr float playerHeight = 1.6f;
+constexpr float halfIOD = 0.032f;
+constexpr int shadingRateTexelSize = 16; // Typical size of the pixel tiles of a shading rate image
+constexpr int maxFragmentSize = 4;
+
+// Each vertex of the model has 7 floats: x, y, z, selection id, r, g, b
+constexpr size_t floatsPerVertex = 7;
+
+struct ClipVertex
+{
+	float x, y, z, w;
+};
+
+struct ScreenVertex
+{
+	float x, y;
+};
+
+ClipVertex toClipSpace(const Fove::Matrix44& mvp, const float* const vertex)
+{
+	const Fove::Vec3 pos{vertex[0], vertex[1], vertex[2]};
+	const Fove::Vec3 xyz = transformPoint(mvp, pos, 1);
+	const float w = mvp.mat[3][0] * pos.x + mvp.mat[3][1] * pos.y + mvp.mat[3][2] * pos.z + mvp.mat[3][3];
+	return ClipVertex{xyz.x, xyz.y, xyz.z, w};
+}
+
+// Clips a triangle against the near plane (z >= -w), writing out the resulting polygon (0, 3 or 4 vertices)
+// The other planes don't need clipping since rasterization is limited to the viewport anyway
+int clipNear(const array<ClipVertex, 3>& in, array<ClipVertex, 4>& out)
+{
+	int count = 0;
+	for (size_t i = 0; i < in.size(); ++i)
+	{
+		const ClipVertex& a = in[i];
+		const ClipVertex& b = in[(i + 1) % in.size()];
+		const float da = a.z + a.w;
+		const float db = b.z + b.w;
+		if (da >= 0)
+			out[count++] = a;
+		if ((da >= 0) != (db >= 0))
+		{
+			const float t = da / (da - db);
+			out[count++] = ClipVertex{a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t};
+		}
+	}
+	return count;
+}
+
+// Rasterizes the scene into the given viewport, calling onFragment(triangleIndex, x, y) for each covered pixel within the scissor
+// This follows the Vulkan example: no depth test, back faces culled, clockwise front faces, and rows counted from the top
+template <typename Callback>
+void rasterizeScene(const Fove::Matrix44& mvp, const EyeViewport& viewport, const EyeViewport& scissor, Callback&& onFragment)
+{
+	const auto ToScreen = [&](const ClipVertex& v) {
+		return ScreenVertex{viewport.offset.x + (v.x / v.w + 1) / 2 * viewport.size.x, viewport.offset.y + (1 - v.y / v.w) / 2 * viewport.size.y};
+	};
+	const int minX = scissor.offset.x;
+	const int minY = scissor.offset.y;
+	const int maxX = minX + scissor.size.x;
+	const int maxY = minY + scissor.size.y;
+
+	const size_t triangleCount = size(levelModelVerts) / floatsPerVertex / 3;
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		const float* const vertices = levelModelVerts + triangle * 3 * floatsPerVertex;
+		const array<ClipVertex, 3> clip{toClipSpace(mvp, vertices), toClipSpace(mvp, vertices + floatsPerVertex), toClipSpace(mvp, vertices + 2 * floatsPerVertex)};
+		array<ClipVertex, 4> polygon;
+		const int polygonSize = clipNear(clip, polygon);
+
+		// Clipping may turn the triangle into a quad, which is rasterized as two triangles, like the GPU would
+		for (int fan = 1; fan + 1 < polygonSize; ++fan)
+		{
+			const ScreenVertex a = ToScreen(polygon[0]);
+			const ScreenVertex b = ToScreen(polygon[fan]);
+			const ScreenVertex c = ToScreen(polygon[fan + 1]);
+
+			// Vulkan computes the signed area with this sign convention, and clockwise triangles end up negative
+			const float area = -((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y));
+			if (area >= 0)
+				continue;
+
+			const auto Edge = [](const ScreenVertex& p, const ScreenVertex& q, const float x, const float y) {
+				return (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x);
+			};
+			const int x0 = max(minX, static_cast<int>(floor(min({a.x, b.x, c.x}))));
+			const int y0 = max(minY, static_cast<int>(floor(min({a.y, b.y, c.y}))));
+			const int x1 = min(maxX, static_cast<int>(ceil(max({a.x, b.x, c.x}))));
+			const int y1 = min(maxY, static_cast<int>(ceil(max({a.y, b.y, c.y}))));
+			for (int y = y0; y < y1; ++y)
+			{
+				for (int x = x0; x < x1; ++x)
+				{
+					// Sample at the pixel center, the winding means all edge functions are positive inside
+					const float px = x + 0.5f;
+					const float py = y + 0.5f;
+					if (Edge(a, b, px, py) >= 0 && Edge(b, c, px, py) >= 0 && Edge(c, a, px, py) >= 0)
+						onFragment(triangle, x, y);
+				}
+			}
+		}
+	}
+}
+
+struct FragmentCounts
+{
+	uint64_t full = 0;
+	uint64_t shadingRate = 0;
+	uint64_t insetPeriphery = 0;
+	uint64_t insetFovea = 0;
+	uint64_t insetUpscaledPixels = 0; // Not fragment shading, but the cost of copying the periphery into the eye texture
+};
+
+// Counts the fragment shader invocations of one eye with each technique
+void countEye(const Fove::Matrix44& mvp, const Fove::Vec2i eyeSize, const Fove::Vec2 gaze, const FoveationSettings& settings, FragmentCounts& counts)
+{
+	const EyeViewport viewport = scaledEyeViewport(eyeSize, 1.0f);
+	const Fove::Vec2 gazePixel = gazeToViewportPixel(gaze, viewport);
+
+	// Full resolution
+	rasterizeScene(mvp, viewport, viewport, [&](size_t, int, int) { ++counts.full; });
+
+	// Variable rate shading
+	// The rate is constant over each tile of the shading rate image, and a coarse fragment is shaded once per triangle covering any of its pixels
+	const int tilesX = (eyeSize.x + shadingRateTexelSize - 1) / shadingRateTexelSize;
+	const int tilesY = (eyeSize.y + shadingRateTexelSize - 1) / shadingRateTexelSize;
+	vector<int> tileFragmentSizes(tilesX * tilesY);
+	for (int ty = 0; ty < tilesY; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			const Fove::Vec2 tileCenter{(tx + 0.5f) * shadingRateTexelSize, (ty + 0.5f) * shadingRateTexelSize};
+			tileFragmentSizes[ty * tilesX + tx] = foveatedFragmentSize(tileCenter, gazePixel, viewport, settings, maxFragmentSize);
+		}
+	}
+	vector<size_t> lastTriangle(eyeSize.x * eyeSize.y, SIZE_MAX); // Last triangle shaded for each coarse fragment, indexed by its first pixel
+	rasterizeScene(mvp, viewport, viewport, [&](const size_t triangle, const int x, const int y) {
+		const int fragmentSize = tileFragmentSizes[(y / shadingRateTexelSize) * tilesX + x / shadingRateTexelSize];
+		const int first = (y - y % fragmentSize) * eyeSize.x + (x - x % fragmentSize);
+		if (lastTriangle[first] != triangle)
+		{
+			lastTriangle[first] = triangle;
+			++counts.shadingRate;
+		}
+	});
+
+	// Multi-resolution inset
+	const EyeViewport lowResViewport = peripheryViewport(viewport, settings);
+	const EyeViewport inset = foveaInset(gazePixel, viewport, settings);
+	rasterizeScene(mvp, lowResViewport, lowResViewport, [&](size_t, int, int) { ++counts.insetPeriphery; });
+	rasterizeScene(mvp, viewport, inset, [&](size_t, int, int) { ++counts.insetFovea; });
+	counts.insetUpscaledPixels += static_cast<uint64_t>(viewport.size.x) * viewport.size.y;
+}
+
+void printRow(const string& name, const uint64_t fragments, const uint64_t reference, const int frames)
+{
+	cout << left << setw(26) << name << right << setw(14) << fragments / frames;
+	if (reference != 0)
+		cout << setw(10) << fixed << setprecision(1) << 100.0 * (1.0 - static_cast<double>(fragments) / reference) << '%';
+	cout << '\n';
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	// Same size as the Vulkan example uses before the compositor gives its ideal resolution
+	Fove::Vec2i eyeSize{1024, 1024};
+	if (argc == 3)
+	{
+		eyeSize.x = stoi(argv[1]);
+		eyeSize.y = stoi(argv[2]);
+	}
+	else if (argc != 1)
+	{
+		cerr << "Usage: " << argv[0] << " [eyeWidth eyeHeight]\n";
+		return EXIT_FAILURE;
+	}
+	if (eyeSize.x <= 0 || eyeSize.y <= 0)
+		throw "Invalid eye size";
+
+	// Look around the level from the spawn point, with the gaze moving over the most common areas of the view
+	constexpr int yawSteps = 8;
+	constexpr array<float, 2> pitches{0.0f, 0.35f};
+	const array<Fove::Vec2, 5> gazes{Fove::Vec2{0.0f, 0.0f}, Fove::Vec2{0.4f, 0.2f}, Fove::Vec2{-0.4f, -0.3f}, Fove::Vec2{0.7f, -0.5f}, Fove::Vec2{-0.6f, 0.6f}};
+	const FoveationSettings settings;
+	const Fove::Matrix44 projection = perspectiveMatrixLH(100.0f * 3.14159265f / 180.0f, static_cast<float>(eyeSize.x) / eyeSize.y, 0.01f, 1000.0f);
+
+	FragmentCounts counts;
+	int frames = 0;
+	for (int yawStep = 0; yawStep < yawSteps; ++yawStep)
+	{
+		for (const float pitch : pitches)
+		{
+			const Fove::Quaternion yaw = axisAngleToQuat(0, 1, 0, yawStep * 2 * 3.14159265f / yawSteps);
+			const Fove::Matrix44 modelView = quatToMatrix(conjugate(axisAngleToQuat(1, 0, 0, pitch))) * quatToMatrix(conjugate(yaw)) * translationMatrix(0, -playerHeight, 0);
+			for (const Fove::Vec2 gaze : gazes)
+			{
+				countEye(projection * translationMatrix(+halfIOD, 0, 0) * modelView, eyeSize, gaze, settings, counts);
+				countEye(projection * translationMatrix(-halfIOD, 0, 0) * modelView, eyeSize, gaze, settings, counts);
+				++frames;
+			}
+		}
+	}
+
+	cout << "Fragment shader invocations per frame (both eyes at " << eyeSize.x << 'x' << eyeSize.y << ", " << frames << " frames)\n\n";
+	cout << left << setw(26) << "Technique" << right << setw(14) << "Invocations" << setw(11) << "Saved" << '\n';
+	printRow("Full resolution", counts.full, 0, frames);
+	printRow("Variable rate shading", counts.shadingRate, counts.full, frames);
+	printRow("Multi-resolution inset", counts.insetPeriphery + counts.insetFovea, counts.full, frames);
+	cout << "\nThe multi-resolution inset additionally upscales " << counts.insetUpscaledPixels / frames << " pixels per frame (a blit, no shading)\n";
+	return EXIT_SUCCESS;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,303 @@
+// FOVE Gaze Analytics
+// This computes summary metrics of many recorded eye tracking sessions in parallel:
+// fixations, dwell time per gazable object, pupil radius statistics and blink rate
+//
+// Usage: FoveGazeAnalytics [--threads N] [--algorithm velocity|dispersion] <directory or session.csv>...
+//        FoveGazeAnalytics [--threads N] --generate <directory> [count] [minutes]
+//        FoveGazeAnalytics --help
+// Sessions are recorded with `FoveDataExample --record session.csv`, and directories are searched recursively for .csv files.
+// The --generate mode writes synthetic sessions, to try the tool out without recordings.
+
+#include "EyeData.h"
+#include "GazeClassifier.h"
+#include "Util.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+// Mean, standard deviation and range of a series of values, computed in one pass (Welford's algorithm)
+struct RunningStats
+{
+	size_t count = 0;
+	double mean = 0;
+	double m2 = 0;
+	double minimum = 0;
+	double maximum = 0;
+
+	void add(const double value)
+	{
+		minimum = count == 0 ? value : min(minimum, value);
+		maximum = count == 0 ? value : max(maximum, value);
+		++count;
+		const double delta = value - mean;
+		mean += delta / count;
+		m2 += delta * (value - mean);
+	}
+	double stddev() const { return count > 1 ? sqrt(m2 / (count - 1)) : 0.0; }
+};
+
+struct ObjectDwell
+{
+	int objectId = fove_ObjectIdInvalid;
+	double seconds = 0; // Total duration of the fixations on the object
+};
+
+struct SessionSummary
+{
+	string name;
+	string error; // Set if the session couldn't be read, the other fields are then meaningless
+	size_t samples = 0;
+	uint64_t bytes = 0;
+	double seconds = 0;
+	size_t fixations = 0;
+	double fixationSeconds = 0;
+	size_t saccades = 0;
+	size_t blinks = 0;
+	Fove::Stereo<RunningStats> pupilRadiusMm;
+	vector<ObjectDwell> dwell; // Sorted by decreasing dwell time
+};
+
+void addEvent(const GazeEvent& event, SessionSummary& summary)
+{
+	switch (event.type)
+	{
+	case GazeEventType::Fixation:
+	{
+		++summary.fixations;
+		summary.fixationSeconds += event.durationSeconds();
+		if (event.gazedObjectId == fove_ObjectIdInvalid)
+			break;
+		// Sessions only have a handful of objects, so a linear search beats a map
+		auto dwell = find_if(summary.dwell.begin(), summary.dwell.end(), [&](const ObjectDwell& d) { return d.objectId == event.gazedObjectId; });
+		if (dwell == summary.dwell.end())
+			dwell = summary.dwell.insert(summary.dwell.end(), ObjectDwell{event.gazedObjectId, 0});
+		dwell->seconds += event.durationSeconds();
+		break;
+	}
+	case GazeEventType::Saccade:
+		++summary.saccades;
+		break;
+	case GazeEventType::Blink:
+		++summary.blinks;
+		break;
+	}
+}
+
+SessionSummary analyzeSession(const filesystem::path& path, const GazeClassifier::Settings& settings)
+{
+	SessionSummary summary;
+	summary.name = path.filename().string();
+	try
+	{
+		summary.bytes = filesystem::file_size(path);
+		const vector<EyeFrame> frames = readEyeSession(path.string());
+		if (frames.empty())
+			throw "no eye frame";
+		summary.samples = frames.size();
+		summary.seconds = (frames.back().timestamp - frames.front().timestamp) / 1e6;
+
+		GazeClassifier classifier(settings);
+		for (const EyeFrame& frame : frames)
+		{
+			if (const optional<GazeEvent> event = classifier.addSample(frame))
+				addEvent(*event, summary);
+
+			// The pupil is only measured when the eye is open
+			if (frame.eyeState.l == Fove::EyeState::Opened && frame.pupilRadius.l > 0)
+				summary.pupilRadiusMm.l.add(frame.pupilRadius.l * 1000.0);
+			if (frame.eyeState.r == Fove::EyeState::Opened && frame.pupilRadius.r > 0)
+				summary.pupilRadiusMm.r.add(frame.pupilRadius.r * 1000.0);
+		}
+		if (const optional<GazeEvent> event = classifier.finish())
+			addEvent(*event, summary);
+
+		sort(summary.dwell.begin(), summary.dwell.end(), [](const ObjectDwell& a, const ObjectDwell& b) { return a.seconds > b.seconds; });
+	}
+	catch (...)
+	{
+		summary.error = currentExceptionMessage();
+	}
+	return summary;
+}
+
+// Finds the sessions to analyze, in a stable order
+vector<filesystem::path> findSessions(const vector<string>& inputs)
+{
+	vector<filesystem::path> paths;
+	for (const string& input : inputs)
+	{
+		if (!filesystem::is_directory(input))
+		{
+			paths.push_back(input);
+			continue;
+		}
+		for (const filesystem::directory_entry& entry : filesystem::recursive_directory_iterator(input))
+		{
+			if (entry.is_regular_file() && entry.path().extension() == ".csv")
+				paths.push_back(entry.path());
+		}
+	}
+	sort(paths.begin(), paths.end());
+	return paths;
+}
+
+string formatPupil(const RunningStats& stats)
+{
+	if (stats.count == 0)
+		return "-";
+	ostringstream out;
+	out << fixed << setprecision(2) << stats.mean << " +-" << stats.stddev();
+	return out.str();
+}
+
+string formatDwell(const SessionSummary& summary)
+{
+	ostringstream out;
+	for (size_t i = 0; i < min<size_t>(summary.dwell.size(), 3); ++i)
+		out << (i > 0 ? " " : "") << summary.dwell[i].objectId << ':' << static_cast<int>(100 * summary.dwell[i].seconds / max(summary.fixationSeconds, 1e-9)) << '%';
+	return summary.dwell.empty() ? "-" : out.str();
+}
+
+void printTable(const vector<SessionSummary>& summaries)
+{
+	const size_t nameWidth = accumulate(summaries.begin(), summaries.end(), size_t{7}, [](const size_t w, const SessionSummary& s) { return max(w, s.name.size()); });
+	cout << left << setw(nameWidth) << "Session" << right << setw(8) << "Minutes" << setw(7) << "Fix" << setw(9) << "Fix/min" << setw(8) << "Fix ms"
+		 << setw(10) << "Blink/min" << setw(14) << "Pupil L (mm)" << setw(14) << "Pupil R (mm)" << "  Top dwell (object:share)\n";
+	cout << fixed;
+	for (const SessionSummary& s : summaries)
+	{
+		cout << left << setw(nameWidth) << s.name << right;
+		if (!s.error.empty())
+		{
+			cout << "  error: " << s.error << '\n';
+			continue;
+		}
+		const double minutes = max(s.seconds / 60, 1e-9);
+		cout << setprecision(2) << setw(8) << s.seconds / 60 << setw(7) << s.fixations << setprecision(1) << setw(9) << s.fixations / minutes
+			 << setprecision(0) << setw(8) << 1000 * s.fixationSeconds / max<size_t>(s.fixations, 1) << setprecision(1) << setw(10) << s.blinks / minutes
+			 << setw(14) << formatPupil(s.pupilRadiusMm.l) << setw(14) << formatPupil(s.pupilRadiusMm.r) << "  " << formatDwell(s) << '\n';
+	}
+}
+
+// Both modes of the tool, printed by --help and with the errors on missing arguments
+constexpr const char* usage = "Usage: FoveGazeAnalytics [--threads N] [--algorithm velocity|dispersion] <directory or session.csv>...\n"
+							  "       FoveGazeAnalytics [--threads N] --generate <directory> [count] [minutes]\n"
+							  "Analyzes recorded sessions (.csv files, directories are searched recursively), or with --generate,\n"
+							  "writes <count> synthetic sessions (100 by default) of <minutes> each (1 by default) to try the analysis on";
+
+int generate(const vector<string>& args, WorkStealingPool& pool)
+{
+	if (args.empty())
+		throw "Missing the --generate directory\n"s + usage;
+	const filesystem::path directory = args[0];
+	const size_t count = args.size() > 1 ? stoul(args[1]) : 100;
+	const float minutes = args.size() > 2 ? stof(args[2]) : 1.0f;
+	filesystem::create_directories(directory);
+
+	pool.run(count, [&](const size_t index, size_t) {
+		ostringstream name;
+		name << "session_" << setw(5) << setfill('0') << index + 1 << ".csv";
+		ofstream out(directory / name.str());
+		if (!out)
+			throw "Unable to write " + (directory / name.str()).string();
+		writeEyeFrameCsvHeader(out);
+		for (const EyeFrame& frame : generateEyeSession(static_cast<uint32_t>(index + 1), minutes * 60))
+			writeEyeFrameCsv(out, frame);
+	});
+	cout << "Generated " << count << " sessions of " << minutes << " minutes in " << directory.string() << '\n';
+	return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	size_t threads = 0;
+	GazeClassifier::Settings settings;
+	bool generateMode = false;
+	vector<string> inputs;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc)
+			threads = stoul(argv[++i]);
+		else if (arg == "--algorithm" && i + 1 < argc)
+		{
+			const string algorithm = argv[++i];
+			if (algorithm == "velocity")
+				settings.algorithm = GazeClassifier::Algorithm::VelocityThreshold;
+			else if (algorithm == "dispersion")
+				settings.algorithm = GazeClassifier::Algorithm::DispersionThreshold;
+			else
+				throw "Unknown algorithm " + algorithm + ", expected velocity or dispersion";
+		}
+		else if (arg == "--generate")
+			generateMode = true;
+		else if (arg == "--help" || arg == "-h")
+		{
+			cout << usage << endl;
+			return EXIT_SUCCESS;
+		}
+		else
+			inputs.push_back(arg);
+	}
+
+	WorkStealingPool pool(threads);
+	if (generateMode)
+		return generate(inputs, pool);
+
+	const vector<filesystem::path> paths = findSessions(inputs);
+	if (paths.empty())
+		throw "No session found\n"s + usage;
+
+	// Each task writes its own slot, so the workers share nothing but the task queues
+	vector<SessionSummary> summaries(paths.size());
+	const auto start = chrono::steady_clock::now();
+	pool.run(paths.size(), [&](const size_t index, size_t) { summaries[index] = analyzeSession(paths[index], settings); });
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printTable(summaries);
+
+	size_t samples = 0;
+	size_t errors = 0;
+	uint64_t bytes = 0;
+	double recordedSeconds = 0;
+	for (const SessionSummary& s : summaries)
+	{
+		errors += s.error.empty() ? 0 : 1;
+		samples += s.samples;
+		bytes += s.bytes;
+		recordedSeconds += s.seconds;
+	}
+	size_t steals = 0;
+	for (const WorkStealingPool::WorkerStats& worker : pool.lastRunStats())
+		steals += worker.steals;
+
+	cout << setprecision(2) << "\nSessions:   " << summaries.size() << " (" << errors << " unreadable), " << recordedSeconds / 3600 << " hours, " << samples << " samples\n"
+		 << "Time:       " << seconds << "s on " << pool.threadCount() << " threads, " << steals << " steals\n"
+		 << "Throughput: " << summaries.size() / seconds << " sessions/s, " << samples / seconds / 1e6 << "M samples/s, " << bytes / seconds / 1e6 << "MB/s\n";
+	return EXIT_SUCCESS;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
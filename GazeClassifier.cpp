@@ -0,0 +1,282 @@
+#include "GazeClassifier.h"
+#include "Util.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+
+float dispersion(const array<float, 4>& bounds)
+{
+	return (bounds[1] - bounds[0]) + (bounds[3] - bounds[2]);
+}
+
+} // namespace
+
+GazeClassifier::Sample GazeClassifier::toSample(const EyeFrame& frame)
+{
+	Sample sample;
+	sample.timestamp = frame.timestamp;
+	sample.direction = normalize(frame.combinedGaze);
+	sample.angles = directionToYawPitch(sample.direction);
+	sample.objectId = frame.gazedObjectId;
+	return sample;
+}
+
+void GazeClassifier::Accumulator::start(const GazeEventType type, const Sample& sample, const Fove::Vec3 fromDirection)
+{
+	active = true;
+	event = GazeEvent{};
+	event.type = type;
+	event.startTimestamp = sample.timestamp;
+	from = fromDirection;
+	directionSum = Fove::Vec3{0, 0, 0};
+	objectIds.fill(fove_ObjectIdInvalid);
+	objectCounts.fill(0);
+	add(sample);
+}
+
+void GazeClassifier::Accumulator::add(const Sample& sample)
+{
+	event.endTimestamp = sample.timestamp;
+	++event.sampleCount;
+	event.direction = sample.direction;
+	directionSum = directionSum + sample.direction;
+
+	// Count the objects in a few slots, replacing the least seen one when a new object comes up (space-saving counting)
+	if (sample.objectId == fove_ObjectIdInvalid)
+		return;
+	const auto found = find(objectIds.begin(), objectIds.end(), sample.objectId);
+	if (found != objectIds.end())
+	{
+		++objectCounts[found - objectIds.begin()];
+		return;
+	}
+	const size_t slot = min_element(objectCounts.begin(), objectCounts.end()) - objectCounts.begin();
+	objectIds[slot] = sample.objectId;
+	++objectCounts[slot];
+}
+
+GazeEvent GazeClassifier::Accumulator::finish()
+{
+	active = false;
+	GazeEvent ret = event;
+	if (ret.type == GazeEventType::Fixation)
+	{
+		ret.direction = normalize(directionSum);
+		const size_t best = max_element(objectCounts.begin(), objectCounts.end()) - objectCounts.begin();
+		ret.gazedObjectId = objectCounts[best] > 0 ? objectIds[best] : fove_ObjectIdInvalid;
+	}
+	else if (ret.type == GazeEventType::Saccade)
+	{
+		ret.amplitudeDegrees = angleBetweenDirections(from, ret.direction);
+	}
+	return ret;
+}
+
+void GazeClassifier::DispersionWindow::clear()
+{
+	m_begin += m_size;
+	m_size = 0;
+	for (MonotonicQueue& queue : m_queues)
+		queue.begin = queue.end = 0;
+}
+
+void GazeClassifier::DispersionWindow::push(const Sample& sample)
+{
+	const uint64_t index = m_begin + m_size;
+	m_samples[index % maxWindowSamples] = sample;
+	++m_size;
+
+	// Each queue keeps the indices of the samples that can still become its extremum, in order
+	// Samples that are beaten by the new one never can, since the new one leaves the window after them
+	for (int q = 0; q < 4; ++q)
+	{
+		MonotonicQueue& queue = m_queues[q];
+		const int axis = q / 2;
+		const bool isMax = q % 2 == 1;
+		const float v = value(index, axis);
+		while (queue.end > queue.begin)
+		{
+			const float last = value(queue.indices[(queue.end - 1) % maxWindowSamples], axis);
+			if (isMax ? last > v : last < v)
+				break;
+			--queue.end;
+		}
+		queue.indices[queue.end++ % maxWindowSamples] = index;
+	}
+}
+
+void GazeClassifier::DispersionWindow::pop()
+{
+	for (MonotonicQueue& queue : m_queues)
+	{
+		if (queue.end > queue.begin && queue.indices[queue.begin % maxWindowSamples] == m_begin)
+			++queue.begin;
+	}
+	++m_begin;
+	--m_size;
+}
+
+array<float, 4> GazeClassifier::DispersionWindow::bounds() const
+{
+	array<float, 4> ret{};
+	for (int q = 0; q < 4; ++q)
+		ret[q] = value(m_queues[q].indices[m_queues[q].begin % maxWindowSamples], q / 2);
+	return ret;
+}
+
+optional<GazeEvent> GazeClassifier::addSample(const EyeFrame& frame)
+{
+	if (!frame.gazeValid || frame.eyeState.l == Fove::EyeState::Closed || frame.eyeState.r == Fove::EyeState::Closed)
+		return addInvalidSample(frame);
+
+	// The first valid sample after a blink completes it
+	optional<GazeEvent> ret;
+	if (m_current.active && m_current.event.type == GazeEventType::Blink)
+		ret = m_current.finish();
+
+	const Sample sample = toSample(frame);
+	optional<GazeEvent> event = m_settings.algorithm == Algorithm::VelocityThreshold ? addVelocitySample(sample) : addDispersionSample(sample);
+	m_last = sample;
+	m_hasLast = true;
+	return ret ? ret : event; // Both can't happen together, since the stream starts over after a blink
+}
+
+optional<GazeEvent> GazeClassifier::addVelocitySample(const Sample& sample)
+{
+	// The velocity is measured from the newest sample at least a window old, or the oldest one kept if none is
+	const Sample* reference = nullptr;
+	const uint64_t windowUs = static_cast<uint64_t>(m_settings.velocityWindowSeconds * 1e6f);
+	for (size_t i = 1; i <= m_historySize; ++i)
+	{
+		reference = &m_history[(m_historyNext + velocityHistorySize - i) % velocityHistorySize];
+		if (reference->timestamp + windowUs <= sample.timestamp)
+			break;
+	}
+	m_history[m_historyNext] = sample;
+	m_historyNext = (m_historyNext + 1) % velocityHistorySize;
+	m_historySize = min(m_historySize + 1, velocityHistorySize);
+
+	if (!reference || sample.timestamp <= reference->timestamp)
+	{
+		// Without a velocity, the sample is assumed to be part of a fixation
+		if (!m_current.active)
+			m_current.start(GazeEventType::Fixation, sample, sample.direction);
+		else
+			m_current.add(sample);
+		return {};
+	}
+
+	const float velocity = angleBetweenDirections(reference->direction, sample.direction) / ((sample.timestamp - reference->timestamp) / 1e6f);
+	const GazeEventType type = velocity > m_settings.velocityThreshold ? GazeEventType::Saccade : GazeEventType::Fixation;
+	if (m_current.active && m_current.event.type == type)
+	{
+		m_current.add(sample);
+		return {};
+	}
+
+	optional<GazeEvent> ret;
+	if (m_current.active)
+		ret = m_current.finish();
+	m_current.start(type, sample, m_last.direction);
+	return ret;
+}
+
+optional<GazeEvent> GazeClassifier::addDispersionSample(const Sample& sample)
+{
+	// Grow the current fixation for as long as the dispersion allows
+	if (m_current.active)
+	{
+		array<float, 4> bounds = m_fixationBounds;
+		bounds[0] = min(bounds[0], sample.angles.x);
+		bounds[1] = max(bounds[1], sample.angles.x);
+		bounds[2] = min(bounds[2], sample.angles.y);
+		bounds[3] = max(bounds[3], sample.angles.y);
+		if (dispersion(bounds) <= m_settings.dispersionThreshold)
+		{
+			m_fixationBounds = bounds;
+			m_current.add(sample);
+			return {};
+		}
+
+		// This sample is the first one that doesn't fit, it starts the search for the next fixation
+		const GazeEvent fixation = m_current.finish();
+		m_saccadeFrom = m_last.direction;
+		m_window.clear();
+		m_window.push(sample);
+		return fixation;
+	}
+
+	// Samples leave the window when it gets too dispersed, or too long, and those are saccade samples
+	const auto PopToSaccade = [this]() {
+		const Sample& front = m_window.front();
+		if (!m_saccade.active)
+			m_saccade.start(GazeEventType::Saccade, front, m_saccadeFrom.value_or(front.direction));
+		else
+			m_saccade.add(front);
+		m_window.pop();
+	};
+	if (m_window.size() == maxWindowSamples)
+		PopToSaccade();
+	m_window.push(sample);
+	while (m_window.size() > 1 && dispersion(m_window.bounds()) > m_settings.dispersionThreshold)
+		PopToSaccade();
+
+	// A fixation starts once the window spans the minimum duration without getting too dispersed
+	const uint64_t minFixationUs = static_cast<uint64_t>(m_settings.minFixationSeconds * 1e6f);
+	if (m_window.back().timestamp - m_window.front().timestamp < minFixationUs)
+		return {};
+
+	optional<GazeEvent> ret;
+	if (m_saccade.active)
+		ret = m_saccade.finish();
+	m_fixationBounds = m_window.bounds();
+	m_current.start(GazeEventType::Fixation, m_window.front(), m_window.front().direction);
+	for (size_t i = 1; i < m_window.size(); ++i)
+		m_current.add(m_window.at(i));
+	m_window.clear();
+	return ret;
+}
+
+optional<GazeEvent> GazeClassifier::addInvalidSample(const EyeFrame& frame)
+{
+	Sample sample;
+	sample.timestamp = frame.timestamp;
+	if (m_current.active && m_current.event.type == GazeEventType::Blink)
+	{
+		m_current.add(sample);
+		return {};
+	}
+
+	// Close whatever was in progress, the gaze can't be followed through the blink
+	optional<GazeEvent> ret = finish();
+	m_current.start(GazeEventType::Blink, sample, sample.direction);
+	return ret;
+}
+
+optional<GazeEvent> GazeClassifier::finish()
+{
+	// Samples still in the I-DT window never formed a fixation
+	while (!m_window.empty())
+	{
+		const Sample& front = m_window.front();
+		if (!m_saccade.active)
+			m_saccade.start(GazeEventType::Saccade, front, m_saccadeFrom.value_or(front.direction));
+		else
+			m_saccade.add(front);
+		m_window.pop();
+	}
+
+	optional<GazeEvent> ret;
+	if (m_current.active)
+		ret = m_current.finish();
+	else if (m_saccade.active)
+		ret = m_saccade.finish();
+	m_saccade.active = false;
+	m_saccadeFrom.reset();
+	m_historySize = 0;
+	m_hasLast = false;
+	return ret;
+}
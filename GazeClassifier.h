@@ -0,0 +1,147 @@
+#pragma once
+#include "EyeData.h"
+#include "FoveAPI.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// This header implements a streaming classifier of eye movements into fixations, saccades and blinks
+// Samples are fed one at a time, as they come from the eye tracker, and each event is emitted as soon as it's over
+// Work per sample is O(1) amortized and memory is bounded (no allocation), so one thread can classify many streams at once
+//
+// Two classic algorithms are available:
+// - I-VT (velocity threshold): samples moving faster than a threshold are saccades, the others fixations
+// - I-DT (dispersion threshold): fixations are the windows of at least a minimum duration whose dispersion stays under a threshold, the rest are saccades
+
+enum class GazeEventType
+{
+	Fixation,
+	Saccade,
+	Blink, // Also covers tracking losses: any run of samples without a valid gaze
+};
+
+struct GazeEvent
+{
+	GazeEventType type = GazeEventType::Fixation;
+	uint64_t startTimestamp = 0; // Timestamp of the first sample of the event
+	uint64_t endTimestamp = 0;   // Timestamp of the last sample of the event
+	uint32_t sampleCount = 0;
+	Fove::Vec3 direction{0, 0, 1}; // Fixations: average gaze direction. Saccades: landing direction
+	float amplitudeDegrees = 0;    // Saccades: angle between the gaze before and after the saccade
+	int gazedObjectId = fove_ObjectIdInvalid; // Fixations: object gazed at for the most samples (of the last few objects seen)
+
+	float durationSeconds() const { return (endTimestamp - startTimestamp) / 1e6f; }
+};
+
+class GazeClassifier
+{
+public:
+	enum class Algorithm
+	{
+		VelocityThreshold,   // I-VT
+		DispersionThreshold, // I-DT
+	};
+
+	struct Settings
+	{
+		Algorithm algorithm = Algorithm::VelocityThreshold;
+		float velocityThreshold = 30.0f;   // I-VT, in degrees per second
+		float velocityWindowSeconds = 0.02f; // I-VT, the velocity is measured over this long, so tracking noise doesn't pass for saccades
+		float dispersionThreshold = 1.0f;  // I-DT, (max - min) of yaw plus (max - min) of pitch, in degrees
+		float minFixationSeconds = 0.1f;   // I-DT, shortest fixation
+	};
+
+	// Maximum number of samples in the I-DT window, which bounds the memory use
+	// Windows longer than this (with a very high sample rate or a long minFixationSeconds) have their oldest samples counted as saccades
+	static constexpr size_t maxWindowSamples = 128;
+
+	GazeClassifier() = default;
+	explicit GazeClassifier(const Settings& settings) : m_settings(settings) {}
+
+	const Settings& settings() const { return m_settings; }
+
+	// Feeds the next sample, and returns the event it completes, if any
+	std::optional<GazeEvent> addSample(const EyeFrame& frame);
+
+	// Ends the stream, and returns the last event if one was in progress
+	// The classifier can be reused for a new stream afterwards
+	std::optional<GazeEvent> finish();
+
+private:
+	// The parts of a frame the classifier uses
+	struct Sample
+	{
+		uint64_t timestamp = 0;
+		Fove::Vec3 direction{0, 0, 1};
+		Fove::Vec2 angles{}; // Yaw & pitch, in degrees
+		int objectId = fove_ObjectIdInvalid;
+	};
+	static Sample toSample(const EyeFrame& frame);
+
+	// Event being accumulated
+	struct Accumulator
+	{
+		bool active = false;
+		GazeEvent event;
+		Fove::Vec3 from{0, 0, 1}; // Saccades: gaze before the saccade
+		Fove::Vec3 directionSum{0, 0, 0};
+		std::array<int, 4> objectIds{};
+		std::array<uint32_t, 4> objectCounts{};
+
+		void start(GazeEventType type, const Sample& sample, Fove::Vec3 fromDirection);
+		void add(const Sample& sample);
+		GazeEvent finish();
+	};
+
+	// Fixed capacity sliding window with O(1) amortized min/max of the yaw & pitch, used by I-DT
+	// Each extremum is tracked with a monotonic queue of sample indices
+	class DispersionWindow
+	{
+	public:
+		void clear();
+		bool empty() const { return m_size == 0; }
+		size_t size() const { return m_size; }
+		void push(const Sample& sample);
+		void pop();
+		const Sample& front() const { return at(0); }
+		const Sample& back() const { return at(m_size - 1); }
+		const Sample& at(const size_t i) const { return m_samples[(m_begin + i) % maxWindowSamples]; }
+		std::array<float, 4> bounds() const; // min yaw, max yaw, min pitch, max pitch
+
+	private:
+		struct MonotonicQueue
+		{
+			std::array<uint64_t, maxWindowSamples> indices{};
+			size_t begin = 0;
+			size_t end = 0;
+		};
+		float value(const uint64_t index, const int axis) const { return axis == 0 ? m_samples[index % maxWindowSamples].angles.x : m_samples[index % maxWindowSamples].angles.y; }
+
+		std::array<Sample, maxWindowSamples> m_samples{};
+		uint64_t m_begin = 0; // Index of the first sample, ever increasing
+		size_t m_size = 0;
+		std::array<MonotonicQueue, 4> m_queues{}; // min yaw, max yaw, min pitch, max pitch
+	};
+
+	std::optional<GazeEvent> addVelocitySample(const Sample& sample);
+	std::optional<GazeEvent> addDispersionSample(const Sample& sample);
+	std::optional<GazeEvent> addInvalidSample(const EyeFrame& frame);
+
+	Settings m_settings;
+	Accumulator m_current; // Event in progress: any event for I-VT, fixations and blinks for I-DT
+	Accumulator m_saccade; // I-DT: samples that left the window without forming a fixation
+	bool m_hasLast = false;
+	Sample m_last; // Last valid sample
+
+	// I-VT state: the last few valid samples, to measure the velocity over a window
+	static constexpr size_t velocityHistorySize = 8;
+	std::array<Sample, velocityHistorySize> m_history{};
+	size_t m_historySize = 0;
+	size_t m_historyNext = 0;
+
+	// I-DT state
+	DispersionWindow m_window;
+	std::array<float, 4> m_fixationBounds{}; // min yaw, max yaw, min pitch, max pitch of the current fixation
+	std::optional<Fove::Vec3> m_saccadeFrom;  // Last gaze of the previous fixation, if there's one since the stream started
+};
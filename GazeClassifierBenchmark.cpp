@@ -0,0 +1,145 @@
+// FOVE Gaze Classifier Benchmark
+// This classifies many eye tracking streams at once on a single thread, as a server collecting data from many headsets would,
+// and measures how many 120Hz streams each algorithm keeps up with, along with the events it finds
+//
+// Usage: FoveGazeClassifierBenchmark [--streams N] [session.csv...]
+// Sessions are recorded with `FoveDataExample --record session.csv`. Without sessions, synthetic sessions are used instead.
+// Streams replay the sessions in turn, and their samples are interleaved like they would arrive from the network.
+
+#include "EyeData.h"
+#include "GazeClassifier.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+constexpr double streamRateHz = 120.0;
+
+struct Stats
+{
+	size_t samples = 0;
+	double seconds = 0;
+	double recordedSeconds = 0; // Sum of the durations of the streams
+	size_t fixations = 0;
+	size_t saccades = 0;
+	size_t blinks = 0;
+	double fixationSeconds = 0;
+	double saccadeAmplitude = 0;
+
+	void addEvent(const GazeEvent& event)
+	{
+		switch (event.type)
+		{
+		case GazeEventType::Fixation:
+			++fixations;
+			fixationSeconds += event.durationSeconds();
+			break;
+		case GazeEventType::Saccade:
+			++saccades;
+			saccadeAmplitude += event.amplitudeDegrees;
+			break;
+		case GazeEventType::Blink:
+			++blinks;
+			break;
+		}
+	}
+};
+
+Stats run(const vector<vector<EyeFrame>>& sessions, const size_t streamCount, const GazeClassifier::Settings& settings)
+{
+	vector<GazeClassifier> classifiers(streamCount, GazeClassifier(settings));
+	size_t length = 0;
+	for (const vector<EyeFrame>& session : sessions)
+		length = max(length, session.size());
+
+	Stats stats;
+	const auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < length; ++i)
+	{
+		for (size_t s = 0; s < streamCount; ++s)
+		{
+			const vector<EyeFrame>& session = sessions[s % sessions.size()];
+			if (i >= session.size())
+				continue;
+			if (const optional<GazeEvent> event = classifiers[s].addSample(session[i]))
+				stats.addEvent(*event);
+			++stats.samples;
+		}
+	}
+	for (GazeClassifier& classifier : classifiers)
+	{
+		if (const optional<GazeEvent> event = classifier.finish())
+			stats.addEvent(*event);
+	}
+	stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	for (size_t s = 0; s < streamCount; ++s)
+	{
+		const vector<EyeFrame>& session = sessions[s % sessions.size()];
+		if (!session.empty())
+			stats.recordedSeconds += (session.back().timestamp - session.front().timestamp) / 1e6;
+	}
+	return stats;
+}
+
+void print(const string& name, const Stats& stats)
+{
+	const double minutes = max(stats.recordedSeconds / 60, 1e-9);
+	const double samplesPerSecond = stats.samples / max(stats.seconds, 1e-9);
+	cout << name << '\n'
+		 << "  Throughput:        " << samplesPerSecond / 1e6 << "M samples/s (" << stats.seconds * 1e9 / max<size_t>(stats.samples, 1) << "ns per sample)\n"
+		 << "  120Hz streams:     " << static_cast<size_t>(samplesPerSecond / streamRateHz) << " on one thread\n"
+		 << "  Fixations:         " << stats.fixations / minutes << " per minute, " << 1000 * stats.fixationSeconds / max<size_t>(stats.fixations, 1) << "ms on average\n"
+		 << "  Saccades:          " << stats.saccades / minutes << " per minute, " << stats.saccadeAmplitude / max<size_t>(stats.saccades, 1) << " degrees on average\n"
+		 << "  Blinks:            " << stats.blinks / minutes << " per minute\n";
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	size_t streamCount = 1000;
+	vector<vector<EyeFrame>> sessions;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--streams" && i + 1 < argc)
+			streamCount = max(stoul(argv[++i]), 1UL);
+		else
+			sessions.push_back(readEyeSession(arg));
+	}
+	if (sessions.empty())
+	{
+		cout << "No session given, using synthetic sessions\n";
+		for (uint32_t seed = 1; seed <= 20; ++seed)
+			sessions.push_back(generateEyeSession(seed, 60.0f));
+	}
+
+	cout << fixed << setprecision(2) << "Streams:             " << streamCount << " (" << sizeof(GazeClassifier) << " bytes of state each)\n";
+
+	GazeClassifier::Settings velocity;
+	velocity.algorithm = GazeClassifier::Algorithm::VelocityThreshold;
+	print("I-VT (" + to_string(static_cast<int>(velocity.velocityThreshold)) + " deg/s)", run(sessions, streamCount, velocity));
+
+	GazeClassifier::Settings dispersion;
+	dispersion.algorithm = GazeClassifier::Algorithm::DispersionThreshold;
+	print("I-DT (" + to_string(dispersion.dispersionThreshold).substr(0, 4) + " deg, " + to_string(static_cast<int>(dispersion.minFixationSeconds * 1000)) + "ms)", run(sessions, streamCount, dispersion));
+	return EXIT_SUCCESS;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,262 @@
+#include "GazeHeatmap.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace std;
+
+namespace
+{
+
+uint64_t toNanoseconds(const float seconds)
+{
+	return static_cast<uint64_t>(llround(max(seconds, 0.0f) * 1e9));
+}
+
+// Black -> red -> yellow -> white
+array<uint8_t, 3> heatColor(const float value)
+{
+	const float v = clamp(value, 0.0f, 1.0f) * 3;
+	const auto Channel = [](const float x) { return static_cast<uint8_t>(clamp(x, 0.0f, 1.0f) * 255 + 0.5f); };
+	return {Channel(v), Channel(v - 1), Channel(v - 2)};
+}
+
+} // namespace
+
+GazeHeatmap::GazeHeatmap(const GazeHeatmapSettings& settings)
+	: m_settings(settings)
+{
+	m_settings.width = max(m_settings.width, 1U);
+	m_settings.height = max(m_settings.height, 1U);
+	m_settings.splatSigma = clamp(m_settings.splatSigma, 0.1f, 10.0f); // Larger splats don't fit in GazeHeatmap::splat()
+	m_settings.maxObjectId = max(m_settings.maxObjectId, 0);
+
+	m_tilesX = (m_settings.width + tileSize - 1) / tileSize;
+	m_tilesY = (m_settings.height + tileSize - 1) / tileSize;
+	m_kernelRadius = static_cast<int>(ceil(3 * m_settings.splatSigma));
+	m_cells.reset(new atomic<uint64_t>[static_cast<size_t>(m_tilesX) * m_tilesY * tileSize * tileSize]()); // Zero initialized
+	m_objects.reset(new ObjectCounters[m_settings.maxObjectId + 1]);
+}
+
+atomic<uint64_t>& GazeHeatmap::cell(const uint32_t x, const uint32_t y) const
+{
+	const uint32_t tile = (y / tileSize) * m_tilesX + x / tileSize;
+	return m_cells[static_cast<size_t>(tile) * tileSize * tileSize + (y % tileSize) * tileSize + x % tileSize];
+}
+
+float GazeHeatmap::kernel(const float dx, const float dy) const
+{
+	const float radius = static_cast<float>(m_kernelRadius);
+	if (fabs(dx) > radius || fabs(dy) > radius)
+		return 0;
+	const float s = 2 * m_settings.splatSigma * m_settings.splatSigma;
+	return exp(-dx * dx / s) * exp(-dy * dy / s);
+}
+
+void GazeHeatmap::splat(const Fove::Vec2 screenPosition, const float seconds)
+{
+	const uint64_t totalNs = toNanoseconds(seconds);
+	if (totalNs == 0)
+		return;
+	m_totalNs.fetch_add(totalNs, memory_order_relaxed);
+
+	// Center of the splat in cells, +y down
+	const float cx = (screenPosition.x + 1) / 2 * m_settings.width - 0.5f;
+	const float cy = (1 - screenPosition.y) / 2 * m_settings.height - 0.5f;
+	const int x0 = static_cast<int>(floor(cx)) - m_kernelRadius;
+	const int y0 = static_cast<int>(floor(cy)) - m_kernelRadius;
+	constexpr int maxDiameter = 64;
+	const int diameter = min(2 * m_kernelRadius + 2, maxDiameter);
+
+	// The kernel is separable, so it's computed once per row and column, and normalized so the splat adds up to the sample duration
+	array<float, maxDiameter> wx{};
+	array<float, maxDiameter> wy{};
+	float sumX = 0;
+	float sumY = 0;
+	for (int i = 0; i < diameter; ++i)
+	{
+		wx[i] = kernel(x0 + i - cx, 0);
+		wy[i] = kernel(0, y0 + i - cy);
+		sumX += wx[i];
+		sumY += wy[i];
+	}
+	const float scale = totalNs / (sumX * sumY);
+
+	// Cells off screen are dropped
+	for (int j = 0; j < diameter; ++j)
+	{
+		const int y = y0 + j;
+		if (y < 0 || y >= static_cast<int>(m_settings.height) || wy[j] == 0)
+			continue;
+		for (int i = 0; i < diameter; ++i)
+		{
+			const int x = x0 + i;
+			if (x < 0 || x >= static_cast<int>(m_settings.width) || wx[i] == 0)
+				continue;
+			const uint64_t ns = static_cast<uint64_t>(wx[i] * wy[j] * scale + 0.5f);
+			if (ns > 0)
+				cell(x, y).fetch_add(ns, memory_order_relaxed);
+		}
+	}
+}
+
+void GazeHeatmap::addDwell(const int objectId, const float seconds)
+{
+	if (objectId < 0 || objectId > m_settings.maxObjectId)
+		return;
+	m_objects[objectId].dwellNs.fetch_add(toNanoseconds(seconds), memory_order_relaxed);
+}
+
+void GazeHeatmap::addBout(const int objectId, const float seconds)
+{
+	if (objectId < 0 || objectId > m_settings.maxObjectId)
+		return;
+	size_t bin = 0;
+	for (float limit = GazeHeatmapSnapshot::firstBoutBinSeconds; seconds >= limit && bin + 1 < GazeHeatmapSnapshot::boutBins; limit *= 2)
+		++bin;
+	m_objects[objectId].bouts[bin].fetch_add(1, memory_order_relaxed);
+}
+
+GazeHeatmapSnapshot GazeHeatmap::snapshot() const
+{
+	GazeHeatmapSnapshot ret;
+	ret.width = m_settings.width;
+	ret.height = m_settings.height;
+	ret.totalSeconds = m_totalNs.load(memory_order_relaxed) / 1e9;
+
+	// Go through the cells in storage order, which is the fastest, and write them to their row major position
+	ret.dwellSeconds.resize(static_cast<size_t>(ret.width) * ret.height);
+	for (uint32_t tileY = 0; tileY < m_tilesY; ++tileY)
+	{
+		for (uint32_t tileX = 0; tileX < m_tilesX; ++tileX)
+		{
+			const uint32_t yEnd = min((tileY + 1) * tileSize, ret.height);
+			const uint32_t xEnd = min((tileX + 1) * tileSize, ret.width);
+			for (uint32_t y = tileY * tileSize; y < yEnd; ++y)
+			{
+				for (uint32_t x = tileX * tileSize; x < xEnd; ++x)
+					ret.dwellSeconds[static_cast<size_t>(y) * ret.width + x] = static_cast<float>(cell(x, y).load(memory_order_relaxed) / 1e9);
+			}
+		}
+	}
+
+	for (int id = 0; id <= m_settings.maxObjectId; ++id)
+	{
+		const ObjectCounters& counters = m_objects[id];
+		GazeHeatmapSnapshot::Object object;
+		object.id = id;
+		object.dwellSeconds = counters.dwellNs.load(memory_order_relaxed) / 1e9;
+		bool any = object.dwellSeconds > 0;
+		for (size_t bin = 0; bin < GazeHeatmapSnapshot::boutBins; ++bin)
+		{
+			object.bouts[bin] = counters.bouts[bin].load(memory_order_relaxed);
+			any = any || object.bouts[bin] > 0;
+		}
+		if (any)
+			ret.objects.push_back(object);
+	}
+	return ret;
+}
+
+void GazeHeatmap::Producer::addFrame(const EyeFrame& frame)
+{
+	if (m_hasLast)
+	{
+		// The previous frame lasted until this one, unless frames were lost in between
+		const float gap = frame.timestamp > m_last.timestamp ? (frame.timestamp - m_last.timestamp) / 1e6f : 0.0f;
+		const float seconds = min(gap, m_heatmap->m_settings.maxSampleGapSeconds);
+		const bool lost = gap > m_heatmap->m_settings.maxSampleGapSeconds;
+
+		const int objectId = m_last.gazeValid ? m_last.gazedObjectId : fove_ObjectIdInvalid;
+		if (objectId != m_boutObjectId)
+			endBout();
+		if (m_last.gazeValid && seconds > 0)
+		{
+			const GazeHeatmapSettings& settings = m_heatmap->m_settings;
+			const float dx = (m_last.screenPosition.x - m_pendingPosition.x) / 2 * settings.width;
+			const float dy = (m_last.screenPosition.y - m_pendingPosition.y) / 2 * settings.height;
+			if (dx * dx + dy * dy > 0.25f || m_pendingSeconds >= maxPendingSeconds)
+				flushSplat();
+			const float weight = seconds / (m_pendingSeconds + seconds);
+			m_pendingPosition.x += (m_last.screenPosition.x - m_pendingPosition.x) * weight;
+			m_pendingPosition.y += (m_last.screenPosition.y - m_pendingPosition.y) * weight;
+			m_pendingSeconds += seconds;
+			m_heatmap->addDwell(objectId, seconds);
+		}
+		m_boutObjectId = objectId;
+		m_boutSeconds += seconds;
+		if (lost)
+			endBout();
+	}
+	m_last = frame;
+	m_hasLast = true;
+}
+
+void GazeHeatmap::Producer::finish()
+{
+	// The duration of the last frame is unknown, so it only ends the bout
+	flushSplat();
+	endBout();
+	m_hasLast = false;
+}
+
+void GazeHeatmap::Producer::flushSplat()
+{
+	if (m_pendingSeconds > 0)
+		m_heatmap->splat(m_pendingPosition, m_pendingSeconds);
+	m_pendingSeconds = 0;
+}
+
+void GazeHeatmap::Producer::endBout()
+{
+	if (m_boutObjectId != fove_ObjectIdInvalid && m_boutSeconds > 0)
+		m_heatmap->addBout(m_boutObjectId, m_boutSeconds);
+	m_boutObjectId = fove_ObjectIdInvalid;
+	m_boutSeconds = 0;
+}
+
+void writeHeatmapPpm(const GazeHeatmapSnapshot& snapshot, const string& path)
+{
+	ofstream out(path, ios::binary);
+	if (!out)
+		throw "Unable to write " + path;
+
+	// A square root scale keeps the areas looked at briefly visible next to the main fixation points
+	const float maximum = snapshot.dwellSeconds.empty() ? 0.0f : *max_element(snapshot.dwellSeconds.begin(), snapshot.dwellSeconds.end());
+	out << "P6\n" << snapshot.width << ' ' << snapshot.height << "\n255\n";
+	vector<uint8_t> row(static_cast<size_t>(snapshot.width) * 3);
+	for (uint32_t y = 0; y < snapshot.height; ++y)
+	{
+		for (uint32_t x = 0; x < snapshot.width; ++x)
+		{
+			const float value = snapshot.dwellSeconds[static_cast<size_t>(y) * snapshot.width + x];
+			const array<uint8_t, 3> color = heatColor(maximum > 0 ? sqrt(value / maximum) : 0.0f);
+			copy(color.begin(), color.end(), row.begin() + x * 3);
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), static_cast<streamsize>(row.size()));
+	}
+	if (!out)
+		throw "Unable to write " + path;
+}
+
+void writeObjectDwellCsv(const GazeHeatmapSnapshot& snapshot, const string& path)
+{
+	ofstream out(path);
+	if (!out)
+		throw "Unable to write " + path;
+
+	out << "object_id,dwell_s,dwell_share";
+	float limit = GazeHeatmapSnapshot::firstBoutBinSeconds;
+	for (size_t bin = 0; bin < GazeHeatmapSnapshot::boutBins; ++bin, limit *= 2)
+		out << (bin + 1 < GazeHeatmapSnapshot::boutBins ? ",bouts_lt_" + to_string(static_cast<int>(limit * 1000)) + "ms" : string(",bouts_longer"));
+	out << '\n';
+	for (const GazeHeatmapSnapshot::Object& object : snapshot.objects)
+	{
+		out << object.id << ',' << object.dwellSeconds << ',' << (snapshot.totalSeconds > 0 ? object.dwellSeconds / snapshot.totalSeconds : 0.0);
+		for (const uint32_t count : object.bouts)
+			out << ',' << count;
+		out << '\n';
+	}
+	if (!out)
+		throw "Unable to write " + path;
+}
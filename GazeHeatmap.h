@@ -0,0 +1,132 @@
+#pragma once
+#include "EyeData.h"
+#include "FoveAPI.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// This header implements the accumulation of where, and on what, the gaze dwells over time
+//
+// Two things are accumulated from the eye frames:
+// - A screen space heatmap, built from the combined gaze screen position (see Headset::getGazeScreenPositionCombined):
+//   each sample splats its duration over a small gaussian footprint
+// - Per gazable object dwell statistics (see Headset::getGazedObjectId): total dwell time,
+//   and a histogram of the durations of the uninterrupted looks ("bouts") at the object
+//
+// Counters are atomic, so any number of threads can accumulate into the same heatmap at once, without locks,
+// and snapshots can be taken at any time from yet another thread without pausing them.
+// The heatmap cells are stored in square tiles, so each splat touches a few cache lines rather than one per row.
+
+struct GazeHeatmapSettings
+{
+	uint32_t width = 256;   // Resolution of the heatmap, covering the whole screen
+	uint32_t height = 256;
+	float splatSigma = 2.0f; // Standard deviation of the gaussian splat of each sample, in cells
+	int maxObjectId = 255;   // Objects with ids from 0 to this are tracked, others are ignored
+	float maxSampleGapSeconds = 0.1f; // Samples count for the time until the next one, up to this long (longer gaps are lost frames)
+};
+
+// Copy of the state of a heatmap at one point in time
+struct GazeHeatmapSnapshot
+{
+	// Bouts are binned by duration, each bin twice as long as the previous: < 50ms, 50-100ms, ... , >= 12.8s
+	static constexpr size_t boutBins = 10;
+	static constexpr float firstBoutBinSeconds = 0.05f;
+
+	struct Object
+	{
+		int id = fove_ObjectIdInvalid;
+		double dwellSeconds = 0;
+		std::array<uint32_t, boutBins> bouts{};
+	};
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<float> dwellSeconds; // Per cell, row major, starting with the top row
+	double totalSeconds = 0;         // Total duration of the samples with a valid gaze
+	std::vector<Object> objects;     // Objects with some dwell time, by increasing id
+};
+
+class GazeHeatmap
+{
+public:
+	static constexpr uint32_t tileSize = 16; // Tiles are tileSize x tileSize cells
+
+	explicit GazeHeatmap(const GazeHeatmapSettings& settings = {});
+
+	const GazeHeatmapSettings& settings() const { return m_settings; }
+
+	// Adds the given duration around a screen position (from -1 to 1, +y up)
+	// Thread safe
+	void splat(Fove::Vec2 screenPosition, float seconds);
+
+	// Adds dwell time on an object, and a completed bout of the given duration
+	// Thread safe
+	void addDwell(int objectId, float seconds);
+	void addBout(int objectId, float seconds);
+
+	// Copies the current state. Thread safe, and doesn't block the threads accumulating samples
+	// Counters are read one by one while others may still add to them, so a snapshot may include part of the latest samples
+	GazeHeatmapSnapshot snapshot() const;
+
+	// Weight of a cell at the given offset from the splat center, in cells, before normalization
+	// Separable truncated gaussian, truncated at 3 sigma
+	float kernel(float dx, float dy) const;
+
+	// Turns a stream of eye frames into splats and dwell times
+	// Each thread or stream needs its own Producer, which tracks the current sample and bout
+	// Consecutive samples less than half a cell apart, like those of a fixation, are merged into one splat, which saves most of the atomic adds
+	class Producer
+	{
+	public:
+		explicit Producer(GazeHeatmap& heatmap) : m_heatmap(&heatmap) {}
+		~Producer() { finish(); }
+
+		// Feeds the next frame. The previous frame is accumulated, now that its duration is known
+		void addFrame(const EyeFrame& frame);
+
+		// Accumulates the last frame and bout, for when the stream ends
+		void finish();
+
+	private:
+		void endBout();
+		void flushSplat();
+
+		static constexpr float maxPendingSeconds = 0.1f; // Merged splats are flushed at least this often, so snapshots stay current
+
+		GazeHeatmap* m_heatmap = nullptr;
+		bool m_hasLast = false;
+		EyeFrame m_last;
+		int m_boutObjectId = fove_ObjectIdInvalid;
+		float m_boutSeconds = 0;
+		Fove::Vec2 m_pendingPosition{}; // Time weighted average position of the samples merged so far
+		float m_pendingSeconds = 0;
+	};
+
+private:
+	struct alignas(64) ObjectCounters
+	{
+		std::atomic<uint64_t> dwellNs{0};
+		std::array<std::atomic<uint32_t>, GazeHeatmapSnapshot::boutBins> bouts{};
+	};
+
+	std::atomic<uint64_t>& cell(uint32_t x, uint32_t y) const;
+
+	GazeHeatmapSettings m_settings;
+	uint32_t m_tilesX = 0;
+	uint32_t m_tilesY = 0;
+	int m_kernelRadius = 0; // In cells
+	std::unique_ptr<std::atomic<uint64_t>[]> m_cells; // Nanoseconds, tile by tile
+	std::unique_ptr<ObjectCounters[]> m_objects;
+	std::atomic<uint64_t> m_totalNs{0};
+};
+
+// Writes the heatmap as a color image (binary PPM), normalized to its maximum
+void writeHeatmapPpm(const GazeHeatmapSnapshot& snapshot, const std::string& path);
+
+// Writes the dwell time and bout histogram of each object as CSV
+void writeObjectDwellCsv(const GazeHeatmapSnapshot& snapshot, const std::string& path);
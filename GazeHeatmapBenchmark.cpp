@@ -0,0 +1,148 @@
+// FOVE Gaze Heatmap Benchmark
+// This accumulates eye tracking sessions into a GazeHeatmap from several threads at once, while another thread keeps taking snapshots,
+// and measures how the accumulation scales with the number of threads
+//
+// Usage: FoveGazeHeatmapBenchmark [--export prefix] [session.csv...]
+// Sessions are recorded with `FoveDataExample --record session.csv`. Without sessions, synthetic sessions are used instead.
+// With --export, the final heatmap is written to prefix.ppm, and the object dwell times to prefix_objects.csv
+
+#include "EyeData.h"
+#include "GazeHeatmap.h"
+#include "Util.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+constexpr int replays = 4; // Each session is replayed this many times per run, to make the runs long enough to measure
+
+struct RunResult
+{
+	double seconds = 0;
+	size_t samples = 0;
+	size_t snapshots = 0;
+	double snapshotSeconds = 0;
+	GazeHeatmapSnapshot last;
+};
+
+RunResult run(const vector<vector<EyeFrame>>& sessions, const size_t threadCount)
+{
+	GazeHeatmap heatmap;
+	atomic<bool> done{false};
+	RunResult result;
+
+	// Snapshots are taken continuously while the producers run, to show they don't get in the way
+	thread snapshotThread([&] {
+		while (!done.load())
+		{
+			const auto start = chrono::steady_clock::now();
+			result.last = heatmap.snapshot();
+			result.snapshotSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			++result.snapshots;
+		}
+	});
+
+	// Each producer thread replays its share of the sessions
+	vector<thread> producers;
+	vector<size_t> samples(threadCount);
+	const auto start = chrono::steady_clock::now();
+	for (size_t t = 0; t < threadCount; ++t)
+	{
+		producers.emplace_back([&, t] {
+			for (size_t i = t; i < sessions.size() * replays; i += threadCount)
+			{
+				GazeHeatmap::Producer producer(heatmap);
+				for (const EyeFrame& frame : sessions[i % sessions.size()])
+					producer.addFrame(frame);
+				samples[t] += sessions[i % sessions.size()].size();
+			}
+		});
+	}
+	for (thread& producer : producers)
+		producer.join();
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.samples = accumulate(samples.begin(), samples.end(), size_t{0});
+
+	done = true;
+	snapshotThread.join();
+	result.last = heatmap.snapshot();
+	return result;
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	string exportPrefix;
+	vector<vector<EyeFrame>> sessions;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--export" && i + 1 < argc)
+			exportPrefix = argv[++i];
+		else
+			sessions.push_back(readEyeSession(arg));
+	}
+	if (sessions.empty())
+	{
+		cout << "No session given, using synthetic sessions\n";
+		for (uint32_t seed = 1; seed <= 20; ++seed)
+			sessions.push_back(generateEyeSession(seed, 60.0f));
+	}
+
+	vector<size_t> threadCounts{1};
+	const size_t hardwareThreads = max<size_t>(thread::hardware_concurrency(), 1);
+	for (size_t n = 2; n <= max<size_t>(hardwareThreads, 4); n *= 2)
+		threadCounts.push_back(n);
+
+	// The snapshot thread runs alongside the accumulating threads, so with few hardware threads it takes time from them
+	cout << fixed << setprecision(2) << "Hardware threads: " << hardwareThreads << " (shared with the snapshot thread)\n";
+#ifndef NDEBUG
+	// CMake builds without optimizations unless a build type is given, which makes this several times slower
+	cout << "Debug build, configure CMake with -DCMAKE_BUILD_TYPE=Release for representative numbers\n";
+#endif
+	cout << "\nThreads  M samples/s  Speedup  Snapshots  ms/snapshot\n";
+	double baseline = 0;
+	RunResult last;
+	for (const size_t threadCount : threadCounts)
+	{
+		last = run(sessions, threadCount);
+		const double rate = last.samples / last.seconds;
+		if (baseline == 0)
+			baseline = rate;
+		cout << setw(7) << threadCount << setw(13) << rate / 1e6 << setw(9) << rate / baseline << setw(11) << last.snapshots
+			 << setw(13) << 1000 * last.snapshotSeconds / max<size_t>(last.snapshots, 1) << '\n';
+	}
+
+	// Splats falling partly off screen lose that part, the rest should all be in the cells
+	const double cellSeconds = accumulate(last.last.dwellSeconds.begin(), last.last.dwellSeconds.end(), 0.0);
+	cout << "\nGaze time:        " << last.last.totalSeconds << "s, " << 100 * cellSeconds / max(last.last.totalSeconds, 1e-9) << "% of it within the heatmap\n"
+		 << "Objects:          " << last.last.objects.size() << '\n';
+
+	if (!exportPrefix.empty())
+	{
+		writeHeatmapPpm(last.last, exportPrefix + ".ppm");
+		writeObjectDwellCsv(last.last, exportPrefix + "_objects.csv");
+		cout << "Exported " << exportPrefix << ".ppm and " << exportPrefix << "_objects.csv\n";
+	}
+	return EXIT_SUCCESS;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#include "GazePrediction.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+
+constexpr float degreesToRadians = 3.14159265f / 180;
+
+Fove::Vec3 cross(const Fove::Vec3 a, const Fove::Vec3 b)
+{
+	return Fove::Vec3{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Rotates a direction by the given angle, towards another direction (along the great circle through both)
+Fove::Vec3 rotateTowards(const Fove::Vec3 from, const Fove::Vec3 towards, const float angleDegrees)
+{
+	const Fove::Vec3 axis = cross(from, towards);
+	const float axisLength = magnitude(axis);
+	if (axisLength < 1e-6f)
+		return from;
+	const Fove::Vec3 perpendicular = cross(axis / axisLength, from); // In the plane of both directions, 90 degrees from `from`
+	const float angle = angleDegrees * degreesToRadians;
+	return normalize(from * cos(angle) + perpendicular * sin(angle));
+}
+
+// Fraction of a saccade covered at the given fraction of its duration (minimum jerk profile)
+float saccadeProfile(const float t)
+{
+	const float x = clamp(t, 0.0f, 1.0f);
+	return x * x * x * (10 + x * (-15 + x * 6));
+}
+
+} // namespace
+
+float GazePredictor::amplitudeFromPeakVelocity(const float peakVelocity) const
+{
+	// Inverse of the main sequence, capped before it diverges near Vmax
+	const float ratio = min(peakVelocity / m_settings.mainSequenceVmax, 0.99f);
+	return -m_settings.mainSequenceC * log(1 - ratio);
+}
+
+float GazePredictor::durationSeconds(const float amplitudeDegrees) const
+{
+	return (m_settings.durationSlopeMs * amplitudeDegrees + m_settings.durationInterceptMs) / 1000;
+}
+
+void GazePredictor::addSample(const EyeFrame& frame)
+{
+	if (!frame.gazeValid)
+	{
+		// The eye can't be followed through a blink, so start over afterwards
+		m_hasLast = false;
+		m_prediction.inSaccade = false;
+		m_velocity = 0;
+		return;
+	}
+
+	const Fove::Vec3 gaze = normalize(frame.combinedGaze);
+	const float dt = (frame.timestamp - m_lastTimestamp) / 1e6f;
+	const bool hasVelocity = m_hasLast && frame.timestamp > m_lastTimestamp && dt <= m_settings.maxSampleGapSeconds;
+	m_velocity = hasVelocity ? angleBetweenDirections(m_last, gaze) / dt : 0;
+
+	if (!m_prediction.inSaccade && m_velocity > m_settings.onsetVelocity)
+	{
+		// The saccade started somewhere between the previous sample and this one, the previous sample is the best guess
+		m_prediction.inSaccade = true;
+		m_saccadeStart = m_last;
+		m_saccadeStartTimestamp = m_lastTimestamp;
+		m_peakVelocity = 0;
+		m_distanceAtPeak = 0;
+		m_pastPeak = false;
+	}
+	else if (m_prediction.inSaccade && m_velocity < m_settings.offsetVelocity)
+	{
+		m_prediction.inSaccade = false;
+	}
+
+	m_last = gaze;
+	m_lastTimestamp = frame.timestamp;
+	m_hasLast = true;
+	m_prediction.valid = true;
+
+	if (!m_prediction.inSaccade)
+	{
+		m_prediction.landing = gaze;
+		m_prediction.amplitudeDegrees = 0;
+		m_prediction.landingTimestamp = frame.timestamp;
+		return;
+	}
+
+	const float travelled = angleBetweenDirections(m_saccadeStart, gaze);
+	if (m_velocity > m_peakVelocity)
+	{
+		m_peakVelocity = m_velocity;
+		m_distanceAtPeak = travelled;
+	}
+	else
+	{
+		m_pastPeak = true;
+	}
+	updateLanding();
+}
+
+void GazePredictor::updateLanding()
+{
+	// Before the peak, the saccade is less than half done, and the main sequence gives another lower bound from the velocity so far
+	// After it, the velocity profile of saccades is close to symmetric, so the amplitude is about twice the distance at the peak
+	const float travelled = angleBetweenDirections(m_saccadeStart, m_last);
+	float amplitude = max(amplitudeFromPeakVelocity(m_peakVelocity), 2 * travelled);
+	if (m_pastPeak)
+		amplitude = 2 * m_distanceAtPeak;
+	amplitude = max(amplitude, travelled);
+
+	m_prediction.amplitudeDegrees = amplitude;
+	m_prediction.landing = rotateTowards(m_saccadeStart, m_last, amplitude);
+	m_prediction.landingTimestamp = m_saccadeStartTimestamp + static_cast<uint64_t>(durationSeconds(amplitude) * 1e6f);
+}
+
+Fove::Vec3 GazePredictor::predictAt(const uint64_t timestamp) const
+{
+	if (!m_prediction.inSaccade)
+		return m_last;
+
+	// Follow the saccade profile, but never go back from where the gaze already is
+	const float elapsed = timestamp > m_saccadeStartTimestamp ? (timestamp - m_saccadeStartTimestamp) / 1e6f : 0.0f;
+	const float fraction = saccadeProfile(elapsed / durationSeconds(m_prediction.amplitudeDegrees));
+	const float travelled = angleBetweenDirections(m_saccadeStart, m_last);
+	return rotateTowards(m_saccadeStart, m_last, max(travelled, m_prediction.amplitudeDegrees * fraction));
+}
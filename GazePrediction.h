@@ -0,0 +1,71 @@
+#pragma once
+#include "EyeData.h"
+#include "FoveAPI.h"
+#include <cstdint>
+
+// This header implements a streaming gaze predictor, to anticipate where the gaze lands at the end of a saccade
+//
+// Saccades, the fast jumps of the gaze between two fixations, last from 20 to 100ms, which is several frames.
+// Anything following the gaze (foveation, selection highlights) lags behind for that long, plus the tracking latency.
+// Saccades are ballistic however: their amplitude can't change once started, and it's closely related to their peak velocity (the main sequence).
+// So shortly after a saccade starts, its landing point can be estimated from the direction and velocity of the eye.
+
+class GazePredictor
+{
+public:
+	struct Settings
+	{
+		float onsetVelocity = 100.0f;        // A saccade starts when the gaze moves faster than this, in degrees per second
+		float offsetVelocity = 50.0f;        // And ends once it gets back below this
+		float mainSequenceVmax = 700.0f;     // Main sequence: peak velocity = Vmax * (1 - exp(-amplitude / C)), in degrees per second
+		float mainSequenceC = 11.0f;         // In degrees
+		float durationSlopeMs = 2.2f;        // Main sequence: duration = slope * amplitude + intercept, in ms per degree
+		float durationInterceptMs = 21.0f;   // In ms
+		float maxSampleGapSeconds = 0.05f;   // Samples further apart than this (lost frames) aren't used to estimate the velocity
+	};
+
+	struct Prediction
+	{
+		Fove::Vec3 landing{0, 0, 1}; // Where the gaze is expected to be once the current movement ends (the current gaze during fixations)
+		bool inSaccade = false;
+		float amplitudeDegrees = 0;  // Estimated amplitude of the current saccade
+		uint64_t landingTimestamp = 0;
+		bool valid = false; // False until a valid gaze sample comes in
+	};
+
+	GazePredictor() = default;
+	explicit GazePredictor(const Settings& settings) : m_settings(settings) {}
+
+	// Feeds the next frame, in order. This is O(1) and doesn't allocate
+	// Invalid frames (blinks, lost tracking) end any ongoing saccade, but keep the last prediction
+	void addSample(const EyeFrame& frame);
+
+	const Prediction& prediction() const { return m_prediction; }
+
+	// Angular velocity between the last two valid samples, in degrees per second
+	float velocity() const { return m_velocity; }
+
+	// Returns the expected gaze direction at the given time (usually a bit after the last sample)
+	// During a saccade, this follows the typical velocity profile of saccades towards the landing point, otherwise it's the last gaze
+	Fove::Vec3 predictAt(uint64_t timestamp) const;
+
+private:
+	float amplitudeFromPeakVelocity(float peakVelocity) const;
+	float durationSeconds(float amplitudeDegrees) const;
+	void updateLanding();
+
+	Settings m_settings;
+	Prediction m_prediction;
+
+	bool m_hasLast = false;
+	Fove::Vec3 m_last{0, 0, 1};
+	uint64_t m_lastTimestamp = 0;
+	float m_velocity = 0;
+
+	// Current saccade
+	Fove::Vec3 m_saccadeStart{0, 0, 1};
+	uint64_t m_saccadeStartTimestamp = 0;
+	float m_peakVelocity = 0;
+	float m_distanceAtPeak = 0; // Angle travelled when the peak velocity was reached, in degrees
+	bool m_pastPeak = false;
+};
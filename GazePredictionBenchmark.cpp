@@ -0,0 +1,217 @@
+// FOVE Gaze Prediction Benchmark
+// This replays eye tracking sessions through the GazePredictor, and measures how well and how early it predicts saccade landing points
+//
+// Usage: FoveGazePredictionBenchmark [session.csv...]
+// Sessions are recorded with `FoveDataExample --record session.csv`. Without arguments, synthetic sessions are used instead.
+
+#include "EyeData.h"
+#include "GazePrediction.h"
+#include "Util.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+// Offline saccade detection, used as the ground truth
+// Unlike the predictor, this can look ahead, so each saccade is known from its very first to its very last sample
+constexpr float groundTruthVelocity = 30.0f;  // Degrees per second, a common threshold for offline I-VT
+constexpr float landingToleranceDegrees = 2.0f; // About the size of the fovea
+
+struct Saccade
+{
+	size_t first; // Index of the last sample before the movement
+	size_t last;  // Index of the landing sample
+};
+
+vector<Saccade> findSaccades(const vector<EyeFrame>& frames, const float minPeakVelocity)
+{
+	vector<Saccade> saccades;
+	size_t i = 1;
+	while (i < frames.size())
+	{
+		const auto Velocity = [&frames](const size_t j) {
+			if (!frames[j].gazeValid || !frames[j - 1].gazeValid || frames[j].timestamp <= frames[j - 1].timestamp)
+				return -1.0f;
+			return angleBetweenDirections(frames[j - 1].combinedGaze, frames[j].combinedGaze) / ((frames[j].timestamp - frames[j - 1].timestamp) / 1e6f);
+		};
+		if (Velocity(i) < groundTruthVelocity)
+		{
+			++i;
+			continue;
+		}
+
+		// Extend over every sample above the threshold, and only keep movements fast enough to be saccades
+		const size_t first = i - 1;
+		float peak = 0;
+		bool interrupted = false;
+		while (i < frames.size())
+		{
+			const float v = Velocity(i);
+			interrupted = interrupted || v < 0;
+			if (v < groundTruthVelocity)
+				break;
+			peak = max(peak, v);
+			++i;
+		}
+		if (!interrupted && i < frames.size() && peak >= minPeakVelocity)
+			saccades.push_back(Saccade{first, i - 1});
+	}
+	return saccades;
+}
+
+struct Stats
+{
+	size_t saccades = 0;
+	size_t detected = 0;
+	double detectionLatencyMs = 0;   // From the start of the saccade to its detection
+	double errorAtDetection = 0;     // Landing error of the prediction when the saccade is detected
+	double reactiveErrorAtDetection = 0; // Distance from the current gaze to the landing point at that time
+	double leadTimeMs = 0;           // How long before landing the prediction is within tolerance (and stays there)
+
+	static constexpr array<int, 3> horizonsMs{10, 20, 30};
+	array<double, 3> predictedError{}; // Error of predictAt(t + horizon) during saccades
+	array<double, 3> reactiveError{};  // Error of the gaze at t, used as-is at t + horizon
+	size_t horizonSamples = 0;
+
+	size_t samples = 0;
+	double predictorSeconds = 0;
+};
+
+// Returns the index of the frame at or just after the given timestamp, or frames.size()
+size_t frameAt(const vector<EyeFrame>& frames, const uint64_t timestamp)
+{
+	return lower_bound(frames.begin(), frames.end(), timestamp, [](const EyeFrame& f, const uint64_t t) { return f.timestamp < t; }) - frames.begin();
+}
+
+void evaluateSession(const vector<EyeFrame>& frames, Stats& stats)
+{
+	const GazePredictor::Settings settings;
+	const vector<Saccade> saccades = findSaccades(frames, settings.onsetVelocity);
+
+	// Run the predictor once over the whole session, keeping its output after each sample
+	vector<GazePredictor::Prediction> predictions(frames.size());
+	array<vector<Fove::Vec3>, 3> predictedAtHorizon;
+	for (vector<Fove::Vec3>& v : predictedAtHorizon)
+		v.resize(frames.size());
+	{
+		GazePredictor predictor(settings);
+		const auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames.size(); ++i)
+		{
+			predictor.addSample(frames[i]);
+			predictions[i] = predictor.prediction();
+		}
+		stats.predictorSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		stats.samples += frames.size();
+
+		// Horizons are evaluated in a second pass, so they don't count in the streaming time
+		GazePredictor replay(settings);
+		for (size_t i = 0; i < frames.size(); ++i)
+		{
+			replay.addSample(frames[i]);
+			for (size_t h = 0; h < Stats::horizonsMs.size(); ++h)
+				predictedAtHorizon[h][i] = replay.predictAt(frames[i].timestamp + Stats::horizonsMs[h] * 1000ULL);
+		}
+	}
+
+	for (const Saccade& saccade : saccades)
+	{
+		++stats.saccades;
+		const EyeFrame& start = frames[saccade.first];
+		const EyeFrame& landing = frames[saccade.last];
+
+		// Detection
+		size_t detection = saccade.first + 1;
+		while (detection <= saccade.last && !predictions[detection].inSaccade)
+			++detection;
+		if (detection > saccade.last)
+			continue;
+		++stats.detected;
+		stats.detectionLatencyMs += (frames[detection].timestamp - start.timestamp) / 1000.0;
+		stats.errorAtDetection += angleBetweenDirections(predictions[detection].landing, landing.combinedGaze);
+		stats.reactiveErrorAtDetection += angleBetweenDirections(frames[detection].combinedGaze, landing.combinedGaze);
+
+		// Lead time: the earliest sample from which the prediction stays within tolerance until landing
+		size_t firstGood = saccade.last;
+		while (firstGood > detection && angleBetweenDirections(predictions[firstGood - 1].landing, landing.combinedGaze) <= landingToleranceDegrees)
+			--firstGood;
+		if (angleBetweenDirections(predictions[firstGood].landing, landing.combinedGaze) <= landingToleranceDegrees)
+			stats.leadTimeMs += (landing.timestamp - frames[firstGood].timestamp) / 1000.0;
+
+		// Horizon errors, for samples within the saccade
+		for (size_t i = saccade.first + 1; i < saccade.last; ++i)
+		{
+			bool complete = true;
+			array<Fove::Vec3, 3> actual;
+			for (size_t h = 0; h < Stats::horizonsMs.size(); ++h)
+			{
+				const size_t future = frameAt(frames, frames[i].timestamp + Stats::horizonsMs[h] * 1000ULL);
+				complete = complete && future < frames.size() && frames[future].gazeValid;
+				if (complete)
+					actual[h] = frames[future].combinedGaze;
+			}
+			if (!complete)
+				continue;
+			for (size_t h = 0; h < Stats::horizonsMs.size(); ++h)
+			{
+				stats.predictedError[h] += angleBetweenDirections(predictedAtHorizon[h][i], actual[h]);
+				stats.reactiveError[h] += angleBetweenDirections(frames[i].combinedGaze, actual[h]);
+			}
+			++stats.horizonSamples;
+		}
+	}
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	vector<vector<EyeFrame>> sessions;
+	for (int i = 1; i < argc; ++i)
+		sessions.push_back(readEyeSession(argv[i]));
+	if (sessions.empty())
+	{
+		cout << "No session given, using synthetic sessions\n";
+		for (uint32_t seed = 1; seed <= 20; ++seed)
+			sessions.push_back(generateEyeSession(seed, 60.0f));
+	}
+
+	Stats stats;
+	for (const vector<EyeFrame>& session : sessions)
+		evaluateSession(session, stats);
+	if (stats.saccades == 0)
+		throw "No saccade found in the sessions";
+
+	const double detected = static_cast<double>(max<size_t>(stats.detected, 1));
+	cout << fixed << setprecision(2)
+		 << "Sessions:                    " << sessions.size() << " (" << stats.samples << " samples)\n"
+		 << "Saccades:                    " << stats.saccades << ", " << 100.0 * stats.detected / stats.saccades << "% detected online\n"
+		 << "Detection latency:           " << stats.detectionLatencyMs / detected << "ms after onset\n"
+		 << "Landing error at detection:  " << stats.errorAtDetection / detected << " degrees (current gaze: " << stats.reactiveErrorAtDetection / detected << " degrees)\n"
+		 << "Landing predicted (<" << landingToleranceDegrees << " deg): " << stats.leadTimeMs / detected << "ms before landing on average\n"
+		 << "Streaming cost:              " << stats.predictorSeconds * 1e9 / stats.samples << "ns per sample\n\n"
+		 << "Gaze error during saccades, in degrees, predicted vs reactive (gaze used as-is)\n";
+	for (size_t h = 0; h < Stats::horizonsMs.size(); ++h)
+	{
+		const double n = static_cast<double>(max<size_t>(stats.horizonSamples, 1));
+		cout << setw(5) << Stats::horizonsMs[h] << "ms ahead: " << setw(6) << stats.predictedError[h] / n << " vs " << setw(6) << stats.reactiveError[h] / n << '\n';
+	}
+	return EXIT_SUCCESS;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,518 @@
+#include "GazeStream.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+
+constexpr uint8_t packetMagic[2] = {'F', 'G'};
+constexpr uint8_t packetVersion = 1;
+constexpr float screenScale = 8192;       // Screen positions are stored in 1/8192ths, from -4 to 4
+constexpr float pupilScale = 1'000'000;   // Pupil radii are stored in micrometers
+constexpr size_t maxEncodedFrameSize = 64; // Upper bound of the size of one frame, so encoding never checks for room
+
+// Variable length integers: 7 bits per byte, least significant first, high bit set on all bytes but the last
+void writeVarint(uint8_t*& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = static_cast<uint8_t>(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = static_cast<uint8_t>(value);
+}
+
+// Signed values are zigzag encoded first, so that small negative values stay small
+void writeSignedVarint(uint8_t*& out, const int64_t value)
+{
+	writeVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void writeInt16(uint8_t*& out, const int16_t value)
+{
+	const uint16_t bits = static_cast<uint16_t>(value);
+	*out++ = static_cast<uint8_t>(bits);
+	*out++ = static_cast<uint8_t>(bits >> 8);
+}
+
+int16_t quantize(const float value, const float scale)
+{
+	return static_cast<int16_t>(clamp(lround(value * scale), -32767L, 32767L));
+}
+
+// Octahedral encoding of a direction: projected on the octahedron |x| + |y| + |z| = 1, whose lower half is folded over the upper half
+void writeDirection(uint8_t*& out, const Fove::Vec3 v)
+{
+	const float norm = fabs(v.x) + fabs(v.y) + fabs(v.z);
+	float x = norm > 0 ? v.x / norm : 0.0f;
+	float y = norm > 0 ? v.y / norm : 0.0f;
+	if (v.z < 0)
+	{
+		const float foldedX = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+		const float foldedY = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+		x = foldedX;
+		y = foldedY;
+	}
+	writeInt16(out, quantize(x, 32767));
+	writeInt16(out, quantize(y, 32767));
+}
+
+// Bounds checked reading of a packet
+struct PacketReader
+{
+	const uint8_t* data;
+	const uint8_t* end;
+	bool valid = true;
+
+	uint8_t byte()
+	{
+		if (data >= end)
+		{
+			valid = false;
+			return 0;
+		}
+		return *data++;
+	}
+
+	uint64_t varint()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			const uint8_t b = byte();
+			value |= static_cast<uint64_t>(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+				return value;
+		}
+		valid = false;
+		return 0;
+	}
+
+	int64_t signedVarint()
+	{
+		const uint64_t value = varint();
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	int16_t int16()
+	{
+		const uint8_t low = byte();
+		return static_cast<int16_t>(static_cast<uint16_t>(low | (byte() << 8)));
+	}
+
+	Fove::Vec3 direction()
+	{
+		float x = int16() / 32767.0f;
+		float y = int16() / 32767.0f;
+		const float z = 1 - fabs(x) - fabs(y);
+		if (z < 0)
+		{
+			const float unfoldedX = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+			const float unfoldedY = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+			x = unfoldedX;
+			y = unfoldedY;
+		}
+		const float length = sqrt(x * x + y * y + z * z);
+		return Fove::Vec3{x / length, y / length, z / length};
+	}
+};
+
+#ifdef _WIN32
+
+using SocketHandle = SOCKET;
+using SocketLength = int;
+constexpr intptr_t invalidSocket = static_cast<intptr_t>(INVALID_SOCKET);
+constexpr int sendFlags = 0;
+
+void closeSocketHandle(const intptr_t s)
+{
+	closesocket(static_cast<SOCKET>(s));
+}
+
+int pollSocket(const intptr_t s, const int timeoutMs)
+{
+	WSAPOLLFD fd{static_cast<SOCKET>(s), POLLRDNORM, 0};
+	return WSAPoll(&fd, 1, timeoutMs);
+}
+
+// Winsock needs initializing once per process
+void initSockets()
+{
+	static const bool initialized = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	if (!initialized)
+		throw "Unable to initialize Winsock";
+}
+
+#else
+
+using SocketHandle = int;
+using SocketLength = socklen_t;
+constexpr intptr_t invalidSocket = -1;
+constexpr int sendFlags = MSG_NOSIGNAL; // Report closed connections as errors rather than killing the process with SIGPIPE
+
+void closeSocketHandle(const intptr_t s)
+{
+	close(static_cast<int>(s));
+}
+
+int pollSocket(const intptr_t s, const int timeoutMs)
+{
+	pollfd fd{static_cast<int>(s), POLLIN, 0};
+	return poll(&fd, 1, timeoutMs);
+}
+
+void initSockets() {}
+
+#endif
+
+intptr_t openSocket(const GazeStreamTransport transport)
+{
+	initSockets();
+	const intptr_t s = static_cast<intptr_t>(socket(AF_INET, transport == GazeStreamTransport::Udp ? SOCK_DGRAM : SOCK_STREAM, 0));
+	if (s == invalidSocket)
+		throw "Unable to create a socket";
+	return s;
+}
+
+int remainingMilliseconds(const chrono::steady_clock::time_point deadline)
+{
+	const auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+	return static_cast<int>(clamp<decltype(remaining)>(remaining, 0, 1000 * 1000));
+}
+
+} // namespace
+
+GazeStreamTransport parseGazeStreamTransport(const string& name)
+{
+	if (name == "udp")
+		return GazeStreamTransport::Udp;
+	if (name == "tcp")
+		return GazeStreamTransport::Tcp;
+	throw "Unknown transport " + name + ", expected udp or tcp";
+}
+
+uint64_t gazeStreamClockNanoseconds()
+{
+	return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+size_t encodeGazePacket(const GazePacket& packet, uint8_t* const buffer)
+{
+	static_assert(32 + maxGazePacketFrames * maxEncodedFrameSize <= 2 * maxGazePacketSize, "Packets must fit in their buffer");
+
+	uint8_t* out = buffer;
+	*out++ = packetMagic[0];
+	*out++ = packetMagic[1];
+	*out++ = packetVersion;
+	writeVarint(out, packet.sequence);
+	for (int i = 0; i < 8; ++i)
+		*out++ = static_cast<uint8_t>(packet.sendNanoseconds >> (8 * i));
+	const size_t count = min(packet.frames.size(), maxGazePacketFrames);
+	writeVarint(out, count);
+
+	const EyeFrame* previous = nullptr;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const EyeFrame& frame = packet.frames[i];
+		if (previous)
+		{
+			writeSignedVarint(out, static_cast<int64_t>(frame.id - previous->id));
+			writeSignedVarint(out, static_cast<int64_t>(frame.timestamp - previous->timestamp));
+		}
+		else
+		{
+			writeVarint(out, frame.id);
+			writeVarint(out, frame.timestamp);
+		}
+		previous = &frame;
+
+		*out++ = static_cast<uint8_t>((frame.gazeValid ? 1 : 0) | (static_cast<int>(frame.eyeState.l) & 3) << 1 | (static_cast<int>(frame.eyeState.r) & 3) << 3);
+		writeDirection(out, frame.combinedGaze);
+		writeDirection(out, frame.gaze.l);
+		writeDirection(out, frame.gaze.r);
+		writeInt16(out, quantize(frame.screenPosition.x, screenScale));
+		writeInt16(out, quantize(frame.screenPosition.y, screenScale));
+		writeInt16(out, static_cast<int16_t>(static_cast<uint16_t>(clamp(lround(frame.pupilRadius.l * pupilScale), 0L, 65535L))));
+		writeInt16(out, static_cast<int16_t>(static_cast<uint16_t>(clamp(lround(frame.pupilRadius.r * pupilScale), 0L, 65535L))));
+		writeSignedVarint(out, frame.gazedObjectId);
+	}
+	return static_cast<size_t>(out - buffer);
+}
+
+bool decodeGazePacket(const uint8_t* const data, const size_t size, GazePacket& packet)
+{
+	PacketReader in{data, data + size};
+	if (in.byte() != packetMagic[0] || in.byte() != packetMagic[1] || in.byte() != packetVersion)
+		return false;
+	packet.sequence = in.varint();
+	packet.sendNanoseconds = 0;
+	for (int i = 0; i < 8; ++i)
+		packet.sendNanoseconds |= static_cast<uint64_t>(in.byte()) << (8 * i);
+	const uint64_t count = in.varint();
+	if (!in.valid || count > maxGazePacketFrames)
+		return false;
+
+	packet.frames.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		EyeFrame& frame = packet.frames[i];
+		if (i == 0)
+		{
+			frame.id = in.varint();
+			frame.timestamp = in.varint();
+		}
+		else
+		{
+			frame.id = packet.frames[i - 1].id + static_cast<uint64_t>(in.signedVarint());
+			frame.timestamp = packet.frames[i - 1].timestamp + static_cast<uint64_t>(in.signedVarint());
+		}
+
+		const uint8_t flags = in.byte();
+		frame.gazeValid = (flags & 1) != 0;
+		frame.eyeState.l = static_cast<Fove::EyeState>((flags >> 1) & 3);
+		frame.eyeState.r = static_cast<Fove::EyeState>((flags >> 3) & 3);
+		frame.combinedGaze = in.direction();
+		frame.gaze.l = in.direction();
+		frame.gaze.r = in.direction();
+		frame.screenPosition.x = in.int16() / screenScale;
+		frame.screenPosition.y = in.int16() / screenScale;
+		frame.pupilRadius.l = static_cast<uint16_t>(in.int16()) / pupilScale;
+		frame.pupilRadius.r = static_cast<uint16_t>(in.int16()) / pupilScale;
+		frame.gazedObjectId = static_cast<int>(in.signedVarint());
+	}
+	return in.valid && in.data == in.end;
+}
+
+GazeStreamSender::GazeStreamSender(const GazeStreamTransport transport, const string& host, const uint16_t port, const size_t batchSize)
+	: m_transport(transport)
+	, m_batchSize(clamp<size_t>(batchSize, 1, maxGazePacketFrames))
+	, m_buffer(2 * maxGazePacketSize)
+{
+	initSockets();
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = transport == GazeStreamTransport::Udp ? SOCK_DGRAM : SOCK_STREAM;
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &result) != 0 || !result)
+		throw "Unable to resolve " + host;
+	m_address.assign(reinterpret_cast<const uint8_t*>(result->ai_addr), reinterpret_cast<const uint8_t*>(result->ai_addr) + result->ai_addrlen);
+	freeaddrinfo(result);
+
+	if (transport == GazeStreamTransport::Udp)
+		m_socket = openSocket(transport);
+	m_batch.frames.reserve(maxGazePacketFrames);
+}
+
+GazeStreamSender::~GazeStreamSender()
+{
+	flush();
+	closeSocket();
+}
+
+void GazeStreamSender::closeSocket()
+{
+	if (m_socket != invalidSocket)
+		closeSocketHandle(m_socket);
+	m_socket = invalidSocket;
+}
+
+bool GazeStreamSender::connectIfNeeded()
+{
+	if (m_socket != invalidSocket)
+		return true;
+	if (chrono::steady_clock::now() < m_nextConnectAttempt)
+		return false;
+	m_nextConnectAttempt = chrono::steady_clock::now() + chrono::seconds{1};
+
+	m_socket = openSocket(m_transport);
+	if (connect(static_cast<SocketHandle>(m_socket), reinterpret_cast<const sockaddr*>(m_address.data()), static_cast<SocketLength>(m_address.size())) != 0)
+	{
+		closeSocket();
+		return false;
+	}
+
+	// Send each packet right away rather than waiting to coalesce them: batching is already done by us
+	const int noDelay = 1;
+	setsockopt(static_cast<SocketHandle>(m_socket), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+	return true;
+}
+
+void GazeStreamSender::send(const EyeFrame& frame)
+{
+	m_batch.frames.push_back(frame);
+	if (m_batch.frames.size() >= m_batchSize)
+		flush();
+}
+
+void GazeStreamSender::flush()
+{
+	if (m_batch.frames.empty())
+		return;
+
+	m_batch.sequence = m_packetsSent + 1;
+	m_batch.sendNanoseconds = gazeStreamClockNanoseconds();
+	bool sent = false;
+	if (m_transport == GazeStreamTransport::Udp)
+	{
+		const size_t size = encodeGazePacket(m_batch, m_buffer.data());
+		const auto written = sendto(static_cast<SocketHandle>(m_socket), reinterpret_cast<const char*>(m_buffer.data()), static_cast<int>(size), sendFlags,
+									reinterpret_cast<const sockaddr*>(m_address.data()), static_cast<SocketLength>(m_address.size()));
+		sent = written > 0 && static_cast<size_t>(written) == size;
+		m_bytesSent += sent ? size : 0;
+	}
+	else if (connectIfNeeded())
+	{
+		// Each packet is prefixed with its size, as 2 bytes
+		const size_t size = encodeGazePacket(m_batch, m_buffer.data() + 2);
+		m_buffer[0] = static_cast<uint8_t>(size);
+		m_buffer[1] = static_cast<uint8_t>(size >> 8);
+		const char* data = reinterpret_cast<const char*>(m_buffer.data());
+		size_t left = size + 2;
+		while (left > 0)
+		{
+			const auto written = ::send(static_cast<SocketHandle>(m_socket), data, static_cast<int>(left), sendFlags);
+			if (written <= 0)
+				break;
+			data += written;
+			left -= static_cast<size_t>(written);
+		}
+		sent = left == 0;
+		if (sent)
+			m_bytesSent += size + 2;
+		else
+			closeSocket(); // Reconnect on the next packet (the receiver may have restarted)
+	}
+
+	if (sent)
+		++m_packetsSent;
+	else
+		m_framesDropped += m_batch.frames.size();
+	m_batch.frames.clear();
+}
+
+GazeStreamReceiver::GazeStreamReceiver(const GazeStreamTransport transport, const uint16_t port)
+	: m_transport(transport)
+	, m_buffer(2 * maxGazePacketSize)
+{
+	m_socket = openSocket(transport);
+	const auto s = static_cast<SocketHandle>(m_socket);
+	const int reuse = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	// A larger receive buffer absorbs bursts when the receiver is briefly descheduled
+	const int bufferSize = 4 * 1024 * 1024;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		closeSocketHandle(m_socket);
+		throw "Unable to listen on port " + to_string(port);
+	}
+	if (transport == GazeStreamTransport::Tcp && listen(s, 1) != 0)
+	{
+		closeSocketHandle(m_socket);
+		throw "Unable to listen on port " + to_string(port);
+	}
+}
+
+GazeStreamReceiver::~GazeStreamReceiver()
+{
+	if (m_connection != invalidSocket)
+		closeSocketHandle(m_connection);
+	closeSocketHandle(m_socket);
+}
+
+bool GazeStreamReceiver::receive(GazePacket& packet, const chrono::milliseconds timeout)
+{
+	const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout;
+	while (true)
+	{
+		if (m_transport == GazeStreamTransport::Udp)
+		{
+			if (pollSocket(m_socket, remainingMilliseconds(deadline)) <= 0)
+				return false;
+			const auto size = recv(static_cast<SocketHandle>(m_socket), reinterpret_cast<char*>(m_buffer.data()), static_cast<int>(m_buffer.size()), 0);
+			if (size > 0 && decodeGazePacket(m_buffer.data(), static_cast<size_t>(size), packet))
+				return true;
+			++m_invalidPackets;
+			continue;
+		}
+
+		// TCP: take the next complete packet out of the stream buffer, reading more if needed
+		if (m_buffered >= 2)
+		{
+			const size_t size = m_buffer[0] | (m_buffer[1] << 8);
+			if (size + 2 > m_buffer.size())
+			{
+				// Not our protocol, drop the connection
+				++m_invalidPackets;
+				closeSocketHandle(m_connection);
+				m_connection = invalidSocket;
+				m_buffered = 0;
+				continue;
+			}
+			if (m_buffered >= size + 2)
+			{
+				const bool valid = decodeGazePacket(m_buffer.data() + 2, size, packet);
+				memmove(m_buffer.data(), m_buffer.data() + size + 2, m_buffered - size - 2);
+				m_buffered -= size + 2;
+				if (valid)
+					return true;
+				++m_invalidPackets;
+				continue;
+			}
+		}
+		if (!readStream(deadline))
+			return false;
+	}
+}
+
+bool GazeStreamReceiver::readStream(const chrono::steady_clock::time_point deadline)
+{
+	if (m_connection == invalidSocket)
+	{
+		if (pollSocket(m_socket, remainingMilliseconds(deadline)) <= 0)
+			return false;
+		m_connection = static_cast<intptr_t>(accept(static_cast<SocketHandle>(m_socket), nullptr, nullptr));
+		m_buffered = 0;
+		return m_connection != invalidSocket || chrono::steady_clock::now() < deadline;
+	}
+
+	if (pollSocket(m_connection, remainingMilliseconds(deadline)) <= 0)
+		return false;
+	const auto size = recv(static_cast<SocketHandle>(m_connection), reinterpret_cast<char*>(m_buffer.data() + m_buffered),
+						   static_cast<int>(m_buffer.size() - m_buffered), 0);
+	if (size <= 0)
+	{
+		// The sender disconnected, wait for the next one
+		closeSocketHandle(m_connection);
+		m_connection = invalidSocket;
+		m_buffered = 0;
+		return chrono::steady_clock::now() < deadline;
+	}
+	m_buffered += static_cast<size_t>(size);
+	return true;
+}
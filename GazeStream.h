@@ -0,0 +1,116 @@
+#pragma once
+#include "EyeData.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// This header implements the streaming of eye frames over the network, to another machine (eg. one presenting stimuli) or another process
+//
+// Frames are sent in batches of a few frames per packet, in a compact binary format:
+// - Timestamps and frame ids are delta encoded from one frame to the next, as variable length integers
+// - Gaze directions are quantized to two 16 bit integers each (octahedral encoding, under 0.01 degree of error)
+// - Screen positions and pupil radii are quantized to 16 bit integers, eye states and validity packed in one byte
+// This takes about 25 bytes per frame, instead of about 100 in memory or 150 as CSV.
+//
+// Two transports are available:
+// - UDP, for the lowest latency: each packet is one datagram, and lost packets are simply lost (packets are numbered so receivers notice)
+// - TCP, for reliability: packets are length prefixed on the stream, and the sender reconnects if the connection drops
+//
+// Batching trades latency for fewer packets: a frame waits for the batch to fill before it's sent, so use a batch size of 1 for the lowest latency.
+
+enum class GazeStreamTransport
+{
+	Udp,
+	Tcp,
+};
+
+// Parses "udp" or "tcp", throws otherwise
+GazeStreamTransport parseGazeStreamTransport(const std::string& name);
+
+// Contents of one packet
+struct GazePacket
+{
+	uint64_t sequence = 0;        // Packet counter of the sender, starting from 1
+	uint64_t sendNanoseconds = 0; // Time the packet was sent (steady_clock), only meaningful on the sending machine
+	std::vector<EyeFrame> frames;
+};
+
+// Limits of the packets, so they fit in one UDP datagram without fragmentation on usual networks
+constexpr size_t maxGazePacketFrames = 32;
+constexpr size_t maxGazePacketSize = 1400;
+
+// Binary format of the packets
+// Returns the number of bytes written to the buffer, which needs room for maxGazePacketSize bytes
+size_t encodeGazePacket(const GazePacket& packet, uint8_t* buffer);
+// Returns false if the data isn't a valid packet
+bool decodeGazePacket(const uint8_t* data, size_t size, GazePacket& packet);
+
+// Time base of GazePacket::sendNanoseconds
+uint64_t gazeStreamClockNanoseconds();
+
+class GazeStreamSender
+{
+public:
+	// Frames are sent in batches of batchSize frames, up to maxGazePacketFrames
+	// TCP connects lazily, and reconnects at most once per second while the receiver is unreachable, dropping the frames meanwhile
+	GazeStreamSender(GazeStreamTransport transport, const std::string& host, uint16_t port, size_t batchSize = 4);
+	~GazeStreamSender();
+
+	GazeStreamSender(const GazeStreamSender&) = delete;
+	GazeStreamSender& operator=(const GazeStreamSender&) = delete;
+
+	// Adds a frame to the current batch, and sends the batch once it's full
+	void send(const EyeFrame& frame);
+
+	// Sends the current batch even if it isn't full
+	void flush();
+
+	uint64_t packetsSent() const { return m_packetsSent; }
+	uint64_t bytesSent() const { return m_bytesSent; }
+	uint64_t framesDropped() const { return m_framesDropped; } // Frames that couldn't be sent (no TCP connection, or socket errors)
+
+private:
+	bool connectIfNeeded();
+	void closeSocket();
+
+	GazeStreamTransport m_transport;
+	std::vector<uint8_t> m_address; // Resolved destination, as a sockaddr
+	size_t m_batchSize = 1;
+	GazePacket m_batch;
+	std::vector<uint8_t> m_buffer;
+	intptr_t m_socket = -1;
+	std::chrono::steady_clock::time_point m_nextConnectAttempt;
+	uint64_t m_packetsSent = 0;
+	uint64_t m_bytesSent = 0;
+	uint64_t m_framesDropped = 0;
+};
+
+class GazeStreamReceiver
+{
+public:
+	// Listens on the given port of all interfaces
+	// TCP accepts one sender at a time, and the next one once it disconnects
+	GazeStreamReceiver(GazeStreamTransport transport, uint16_t port);
+	~GazeStreamReceiver();
+
+	GazeStreamReceiver(const GazeStreamReceiver&) = delete;
+	GazeStreamReceiver& operator=(const GazeStreamReceiver&) = delete;
+
+	// Waits up to timeout for the next packet, returns false if none came
+	// Invalid packets are skipped, and counted
+	bool receive(GazePacket& packet, std::chrono::milliseconds timeout);
+
+	uint64_t invalidPackets() const { return m_invalidPackets; }
+
+private:
+	bool readStream(std::chrono::steady_clock::time_point deadline);
+
+	GazeStreamTransport m_transport;
+	intptr_t m_socket = -1;     // UDP socket, or TCP listening socket
+	intptr_t m_connection = -1; // Current TCP connection
+	std::vector<uint8_t> m_buffer;
+	size_t m_buffered = 0;
+	uint64_t m_invalidPackets = 0;
+};
@@ -0,0 +1,176 @@
+// FOVE Gaze Stream Benchmark
+// This streams eye frames with GazeStreamSender to a GazeStreamReceiver over the loopback interface, with each transport and batch size,
+// and measures the end to end latency, the throughput, and the precision lost by the binary encoding
+//
+// Usage: FoveGazeStreamBenchmark [--transport udp|tcp] [--batch N] [--rate Hz] [--port P] [session.csv]
+// Sessions are recorded with `FoveDataExample --record session.csv`. Without a session, a synthetic session is used instead.
+//
+// Each configuration is run twice:
+// - Paced: frames are sent at the given rate (1000Hz by default), and the latency is measured from the time each frame is handed to the sender
+//   to the time it's decoded by the receiver, so it includes the wait for the batch to fill. The latency of the packets alone is also shown.
+// - Flat out: frames are sent as fast as possible, which measures the throughput (UDP drops the packets the receiver can't keep up with)
+
+#include "EyeData.h"
+#include "GazeStream.h"
+#include "Util.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+struct RunResult
+{
+	uint64_t framesSent = 0;
+	uint64_t framesReceived = 0;
+	uint64_t bytesSent = 0;
+	double seconds = 0;                 // From the first frame sent to the last one received
+	vector<double> frameLatenciesUs;    // From handing each frame to the sender, to decoding it
+	vector<double> packetLatenciesUs;   // From sending each packet, to decoding it
+	float maxGazeErrorDegrees = 0;      // Largest error on the combined and per eye gaze directions
+	float maxScreenError = 0;           // Largest error on the screen positions
+	float maxPupilErrorMm = 0;          // Largest error on the pupil radii
+	bool identical = true;              // Whether the fields that are sent exactly (ids, timestamps, states, objects) were
+};
+
+RunResult run(const vector<EyeFrame>& session, const GazeStreamTransport transport, const size_t batchSize, const uint16_t port, const uint64_t frameCount,
+			  const double rateHz)
+{
+	RunResult result;
+	result.framesSent = frameCount;
+	unique_ptr<atomic<uint64_t>[]> handoffNanoseconds(new atomic<uint64_t>[frameCount + 1]());
+	atomic<bool> sendingDone{false};
+	atomic<uint64_t> lastReceiveNanoseconds{0};
+
+	GazeStreamReceiver receiver(transport, port);
+	thread receiverThread([&] {
+		GazePacket packet;
+		while (true)
+		{
+			if (!receiver.receive(packet, chrono::milliseconds{200}))
+			{
+				if (sendingDone.load())
+					break; // Nothing more came since the sender finished
+				continue;
+			}
+			const uint64_t now = gazeStreamClockNanoseconds();
+			lastReceiveNanoseconds = now;
+			result.packetLatenciesUs.push_back((now - packet.sendNanoseconds) / 1000.0);
+			for (const EyeFrame& frame : packet.frames)
+			{
+				if (frame.id == 0 || frame.id > frameCount)
+				{
+					result.identical = false;
+					continue;
+				}
+				++result.framesReceived;
+				result.frameLatenciesUs.push_back((now - handoffNanoseconds[frame.id].load()) / 1000.0);
+
+				const EyeFrame expected = sessionFrame(session, frame.id);
+				result.identical = result.identical && frame.timestamp == expected.timestamp && frame.gazeValid == expected.gazeValid
+								   && frame.eyeState.l == expected.eyeState.l && frame.eyeState.r == expected.eyeState.r && frame.gazedObjectId == expected.gazedObjectId;
+				result.maxGazeErrorDegrees = max({result.maxGazeErrorDegrees, angleBetweenDirections(frame.combinedGaze, expected.combinedGaze),
+												  angleBetweenDirections(frame.gaze.l, expected.gaze.l), angleBetweenDirections(frame.gaze.r, expected.gaze.r)});
+				result.maxScreenError = max({result.maxScreenError, fabs(frame.screenPosition.x - expected.screenPosition.x), fabs(frame.screenPosition.y - expected.screenPosition.y)});
+				result.maxPupilErrorMm = max({result.maxPupilErrorMm, 1000 * fabs(frame.pupilRadius.l - expected.pupilRadius.l), 1000 * fabs(frame.pupilRadius.r - expected.pupilRadius.r)});
+			}
+		}
+	});
+
+	uint64_t start = 0;
+	{
+		GazeStreamSender sender(transport, "127.0.0.1", port, batchSize);
+		const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+		start = gazeStreamClockNanoseconds();
+		for (uint64_t index = 1; index <= frameCount; ++index)
+		{
+			if (rateHz > 0)
+				this_thread::sleep_until(startTime + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(index / rateHz)));
+			handoffNanoseconds[index] = gazeStreamClockNanoseconds();
+			sender.send(sessionFrame(session, index));
+		}
+		sender.flush();
+		result.bytesSent = sender.bytesSent();
+	}
+	sendingDone = true;
+	receiverThread.join();
+	result.seconds = (lastReceiveNanoseconds.load() - start) / 1e9;
+	return result;
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	vector<GazeStreamTransport> transports{GazeStreamTransport::Udp, GazeStreamTransport::Tcp};
+	vector<size_t> batchSizes{1, 4, 16};
+	double rateHz = 1000;
+	uint16_t port = 47810;
+	vector<EyeFrame> session;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string arg = argv[i];
+		if (arg == "--transport" && i + 1 < argc)
+			transports = {parseGazeStreamTransport(argv[++i])};
+		else if (arg == "--batch" && i + 1 < argc)
+			batchSizes = {clamp<size_t>(stoul(argv[++i]), 1, maxGazePacketFrames)};
+		else if (arg == "--rate" && i + 1 < argc)
+			rateHz = max(stod(argv[++i]), 1.0);
+		else if (arg == "--port" && i + 1 < argc)
+			port = static_cast<uint16_t>(stoul(argv[++i]));
+		else
+			session = readEyeSession(arg);
+	}
+	if (session.empty())
+	{
+		cout << "No session given, using a synthetic session\n";
+		session = generateEyeSession(1, 60.0f);
+	}
+
+	cout << fixed << setprecision(1) << "Paced at " << rateHz << "Hz, latencies in microseconds\n\n"
+		 << "Transport  Batch  Bytes/frame  Packet p50  Frame p50  Frame p99   Lost  |  Flat out frames/s      MB/s  Lost\n";
+	RunResult worst;
+	for (const GazeStreamTransport transport : transports)
+	{
+		for (const size_t batchSize : batchSizes)
+		{
+			const RunResult paced = run(session, transport, batchSize, port, static_cast<uint64_t>(2 * rateHz), rateHz);
+			const RunResult flatOut = run(session, transport, batchSize, port, 200'000, 0);
+			worst.maxGazeErrorDegrees = max({worst.maxGazeErrorDegrees, paced.maxGazeErrorDegrees, flatOut.maxGazeErrorDegrees});
+			worst.maxScreenError = max({worst.maxScreenError, paced.maxScreenError, flatOut.maxScreenError});
+			worst.maxPupilErrorMm = max({worst.maxPupilErrorMm, paced.maxPupilErrorMm, flatOut.maxPupilErrorMm});
+			worst.identical = worst.identical && paced.identical && flatOut.identical;
+
+			cout << left << setw(9) << (transport == GazeStreamTransport::Udp ? "UDP" : "TCP") << right << setw(7) << batchSize
+				 << setw(13) << static_cast<double>(paced.bytesSent) / paced.framesSent << setw(12) << percentile(paced.packetLatenciesUs, 0.5)
+				 << setw(11) << percentile(paced.frameLatenciesUs, 0.5) << setw(11) << percentile(paced.frameLatenciesUs, 0.99)
+				 << setw(7) << paced.framesSent - paced.framesReceived << "  |" << setw(19) << setprecision(0) << flatOut.framesReceived / flatOut.seconds
+				 << setw(10) << setprecision(1) << flatOut.bytesSent / flatOut.seconds / 1e6 << setw(5) << setprecision(1)
+				 << 100.0 * (flatOut.framesSent - flatOut.framesReceived) / flatOut.framesSent << "%\n";
+		}
+	}
+
+	cout << setprecision(4) << "\nEncoding error: gaze " << worst.maxGazeErrorDegrees << " degrees, screen position " << worst.maxScreenError
+		 << ", pupil radius " << worst.maxPupilErrorMm << "mm\n"
+		 << "Ids, timestamps, eye states and object ids: " << (worst.identical ? "exact" : "ERROR: some differ") << '\n';
+	return worst.identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
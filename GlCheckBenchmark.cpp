@@ -0,0 +1,153 @@
+// FOVE GL Check Benchmark
+// This measures the CPU cost of the GL error checking policies of glCall (see GlCheckPolicy in OpenGLUtil.h)
+// The policy is picked at compile time, so the OpenGL example is built once more per policy (FoveOpenGLExample<Policy>Checks, see CMakeLists.txt)
+// This runs the headless mode of each of them (`FoveOpenGLExample --headless`), which renders the real frames of the example offscreen,
+// and reports the CPU time spent issuing them, then checks that the PerFrame and Async policies still report a failing call
+//
+// Usage: FoveGlCheckBenchmark [frameCount] [eyeWidth eyeHeight]
+// Like `FoveOpenGLExample --headless`, this needs no headset, window or display server (eg. Mesa llvmpipe on a server)
+// The example itself is built with a given policy by setting FOVE_OPENGL_CHECKS in CMake
+
+#include "NativeUtil.h"
+#include "OpenGLUtil.h"
+#include "Util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+// Runs the headless mode of the example built with one of the policies, and returns the CPU time it took to issue a frame, in microseconds
+double exampleCpuMicrosecondsPerFrame(const filesystem::path& example, const int frameCount, const Fove::Vec2i resolution)
+{
+	if (!filesystem::exists(example))
+		throw "Missing " + example.string() + ", which is built along with this benchmark";
+
+	const string command = '"' + example.string() + "\" --headless " + to_string(frameCount) + ' ' + to_string(resolution.x) + ' ' + to_string(resolution.y) + " 2>&1";
+	FILE* const pipe = popen(command.c_str(), "r");
+	if (!pipe)
+		throw "Unable to run " + example.string();
+	string output;
+	char buffer[256];
+	while (fgets(buffer, sizeof(buffer), pipe))
+		output += buffer;
+	const int status = pclose(pipe);
+
+	// The example reports "CPU submission: <ms> ms/frame", which doesn't count the time the GPU takes to catch up
+	constexpr const char* cpuLine = "CPU submission: ";
+	const size_t found = output.find(cpuLine);
+	if (status != 0 || found == string::npos)
+		throw example.filename().string() + " failed:\n" + output;
+	return stod(output.substr(found + strlen(cpuLine))) * 1000;
+}
+
+// Returns the average cost of one cheap GL call (binding no buffer) with the given policy, in nanoseconds
+template <GlCheckPolicy Policy>
+double nanosecondsPerCall()
+{
+	constexpr int callCount = 200000;
+	const auto start = chrono::steady_clock::now();
+	for (int i = 0; i < callCount; ++i)
+		glCallWithPolicy<Policy>(glBindBuffer, (GLenum)GL_ARRAY_BUFFER, 0u);
+	if constexpr (Policy == GlCheckPolicy::PerFrame)
+		glCheckDeferredErrors();
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / callCount;
+}
+
+} // namespace
+
+// Entry point, invoked by main() in LinuxUtil.cpp
+void programMain(NativeLaunchInfo nativeLaunchInfo)
+{
+	try
+	{
+		const vector<string> args = getCommandLineArgs(nativeLaunchInfo);
+		const int frameCount = args.size() > 0 ? stoi(args[0]) : 2000;
+		const Fove::Vec2i resolution = args.size() > 2 ? Fove::Vec2i{stoi(args[1]), stoi(args[2])} : Fove::Vec2i{256, 256};
+		if (frameCount <= 0 || resolution.x <= 0 || resolution.y <= 0)
+			throw "Invalid arguments"s;
+
+		// The policy variants of the example are built next to this benchmark
+		const filesystem::path directory = filesystem::read_symlink("/proc/self/exe").parent_path();
+		cout << "Issuing " << frameCount << " frames of the OpenGL example at " << resolution.x << "x" << resolution.y << " per eye\n"
+			 << "Policy      CPU us/frame\n"
+			 << flush;
+		for (const char* const policy : {"None", "Full", "PerFrame", "Async"})
+		{
+			const double usPerFrame = exampleCpuMicrosecondsPerFrame(directory / ("FoveOpenGLExample"s + policy + "Checks"), frameCount, resolution);
+			cout << left << setw(12) << policy << right << fixed << setprecision(1) << setw(12) << usPerFrame << endl;
+		}
+
+		// The cost of a single call, and the error reports, are measured here, with all the policies in one context
+		[[maybe_unused]] const NativeOpenGLContext nativeOpenGLContext = createHeadlessOpenGLContext();
+		cout << "\nRenderer: " << (const char*)glGetString(GL_RENDERER) << '\n'
+			 << "Policy                      ns/call\n";
+		const auto Report = [&](const char* const name, auto policy) {
+			constexpr GlCheckPolicy Policy = decltype(policy)::value;
+			cout << left << setw(28) << name << right << fixed << setprecision(1) << setw(7) << nanosecondsPerCall<Policy>() << endl;
+		};
+		Report("None", integral_constant<GlCheckPolicy, GlCheckPolicy::None>());
+		Report("Full", integral_constant<GlCheckPolicy, GlCheckPolicy::Full>());
+		Report("PerFrame", integral_constant<GlCheckPolicy, GlCheckPolicy::PerFrame>());
+
+		// The callbacks stay installed once they are, so these go last
+		const bool callback = installGlErrorCallback();
+		Report(callback ? "PerFrame + KHR_debug" : "PerFrame (no KHR_debug)", integral_constant<GlCheckPolicy, GlCheckPolicy::PerFrame>());
+
+		// Make a call fail in the middle of a frame, and check that the end of frame check reports it, and names it if KHR_debug is available
+		glCallWithPolicy<GlCheckPolicy::PerFrame>(glBindBuffer, (GLenum)GL_ARRAY_BUFFER, 0u);
+		glCallWithPolicy<GlCheckPolicy::PerFrame>(glBindBuffer, (GLenum)0x1234, 0u);
+		glCallWithPolicy<GlCheckPolicy::PerFrame>(glBindBuffer, (GLenum)GL_ARRAY_BUFFER, 0u);
+		string report;
+		try
+		{
+			glCheckDeferredErrors();
+		}
+		catch (...)
+		{
+			report = currentExceptionMessage();
+		}
+		const bool reported = !report.empty() && (!callback || report.find("glBindBuffer") != string::npos);
+		cout << "\nDeferred check of a failing glBindBuffer: " << (reported ? "ok" : "ERROR: not reported") << '\n' << report << endl;
+		if (!reported)
+			exit(EXIT_FAILURE);
+
+		// Same with the asynchronous debug log, which reports the failing call from its own thread, tagged with its debug group
+		if (!installGlDebugLog())
+			return;
+		Report("\nAsync + KHR_debug log", integral_constant<GlCheckPolicy, GlCheckPolicy::Async>());
+		const uint64_t errorsBefore = glDebugLogStats().errors;
+		{
+			const GlDebugGroup debugGroup("Failure test");
+			glBindBuffer((GLenum)0x1234, 0u);
+		}
+		glFinish();
+		this_thread::sleep_for(chrono::milliseconds{50}); // Let the log thread print it
+		while (glGetError() != GL_NO_ERROR) // The error is still set, clear it for the cleanup, which checks errors
+		{
+		}
+		const GlDebugLogStats stats = glDebugLogStats();
+		cout << "Asynchronous report of a failing glBindBuffer: " << (stats.errors > errorsBefore ? "ok" : "ERROR: not reported") << " (" << stats.messages
+			 << " messages, " << stats.dropped << " dropped)" << endl;
+		if (stats.errors == errorsBefore)
+			exit(EXIT_FAILURE);
+	}
+	catch (...)
+	{
+		// If an exception is thrown for any reason, log it and exit
+		cerr << "Error: " << currentExceptionMessage() << endl;
+		exit(EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,341 @@
+#include "GlCulling.h"
+#include <cmath>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+bool GlSceneCuller::isSupported()
+{
+#ifdef GL_DRAW_INDIRECT_BUFFER
+	return hasGlExtensions({"GL_ARB_compute_shader", "GL_ARB_shader_storage_buffer_object", "GL_ARB_multi_draw_indirect", "GL_ARB_base_instance",
+							"GL_ARB_shader_image_load_store", "GL_ARB_texture_storage", "GL_ARB_clear_buffer_object"});
+#else
+	return false; // Not even in the headers (eg. macOS, which stops at GL 4.1)
+#endif
+}
+
+#ifdef GL_DRAW_INDIRECT_BUFFER
+
+namespace
+{
+
+// Bindings used while culling
+constexpr GLuint cullUniformsBinding = 1;
+constexpr GLuint boundsBinding = 2;
+constexpr GLuint commandsBinding = 3;
+constexpr GLuint visibleBinding = 4;
+
+// The visible buffer starts with the count of visible objects, padded to 16 bytes, followed by their draw commands
+constexpr GLintptr visibleCommandsOffset = 16;
+
+// Layout of the Cull uniform block of the culling shader (std140)
+struct CullUniforms
+{
+	float clip[2][16];
+	float planes[12][4];
+	GLint viewports[2][4];
+	GLuint objectCount;
+	GLint hizLevels;
+	GLuint padding[2];
+};
+
+// Culling shader source, one invocation per object
+// The binding of the Objects block is inserted in front of the rest of the source, which is that of the scene shader
+const char* const cullSrc = "	readonly buffer Objects\n"                                               // Data of every object (SceneObjectData)
+							"{\n"                                                                         //
+							"	Object objects[];\n"                                                       //
+							"};\n"                                                                        //
+							"layout(std430, binding = 2) readonly buffer Bounds\n"                        // Bounding sphere of every object
+							"{\n"                                                                         //
+							"	vec4 bounds[];\n"                                                          // Center and radius
+							"};\n"                                                                        //
+							"struct Command\n"                                                            // Same as DrawArraysIndirectCommand
+							"{\n"                                                                         //
+							"	uint vertexCount;\n"                                                       //
+							"	uint instanceCount;\n"                                                     //
+							"	uint firstVertex;\n"                                                       //
+							"	uint firstInstance;\n"                                                     //
+							"};\n"                                                                        //
+							"layout(std430, binding = 3) readonly buffer Commands\n"                      // Draw command of every object
+							"{\n"                                                                         //
+							"	Command commands[];\n"                                                     //
+							"};\n"                                                                        //
+							"layout(std430, binding = 4) buffer Visible\n"                                // Output, draw commands of the visible objects
+							"{\n"                                                                         //
+							"	uint visibleCount;\n"                                                      // Count, which the draw reads as its parameter
+							"	uint padding[3];\n"                                                        //
+							"	Command visibleCommands[];\n"                                              //
+							"};\n"                                                                        //
+							"layout(std140, row_major, binding = 1) uniform Cull\n"                       // Per-frame uniforms
+							"{\n"                                                                         //
+							"	mat4 clip[2];\n"                                                           // World to clip space, for each eye
+							"	vec4 planes[12];\n"                                                        // Frustum planes of each eye, in world space
+							"	ivec4 viewports[2];\n"                                                     // Viewport of each eye in the depth buffer of the Hi-Z pyramid
+							"	uint objectCount;\n"                                                       //
+							"	int hizLevels;\n"                                                          // 0 without occlusion culling
+							"};\n"                                                                        //
+							"layout(binding = 0) uniform sampler2D hiz;\n"                                // Hi-Z pyramid, farthest depth of the previous frame
+							"bool isOccluded(vec3 center, float radius, int eye)\n"                       // Whether a sphere is behind the previous depth of an eye
+							"{\n"                                                                         //
+							"	vec3 lo = vec3(1e30);\n"                                                   // Bounds of the projected bounding box of the sphere
+							"	vec3 hi = vec3(-1e30);\n"                                                  //
+							"	for (int i = 0; i < 8; ++i)\n"                                             //
+							"	{\n"                                                                       //
+							"		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);\n"
+							"		vec4 p = clip[eye] * vec4(corner, 1.0);\n"                             //
+							"		if (p.w <= 0.0)\n"                                                     // Reaches behind the eye, can't be projected
+							"			return false;\n"                                                   //
+							"		lo = min(lo, p.xyz / p.w);\n"                                          //
+							"		hi = max(hi, p.xyz / p.w);\n"                                          //
+							"	}\n"                                                                       //
+							"	vec2 size = vec2(viewports[eye].zw);\n"                                    // Covered pixels of the depth buffer
+							"	ivec2 first = viewports[eye].xy + ivec2(clamp((lo.xy * 0.5 + 0.5) * size, vec2(0.0), size - 1.0));\n"
+							"	ivec2 last = viewports[eye].xy + ivec2(clamp((hi.xy * 0.5 + 0.5) * size, vec2(0.0), size - 1.0));\n"
+							"	ivec2 span = last - first + 1;\n"                                          // Level where they span at most 2x2 texels
+							"	int level = clamp(int(ceil(log2(float(max(span.x, span.y))))) - 1, 0, hizLevels - 1);\n"
+							"	ivec2 levelLast = max(textureSize(hiz, 0) >> level, 1) - 1;\n"             // Not textureSize(hiz, level), which llvmpipe gets wrong when the level varies
+							"	first = min(first >> (level + 1), levelLast);\n"                            //
+							"	last = min(last >> (level + 1), levelLast);\n"                              //
+							"	float farthest = max(max(texelFetch(hiz, first, level).r, texelFetch(hiz, ivec2(last.x, first.y), level).r),\n"
+							"						 max(texelFetch(hiz, ivec2(first.x, last.y), level).r, texelFetch(hiz, last, level).r));\n"
+							"	return lo.z * 0.5 + 0.5 > farthest;\n"                                     // Nearest depth of the sphere, with the default depth range
+							"}\n"                                                                         //
+							"void main(void)\n"                                                           //
+							"{\n"                                                                         //
+							"	uint i = gl_GlobalInvocationID.x;\n"                                       //
+							"	if (i >= objectCount)\n"                                                   //
+							"		return;\n"                                                             //
+							"	mat4 model = objects[i].model;\n"                                          // Bounding sphere in world space
+							"	vec3 center = (model * vec4(bounds[i].xyz, 1.0)).xyz;\n"                   //
+							"	float scale = max(max(dot(model[0].xyz, model[0].xyz), dot(model[1].xyz, model[1].xyz)), dot(model[2].xyz, model[2].xyz));\n"
+							"	float radius = bounds[i].w * sqrt(scale);\n"                               //
+							"	bool visible = false;\n"                                                   // Visible if either eye can see it
+							"	for (int eye = 0; eye < 2 && !visible; ++eye)\n"                           //
+							"	{\n"                                                                       //
+							"		bool inside = true;\n"                                                 //
+							"		for (int p = eye * 6; p < eye * 6 + 6; ++p)\n"                         //
+							"			inside = inside && dot(planes[p].xyz, center) + planes[p].w >= -radius;\n"
+							"		visible = inside && (hizLevels == 0 || !isOccluded(center, radius, eye));\n"
+							"	}\n"                                                                       //
+							"	if (visible)\n"                                                            // Append the draw command
+							"		visibleCommands[atomicAdd(visibleCount, 1u)] = commands[i];\n"         //
+							"}";
+
+// Hi-Z pyramid shader sources, one invocation per texel of a level, which is the farthest depth of the texels below it in the previous level
+// The first level reads the depth texture, the next ones the previous level of the pyramid
+const char* const hizFromDepthSrc = "layout(binding = 0) uniform sampler2D source;\n"
+									"float load(ivec2 p) { return texelFetch(source, p, 0).r; }\n"
+									"ivec2 sourceSize() { return textureSize(source, 0); }\n";
+const char* const hizDownsampleSrc = "layout(r32f, binding = 1) uniform readonly image2D source;\n"
+									 "float load(ivec2 p) { return imageLoad(source, p).r; }\n"
+									 "ivec2 sourceSize() { return imageSize(source); }\n";
+const char* const hizSrc = "layout(r32f, binding = 0) uniform writeonly image2D destination;\n"
+						   "void main(void)\n"
+						   "{\n"
+						   "	ivec2 p = ivec2(gl_GlobalInvocationID.xy);\n"
+						   "	ivec2 size = imageSize(destination);\n"
+						   "	if (any(greaterThanEqual(p, size)))\n"
+						   "		return;\n"
+						   "	ivec2 last = min(p * 2 + 1 + ivec2(equal(p, size - 1)) * (sourceSize() & 1), sourceSize() - 1);\n" // The last row and column also cover the odd one out
+						   "	float depth = 0.0;\n"
+						   "	for (int y = p.y * 2; y <= last.y; ++y)\n"
+						   "		for (int x = p.x * 2; x <= last.x; ++x)\n"
+						   "			depth = max(depth, load(ivec2(x, y)));\n"
+						   "	imageStore(destination, p, vec4(depth));\n"
+						   "}";
+
+GlResource<GlResourceType::Program> createComputeProgram(const string& source)
+{
+	// Returns the info log of a shader or program, with the given getters
+	const auto Log = [](const GLuint object, const auto getiv, const auto getInfoLog) {
+		GLint length = 0;
+		glCall(getiv, object, GL_INFO_LOG_LENGTH, &length);
+		string log(max(length, 1), '\0');
+		glCall(getInfoLog, object, length, &length, &log[0]);
+		log.resize(length);
+		return log;
+	};
+
+	GlResource<GlResourceType::Shader> shader;
+	shader.create(GL_COMPUTE_SHADER);
+	const char* const src = source.c_str();
+	glCall(glShaderSource, shader, 1, &src, nullptr);
+	glCall(glCompileShader, shader);
+	GLint isCompiled = GL_FALSE;
+	glCall(glGetShaderiv, shader, GL_COMPILE_STATUS, &isCompiled);
+	if (isCompiled == GL_FALSE)
+		throw "Failed to compile compute shader: " + Log(shader, glGetShaderiv, glGetShaderInfoLog);
+
+	GlResource<GlResourceType::Program> program;
+	program.create();
+	glCall(glAttachShader, program, shader);
+	glCall(glLinkProgram, program);
+	GLint isLinked = GL_FALSE;
+	glCall(glGetProgramiv, program, GL_LINK_STATUS, &isLinked);
+	if (isLinked == GL_FALSE)
+		throw "Failed to link compute shader: " + Log(program, glGetProgramiv, glGetProgramInfoLog);
+	glCall(glDetachShader, program, shader);
+	return program;
+}
+
+} // namespace
+
+GlSceneCuller::GlSceneCuller(const vector<SceneObject>& objects, const GLuint objectBufferBinding)
+	: objectCount_(objects.size())
+	, drawCount_(hasGlExtension("GL_ARB_indirect_parameters"))
+{
+	// The culling shader reads the data of the objects with the same declaration as the scene shader
+	const string version = "#version 430\n";
+	cullProgram_ = createComputeProgram(version + "layout(local_size_x = 64) in;\n"
+										"struct Object\n"
+										"{\n"
+										"	mat4 model;\n"
+										"	float highlight;\n"
+										"};\n"
+										"layout(std430, row_major, binding = " +
+										to_string(objectBufferBinding) + ")" + cullSrc);
+	hizFromDepthProgram_ = createComputeProgram(version + "layout(local_size_x = 8, local_size_y = 8) in;\n" + hizFromDepthSrc + hizSrc);
+	hizDownsampleProgram_ = createComputeProgram(version + "layout(local_size_x = 8, local_size_y = 8) in;\n" + hizDownsampleSrc + hizSrc);
+
+	// Upload the bounds and draw commands, which only change through setCommands()
+	vector<float> bounds;
+	bounds.reserve(objects.size() * 4);
+	for (const SceneObject& object : objects)
+		bounds.insert(bounds.end(), {object.bounds.center.x, object.bounds.center.y, object.bounds.center.z, object.bounds.radius});
+	bounds_.createAndBind(GL_SHADER_STORAGE_BUFFER);
+	glCall(glBufferData, GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(sizeof(float) * bounds.size()), bounds.data(), GL_STATIC_DRAW);
+	const vector<DrawArraysIndirectCommand> commands = sceneDrawCommands(objects);
+	commands_.createAndBind(GL_SHADER_STORAGE_BUFFER);
+	glCall(glBufferData, GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size()), commands.data(), GL_DYNAMIC_DRAW);
+	visible_.createAndBind(GL_SHADER_STORAGE_BUFFER);
+	glCall(glBufferData, GL_SHADER_STORAGE_BUFFER, visibleCommandsOffset + (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size()), nullptr, GL_DYNAMIC_DRAW);
+
+	uniforms_ = GlStreamBuffer(GL_UNIFORM_BUFFER, sizeof(CullUniforms));
+}
+
+void GlSceneCuller::setCommands(const vector<DrawArraysIndirectCommand>& commands)
+{
+	if (commands.size() != objectCount_)
+		throw "Wrong number of draw commands";
+	commands_.bind(GL_SHADER_STORAGE_BUFFER);
+	glCall(glBufferSubData, GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size()), commands.data());
+}
+
+void GlSceneCuller::setOcclusion(const bool enabled)
+{
+	occlusion_ = enabled;
+	hizValid_ = false; // Whatever the pyramid holds is out of date
+}
+
+void GlSceneCuller::cull(const Fove::Stereo<Fove::Matrix44>& clipMatrices)
+{
+	const GlDebugGroup debugGroup("Culling");
+
+	// Update the uniforms of this frame
+	CullUniforms uniforms = {};
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		const Fove::Matrix44& clip = eye == 0 ? clipMatrices.l : clipMatrices.r;
+		memcpy(uniforms.clip[eye], clip.mat, sizeof(uniforms.clip[eye]));
+		const Frustum frustum = frustumFromClipMatrix(clip);
+		memcpy(uniforms.planes[eye * 6], frustum.planes, sizeof(frustum.planes));
+		memcpy(uniforms.viewports[eye], hizViewports_[eye], sizeof(uniforms.viewports[eye]));
+	}
+	uniforms.objectCount = static_cast<GLuint>(objectCount_);
+	uniforms.hizLevels = occlusion_ && hizValid_ ? hizLevels_ : 0;
+	uniforms_.beginRegion();
+	uniforms_.bindRange(cullUniformsBinding, uniforms_.write(&uniforms, sizeof(uniforms)), sizeof(uniforms));
+
+	// Reset the count of visible objects
+	// Without ARB_indirect_parameters, every command is drawn, so the ones left over from the previous frame are reset to no instance too
+	visible_.bind(GL_SHADER_STORAGE_BUFFER);
+	const GLsizeiptr resetSize = drawCount_ ? sizeof(GLuint) : visibleCommandsOffset + (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * objectCount_);
+	glCall(glClearBufferSubData, GL_SHADER_STORAGE_BUFFER, GL_R32UI, (GLintptr)0, resetSize, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	// Cull, then make the commands visible to the draws
+	glCall(glBindBufferBase, GL_SHADER_STORAGE_BUFFER, boundsBinding, bounds_);
+	glCall(glBindBufferBase, GL_SHADER_STORAGE_BUFFER, commandsBinding, commands_);
+	glCall(glBindBufferBase, GL_SHADER_STORAGE_BUFFER, visibleBinding, visible_);
+	if (uniforms.hizLevels > 0)
+	{
+		glStateCache().activeTexture(GL_TEXTURE0);
+		hiz_.bind(GL_TEXTURE_2D);
+	}
+	cullProgram_.bind();
+	glCall(glDispatchCompute, (GLuint)((objectCount_ + 63) / 64), 1u, 1u);
+	glCall(glMemoryBarrier, (GLbitfield)GL_COMMAND_BARRIER_BIT);
+	uniforms_.endRegion();
+}
+
+void GlSceneCuller::draw() const
+{
+	visible_.bind(GL_DRAW_INDIRECT_BUFFER);
+	if (drawCount_)
+	{
+		visible_.bind(GL_PARAMETER_BUFFER_ARB);
+		glCall(glMultiDrawArraysIndirectCountARB, GL_TRIANGLES, (const void*)visibleCommandsOffset, (GLintptr)0, (GLsizei)objectCount_, 0);
+	}
+	else
+	{
+		glCall(glMultiDrawArraysIndirect, GL_TRIANGLES, (const void*)visibleCommandsOffset, (GLsizei)objectCount_, 0);
+	}
+}
+
+void GlSceneCuller::buildOcclusion(const GLuint depthTexture, const Fove::Vec2i singleEyeResolution, const EyeViewport& eyeViewport)
+{
+	if (!occlusion_)
+		return;
+	const GlDebugGroup debugGroup("Hi-Z pyramid");
+
+	// (Re)allocate the pyramid, whose first level is half the size of the depth texture (which is two eyes wide), down to 1x1
+	const Fove::Vec2i size{max(1, singleEyeResolution.x), max(1, singleEyeResolution.y / 2)};
+	if (!hiz_ || size.x != hizSize_.x || size.y != hizSize_.y)
+	{
+		hiz_.clear();
+		hiz_.createAndBind(GL_TEXTURE_2D);
+		hizSize_ = size;
+		hizLevels_ = static_cast<int>(log2(max(size.x, size.y))) + 1;
+		glCall(glTexStorage2D, GL_TEXTURE_2D, hizLevels_, GL_R32F, size.x, size.y);
+	}
+
+	// The objects of the next frame are projected to the viewports of this one, since that's where the depth comes from
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		hizViewports_[eye][0] = (eye == 0 ? 0 : singleEyeResolution.x) + eyeViewport.offset.x;
+		hizViewports_[eye][1] = eyeViewport.offset.y;
+		hizViewports_[eye][2] = eyeViewport.size.x;
+		hizViewports_[eye][3] = eyeViewport.size.y;
+	}
+
+	// Reduce the depth texture into the first level, then each level into the next
+	glStateCache().activeTexture(GL_TEXTURE0);
+	glStateCache().bindTexture(GL_TEXTURE_2D, depthTexture);
+	hizFromDepthProgram_.bind();
+	for (int level = 0; level < hizLevels_; ++level)
+	{
+		if (level == 1)
+			hizDownsampleProgram_.bind();
+		if (level > 0)
+		{
+			glCall(glMemoryBarrier, (GLbitfield)GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			glCall(glBindImageTexture, 1u, hiz_, level - 1, (GLboolean)GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		}
+		glCall(glBindImageTexture, 0u, hiz_, level, (GLboolean)GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		const Fove::Vec2i levelSize{max(1, hizSize_.x >> level), max(1, hizSize_.y >> level)};
+		glCall(glDispatchCompute, (GLuint)((levelSize.x + 7) / 8), (GLuint)((levelSize.y + 7) / 8), 1u);
+	}
+	glCall(glMemoryBarrier, (GLbitfield)GL_TEXTURE_FETCH_BARRIER_BIT);
+	hizValid_ = true;
+}
+
+GLuint GlSceneCuller::visibleCount() const
+{
+	GLuint ret = 0;
+	glCall(glMemoryBarrier, (GLbitfield)GL_BUFFER_UPDATE_BARRIER_BIT);
+	visible_.bind(GL_SHADER_STORAGE_BUFFER);
+	glCall(glGetBufferSubData, GL_SHADER_STORAGE_BUFFER, (GLintptr)0, (GLsizeiptr)sizeof(ret), &ret);
+	return ret;
+}
+
+#endif
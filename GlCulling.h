@@ -0,0 +1,78 @@
+#pragma once
+#include "DynamicResolution.h"
+#include "OpenGLUtil.h"
+#include "SceneObjects.h"
+#include <vector>
+
+// This header implements the culling of the scene objects on the GPU, for the multi-draw path of the OpenGL example (see SceneObjects.h)
+//
+// Every frame, a compute shader tests the bounding sphere of each object against the frusta of both eyes at once,
+// and appends the draw command of every object that either eye can see to a compacted indirect buffer, along with their count.
+// Each eye then draws that buffer with glMultiDrawArraysIndirectCountARB, so the count never has to come back to the CPU.
+// An object seen by one eye only is drawn for both, which costs little since the eyes see almost the same thing, and halves the culling work.
+//
+// Occlusion culling is optional: after a frame, its depth buffer is reduced to a Hi-Z pyramid, each texel holding the farthest depth below it,
+// and the next frame compares the nearest depth of each object with the level of the pyramid where the object covers at most 2x2 texels.
+// Since that depth is the one of the previous frame, an object being uncovered (eg. when turning the head fast) can appear one frame late,
+// which is why it's off by default.
+//
+// This needs GL 4.3 (compute shaders, shader storage buffers and indirect draws) and image load/store.
+// Without ARB_indirect_parameters, the compacted buffer is drawn whole instead, its commands past the count having no instance.
+// Only the OpenGL example culls this way, the Vulkan example still draws the indirect commands of every object.
+class GlSceneCuller
+{
+public:
+	GlSceneCuller() {}
+
+	// Uploads the bounds and draw commands of the objects (see sceneDrawCommands), which then only move through the model matrix in their data
+	// objectBufferBinding is the shader storage binding of the data of the objects (SceneObjectData), which cull() reads the model matrices from
+	GlSceneCuller(const std::vector<SceneObject>& objects, GLuint objectBufferBinding);
+
+	// Whether the current GL context supports the culling
+	static bool isSupported();
+
+	// Replaces the draw command of each object, for instance to draw another level of detail (see LevelOfDetail.h)
+	// Each object must keep its first instance, which is its index
+	void setCommands(const std::vector<DrawArraysIndirectCommand>& commands);
+
+	// Enables or disables the occlusion culling, which is disabled by default
+	void setOcclusion(bool enabled);
+	bool occlusion() const { return occlusion_; }
+
+	// Culls the objects against the frusta of both eyes (clip matrices of the world, row-major like Fove::Matrix44)
+	// The data of the objects must be bound to objectBufferBinding. This uses uniform binding 1, and shader storage bindings 2 to 4 during the call
+	void cull(const Fove::Stereo<Fove::Matrix44>& clipMatrices);
+
+	// Draws the objects which passed the last cull(), with the scene shader and vertex array bound, once per eye
+	void draw() const;
+
+	// Builds the Hi-Z pyramid of the occlusion culling of the next frame, from the depth texture of the frame which was just drawn
+	// Like the render surfaces of the example, the depth texture holds the left eye on its left half and the right eye on its right half,
+	// each drawn to eyeViewport within its half
+	void buildOcclusion(GLuint depthTexture, Fove::Vec2i singleEyeResolution, const EyeViewport& eyeViewport);
+
+	// Returns the number of objects which passed the last cull()
+	// This reads it back from the GPU, waiting for the culling to finish, so it's meant for statistics and benchmarks only
+	GLuint visibleCount() const;
+
+	size_t objectCount() const { return objectCount_; }
+
+private:
+	size_t objectCount_ = 0;
+	bool drawCount_ = false; // Whether ARB_indirect_parameters is supported
+	bool occlusion_ = false;
+	GlResource<GlResourceType::Program> cullProgram_;
+	GlResource<GlResourceType::Program> hizFromDepthProgram_; // First level of the pyramid, from the depth texture
+	GlResource<GlResourceType::Program> hizDownsampleProgram_; // Next levels, from the previous level
+	GlResource<GlResourceType::Buffer> bounds_;   // Bounding sphere of each object (center and radius)
+	GlResource<GlResourceType::Buffer> commands_; // Draw command of each object
+	GlResource<GlResourceType::Buffer> visible_;  // Count of the visible objects, then their draw commands, compacted
+	GlStreamBuffer uniforms_;
+
+	// Hi-Z pyramid, along with the viewports of the frame it was built from, which are those to project the objects with
+	GlResource<GlResourceType::Texture> hiz_;
+	Fove::Vec2i hizSize_{};
+	int hizLevels_ = 0;
+	bool hizValid_ = false; // Whether the pyramid holds the depth of the previous frame
+	GLint hizViewports_[2][4] = {};
+};
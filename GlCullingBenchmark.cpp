@@ -0,0 +1,437 @@
+// FOVE GL Culling Benchmark
+// This measures the GPU culling of GlCulling.h on a scene much bigger than the level of the examples: the objects of the level,
+// scattered over a large area with random orientations and sizes, 100k of them by default, each with its own model matrix (see SceneObjects.h)
+// The same frames are rendered without culling, with frustum culling on the CPU, then with the GPU culling, without and with occlusion culling,
+// and the frame times and number of objects drawn are reported. Finally, it checks that the GPU and CPU agree on the visible objects,
+// and that the culling doesn't change the rendered image
+//
+// Usage: FoveGlCullingBenchmark [objectCount] [frameCount] [eyeWidth eyeHeight]
+// Like `FoveOpenGLExample --headless`, this needs no headset, window or display server (eg. Mesa llvmpipe on a server)
+
+#include "GlCulling.h"
+#include "Model.h"
+#include "NativeUtil.h"
+#include "OpenGLUtil.h"
+#include "SceneObjects.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+// Vertex format size
+constexpr size_t floatsPerVert = 7;
+
+// Shader storage buffer binding point of the data of the objects
+constexpr GLuint objectBufferBinding = 1;
+
+// Number of draw commands per glMultiDrawArraysIndirect of the frames culled on the CPU or not culled
+constexpr GLsizei drawBatchSize = 1000;
+
+// Same shaders as the multi-draw path of the OpenGL example, but with a plain uniform for the clip matrix
+const char* const sceneVertSrc = "#version 430\n"
+								 "uniform mat4 mvp;\n"
+								 "struct Object\n"
+								 "{\n"
+								 "	mat4 model;\n"
+								 "	float highlight;\n"
+								 "};\n"
+								 "layout(std430, row_major, binding = 1) readonly buffer Objects\n"
+								 "{\n"
+								 "	Object objects[];\n"
+								 "};\n"
+								 "in vec4 pos;\n"
+								 "in vec3 color;\n"
+								 "in uint objectIndex;\n"
+								 "out vec3 fragColor;\n"
+								 "void main(void)\n"
+								 "{\n"
+								 "	Object object = objects[objectIndex];\n"
+								 "	gl_Position = mvp * (object.model * vec4(pos.xyz, 1.0));\n"
+								 "	fragColor = color + vec3(object.highlight);\n"
+								 "}";
+const char* const sceneFragSrc = "#version 140\n"
+								 "in vec3 fragColor;\n"
+								 "out vec4 finalColor;\n"
+								 "void main(void)\n"
+								 "{\n"
+								 "	finalColor = vec4(fragColor, 1.0);\n"
+								 "}";
+
+GlResource<GlResourceType::Program> createProgram(const char* const vertSrc, const char* const fragSrc)
+{
+	const auto Compile = [](const GLenum type, const char* const source) {
+		GlResource<GlResourceType::Shader> shader;
+		shader.create(type);
+		glCall(glShaderSource, shader, 1, &source, nullptr);
+		glCall(glCompileShader, shader);
+		GLint status = 0;
+		glCall(glGetShaderiv, shader, GL_COMPILE_STATUS, &status);
+		if (!status)
+			throw "Shader compilation failed"s;
+		return shader;
+	};
+
+	GlResource<GlResourceType::Program> program;
+	program.create();
+	const GlResource<GlResourceType::Shader> vert = Compile(GL_VERTEX_SHADER, vertSrc);
+	const GlResource<GlResourceType::Shader> frag = Compile(GL_FRAGMENT_SHADER, fragSrc);
+	glCall(glAttachShader, program, vert);
+	glCall(glAttachShader, program, frag);
+	glCall(glLinkProgram, program);
+	GLint status = 0;
+	glCall(glGetProgramiv, program, GL_LINK_STATUS, &status);
+	if (!status)
+		throw "Shader linking failed"s;
+	return program;
+}
+
+// Procedural scene: the objects of the level, many times over
+struct Scene
+{
+	vector<SceneObject> objects;
+	vector<SceneObjectData> data;
+};
+
+// Scatters copies of the objects of the level (but the ground) over a jittered grid around the origin, with one object per cell of the given size
+// Each copy is turned around the vertical axis and scaled randomly, so that some of them hide the ones behind them
+// The cells near the origin are left empty, so that the camera starts in the clear
+Scene scatterLevelObjects(const size_t count, const float cellSize, const uint32_t seed)
+{
+	constexpr size_t numVerts = sizeof(levelModelVerts) / (sizeof(float) * floatsPerVert);
+	vector<SceneObject> levelObjects = findSceneObjects(levelModelVerts, numVerts, floatsPerVert);
+	computeSceneObjectBounds(levelObjects, levelModelVerts, floatsPerVert, collisionSpheres, sizeof(collisionSpheres) / (sizeof(float) * 5));
+	levelObjects.erase(remove_if(levelObjects.begin(), levelObjects.end(), [](const SceneObject& object) { return object.id == 0; }), levelObjects.end());
+
+	mt19937 random(seed);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const int gridSize = static_cast<int>(ceil(sqrt(static_cast<double>(count) + 16)));
+	Scene ret;
+	for (int cell = 0; ret.objects.size() < count; ++cell)
+	{
+		const float x = (cell % gridSize - gridSize / 2 + unit(random) - 0.5f) * cellSize;
+		const float z = (cell / gridSize - gridSize / 2 + unit(random) - 0.5f) * cellSize;
+		if (x * x + z * z < 4 * cellSize * cellSize)
+			continue;
+
+		// Move the object from where it is in the level to its cell, keeping its height, then turn and scale it around its center
+		const SceneObject& object = levelObjects[random() % levelObjects.size()];
+		const float angle = unit(random) * 6.2831853f;
+		const float scale = 0.5f + 2.0f * unit(random) * unit(random);
+		Fove::Matrix44 scaling = translationMatrix(0, 0, 0);
+		for (int i = 0; i < 3; ++i)
+			scaling.mat[i][i] = scale;
+		const Fove::Matrix44 model = translationMatrix(x, 0, z) * quatToMatrix(axisAngleToQuat(0, 1, 0, angle)) * scaling
+									 * translationMatrix(-object.bounds.center.x, 0, -object.bounds.center.z);
+
+		SceneObjectData data = {};
+		memcpy(data.model, model.mat, sizeof(data.model));
+		ret.objects.push_back(object);
+		ret.data.push_back(data);
+	}
+	return ret;
+}
+
+// Frame buffer of both eyes side by side, with a depth texture for the occlusion culling
+struct Target
+{
+	GlResource<GlResourceType::Texture> color;
+	GlResource<GlResourceType::Texture> depth;
+	GlResource<GlResourceType::Fbo> fbo;
+};
+
+Target createTarget(const Fove::Vec2i singleEyeResolution)
+{
+	Target ret;
+	ret.color.createAndBind(GL_TEXTURE_2D);
+	glCall(glTexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, singleEyeResolution.x * 2, singleEyeResolution.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glCall(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	ret.depth.createAndBind(GL_TEXTURE_2D);
+	glCall(glTexImage2D, GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, singleEyeResolution.x * 2, singleEyeResolution.y, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glCall(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	ret.fbo.createAndBind(GL_FRAMEBUFFER);
+	glCall(glFramebufferTexture, GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ret.color, 0);
+	glCall(glFramebufferTexture, GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ret.depth, 0);
+	if (GL_FRAMEBUFFER_COMPLETE != glCall(glCheckFramebufferStatus, GL_FRAMEBUFFER))
+		throw "Framebuffer is incomplete"s;
+	return ret;
+}
+
+// The GL objects of the scene, created once
+struct Resources
+{
+	GlResource<GlResourceType::Program> shader;
+	GLint mvpLoc = -1;
+	GlResource<GlResourceType::Buffer> vbo;
+	GlResource<GlResourceType::Buffer> objectIndices;
+	GlResource<GlResourceType::Vao> vao;
+	GlResource<GlResourceType::Buffer> objectBuffer;
+	GlResource<GlResourceType::Buffer> drawCommands; // Every object, for the frames without culling
+	GlStreamBuffer cpuDrawCommands;                  // Visible objects, for the frames culled on the CPU
+	GlSceneCuller culler;
+	GlResource<GlResourceType::Query> timer;
+};
+
+Resources createResources(const Scene& scene)
+{
+	Resources ret;
+	ret.shader = createProgram(sceneVertSrc, sceneFragSrc);
+	ret.mvpLoc = glCall(glGetUniformLocation, ret.shader, "mvp");
+
+	ret.vbo.createAndBind(GL_ARRAY_BUFFER);
+	glCall(glBufferData, GL_ARRAY_BUFFER, (GLsizeiptr)sizeof(levelModelVerts), levelModelVerts, GL_STATIC_DRAW);
+	ret.vao.createAndBind();
+	const GLuint posLoc = (GLuint)glCall(glGetAttribLocation, ret.shader, "pos");
+	const GLuint colorLoc = (GLuint)glCall(glGetAttribLocation, ret.shader, "color");
+	const GLuint objectIndexLoc = (GLuint)glCall(glGetAttribLocation, ret.shader, "objectIndex");
+	constexpr GLsizei stride = static_cast<GLsizei>(sizeof(float) * floatsPerVert);
+	glCall(glEnableVertexAttribArray, posLoc);
+	glCall(glEnableVertexAttribArray, colorLoc);
+	glCall(glVertexAttribPointer, posLoc, 4, GL_FLOAT, false, stride, nullptr);
+	glCall(glVertexAttribPointer, colorLoc, 3, GL_FLOAT, false, stride, (const void*)(sizeof(float) * 4));
+	vector<GLuint> indices(scene.objects.size());
+	iota(indices.begin(), indices.end(), 0u);
+	ret.objectIndices.createAndBind(GL_ARRAY_BUFFER);
+	glCall(glBufferData, GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(GLuint) * indices.size()), indices.data(), GL_STATIC_DRAW);
+	glCall(glEnableVertexAttribArray, objectIndexLoc);
+	glCall(glVertexAttribIPointer, objectIndexLoc, 1, GL_UNSIGNED_INT, 0, nullptr);
+	glCall(glVertexAttribDivisor, objectIndexLoc, 1u);
+
+	// The scene is static, so the data of the objects is uploaded once
+	ret.objectBuffer.createAndBind(GL_SHADER_STORAGE_BUFFER);
+	glCall(glBufferData, GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(sizeof(SceneObjectData) * scene.data.size()), scene.data.data(), GL_STATIC_DRAW);
+	glCall(glBindBufferBase, GL_SHADER_STORAGE_BUFFER, objectBufferBinding, ret.objectBuffer);
+
+	const vector<DrawArraysIndirectCommand> commands = sceneDrawCommands(scene.objects);
+	const GLsizeiptr commandsSize = (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size());
+	ret.drawCommands.createAndBind(GL_DRAW_INDIRECT_BUFFER);
+	glCall(glBufferData, GL_DRAW_INDIRECT_BUFFER, commandsSize, commands.data(), GL_STATIC_DRAW);
+	ret.cpuDrawCommands = GlStreamBuffer(GL_DRAW_INDIRECT_BUFFER, commandsSize);
+	ret.culler = GlSceneCuller(scene.objects, objectBufferBinding);
+
+	ret.timer.create();
+	return ret;
+}
+
+enum class CullingMode
+{
+	None,
+	CpuFrustum,
+	GpuFrustum,
+	GpuOcclusion,
+};
+
+// Camera of a frame, at eye height in the middle of the scene, turning around
+Fove::Stereo<Fove::Matrix44> clipMatrices(const Fove::Vec2i singleEyeResolution, const int frame)
+{
+	const Fove::Matrix44 projection = perspectiveMatrixLH(1.6f, (float)singleEyeResolution.x / singleEyeResolution.y, 0.01f, 1000.0f);
+	const Fove::Matrix44 modelview = quatToMatrix(conjugate(axisAngleToQuat(0, 1, 0, frame * 0.05f))) * translationMatrix(0, -1.6f, 0);
+	return {projection * (translationMatrix(0.032f, 0, 0) * modelview), projection * (translationMatrix(-0.032f, 0, 0) * modelview)};
+}
+
+// Returns the indices of the objects inside either frustum
+vector<size_t> cullOnCpu(const Scene& scene, const Fove::Stereo<Fove::Matrix44>& clip)
+{
+	// Like the GPU, the bounds are moved by the model matrices every frame, as they would be for moving objects
+	const Frustum left = frustumFromClipMatrix(clip.l);
+	const Frustum right = frustumFromClipMatrix(clip.r);
+	vector<size_t> ret;
+	for (size_t i = 0; i < scene.objects.size(); ++i)
+	{
+		const BoundingSphere sphere = transformBoundingSphere(scene.objects[i].bounds, scene.data[i].model);
+		if (isSphereInFrustum(left, sphere) || isSphereInFrustum(right, sphere))
+			ret.push_back(i);
+	}
+	return ret;
+}
+
+// Results of a frame
+struct FrameStats
+{
+	double cullMs = 0; // CPU time of the CPU culling, or GPU time of the GPU culling
+	size_t drawn = 0;  // Number of objects drawn
+};
+
+// Renders one frame with the given culling, and waits for it to finish
+// The culling time of the GPU culling, and the number of objects it drew, are only known after that
+FrameStats renderFrame(Resources& res, const Scene& scene, const Target& target, const Fove::Vec2i singleEyeResolution, const int frame, const CullingMode mode)
+{
+	FrameStats ret;
+	const Fove::Stereo<Fove::Matrix44> clip = clipMatrices(singleEyeResolution, frame);
+	const bool gpu = mode == CullingMode::GpuFrustum || mode == CullingMode::GpuOcclusion;
+
+	// Cull the objects
+	GLintptr commandsOffset = 0;
+	GLsizei commandCount = (GLsizei)scene.objects.size();
+	if (mode == CullingMode::CpuFrustum)
+	{
+		const auto start = chrono::steady_clock::now();
+		const vector<size_t> visible = cullOnCpu(scene, clip);
+		vector<DrawArraysIndirectCommand> commands;
+		commands.reserve(visible.size());
+		for (const size_t i : visible)
+			commands.push_back(DrawArraysIndirectCommand{scene.objects[i].vertexCount, 1, scene.objects[i].firstVertex, static_cast<uint32_t>(i)});
+		res.cpuDrawCommands.beginRegion();
+		commandsOffset = res.cpuDrawCommands.write(commands.data(), (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size()));
+		commandCount = (GLsizei)commands.size();
+		ret.cullMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+	else if (gpu)
+	{
+		glCall(glBeginQuery, GL_TIME_ELAPSED, (GLuint)res.timer);
+		res.culler.cull(clip);
+		glCall(glEndQuery, GL_TIME_ELAPSED);
+	}
+
+	// Draw both eyes
+	target.fbo.bind(GL_FRAMEBUFFER);
+	glCall(glClearColor, 0.3f, 0.3f, 0.8f, 0.3f);
+	glCall(glClear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	res.shader.bind();
+	res.vao.bind();
+	glStateCache().enable(GL_DEPTH_TEST);
+	for (const bool isLeft : {true, false})
+	{
+		glStateCache().viewport(isLeft ? 0 : singleEyeResolution.x, 0, singleEyeResolution.x, singleEyeResolution.y);
+		glCall(glUniformMatrix4fv, res.mvpLoc, 1, (GLboolean) true, (const float*)(isLeft ? clip.l : clip.r).mat);
+		if (gpu)
+		{
+			res.culler.draw();
+			continue;
+		}
+		// Mesa llvmpipe loses some of the draws of a multi-draw of every object, so the commands are drawn in batches (which costs next to nothing)
+		glCall(glBindBuffer, GL_DRAW_INDIRECT_BUFFER, mode == CullingMode::CpuFrustum ? res.cpuDrawCommands.buffer() : (GLuint)res.drawCommands);
+		for (GLsizei first = 0; first < commandCount; first += drawBatchSize)
+			glCall(glMultiDrawArraysIndirect, GL_TRIANGLES, (const void*)(commandsOffset + first * sizeof(DrawArraysIndirectCommand)), min(drawBatchSize, commandCount - first), 0);
+	}
+	if (mode == CullingMode::CpuFrustum)
+		res.cpuDrawCommands.endRegion();
+	if (mode == CullingMode::GpuOcclusion)
+		res.culler.buildOcclusion(target.depth, singleEyeResolution, EyeViewport{{0, 0}, singleEyeResolution});
+	glCall(glFinish);
+
+	// Read back the results of the GPU culling
+	ret.drawn = commandCount;
+	if (gpu)
+	{
+		GLuint64 ns = 0;
+		glCall(glGetQueryObjectui64v, res.timer, GL_QUERY_RESULT, &ns);
+		ret.cullMs = ns / 1e6;
+		ret.drawn = res.culler.visibleCount();
+	}
+	return ret;
+}
+
+// Returns the pixels of both eyes
+vector<unsigned char> readPixels(const Target& target, const Fove::Vec2i singleEyeResolution)
+{
+	vector<unsigned char> ret(singleEyeResolution.x * 2 * singleEyeResolution.y * 4);
+	target.fbo.bind(GL_FRAMEBUFFER);
+	glCall(glReadPixels, 0, 0, singleEyeResolution.x * 2, singleEyeResolution.y, GL_RGBA, GL_UNSIGNED_BYTE, ret.data());
+	return ret;
+}
+
+// Returns the number of pixels which differ between two images
+size_t differentPixels(const vector<unsigned char>& a, const vector<unsigned char>& b)
+{
+	size_t ret = 0;
+	for (size_t i = 0; i < a.size(); i += 4)
+		ret += memcmp(&a[i], &b[i], 4) != 0;
+	return ret;
+}
+
+} // namespace
+
+// Entry point, invoked by main() in LinuxUtil.cpp
+void programMain(NativeLaunchInfo nativeLaunchInfo)
+{
+	try
+	{
+		const vector<string> args = getCommandLineArgs(nativeLaunchInfo);
+		const size_t objectCount = args.size() > 0 ? stoul(args[0]) : 100000;
+		const int frameCount = args.size() > 1 ? stoi(args[1]) : 20;
+		const Fove::Vec2i resolution = args.size() > 3 ? Fove::Vec2i{stoi(args[2]), stoi(args[3])} : Fove::Vec2i{256, 256};
+		if (objectCount == 0 || frameCount <= 0 || resolution.x <= 0 || resolution.y <= 0)
+			throw "Invalid arguments"s;
+
+		[[maybe_unused]] const NativeOpenGLContext nativeOpenGLContext = createHeadlessOpenGLContext();
+		if (!GlSceneCuller::isSupported())
+			throw "The GL context doesn't support the GPU culling (GL 4.3 or later is needed)"s;
+		const Scene scene = scatterLevelObjects(objectCount, 3.0f, 1234);
+		Resources res = createResources(scene);
+		const Target target = createTarget(resolution);
+		size_t vertexCount = 0;
+		for (const SceneObject& object : scene.objects)
+			vertexCount += object.vertexCount;
+		cout << "Renderer: " << (const char*)glGetString(GL_RENDERER) << '\n'
+			 << "Rendering " << objectCount << " objects (" << vertexCount << " vertices per eye), " << frameCount << " frames at " << resolution.x << "x" << resolution.y << " per eye\n"
+			 << "Each frame is waited for, so its time is that of the CPU and GPU work together\n"
+			 << "Culling                   ms/frame  cull ms  objects drawn" << endl;
+
+		const auto Report = [&](const char* const name, const CullingMode mode) {
+			res.culler.setOcclusion(mode == CullingMode::GpuOcclusion);
+			renderFrame(res, scene, target, resolution, 0, mode); // Warm up, and build the first Hi-Z pyramid
+			double frameMs = 0, cullMs = 0, drawn = 0;
+			for (int frame = 1; frame <= frameCount; ++frame)
+			{
+				const auto start = chrono::steady_clock::now();
+				const FrameStats stats = renderFrame(res, scene, target, resolution, frame, mode);
+				frameMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+				cullMs += stats.cullMs / frameCount;
+				drawn += static_cast<double>(stats.drawn) / frameCount;
+			}
+			cout << left << setw(24) << name << right << fixed << setprecision(2) << setw(10) << frameMs << setw(9) << cullMs << setw(15) << setprecision(0) << drawn << endl;
+		};
+		Report("None", CullingMode::None);
+		Report("CPU frustum", CullingMode::CpuFrustum);
+		Report("GPU frustum", CullingMode::GpuFrustum);
+		Report("GPU frustum + occlusion", CullingMode::GpuOcclusion);
+
+		// The GPU culling should keep the same objects as the CPU, but for rounding differences on the edges of the frusta
+		res.culler.setOcclusion(false);
+		size_t worstDifference = 0;
+		for (int frame = 1; frame <= frameCount; ++frame)
+		{
+			const size_t gpuDrawn = renderFrame(res, scene, target, resolution, frame, CullingMode::GpuFrustum).drawn;
+			const size_t cpuDrawn = cullOnCpu(scene, clipMatrices(resolution, frame)).size();
+			worstDifference = max(worstDifference, gpuDrawn > cpuDrawn ? gpuDrawn - cpuDrawn : cpuDrawn - gpuDrawn);
+		}
+		const bool countsAgree = worstDifference <= objectCount / 1000;
+		cout << "\nGPU and CPU frustum culling: " << (countsAgree ? "ok" : "ERROR: disagree") << " (at most " << worstDifference << " objects apart)" << endl;
+
+		// Culling must not change the image, including the occlusion culling when the camera doesn't move (the Hi-Z pyramid of the first frame is then exact)
+		const int frame = frameCount / 2;
+		renderFrame(res, scene, target, resolution, frame, CullingMode::None);
+		const vector<unsigned char> reference = readPixels(target, resolution);
+		renderFrame(res, scene, target, resolution, frame, CullingMode::GpuFrustum);
+		const size_t frustumDifference = differentPixels(reference, readPixels(target, resolution));
+		res.culler.setOcclusion(true);
+		renderFrame(res, scene, target, resolution, frame, CullingMode::GpuOcclusion);
+		renderFrame(res, scene, target, resolution, frame, CullingMode::GpuOcclusion);
+		const size_t occlusionDifference = differentPixels(reference, readPixels(target, resolution));
+		const bool imagesAgree = frustumDifference == 0 && occlusionDifference == 0;
+		cout << "Image with GPU culling: " << (imagesAgree ? "ok" : "ERROR: different") << " (" << frustumDifference << " pixels differ with frustum culling, " << occlusionDifference
+			 << " with occlusion culling)" << endl;
+		if (!countsAgree || !imagesAgree)
+			exit(EXIT_FAILURE);
+	}
+	catch (...)
+	{
+		// If an exception is thrown for any reason, log it and exit
+		cerr << "Error: " << currentExceptionMessage() << endl;
+		exit(EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,494 @@
+#include "LevelOfDetail.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+using namespace std;
+
+namespace
+{
+
+constexpr float radiansToDegrees = 57.2957795f;
+
+Fove::Vec3 cross(const Fove::Vec3 v1, const Fove::Vec3 v2)
+{
+	return {v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x};
+}
+
+// Returns the squared distance from p to the segment ab
+float segmentDistanceSquared(const Fove::Vec3 p, const Fove::Vec3 a, const Fove::Vec3 b)
+{
+	const Fove::Vec3 ab = b - a;
+	const float lengthSquared = dot(ab, ab);
+	const float t = lengthSquared > 0 ? clamp(dot(p - a, ab) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+	return distanceSquared(p, a + ab * t);
+}
+
+// Returns the squared distance from p to the triangle abc
+float triangleDistanceSquared(const Fove::Vec3 p, const Fove::Vec3 a, const Fove::Vec3 b, const Fove::Vec3 c)
+{
+	// Within the prism over the triangle, the nearest point is in the triangle, otherwise it's on a side
+	const Fove::Vec3 normal = cross(b - a, c - a);
+	const float lengthSquared = dot(normal, normal);
+	if (lengthSquared > 0 && dot(cross(b - a, p - a), normal) >= 0 && dot(cross(c - b, p - b), normal) >= 0 && dot(cross(a - c, p - c), normal) >= 0)
+	{
+		const float d = dot(p - a, normal);
+		return d * d / lengthSquared;
+	}
+	return min({segmentDistanceSquared(p, a, b), segmentDistanceSquared(p, b, c), segmentDistanceSquared(p, c, a)});
+}
+
+// Sum of the squared distances to a set of planes, as a symmetric 4x4 matrix (only the upper triangle is stored)
+// The error of a point p is (p, 1)^T Q (p, 1)
+struct Quadric
+{
+	double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+	// Adds the plane ax + by + cz + d = 0, (a, b, c) being normalized
+	void addPlane(const double a, const double b, const double c, const double d)
+	{
+		xx += a * a, xy += a * b, xz += a * c, xw += a * d;
+		yy += b * b, yz += b * c, yw += b * d;
+		zz += c * c, zw += c * d;
+		ww += d * d;
+	}
+
+	Quadric& operator+=(const Quadric& q)
+	{
+		xx += q.xx, xy += q.xy, xz += q.xz, xw += q.xw, yy += q.yy, yz += q.yz, yw += q.yw, zz += q.zz, zw += q.zw, ww += q.ww;
+		return *this;
+	}
+
+	double error(const Fove::Vec3 p) const
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		return max(0.0, xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x + yy * y * y + 2 * yz * y * z + 2 * yw * y + zz * z * z + 2 * zw * z + ww);
+	}
+
+	// Finds the point of least error, which fails when it isn't unique (eg. all the planes are parallel, or meet along a line)
+	bool minimum(Fove::Vec3& ret) const
+	{
+		// Cramer's rule on the 3x3 system A p = -b
+		const double det = xx * (yy * zz - yz * yz) - xy * (xy * zz - yz * xz) + xz * (xy * yz - yy * xz);
+		const double trace = xx + yy + zz;
+		if (fabs(det) <= 1e-6 * trace * trace * trace)
+			return false;
+		const double bx = -xw, by = -yw, bz = -zw;
+		ret.x = static_cast<float>((bx * (yy * zz - yz * yz) - xy * (by * zz - yz * bz) + xz * (by * yz - yy * bz)) / det);
+		ret.y = static_cast<float>((xx * (by * zz - yz * bz) - bx * (xy * zz - yz * xz) + xz * (xy * bz - by * xz)) / det);
+		ret.z = static_cast<float>((xx * (yy * bz - by * yz) - xy * (xy * bz - by * xz) + bx * (xy * yz - yy * xz)) / det);
+		return true;
+	}
+};
+
+// Mesh of one object being simplified, with the vertices welded by position
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const float* const verts, const uint32_t vertexCount, const size_t floatsPerVert)
+		: verts_(verts), floatsPerVert_(floatsPerVert)
+	{
+		// Weld the vertices by position, each corner of each triangle keeping its original vertex for the other attributes
+		unordered_map<uint64_t, vector<uint32_t>> welded; // Hash of the position, to the welded vertices with that hash
+		corners_.resize(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			const Fove::Vec3 p{verts[i * floatsPerVert], verts[i * floatsPerVert + 1], verts[i * floatsPerVert + 2]};
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			vector<uint32_t>& candidates = welded[(uint64_t(bits[0]) * 73856093u) ^ (uint64_t(bits[1]) * 19349663u) ^ (uint64_t(bits[2]) * 83492791u)];
+			const auto found = find_if(candidates.begin(), candidates.end(), [&](const uint32_t v) { return positions_[v].x == p.x && positions_[v].y == p.y && positions_[v].z == p.z; });
+			if (found != candidates.end())
+			{
+				corners_[i] = *found;
+				continue;
+			}
+			corners_[i] = static_cast<uint32_t>(positions_.size());
+			candidates.push_back(corners_[i]);
+			positions_.push_back(p);
+		}
+		originalPositions_ = positions_;
+		liveTriangles_ = vertexCount / 3;
+		triangleAlive_.assign(liveTriangles_, true);
+		vertexAlive_.assign(positions_.size(), true);
+		stamps_.assign(positions_.size(), 0);
+		trianglesOfVertex_.resize(positions_.size());
+		for (uint32_t t = 0; t < liveTriangles_; ++t)
+		{
+			for (int c = 0; c < 3; ++c)
+				trianglesOfVertex_[corners_[t * 3 + c]].push_back(t);
+		}
+		initQuadrics();
+		for (uint32_t v = 0; v < positions_.size(); ++v)
+		{
+			for (const uint32_t n : neighbours(v))
+			{
+				if (v < n)
+					pushEdge(v, n);
+			}
+		}
+	}
+
+	uint32_t liveTriangles() const { return liveTriangles_; }
+
+	// Largest error of the collapses so far
+	float error() const { return error_; }
+
+	// Distance from the farthest vertex of the original mesh to the triangles that remain
+	// The quadrics miss this: the tip of a thin spike collapses onto its base almost for free, since the base is on the planes of the spike
+	float originalVertexDistance() const
+	{
+		float ret = 0;
+		for (const Fove::Vec3& p : originalPositions_)
+		{
+			float nearest = INFINITY;
+			for (uint32_t t = 0; t < triangleAlive_.size() && nearest > ret; ++t)
+			{
+				if (triangleAlive_[t])
+					nearest = min(nearest, triangleDistanceSquared(p, positions_[corners_[t * 3]], positions_[corners_[t * 3 + 1]], positions_[corners_[t * 3 + 2]]));
+			}
+			ret = max(ret, nearest);
+		}
+		return sqrt(ret);
+	}
+
+	// Collapses edges until at most targetTriangles remain, or no edge can be collapsed, returning whether the target was reached
+	bool simplify(const uint32_t targetTriangles)
+	{
+		while (liveTriangles_ > targetTriangles)
+		{
+			if (edges_.empty())
+				return false;
+			const Edge edge = edges_.top();
+			edges_.pop();
+			if (!vertexAlive_[edge.a] || !vertexAlive_[edge.b] || stamps_[edge.a] != edge.stampA || stamps_[edge.b] != edge.stampB)
+				continue; // A vertex moved since the edge was queued, it was queued again then
+			if (!canCollapse(edge))
+				continue;
+			collapse(edge);
+		}
+		return true;
+	}
+
+	// Appends the triangles that remain, in the layout of the input
+	void write(vector<float>& out) const
+	{
+		for (uint32_t t = 0; t < triangleAlive_.size(); ++t)
+		{
+			if (!triangleAlive_[t])
+				continue;
+			for (uint32_t i = t * 3; i < t * 3 + 3; ++i)
+			{
+				const Fove::Vec3& p = positions_[corners_[i]];
+				out.insert(out.end(), {p.x, p.y, p.z});
+				out.insert(out.end(), verts_ + i * floatsPerVert_ + 3, verts_ + (i + 1) * floatsPerVert_);
+			}
+		}
+	}
+
+private:
+	struct Edge
+	{
+		double cost;
+		uint32_t a, b;
+		uint32_t stampA, stampB; // Stamps of the vertices when the edge was queued
+		Fove::Vec3 target;       // Where the collapse moves the vertices
+		bool operator>(const Edge& other) const { return cost > other.cost; }
+	};
+
+	void initQuadrics()
+	{
+		// Each vertex starts with the planes of its triangles
+		quadrics_.resize(positions_.size());
+		unordered_map<uint64_t, int> edgeUses;
+		const auto EdgeKey = [](const uint32_t a, const uint32_t b) { return (uint64_t(min(a, b)) << 32) | max(a, b); };
+		for (uint32_t t = 0; t < liveTriangles_; ++t)
+		{
+			const uint32_t* const v = &corners_[t * 3];
+			const Fove::Vec3 normal = cross(positions_[v[1]] - positions_[v[0]], positions_[v[2]] - positions_[v[0]]);
+			const float length = magnitude(normal);
+			if (length > 0)
+			{
+				const Fove::Vec3 n = normal / length;
+				for (int c = 0; c < 3; ++c)
+					quadrics_[v[c]].addPlane(n.x, n.y, n.z, -dot(n, positions_[v[0]]));
+			}
+			for (int c = 0; c < 3; ++c)
+				++edgeUses[EdgeKey(v[c], v[(c + 1) % 3])];
+		}
+
+		// The borders of open surfaces also get the plane through them, perpendicular to their triangle, so that they don't shrink
+		for (uint32_t t = 0; t < liveTriangles_; ++t)
+		{
+			const uint32_t* const v = &corners_[t * 3];
+			const Fove::Vec3 normal = cross(positions_[v[1]] - positions_[v[0]], positions_[v[2]] - positions_[v[0]]);
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t a = v[c], b = v[(c + 1) % 3];
+				const Fove::Vec3 side = cross(positions_[b] - positions_[a], normal);
+				const float length = magnitude(side);
+				if (edgeUses[EdgeKey(a, b)] != 1 || length <= 0)
+					continue;
+				const Fove::Vec3 n = side / length;
+				const double d = -dot(n, positions_[a]);
+				quadrics_[a].addPlane(n.x, n.y, n.z, d);
+				quadrics_[b].addPlane(n.x, n.y, n.z, d);
+			}
+		}
+	}
+
+	// Returns the vertices sharing a live triangle with v
+	vector<uint32_t> neighbours(const uint32_t v) const
+	{
+		vector<uint32_t> ret;
+		for (const uint32_t t : trianglesOfVertex_[v])
+		{
+			if (!triangleAlive_[t])
+				continue;
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t n = corners_[t * 3 + c];
+				if (n != v && find(ret.begin(), ret.end(), n) == ret.end())
+					ret.push_back(n);
+			}
+		}
+		return ret;
+	}
+
+	// Queues the collapse of an edge, to the point of least error, or the best of its ends and middle when that point isn't unique
+	void pushEdge(const uint32_t a, const uint32_t b)
+	{
+		Quadric q = quadrics_[a];
+		q += quadrics_[b];
+		Edge edge{0, a, b, stamps_[a], stamps_[b], {}};
+		Fove::Vec3 optimum;
+		const Fove::Vec3 middle = (positions_[a] + positions_[b]) * 0.5f;
+		edge.cost = INFINITY;
+		const auto Consider = [&](const Fove::Vec3 p) {
+			const double cost = q.error(p);
+			if (cost < edge.cost)
+			{
+				edge.cost = cost;
+				edge.target = p;
+			}
+		};
+		// The optimum is only used near the edge, the planes of thin slivers can put it far away
+		if (q.minimum(optimum) && distanceSquared(optimum, middle) <= distanceSquared(positions_[a], positions_[b]))
+			Consider(optimum);
+		Consider(positions_[a]);
+		Consider(positions_[b]);
+		Consider(middle);
+		edges_.push(edge);
+	}
+
+	// Whether collapsing the edge keeps the mesh sound: no triangle turns over or becomes degenerate,
+	// and the ends of the edge share no other neighbour than the opposite corners of the triangles of the edge (which would pinch the surface)
+	bool canCollapse(const Edge& edge) const
+	{
+		const vector<uint32_t> neighboursA = neighbours(edge.a);
+		const vector<uint32_t> neighboursB = neighbours(edge.b);
+		size_t shared = 0, edgeTriangles = 0;
+		for (const uint32_t n : neighboursA)
+			shared += find(neighboursB.begin(), neighboursB.end(), n) != neighboursB.end();
+		for (const uint32_t v : {edge.a, edge.b})
+		{
+			for (const uint32_t t : trianglesOfVertex_[v])
+			{
+				if (!triangleAlive_[t])
+					continue;
+				const uint32_t* const corners = &corners_[t * 3];
+				const bool hasA = corners[0] == edge.a || corners[1] == edge.a || corners[2] == edge.a;
+				const bool hasB = corners[0] == edge.b || corners[1] == edge.b || corners[2] == edge.b;
+				if (hasA && hasB)
+				{
+					edgeTriangles += v == edge.a; // Counted once
+					continue;
+				}
+
+				// The triangle loses an end of the edge for the target
+				Fove::Vec3 p[3];
+				for (int c = 0; c < 3; ++c)
+					p[c] = corners[c] == edge.a || corners[c] == edge.b ? edge.target : positions_[corners[c]];
+				const Fove::Vec3 before = cross(positions_[corners[1]] - positions_[corners[0]], positions_[corners[2]] - positions_[corners[0]]);
+				const Fove::Vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+				if (dot(before, after) <= 0.2f * magnitude(before) * magnitude(after))
+					return false;
+			}
+		}
+		return shared <= edgeTriangles;
+	}
+
+	void collapse(const Edge& edge)
+	{
+		// Keep a, moved to the target, and remove b
+		const uint32_t a = edge.a, b = edge.b;
+		positions_[a] = edge.target;
+		quadrics_[a] += quadrics_[b];
+		vertexAlive_[b] = false;
+		++stamps_[a];
+		error_ = max(error_, static_cast<float>(sqrt(edge.cost)));
+		for (const uint32_t t : trianglesOfVertex_[b])
+		{
+			if (!triangleAlive_[t])
+				continue;
+			uint32_t* const corners = &corners_[t * 3];
+			if (corners[0] == a || corners[1] == a || corners[2] == a)
+			{
+				triangleAlive_[t] = false; // Triangles of the edge become degenerate
+				--liveTriangles_;
+				continue;
+			}
+			replace(corners, corners + 3, b, a);
+			trianglesOfVertex_[a].push_back(t);
+		}
+		trianglesOfVertex_[a].erase(remove_if(trianglesOfVertex_[a].begin(), trianglesOfVertex_[a].end(), [&](const uint32_t t) { return !triangleAlive_[t]; }), trianglesOfVertex_[a].end());
+
+		// The edges around a changed, queue them again
+		for (const uint32_t n : neighbours(a))
+			pushEdge(a, n);
+	}
+
+	const float* verts_;
+	size_t floatsPerVert_;
+	vector<Fove::Vec3> positions_;         // Welded vertices
+	vector<Fove::Vec3> originalPositions_; // Welded vertices, before any collapse
+	vector<uint32_t> corners_;             // Welded vertex of each corner of each triangle
+	vector<bool> triangleAlive_;
+	vector<bool> vertexAlive_;
+	vector<uint32_t> stamps_;              // Incremented when a vertex moves, which invalidates the queued edges around it
+	vector<vector<uint32_t>> trianglesOfVertex_;
+	vector<Quadric> quadrics_;
+	priority_queue<Edge, vector<Edge>, greater<Edge>> edges_; // Cheapest collapse first
+	uint32_t liveTriangles_ = 0;
+	float error_ = 0;
+};
+
+} // namespace
+
+SceneLods buildSceneLods(const float* const verts, const size_t floatsPerVert, const vector<SceneObject>& objects, const LodBuildSettings& settings)
+{
+	SceneLods ret;
+	ret.objects.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); ++i)
+	{
+		const SceneObject& object = objects[i];
+		ObjectLods& lods = ret.objects[i];
+		const auto VertexCount = [&] { return static_cast<uint32_t>(ret.verts.size() / floatsPerVert); };
+		const auto AddLod = [&](const uint32_t firstVertex, const float error) {
+			lods.firstVertex[lods.count] = firstVertex;
+			lods.vertexCount[lods.count] = VertexCount() - firstVertex;
+			lods.error[lods.count] = error;
+			++lods.count;
+		};
+
+		// The original mesh
+		const float* const objectVerts = verts + object.firstVertex * floatsPerVert;
+		const uint32_t originalFirstVertex = VertexCount();
+		ret.verts.insert(ret.verts.end(), objectVerts, objectVerts + object.vertexCount * floatsPerVert);
+		AddLod(originalFirstVertex, 0);
+
+		// Then each coarser LOD, continuing the simplification of the previous one
+		MeshSimplifier simplifier(objectVerts, object.vertexCount, floatsPerVert);
+		while (lods.count < maxLods)
+		{
+			const uint32_t previousTriangles = lods.vertexCount[lods.count - 1] / 3;
+			const uint32_t target = max(settings.minTriangles, static_cast<uint32_t>(previousTriangles * settings.reduction));
+			if (target >= previousTriangles)
+				break;
+			simplifier.simplify(target);
+			if (simplifier.liveTriangles() >= previousTriangles)
+				break; // No edge could be collapsed
+			const uint32_t firstVertex = VertexCount();
+			simplifier.write(ret.verts);
+			AddLod(firstVertex, max({simplifier.error(), simplifier.originalVertexDistance(), lods.error[lods.count - 1]}));
+		}
+	}
+	return ret;
+}
+
+LodSelector::LodSelector(const SceneLods& lods, const LodSelectionSettings& settings)
+	: lods_(lods.objects)
+	, settings_(settings)
+	, current_(lods.objects.size(), 0)
+{
+	commands_.reserve(lods_.size());
+	for (const ObjectLods& object : lods_)
+		commands_.push_back(DrawArraysIndirectCommand{object.vertexCount[0], 1, object.firstVertex[0], static_cast<uint32_t>(commands_.size())});
+}
+
+bool LodSelector::select(const vector<SceneObject>& objects, const vector<SceneObjectData>& data, const Fove::Matrix44& view, const Fove::Ray* const gazeRay,
+						 const float pixelsPerRadian, const Fove::Stereo<Fove::Matrix44>& clipMatrices)
+{
+	stats_ = LodStats();
+	const Frustum frusta[2] = {frustumFromClipMatrix(clipMatrices.l), frustumFromClipMatrix(clipMatrices.r)};
+	Fove::Vec3 gazeDirection{};
+	if (gazeRay)
+		gazeDirection = normalize(Fove::Vec3{gazeRay->direction.x, gazeRay->direction.y, gazeRay->direction.z});
+
+	for (size_t i = 0; i < lods_.size(); ++i)
+	{
+		const ObjectLods& lods = lods_[i];
+		const BoundingSphere bounds = transformBoundingSphere(objects[i].bounds, data[i].model);
+		const float scale = objects[i].bounds.radius > 0 ? bounds.radius / objects[i].bounds.radius : 1.0f; // The LOD errors are before the model matrix
+		const Fove::Vec3 center = transformPoint(view, bounds.center, 1);
+
+		// The error allowed grows with the angle between the gaze and the nearest point of the object
+		float allowedPixels = settings_.maxErrorPixels;
+		if (gazeRay)
+		{
+			const Fove::Vec3 toObject = center - Fove::Vec3{gazeRay->origin.x, gazeRay->origin.y, gazeRay->origin.z};
+			const float distance = magnitude(toObject);
+			if (distance > bounds.radius)
+			{
+				const float angle = acos(clamp(dot(toObject / distance, gazeDirection), -1.0f, 1.0f)) - asin(bounds.radius / distance);
+				allowedPixels *= min(1 + max(angle, 0.0f) * radiansToDegrees / settings_.halfAcuityDegrees, settings_.maxEccentricityScale);
+			}
+		}
+
+		// Error of each LOD on screen, none when the eye is within the object
+		const float distance = magnitude(center) - bounds.radius;
+		const auto ErrorPixels = [&](const int lod) { return distance > 0 ? lods.error[lod] * scale / distance * pixelsPerRadian : (lod == 0 ? 0 : INFINITY); };
+
+		// Switch to a finer LOD as soon as the current one is too coarse, but to a coarser one only once it's well within the error allowed
+		int& current = current_[i];
+		int next = current;
+		if (ErrorPixels(current) > allowedPixels)
+		{
+			while (next > 0 && ErrorPixels(next) > allowedPixels)
+				--next;
+		}
+		else
+		{
+			for (int lod = lods.count - 1; lod > current; --lod)
+			{
+				if (ErrorPixels(lod) <= allowedPixels * (1 - settings_.hysteresis))
+				{
+					next = lod;
+					break;
+				}
+			}
+		}
+		if (next != current)
+		{
+			current = next;
+			commands_[i].vertexCount = lods.vertexCount[current];
+			commands_[i].firstVertex = lods.firstVertex[current];
+			++stats_.switches;
+		}
+
+		// Statistics
+		++stats_.objectsPerLod[current];
+		for (int eye = 0; eye < 2; ++eye)
+		{
+			if (!isSphereInFrustum(frusta[eye], bounds))
+				continue;
+			stats_.triangles[eye] += lods.vertexCount[current] / 3;
+			stats_.fullDetailTriangles[eye] += lods.vertexCount[0] / 3;
+		}
+	}
+	return stats_.switches > 0;
+}
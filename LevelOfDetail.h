@@ -0,0 +1,95 @@
+#pragma once
+#include "FoveAPI.h"
+#include "SceneObjects.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// This header implements levels of detail (LODs) for the objects of the scene (see SceneObjects.h)
+//
+// When the scene is loaded, each object is simplified into up to 3 coarser meshes by edge collapses ordered by quadric error (Garland & Heckbert):
+// each vertex keeps the sum of the squared distances to the planes of its original triangles, and the edges whose collapse moves the surface
+// the least go first. The error of a LOD is the larger of how far its vertices stray from the planes of the original triangles (the square root
+// of that sum), and how far the original vertices are from its triangles, which catches the thin features that the planes alone miss.
+//
+// Every frame, each object gets the coarsest LOD whose error, projected on screen, is below a budget in pixels.
+// The eye only sees sharply around the gaze (visual acuity falls roughly inversely to the angle away from it, halving within a couple of degrees),
+// so the budget grows with the angle between the object and the combined gaze ray, and objects in the periphery get coarser meshes than what's looked at.
+// Hysteresis keeps objects near a threshold from switching back and forth between two LODs every frame, which would be visible as popping.
+
+// Maximum number of LODs per object, the first being the original mesh
+constexpr int maxLods = 4;
+
+// LODs of one object, each a range of vertices of SceneLods::verts
+struct ObjectLods
+{
+	int count = 0;
+	uint32_t firstVertex[maxLods] = {};
+	uint32_t vertexCount[maxLods] = {};
+	float error[maxLods] = {}; // Distance between each LOD and the original mesh, in the units of the model, 0 for the original and growing with each LOD
+};
+
+// The LODs of every object of a model, from finest to coarsest
+struct SceneLods
+{
+	std::vector<float> verts;        // Vertices of all the LODs, in the layout of the model they were built from (see Model.h)
+	std::vector<ObjectLods> objects; // LODs of each object, in the order of the objects they were built from
+};
+
+struct LodBuildSettings
+{
+	float reduction = 0.5f;   // Each LOD aims at this fraction of the triangles of the previous one
+	uint32_t minTriangles = 4; // Objects aren't simplified below this many triangles
+};
+
+// Simplifies each object of the model into up to maxLods - 1 coarser meshes, fewer for the objects too small to simplify further
+// The vertices of the objects are welded by position, so only the positions are simplified: the other attributes (id, color)
+// follow the corners of the triangles that remain
+SceneLods buildSceneLods(const float* verts, size_t floatsPerVert, const std::vector<SceneObject>& objects, const LodBuildSettings& settings = {});
+
+struct LodSelectionSettings
+{
+	float maxErrorPixels = 1.0f;        // Error allowed at the gaze point, in pixels
+	float halfAcuityDegrees = 2.5f;     // The error allowed doubles this many degrees away from the gaze, and keeps growing linearly past it
+	float maxEccentricityScale = 10.0f; // Up to this multiple of maxErrorPixels, so that even the far periphery keeps some detail
+	float hysteresis = 0.3f;            // A coarser LOD is only switched to once its error is below (1 - hysteresis) times the error allowed
+};
+
+// LOD statistics of a frame
+struct LodStats
+{
+	size_t triangles[2] = {};           // Triangles of the objects in the frustum of each eye (left, right)
+	size_t fullDetailTriangles[2] = {}; // The same, with the original meshes
+	size_t objectsPerLod[maxLods] = {}; // Number of objects at each LOD, in view or not
+	size_t switches = 0;                // Number of objects which changed LOD
+};
+
+// Picks the LOD of each object every frame
+class LodSelector
+{
+public:
+	LodSelector() {}
+
+	// Every object starts with its original mesh
+	explicit LodSelector(const SceneLods& lods, const LodSelectionSettings& settings = {});
+
+	// Picks the LOD of each object, and returns whether any changed, in which case the draw commands need to be uploaded again
+	// The objects are moved by the model matrices of their data, then by view (world to head, the modelview of the examples)
+	// gazeRay is the combined gaze ray in head space (Headset::getCombinedGazeRay), or null without eye tracking, the gaze then being ignored
+	// pixelsPerRadian converts angles to pixels near the center of the eye image, and clipMatrices are only used to count the triangles of each eye
+	bool select(const std::vector<SceneObject>& objects, const std::vector<SceneObjectData>& data, const Fove::Matrix44& view, const Fove::Ray* gazeRay,
+				float pixelsPerRadian, const Fove::Stereo<Fove::Matrix44>& clipMatrices);
+
+	// Draw command of each object, drawing its current LOD (see sceneDrawCommands)
+	const std::vector<DrawArraysIndirectCommand>& commands() const { return commands_; }
+
+	// Statistics of the last select()
+	const LodStats& stats() const { return stats_; }
+
+private:
+	std::vector<ObjectLods> lods_;
+	LodSelectionSettings settings_;
+	std::vector<int> current_; // Current LOD of each object
+	std::vector<DrawArraysIndirectCommand> commands_;
+	LodStats stats_;
+};
@@ -3,6 +3,7 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -10,6 +11,7 @@
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -101,7 +103,24 @@ public:
 	const XDisplay* xDisplay() const { return m_display.get(); }
 	XWindow xWindow() const { return m_window; }
 
+	XWindowSize windowSize() const
+	{
+		const uint64_t size = m_size;
+		return XWindowSize{static_cast<unsigned int>(size >> 32), static_cast<unsigned int>(size & 0xFFFFFFFF)};
+	}
+
+	bool consumeResize()
+	{
+		return m_resized.exchange(false);
+	}
+
 private:
+	// Width & height are packed into a single integer so that the renderer always sees a consistent pair
+	static uint64_t packSize(const unsigned int width, const unsigned int height)
+	{
+		return (static_cast<uint64_t>(width) << 32) | height;
+	}
+
 	void startEventThread()
 	{
 		m_keepAlive = true;
@@ -135,8 +154,11 @@ private:
 			}
 			else if (event.type == ConfigureNotify)
 			{
-				// TODO
-				// updateSize(&dataLock.data());
+				// ConfigureNotify is also sent when the window only moves, so only flag a resize if the size is new
+				// The renderer polls this via NativeWindow::consumeResize() and never has to touch Xlib itself
+				const uint64_t size = packSize(event.xconfigure.width, event.xconfigure.height);
+				if (m_size.exchange(size) != size)
+					m_resized = true;
 			}
 			else if (event.type == KeyPress)
 			{
@@ -162,6 +184,10 @@ private:
 	condition_variable m_eventThreadCV{};
 	thread m_eventThread{};
 	atomic_bool m_keepAlive{true};
+
+	// Written by the event thread, read by the render thread
+	atomic<uint64_t> m_size{packSize(windowSizeX, windowSizeY)};
+	atomic_bool m_resized{false};
 };
 
 NativeWindow::NativeWindow() = default;
@@ -184,16 +210,22 @@ XDisplay* NativeWindow::xDisplay()
 	return m_impl->xDisplay();
 }
 
-XWindowSize NativeWindow::windowSize()
+XWindowSize NativeWindow::windowSize() const
+{
+	return m_impl->windowSize();
+}
+
+bool NativeWindow::consumeResize()
+{
+	return m_impl->consumeResize();
+}
+
+vector<string> getCommandLineArgs(const NativeLaunchInfo& nativeLaunchInfo)
 {
-	XWindowSize size{};
-	Window root{};
-	int xOffset{};
-	int yOffset{};
-	unsigned int border{};
-	unsigned int depth{};
-	XGetGeometry(xDisplay(), xWindow(), &root, &xOffset, &yOffset, &size.width, &size.height, &border, &depth);
-	return size;
+	vector<string> args;
+	for (int i = 1; i < nativeLaunchInfo.argc; ++i)
+		args.emplace_back(nativeLaunchInfo.argv[i]);
+	return args;
 }
 
 NativeWindow createNativeWindow(NativeLaunchInfo& nativeLaunchInfo, const string& windowTitle)
@@ -244,9 +276,11 @@ bool flushWindowEvents(NativeWindow& window)
 }
 
 // Main program entry point and loop
-int main()
+int main(int argc, char** argv)
 {
 	NativeLaunchInfo info;
+	info.argc = argc;
+	info.argv = argv;
 	programMain(info);
 	return 0;
 }
@@ -12,8 +12,8 @@ using XDisplay = struct _XDisplay; // Opaque handle to X11 display
 // Linux version of NativeLaunchInfo
 struct NativeLaunchInfo
 {
-	//	HINSTANCE instance = nullptr;
-	//	int cmdShow = 0;
+	int argc = 0;
+	char** argv = nullptr;
 };
 
 struct XWindowSize
@@ -33,7 +33,12 @@ struct NativeWindow
 	const XDisplay* xDisplay() const;
 	XWindow xWindow() const;
 
-	XWindowSize windowSize();
+	// Last size reported by the window system
+	// This is updated from the event thread, so it's cheap and safe to call every frame
+	XWindowSize windowSize() const;
+
+	// Returns true (once) if the window has been resized since the last call
+	bool consumeResize();
 
 	~NativeWindow();
 	NativeWindow();
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 
 // This header declares structs and functions that are implemented
 // per platform. Each item here is implemented by the corresponding Util header
@@ -17,6 +18,9 @@ struct NativeWindow;
 // This function is implented by each example program that uses native gui (eg, opening windows)
 void programMain(NativeLaunchInfo);
 
+// Returns the command line arguments the program was launched with, excluding the program name
+std::vector<std::string> getCommandLineArgs(const NativeLaunchInfo&);
+
 // Creates a window
 NativeWindow createNativeWindow(NativeLaunchInfo&, const std::string& windowTitle);
 
@@ -1,16 +1,26 @@
 // FOVE OpenGL Example
 // This shows how to display content in a FOVE HMD via the FOVE SDK & OpenGL
 
+#include "DynamicResolution.h"
 #include "FoveAPI.h"
-#include "Model.h"
+#include "GlCulling.h"
+#include "LevelOfDetail.h"
 #include "NativeUtil.h"
 #include "OpenGLUtil.h"
+#include "SceneGenerator.h"
+#include "SceneObjects.h"
 #include "Util.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 // Use std namespace for convenience
 using namespace std;
@@ -33,8 +43,11 @@ constexpr float playerHeight = 1.6f;
 
 // Main vertex shader source
 const char* const demoSceneVertSrc = "#version 140\n"                                                // Declare GLSL version
-									 "uniform mat4 mvp;\n"                                           // Modelview matrix (updated per-frame)
-									 "uniform float selection;\n"                                    // Currently selected object
+									 "layout(std140, row_major) uniform Eye\n"                      // Per-eye uniforms (streamed every frame, see GlStreamBuffer)
+									 "{\n"                                                           //
+									 "	mat4 mvp;\n"                                                 // Modelview matrix
+									 "	float selection;\n"                                          // Currently selected object
+									 "};\n"                                                          //
 									 "in vec4 pos;\n"                                                // Position of the vertex (from the model), 4th element is the object
 									 "in vec3 color;\n"                                              // Color of the vertex (from the model)
 									 "out vec3 fragColor;\n"                                         // The output color we will pass to the shader
@@ -45,6 +58,34 @@ const char* const demoSceneVertSrc = "#version 140\n"
 									 "	fragColor = color + vec3(selection);\n"                      // Color is simply passed through to frag shader
 									 "}";
 
+// Vertex shader source of the multi-draw path, where each object reads its transform and highlight from the object buffer
+// The index of the object is an instanced attribute, which starts at the first instance of each draw command (see SceneObjects.h)
+const char* const demoSceneMultiDrawVertSrc = "#version 430\n"                                                // Declare GLSL version
+											  "layout(std140, row_major) uniform Eye\n"                      // Per-eye uniforms (streamed every frame, see GlStreamBuffer)
+											  "{\n"                                                           //
+											  "	mat4 mvp;\n"                                                 // Modelview matrix
+											  "	float selection;\n"                                          // Unused, the highlight is per object
+											  "};\n"                                                          //
+											  "struct Object\n"                                               // Per-object data (SceneObjectData)
+											  "{\n"                                                           //
+											  "	mat4 model;\n"                                               // Model matrix of the object
+											  "	float highlight;\n"                                          // Added to the color of the object
+											  "};\n"                                                          //
+											  "layout(std430, row_major, binding = 1) readonly buffer Objects\n" // Data of every object (streamed every frame)
+											  "{\n"                                                           //
+											  "	Object objects[];\n"                                         //
+											  "};\n"                                                          //
+											  "in vec4 pos;\n"                                                // Position of the vertex (from the model)
+											  "in vec3 color;\n"                                              // Color of the vertex (from the model)
+											  "in uint objectIndex;\n"                                        // Index of the object in the object buffer
+											  "out vec3 fragColor;\n"                                         // The output color we will pass to the shader
+											  "void main(void)\n"                                             // Entry point of the shader
+											  "{\n"                                                           //
+											  "	Object object = objects[objectIndex];\n"                     // Fetch the data of our object
+											  "	gl_Position = mvp * (object.model * vec4(pos.xyz, 1.0));\n"  // Transform the position by the model, then modelview matrix
+											  "	fragColor = color + vec3(object.highlight);\n"               // Highlight the color of the selected object
+											  "}";
+
 // Main fragment shader source
 const char* const demoSceneFragSrc = "#version 140\n"                         // Declare GLSL version
 									 "in vec3 fragColor;\n"                   // The incoming color from the vertex shader
@@ -160,11 +201,19 @@ GlResource<GlResourceType::Program> createShaderProgram(const char* vertSrc, con
 
 struct RenderSurface
 {
-	GlResource<GlResourceType::RenderBuffer> depthBuffer; // Z-buffer
+	GlResource<GlResourceType::Texture> depthTexture;     // Z-buffer, which can also be read by the occlusion culling (see GlCulling.h)
 	GlResource<GlResourceType::Texture> fboTexture;       // Color buffer that can be used as a texture
 	GlResource<GlResourceType::Fbo> fbo;                  // Framebuffer associated with the above two textures
 };
 
+// A render surface, along with a fence after the last GPU commands using it
+// Surfaces that have been replaced are kept alive until their fence is passed, so switching surfaces never has to wait on the GPU
+struct FencedRenderSurface
+{
+	RenderSurface surface;
+	GlFence fence;
+};
+
 RenderSurface generateRenderSurface(const Fove::Vec2i singleEyeResolution)
 {
 	RenderSurface ret;
@@ -182,13 +231,16 @@ RenderSurface generateRenderSurface(const Fove::Vec2i singleEyeResolution)
 	glCall(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
 	// Create the depth buffer
-	ret.depthBuffer.createAndBind(GL_RENDERBUFFER);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, singleEyeResolution.x * 2, singleEyeResolution.y);
+	// It's a texture rather than a renderbuffer so that it can be read after rendering, with a nearest filter and no mipmaps so that it's complete
+	ret.depthTexture.createAndBind(GL_TEXTURE_2D);
+	glCall(glTexImage2D, GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, singleEyeResolution.x * 2, singleEyeResolution.y, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glCall(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glCall(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
 	// Bind the texture & depth buffer to the framebuffer
 	ret.fbo.createAndBind(GL_FRAMEBUFFER);
 	glCall(glFramebufferTexture, GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ret.fboTexture, 0);
-	glCall(glFramebufferRenderbuffer, GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ret.depthBuffer);
+	glCall(glFramebufferTexture, GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ret.depthTexture, 0);
 
 	// Check that the framebuffer we created is complete
 	// If this fails, it means we've not set up the frame buffers correctly and can't render to it
@@ -198,11 +250,602 @@ RenderSurface generateRenderSurface(const Fove::Vec2i singleEyeResolution)
 	return ret;
 }
 
+// Number of render surfaces the example cycles through
+// With a single surface, the next frame can't be rendered until the GPU is done with the previous one, including the copy made for the compositor,
+// which the driver enforces by stalling somewhere unpredictable, since the texture is shared with the compositor
+// With 3 surfaces, we render a frame while the previous one is being submitted, and the one before is still free to be read
+constexpr int defaultRenderSurfaceCount = 3;
+
+// Ring of render surfaces, each with a fence after the last frame rendered to it
+// The frame rendered to a surface is submitted, then the next frame goes to the next surface, so the CPU, the GPU and the compositor work in parallel
+// A surface is only reused once its fence has passed, which is normally long done by then, but bounds how far ahead the CPU can go
+class RenderSurfaceRing
+{
+public:
+	RenderSurfaceRing(const Fove::Vec2i singleEyeResolution, const int count)
+		: singleEyeResolution_(singleEyeResolution)
+	{
+		for (int i = 0; i < count; ++i)
+			surfaces_.push_back(FencedRenderSurface{generateRenderSurface(singleEyeResolution), GlFence()});
+	}
+
+	Fove::Vec2i singleEyeResolution() const { return singleEyeResolution_; }
+
+	// Moves on to the next surface and returns it, after waiting until the GPU is done with the last frame rendered to it
+	const RenderSurface& acquire()
+	{
+		current_ = (current_ + 1) % surfaces_.size();
+		FencedRenderSurface& next = surfaces_[current_];
+		if (!next.fence.isSignaled())
+		{
+			const auto start = chrono::steady_clock::now();
+			next.fence.wait();
+			waitMs_ += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			++waits_;
+		}
+		return next.surface;
+	}
+
+	// Inserts the fence of the current surface, to be called once all the commands using it were issued (rendering, submission and mirroring)
+	void release() { surfaces_[current_].fence.insert(); }
+
+	// Moves the surfaces to the retired ones, to be deleted once the GPU is done with them (eg. when the resolution changes)
+	void retire(vector<FencedRenderSurface>& retired)
+	{
+		for (FencedRenderSurface& surface : surfaces_)
+		{
+			if (!surface.fence.isSignaled())
+				retired.push_back(std::move(surface));
+		}
+		surfaces_.clear();
+	}
+
+	int waits() const { return waits_; }         // Number of times acquire() had to wait for the GPU
+	double waitMs() const { return waitMs_; }    // Total time spent waiting in acquire()
+
+private:
+	vector<FencedRenderSurface> surfaces_;
+	Fove::Vec2i singleEyeResolution_;
+	size_t current_ = 0;
+	int waits_ = 0;
+	double waitMs_ = 0;
+};
+
+// Decides which frames are mirrored to the window
+// Without vsync (a swap interval of 0), every frame is, since presenting never waits
+// With vsync, a present waits until the previous one was displayed, which would hold the HMD frame loop to the refresh rate of the monitor
+// (eg. 60Hz instead of 90Hz). Instead, we learn when the monitor refreshes from the presents that did wait,
+// and only mirror the frames that come after the next refresh, whose present then doesn't have to wait
+class MirrorPacer
+{
+public:
+	explicit MirrorPacer(const int swapInterval)
+		: swapInterval_(swapInterval)
+	{
+	}
+
+	bool shouldPresent(const chrono::steady_clock::time_point now) const
+	{
+		return swapInterval_ == 0 || refreshPeriod_ == chrono::steady_clock::duration::zero() || now >= nextPresent_;
+	}
+
+	// To be called after each present, with the times swapBuffers was called and returned
+	void presented(const chrono::steady_clock::time_point start, const chrono::steady_clock::time_point end)
+	{
+		if (swapInterval_ == 0)
+			return;
+
+		// A present that waited returned right after the refresh which displayed the previous one
+		// The shortest time between two of them is the refresh period (times the swap interval)
+		if (end - start > blockedPresentTime)
+		{
+			if (lastRefresh_ != chrono::steady_clock::time_point{})
+			{
+				const chrono::steady_clock::duration interval = end - lastRefresh_;
+				if (interval > blockedPresentTime && (refreshPeriod_ == chrono::steady_clock::duration::zero() || interval < refreshPeriod_))
+					refreshPeriod_ = interval;
+			}
+			lastRefresh_ = end;
+		}
+
+		// The next present shouldn't come before the refresh displaying this one
+		// If the refreshes drifted from our estimate, a present waits a little again, which gives us a new reference
+		if (refreshPeriod_ != chrono::steady_clock::duration::zero())
+		{
+			nextPresent_ = lastRefresh_ + refreshPeriod_;
+			while (nextPresent_ <= end)
+				nextPresent_ += refreshPeriod_;
+			nextPresent_ += chrono::microseconds{500}; // Margin for the timing of the refreshes
+		}
+	}
+
+private:
+	static constexpr chrono::steady_clock::duration blockedPresentTime = chrono::milliseconds{1}; // Longer presents are considered to have waited for a refresh
+
+	int swapInterval_ = 0;
+	chrono::steady_clock::duration refreshPeriod_{}; // Zero until measured
+	chrono::steady_clock::time_point lastRefresh_;
+	chrono::steady_clock::time_point nextPresent_;
+};
+
+// Helper function for getting uniform/attrib locations
+// The gl functions glGetUniformLocation/glGetAttribLocation return a signed integer
+// Native indicates that the attribute/uniform name doesn't exist
+// Positive indicates the index of the item, but it must be converted to unsigned before use
+// This function checks for error and then converts to unsigned
+GLint checkLocation(const GLint location, const char* const name)
+{
+	if (0 > location)
+		throw "Unable to find location of "s + name;
+	return location;
+}
+
+// GL objects needed to draw the level model
+struct SceneResources
+{
+	GlResource<GlResourceType::Program> shader;
+	GlResource<GlResourceType::Buffer> vbo;
+	size_t vertexCount = 0; // Vertices of the model in vbo
+	GlResource<GlResourceType::Vao> vao;
+	GlStreamBuffer uniforms; // Holds the Eye uniform block of each eye, for the last few frames
+
+	// Objects of the model, drawn with one glMultiDrawArraysIndirect per eye when supported, or a single glDrawArrays otherwise
+	bool multiDraw = false;
+	vector<SceneObject> objects;
+	vector<SceneObjectData> objectData;               // Rewritten to objectBuffer every frame
+	GlResource<GlResourceType::Buffer> drawCommands;  // One draw command per object
+	GlResource<GlResourceType::Buffer> objectIndices; // Instanced attribute, the index of the object drawn by each command
+	GlStreamBuffer objectBuffer;                      // Holds objectData, for the last few frames
+
+	// With compute shaders, the objects that neither eye can see are culled on the GPU, and the rest drawn from a compacted buffer
+	bool culling = false;
+	GlSceneCuller culler;
+
+	// With levels of detail, vbo holds every LOD of every object, and the draw commands are rewritten whenever an object changes LOD
+	bool lod = false;
+	LodSelector lodSelector;
+};
+
+// Layout of the Eye uniform block of the scene shader (std140)
+struct EyeUniforms
+{
+	float mvp[16];
+	float selection;
+	float padding[3];
+};
+
+// Uniform buffer binding point of the Eye uniform block
+constexpr GLuint eyeUniformsBinding = 0;
+
+// Shader storage buffer binding point of the Objects block (multi-draw path only)
+constexpr GLuint objectBufferBinding = 1;
+
+// Returns whether the objects can be drawn with glMultiDrawArraysIndirect, reading their data from a shader storage buffer (GL 4.3)
+bool supportsMultiDraw()
+{
+#ifdef GL_DRAW_INDIRECT_BUFFER
+	return hasGlExtensions({"GL_ARB_multi_draw_indirect", "GL_ARB_shader_storage_buffer_object", "GL_ARB_base_instance"});
+#else
+	return false; // Not even in the headers (eg. macOS, which stops at GL 4.1)
+#endif
+}
+
+// The model is the level of Model.h, or a generated scene in the same layout (see SceneGenerator.h)
+// Occlusion culling is optional (see GlCulling.h), frustum culling is always done when supported
+// Levels of detail are optional too (see LevelOfDetail.h), and need the multi-draw path
+SceneResources createSceneResources(const SceneModel& model, const bool occlusionCulling, const bool lod)
+{
+	SceneResources ret;
+
+	// Create the shader
+	ret.multiDraw = supportsMultiDraw();
+	ret.shader = createShaderProgram(ret.multiDraw ? demoSceneMultiDrawVertSrc : demoSceneVertSrc, demoSceneFragSrc);
+
+	// Get data indexes for the shader inputs
+	// We will use these to bind data to the shader
+	const GLuint eyeBlock = glCall(glGetUniformBlockIndex, ret.shader, "Eye");
+	if (eyeBlock == GL_INVALID_INDEX)
+		throw "Unable to find shader uniform block: Eye"s;
+	glCall(glUniformBlockBinding, ret.shader, eyeBlock, eyeUniformsBinding);
+	const GLuint posLoc = (GLuint)checkLocation(glCall(glGetAttribLocation, ret.shader, "pos"), "pos");
+	const GLuint colorLoc = (GLuint)checkLocation(glCall(glGetAttribLocation, ret.shader, "color"), "color");
+
+	// Setup the vertex buffer, uploading our model data to OpenGL (and the GPU)
+	ret.vbo.createAndBind(GL_ARRAY_BUFFER);
+	glCall(glBufferData, GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(float) * model.verts.size()), model.verts.data(), GL_STATIC_DRAW);
+	ret.vertexCount = model.vertexCount();
+
+	// Setup vertex array object
+	// This will associate the above buffer data with semantic meaning to the shader
+	ret.vao.createAndBind();
+
+	// Attach the vertex buffer we created to the VAO
+	ret.vbo.bind(GL_ARRAY_BUFFER);
+
+	// Enable usage of the position/color attributes
+	glCall(glEnableVertexAttribArray, posLoc);
+	glCall(glEnableVertexAttribArray, colorLoc);
+
+	// Bind the vertex array
+	constexpr GLsizei stride = static_cast<GLsizei>(sizeof(float) * floatsPerVert);
+	glCall(glVertexAttribPointer, posLoc, 4, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glCall(glVertexAttribPointer, colorLoc, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 4));
+
+#ifdef GL_DRAW_INDIRECT_BUFFER
+	if (ret.multiDraw)
+	{
+		// Setup one draw command per object
+		ret.objects = findSceneObjects(model.verts.data(), model.vertexCount(), floatsPerVert);
+		computeSceneObjectBounds(ret.objects, model.verts.data(), floatsPerVert, model.spheres.data(), model.sphereCount());
+		vector<DrawArraysIndirectCommand> commands = sceneDrawCommands(ret.objects);
+
+		// Simplify the objects, and replace the vertices of the model by those of all their LODs, each object starting at its original mesh
+		ret.lod = lod;
+		if (ret.lod)
+		{
+			const auto start = chrono::steady_clock::now();
+			const SceneLods lods = buildSceneLods(model.verts.data(), floatsPerVert, ret.objects);
+			const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			ret.vbo.bind(GL_ARRAY_BUFFER);
+			glCall(glBufferData, GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(float) * lods.verts.size()), lods.verts.data(), GL_STATIC_DRAW);
+			ret.lodSelector = LodSelector(lods);
+			commands = ret.lodSelector.commands();
+			cout << "Built the levels of detail in " << ms << " ms (" << lods.verts.size() / floatsPerVert << " vertices, " << model.vertexCount() << " originally)" << endl;
+		}
+		ret.drawCommands.createAndBind(GL_DRAW_INDIRECT_BUFFER);
+		glCall(glBufferData, GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size()), commands.data(), ret.lod ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+
+		// Attach the object indices to the VAO, advancing once per instance rather than once per vertex
+		vector<GLuint> indices(ret.objects.size());
+		iota(indices.begin(), indices.end(), 0u);
+		const GLuint objectIndexLoc = (GLuint)checkLocation(glCall(glGetAttribLocation, ret.shader, "objectIndex"), "objectIndex");
+		ret.objectIndices.createAndBind(GL_ARRAY_BUFFER);
+		glCall(glBufferData, GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(GLuint) * indices.size()), indices.data(), GL_STATIC_DRAW);
+		glCall(glEnableVertexAttribArray, objectIndexLoc);
+		glCall(glVertexAttribIPointer, objectIndexLoc, 1, GL_UNSIGNED_INT, 0, (void*)0);
+		glCall(glVertexAttribDivisor, objectIndexLoc, 1u);
+
+		// The level is static, so the model matrices are set once here, but each object could move on its own by updating its matrix every frame
+		const Fove::Matrix44 identity = translationMatrix(0, 0, 0);
+		ret.objectData.resize(ret.objects.size());
+		for (SceneObjectData& data : ret.objectData)
+			memcpy(data.model, identity.mat, sizeof(data.model));
+		ret.objectBuffer = GlStreamBuffer(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(sizeof(SceneObjectData) * ret.objectData.size()));
+		cout << "Drawing " << ret.objects.size() << " objects with one glMultiDrawArraysIndirect per eye" << endl;
+
+		// Setup the culling of the objects
+		ret.culling = GlSceneCuller::isSupported();
+		if (ret.culling)
+		{
+			ret.culler = GlSceneCuller(ret.objects, objectBufferBinding);
+			ret.culler.setOcclusion(occlusionCulling);
+			if (ret.lod)
+				ret.culler.setCommands(commands);
+			cout << "Culling the objects on the GPU, " << (occlusionCulling ? "with" : "without") << " occlusion culling" << endl;
+		}
+	}
+#endif
+	if (lod && !ret.lod)
+		cout << "Levels of detail need glMultiDrawArraysIndirect, drawing the original meshes" << endl;
+
+	// Setup the per-frame uniforms
+	// Two blocks are written each frame, the buffer is sized generously since the uniform buffer alignment can be up to 256 bytes
+	ret.uniforms = GlStreamBuffer(GL_UNIFORM_BUFFER, 4096);
+
+	return ret;
+}
+
+// Renders the level for both eyes into the render surface, the left eye to the left half, the right eye to the right half
+// Within each half, only the area covered by eyeViewport is rendered to (see DynamicResolution.h)
+// The projection matrices are expected in the (transposed) format returned by Headset::getProjectionMatricesLH
+// gazeRay is the combined gaze ray (Headset::getCombinedGazeRay), which the levels of detail follow, or null when there is none
+void renderScene(SceneResources& scene, const RenderSurface& renderSurface, const Fove::Vec2i singleEyeResolution, const EyeViewport& eyeViewport, const Fove::Pose& pose, const Fove::Stereo<Fove::Matrix44>& projections, const float halfIOD, const float selection, const Fove::Ray* const gazeRay)
+{
+	// Bind our framebuffer so that we render to a texture
+	renderSurface.fbo.bind(GL_FRAMEBUFFER);
+
+	// Clear the back buffer to a nice sky blue
+	glCall(glClearColor, 0.3f, 0.3f, 0.8f, 0.3f);
+	glCall(glClear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Compute the modelview matrix
+	// Everything here is reverse since we are moving the world we are going to draw, not the camera
+	const Fove::Matrix44 modelview = quatToMatrix(conjugate(pose.orientation))                                 // Apply the HMD orientation
+									 * translationMatrix(-pose.position.x, -pose.position.y, -pose.position.z) // Apply the position tracking offset
+									 * translationMatrix(0, -playerHeight, 0);                                 // Move ground downwards to compensate for player height
+
+	// Compute the clip matrix of each eye
+	const auto ClipMatrix = [&](const bool isLeft) { return transpose(isLeft ? projections.l : projections.r) * (translationMatrix(isLeft ? halfIOD : -halfIOD, 0, 0) * modelview); };
+	const Fove::Stereo<Fove::Matrix44> clipMatrices{ClipMatrix(true), ClipMatrix(false)};
+
+#ifdef GL_DRAW_INDIRECT_BUFFER
+	if (scene.multiDraw)
+	{
+		// Update the highlight of each object, and upload the data of every object at once
+		for (size_t i = 0; i < scene.objects.size(); ++i)
+			scene.objectData[i].highlight = sceneObjectHighlight(scene.objects[i].id, selection);
+		const GLsizeiptr objectDataSize = (GLsizeiptr)(sizeof(SceneObjectData) * scene.objectData.size());
+		scene.objectBuffer.beginRegion();
+		scene.objectBuffer.bindRange(objectBufferBinding, scene.objectBuffer.write(scene.objectData.data(), objectDataSize), objectDataSize);
+
+		// Pick the LOD of each object, from the head rather than either eye, and upload the draw commands when any object changed LOD
+		// The hysteresis of the selection keeps this rare once the head and gaze settle, so the driver is left to order it with the previous frames
+		if (scene.lod)
+		{
+			const float pixelsPerRadian = projections.l.mat[1][1] * eyeViewport.size.y * 0.5f; // Near the center of the eye image
+			if (scene.lodSelector.select(scene.objects, scene.objectData, modelview, gazeRay, pixelsPerRadian, clipMatrices))
+			{
+				const vector<DrawArraysIndirectCommand>& commands = scene.lodSelector.commands();
+				if (scene.culling)
+					scene.culler.setCommands(commands);
+				else
+				{
+					scene.drawCommands.bind(GL_DRAW_INDIRECT_BUFFER);
+					glCall(glBufferSubData, GL_DRAW_INDIRECT_BUFFER, 0, (GLsizeiptr)(sizeof(DrawArraysIndirectCommand) * commands.size()), commands.data());
+				}
+			}
+		}
+
+		// Cull the objects for both eyes at once, before drawing either of them
+		if (scene.culling)
+			scene.culler.cull(clipMatrices);
+		else
+			scene.drawCommands.bind(GL_DRAW_INDIRECT_BUFFER);
+	}
+#endif
+
+	// Bind the various state we use for rendering the scene
+	// This goes through the GL state cache, which skips what is still bound from the previous frame
+	scene.shader.bind();
+	scene.vao.bind();
+	glStateCache().enable(GL_DEPTH_TEST);
+
+	// Start writing this frame's uniforms, in a part of the buffer the GPU is done reading
+	scene.uniforms.beginRegion();
+
+	// Helper function to render the scene
+	const auto RenderScene = [&](bool isLeft) {
+		// Label the commands of each eye, for the GL debug messages and GPU debuggers
+		const GlDebugGroup debugGroup(isLeft ? "Left eye" : "Right eye");
+
+		// Setup the viewport such that we only render to the right/left half of the texture
+		glStateCache().viewport((isLeft ? 0 : singleEyeResolution.x) + eyeViewport.offset.x, eyeViewport.offset.y, eyeViewport.size.x, eyeViewport.size.y);
+
+		// Update clip matrix and selection
+		// The block is declared row_major, since Fove::Matrix44 is row-major
+		EyeUniforms uniforms = {};
+		memcpy(uniforms.mvp, (isLeft ? clipMatrices.l : clipMatrices.r).mat, sizeof(uniforms.mvp));
+		uniforms.selection = selection;
+		scene.uniforms.bindRange(eyeUniformsBinding, scene.uniforms.write(&uniforms, sizeof(uniforms)), sizeof(uniforms));
+
+		// Issue draw command, or one per object with the multi-draw path
+#ifdef GL_DRAW_INDIRECT_BUFFER
+		if (scene.culling)
+		{
+			scene.culler.draw();
+			return;
+		}
+		if (scene.multiDraw)
+		{
+			glCall(glMultiDrawArraysIndirect, GL_TRIANGLES, (const void*)0, (GLsizei)scene.objects.size(), 0);
+			return;
+		}
+#endif
+		glCall(glDrawArrays, GL_TRIANGLES, 0, (GLsizei)scene.vertexCount);
+	};
+
+	// Render the scene twice, once for the left, once for the right
+	RenderScene(true);
+	RenderScene(false);
+
+	// Keep the depth of this frame for the occlusion culling of the next one
+#ifdef GL_DRAW_INDIRECT_BUFFER
+	if (scene.culling && scene.culler.occlusion())
+		scene.culler.buildOcclusion(renderSurface.depthTexture, singleEyeResolution, eyeViewport);
+#endif
+
+	// Fence the uniforms of this frame, so they aren't overwritten before the GPU is done with them
+	scene.uniforms.endRegion();
+	if (scene.multiDraw)
+		scene.objectBuffer.endRegion();
+}
+
+// Renders the scene offscreen for a fixed number of frames, and reports how long it took
+// This needs no window, headset, or compositor, so GL throughput can be benchmarked on any machine (eg. Mesa llvmpipe on a server)
+// The compositor is stood in for by a copy of each frame to another framebuffer, which reads the render surface after the frame, like the real one
+void runHeadlessBenchmark(const int frameCount, const Fove::Vec2i singleEyeResolution, const int renderSurfaceCount, const SceneModel& model, const bool occlusionCulling, const bool lod)
+{
+	// Setup an OpenGL context without any window, and the same render surfaces & scene as the normal path
+	[[maybe_unused]] const NativeOpenGLContext nativeOpenGLContext = createHeadlessOpenGLContext();
+	RenderSurfaceRing renderSurfaces(singleEyeResolution, renderSurfaceCount);
+	SceneResources scene = createSceneResources(model, occlusionCulling, lod);
+
+	// Destination of the copy standing in for the compositor
+	const Fove::Vec2i surfaceSize{singleEyeResolution.x * 2, singleEyeResolution.y};
+	GlResource<GlResourceType::Texture> compositorTexture;
+	compositorTexture.createAndBind(GL_TEXTURE_2D);
+	glCall(glTexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, surfaceSize.x, surfaceSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	GlResource<GlResourceType::Fbo> compositorFbo;
+	compositorFbo.createAndBind(GL_FRAMEBUFFER);
+	glCall(glFramebufferTexture, GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, compositorTexture, 0);
+
+	// Without a headset, use a fixed projection and IOD
+	// FOVE projection matrices are transposed, so we transpose ours to match
+	const Fove::Matrix44 projection = transpose(perspectiveMatrixLH(1.6f, (float)singleEyeResolution.x / singleEyeResolution.y, 0.01f, 1000.0f));
+	const Fove::Stereo<Fove::Matrix44> projections{projection, projection};
+	constexpr float halfIOD = 0.032f;
+
+	// Sums of the LOD statistics of the timed frames
+	LodStats lodTotals;
+
+	// Slowly turn the head around so each frame sees something slightly different
+	// Without eye tracking, the gaze sweeps left and right across the view instead
+	const auto RenderFrame = [&](const int frame) {
+		const RenderSurface& renderSurface = renderSurfaces.acquire();
+		Fove::Pose pose;
+		pose.orientation = axisAngleToQuat(0, 1, 0, frame * 0.01f);
+		Fove::Ray gazeRay;
+		gazeRay.origin = Fove::Vec3{0, 0, 0};
+		gazeRay.direction = Fove::Vec3{0.5f * sin(frame * 0.05f), 0, 1};
+		renderScene(scene, renderSurface, singleEyeResolution, scaledEyeViewport(singleEyeResolution, 1.0f), pose, projections, halfIOD, static_cast<float>(frame % 64), &gazeRay);
+		if (scene.lod && frame > 0)
+		{
+			const LodStats& stats = scene.lodSelector.stats();
+			for (int eye = 0; eye < 2; ++eye)
+			{
+				lodTotals.triangles[eye] += stats.triangles[eye];
+				lodTotals.fullDetailTriangles[eye] += stats.fullDetailTriangles[eye];
+			}
+			lodTotals.switches += stats.switches;
+		}
+
+		// "Submit" the frame
+		glStateCache().bindFramebuffer(GL_READ_FRAMEBUFFER, renderSurface.fbo);
+		glStateCache().bindFramebuffer(GL_DRAW_FRAMEBUFFER, compositorFbo);
+		glCall(glBlitFramebuffer, 0, 0, surfaceSize.x, surfaceSize.y, 0, 0, surfaceSize.x, surfaceSize.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		renderSurfaces.release();
+		glCheckFrameErrors();
+	};
+
+	// Render one frame outside of the timing, so that one-time costs like shader compilation in the driver are not counted
+	RenderFrame(0);
+	glCall(glFinish);
+
+	cout << "Rendering " << frameCount << " frames at " << singleEyeResolution.x << "x" << singleEyeResolution.y << " per eye, cycling through " << renderSurfaceCount << " render surfaces" << endl;
+	const auto start = chrono::steady_clock::now();
+	vector<chrono::steady_clock::time_point> frameEnds;
+	frameEnds.reserve(frameCount);
+	for (int frame = 1; frame <= frameCount; ++frame)
+	{
+		RenderFrame(frame);
+		frameEnds.push_back(chrono::steady_clock::now());
+	}
+	const auto submitted = chrono::steady_clock::now();
+	glCall(glFinish); // Wait for the GPU to finish all queued work so the total time is meaningful
+	const auto finished = chrono::steady_clock::now();
+
+	// Statistics of the CPU frame times (including the waits for the render surfaces to be free)
+	const auto ms = [](const chrono::steady_clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+	vector<double> frameMs;
+	for (int frame = 0; frame < frameCount; ++frame)
+		frameMs.push_back(ms(frameEnds[frame] - (frame == 0 ? start : frameEnds[frame - 1])));
+	double mean = 0;
+	for (const double t : frameMs)
+		mean += t / frameCount;
+	double variance = 0;
+	for (const double t : frameMs)
+		variance += (t - mean) * (t - mean) / frameCount;
+	sort(frameMs.begin(), frameMs.end());
+
+	// Report the results
+	const double totalMs = ms(finished - start);
+	cout << "CPU submission: " << ms(submitted - start) / frameCount << " ms/frame" << endl;
+	cout << "Frame time: std dev " << sqrt(variance) << " ms, 99th percentile " << frameMs[frameCount * 99 / 100] << " ms, max " << frameMs.back() << " ms" << endl;
+	cout << "Waited for a render surface in " << renderSurfaces.waits() << " frames, " << renderSurfaces.waitMs() / frameCount << " ms/frame" << endl;
+	cout << "Total: " << totalMs << " ms, " << totalMs / frameCount << " ms/frame, " << frameCount * 1000.0 / totalMs << " FPS" << endl;
+
+	// Report how many state changes the GL state cache skipped
+	const GlStateCacheStats& stateStats = glStateCache().stats();
+	const auto Skipped = [](const GlStateCacheStats::Counts& counts) { return to_string(counts.skipped) + "/" + to_string(counts.issued + counts.skipped); };
+	cout << "GL state changes skipped: " << Skipped(stateStats.total()) << " (programs " << Skipped(stateStats.programs) << ", VAOs " << Skipped(stateStats.vertexArrays)
+		 << ", framebuffers " << Skipped(stateStats.framebuffers) << ", textures " << Skipped(stateStats.textures) << ", viewports " << Skipped(stateStats.viewports)
+		 << ", capabilities " << Skipped(stateStats.capabilities) << ")" << endl;
+
+	// Report how many objects the last frame drew
+#ifdef GL_DRAW_INDIRECT_BUFFER
+	if (scene.culling)
+		cout << "Objects drawn in the last frame: " << scene.culler.visibleCount() << "/" << scene.objects.size() << endl;
+#endif
+
+	// Report the triangles the levels of detail saved
+	if (scene.lod)
+	{
+		for (int eye = 0; eye < 2; ++eye)
+			cout << (eye ? "Right" : "Left") << " eye: " << lodTotals.triangles[eye] / frameCount << " triangles/frame in view, " << lodTotals.fullDetailTriangles[eye] / frameCount
+				 << " with the original meshes" << endl;
+		const LodStats& stats = scene.lodSelector.stats();
+		cout << "LOD switches: " << static_cast<double>(lodTotals.switches) / frameCount << " objects/frame, objects at each LOD in the last frame:";
+		for (const size_t count : stats.objectsPerLod)
+			cout << " " << count;
+		cout << endl;
+	}
+}
+
 // Platform-independent main program entry point and loop
 // This is invoked from WinMain in WindowsUtil.cpp
 void programMain(NativeLaunchInfo nativeLaunchInfo)
 try
 {
+	// Usage: FoveOpenGLExample [--occlusion-culling] [--lod] [--scene-scale S] [--scene-seed N] ...
+	// --occlusion-culling enables the occlusion culling of the objects (see GlCulling.h)
+	// --lod draws the objects with levels of detail following the gaze (see LevelOfDetail.h)
+	// --scene-scale replaces the level by a generated scene with S times as many objects (see SceneGenerator.h), whose layout is picked by --scene-seed
+	// These apply to both modes below
+	vector<string> args = getCommandLineArgs(nativeLaunchInfo);
+	bool occlusionCulling = false;
+	bool lod = false;
+	float sceneScale = 0;
+	uint32_t sceneSeed = 1;
+	for (size_t i = 0; i < args.size();)
+	{
+		// Take out the options handled here, leaving the others to the modes below
+		const bool hasValue = i + 1 < args.size();
+		size_t used = 0;
+		if (args[i] == "--occlusion-culling")
+		{
+			occlusionCulling = true;
+			used = 1;
+		}
+		else if (args[i] == "--lod")
+		{
+			lod = true;
+			used = 1;
+		}
+		else if (args[i] == "--scene-scale" && hasValue)
+		{
+			sceneScale = stof(args[i + 1]);
+			used = 2;
+		}
+		else if (args[i] == "--scene-seed" && hasValue)
+		{
+			sceneSeed = static_cast<uint32_t>(stoul(args[i + 1]));
+			used = 2;
+		}
+		if (used)
+			args.erase(args.begin() + i, args.begin() + i + used);
+		else
+			++i;
+	}
+	if (sceneScale < 0)
+		throw "Invalid scene scale";
+	const SceneModel model = sceneModelAtScale(sceneScale, sceneSeed);
+	if (sceneScale > 0)
+		cout << "Generated a scene of " << model.sphereCount() << " objects (" << model.vertexCount() << " vertices)" << endl;
+
+	// Usage: FoveOpenGLExample --headless [frameCount] [eyeWidth eyeHeight] [renderSurfaceCount]
+	// This renders offscreen only, without connecting to FOVE, and prints timing information
+	if (!args.empty() && args[0] == "--headless")
+	{
+		const int frameCount = args.size() > 1 ? stoi(args[1]) : 1000;
+		const Fove::Vec2i resolution = args.size() > 3 ? Fove::Vec2i{stoi(args[2]), stoi(args[3])} : Fove::Vec2i{1024, 1024};
+		const int renderSurfaceCount = args.size() > 4 ? stoi(args[4]) : defaultRenderSurfaceCount;
+		if (frameCount <= 0 || resolution.x <= 0 || resolution.y <= 0 || renderSurfaceCount <= 0)
+			throw "Invalid headless arguments";
+		runHeadlessBenchmark(frameCount, resolution, renderSurfaceCount, model, occlusionCulling, lod);
+		return;
+	}
+
+	// Usage: FoveOpenGLExample [--swap-interval N]
+	// The swap interval is the number of monitor refreshes each present of the mirror window waits for, 0 (the default) for no vsync
+	int swapInterval = 0;
+	for (size_t i = 0; i < args.size(); ++i)
+	{
+		if (args[i] == "--swap-interval" && i + 1 < args.size())
+			swapInterval = stoi(args[++i]);
+		else
+			throw "Unknown argument: " + args[i];
+	}
+
 	// Connect to headset, specifying the capabilities we will use
 	Fove::Headset headset = Fove::Headset::create(Fove::ClientCapabilities::OrientationTracking | Fove::ClientCapabilities::PositionTracking | Fove::ClientCapabilities::EyeTracking | Fove::ClientCapabilities::GazedObjectDetection).getValue();
 
@@ -218,63 +861,27 @@ try
 	NativeWindow nativeWindow = createNativeWindow(nativeLaunchInfo, "FOVE OpenGL Example");
 	NativeOpenGLContext nativeOpenGLContext = createOpenGLContext(nativeWindow);
 
-	// Set up a framebuffer which we will render to
-	// If we were unable to create a layer now (eg. compositor not running), use a default size while we wait for the compositor
-	RenderSurface renderSurface = generateRenderSurface(renderSurfaceSize);
-
-	// Create the shaders
-	const GlResource<GlResourceType::Program> mainShader = createShaderProgram(demoSceneVertSrc, demoSceneFragSrc);
-	const GlResource<GlResourceType::Program> texCopyShader = createShaderProgram(texCopyVertSrc, texCopyFragSrc);
-
-	// Helper function for getting uniform/attrib locations
-	// The gl functions glGetUniformLocation/glGetAttribLocation return a signed integer
-	// Native indicates that the attribute/uniform name doesn't exist
-	// Positive indicates the index of the item, but it must be converted to unsigned before use
-	// This function checks for error and then converts to unsigned
-	const auto Check = [](const GLint location, const char* const name) {
-		if (0 > location)
-			throw "Unable to find location of "s + name;
-		return location;
-	};
-
-	// Get data indexes for the shader inputs
-	// We will use these to bind data to the shader
-	const GLint mvpLoc = Check(glCall(glGetUniformLocation, mainShader, "mvp"), "mvp");
-	const GLint selectionLoc = Check(glCall(glGetUniformLocation, mainShader, "selection"), "selection");
-	const GLuint posLoc = (GLuint)Check(glCall(glGetAttribLocation, mainShader, "pos"), "pos");
-	const GLuint colorLoc = (GLuint)Check(glCall(glGetAttribLocation, mainShader, "color"), "color");
-	const GLuint texCopyPosLoc = (GLuint)Check(glCall(glGetAttribLocation, texCopyShader, "pos"), "pos");
-
-	// Setup the vertex buffer, uploading our model data to OpenGL (and the GPU)
-	const GlResource<GlResourceType::Buffer> vbo = [] {
-		GlResource<GlResourceType::Buffer> vbo;
-		vbo.createAndBind(GL_ARRAY_BUFFER);
-
-		glCall(glBufferData, GL_ARRAY_BUFFER, (GLsizeiptr)sizeof(levelModelVerts), levelModelVerts, GL_STATIC_DRAW);
-
-		return vbo;
-	}();
-
-	// Setup vertex array object
-	// This will associate the above buffer data with semantic meaning to the shader
-	const GlResource<GlResourceType::Vao> vao = [&] {
-		GlResource<GlResourceType::Vao> vao;
-		vao.createAndBind();
+	// The HMD frame rate is set by the compositor (see waitForRenderPose below), so presenting the mirror must not wait for the monitor
+	// With vsync requested, only the frames that can be presented without waiting are mirrored
+	setSwapInterval(nativeOpenGLContext, swapInterval);
+	MirrorPacer mirrorPacer(swapInterval);
 
-		// Attach the vertex buffer we created to the VAO
-		vbo.bind(GL_ARRAY_BUFFER);
+	// Set up the framebuffers which we will render to
+	// If we were unable to create a layer now (eg. compositor not running), use a default size while we wait for the compositor
+	RenderSurfaceRing renderSurfaces(renderSurfaceSize, defaultRenderSurfaceCount);
+	vector<FencedRenderSurface> retiredRenderSurfaces;
 
-		// Enable usage of the position/color attributes
-		glCall(glEnableVertexAttribArray, posLoc);
-		glCall(glEnableVertexAttribArray, colorLoc);
+	// The render surface is always allocated at full size, but under heavy load we only render to part of it
+	// This is driven by the GPU time of previous frames, so that we can keep up with the HMD refresh rate
+	DynamicResolution dynamicResolution;
+	GlGpuTimer gpuTimer;
 
-		// Bind the vertex array
-		constexpr GLsizei stride = static_cast<GLsizei>(sizeof(float) * floatsPerVert);
-		glCall(glVertexAttribPointer, posLoc, 4, GL_FLOAT, GL_FALSE, stride, (void*)0);
-		glCall(glVertexAttribPointer, colorLoc, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 4));
+	// Create the level model & its shader
+	SceneResources scene = createSceneResources(model, occlusionCulling, lod);
 
-		return vao;
-	}();
+	// Create the shader used to copy the render surface to the window
+	const GlResource<GlResourceType::Program> texCopyShader = createShaderProgram(texCopyVertSrc, texCopyFragSrc);
+	const GLuint texCopyPosLoc = (GLuint)checkLocation(glCall(glGetAttribLocation, texCopyShader, "pos"), "pos");
 
 	// Setup the vertex buffer, uploading our model data to OpenGL (and the GPU)
 	const GlResource<GlResourceType::Buffer> fullscreenQuadVbo = [] {
@@ -331,23 +938,20 @@ try
 
 		// This can also be done manually if needed, using the gaze vectors,
 		// but we recommend using the FOVE API, as the additional scene info can increase the accuracy of ET
-		constexpr size_t numSphereFloats = sizeof(collisionSpheres) / sizeof(float);
-		static_assert(numSphereFloats % 5 == 0, "Invalid collision sphere format");
-		constexpr size_t numSpheres = numSphereFloats / 5;
-		for (size_t i = 0; i < numSpheres; ++i)
+		for (size_t i = 0; i < model.sphereCount(); ++i)
 		{
-			[[maybe_unused]] const float selectionid = collisionSpheres[i * 5 + 0];
+			const float* const sphere = &model.spheres[i * sceneFloatsPerSphere];
 
 			Fove::ObjectCollider collider;
-			collider.center = Fove::Vec3{collisionSpheres[i * 5 + 2], collisionSpheres[i * 5 + 3], collisionSpheres[i * 5 + 4]};
+			collider.center = Fove::Vec3{sphere[2], sphere[3], sphere[4]};
 			collider.shapeType = Fove::ColliderType::Sphere;
-			collider.shapeDefinition.sphere.radius = collisionSpheres[i * 5 + 1];
+			collider.shapeDefinition.sphere.radius = sphere[1];
 
 			Fove::GazableObject object;
 			object.colliderCount = 1;
 			object.colliders = &collider;
 			object.group = Fove::ObjectGroup::Group0; // Groups allows masking of different objects to difference cameras (not needed here)
-			object.id = static_cast<int>(collisionSpheres[i * 5 + 0]);
+			object.id = static_cast<int>(sphere[0]);
 			checkError(headset.registerGazableObject(object), "registerGazableObject");
 		}
 	}
@@ -357,6 +961,10 @@ try
 	{
 		// Update
 		float selection = -1; // Selected model that will be computed each time in the update phase
+
+		// Combined gaze ray, when eye tracking is available, which the levels of detail follow
+		optional<Fove::Ray> gazeRay;
+
 		{
 			if (!flushWindowEvents(nativeWindow))
 				break;
@@ -371,7 +979,14 @@ try
 				{
 					if ((layerOrError = compositor.createLayer(layerCreateInfo)).isValid())
 					{
-						// Todo: resize rendering surface
+						// We were rendering at the default size so far, switch to the resolution the compositor wants
+						const Fove::Vec2i idealSize = layerOrError->idealResolutionPerEye;
+						if (idealSize.x != renderSurfaceSize.x || idealSize.y != renderSurfaceSize.y)
+						{
+							renderSurfaces.retire(retiredRenderSurfaces);
+							renderSurfaces = RenderSurfaceRing(idealSize, defaultRenderSurfaceCount);
+							renderSurfaceSize = idealSize;
+						}
 					}
 				}
 			}
@@ -381,6 +996,8 @@ try
 			if (const Fove::Result<int> gazeOrError = headset.getGazedObjectId())
 				if (gazeOrError.getValue() != fove_ObjectIdInvalid)
 					selection = static_cast<float>(gazeOrError.getValue());
+			if (const Fove::Result<Fove::Ray> rayOrError = headset.getCombinedGazeRay())
+				gazeRay = rayOrError.getValue();
 		}
 
 		// Wait for the compositor to tell us to render
@@ -397,29 +1014,21 @@ try
 			this_thread::sleep_for(10ms);
 		}
 
-		// Render the scene
+		// Pick the resolution of this frame based on the GPU time of the previous frames
+		float gpuTimeMs = 0;
+		if (gpuTimer.poll(gpuTimeMs))
 		{
-			// Bind our framebuffer so that we render to a texture
-			renderSurface.fbo.bind(GL_FRAMEBUFFER);
-
-			// Clear the back buffer to a nice sky blue
-			glCall(glClearColor, 0.3f, 0.3f, 0.8f, 0.3f);
-			glCall(glClear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-			// Bind the various state we use for rendering the scene
-			mainShader.bind();
-			vao.bind();
-			glCall(glEnable, GL_DEPTH_TEST);
-
-			// Update selection
-			glCall(glUniform1f, selectionLoc, (GLfloat)selection);
+			const float previousScale = dynamicResolution.scale();
+			if (dynamicResolution.update(gpuTimeMs) != previousScale)
+				cout << "Resolution scale: " << dynamicResolution.scale() << " (GPU time " << dynamicResolution.smoothedGpuTimeMs() << "ms)" << endl;
+		}
+		const EyeViewport eyeViewport = scaledEyeViewport(renderSurfaceSize, dynamicResolution.scale());
 
-			// Compute the modelview matrix
-			// Everything here is reverse since we are moving the world we are going to draw, not the camera
-			const Fove::Matrix44 modelview = quatToMatrix(conjugate(pose.orientation))                                 // Apply the HMD orientation
-											 * translationMatrix(-pose.position.x, -pose.position.y, -pose.position.z) // Apply the position tracking offset
-											 * translationMatrix(0, -playerHeight, 0);                                 // Move ground downwards to compensate for player height
+		// Render to the next surface, while the compositor may still be reading the previous one
+		const RenderSurface& renderSurface = renderSurfaces.acquire();
 
+		// Render the scene
+		{
 			// Get distance between eyes to shift camera for stereo effect
 			const Fove::Result<float> iodOrError = headset.getRenderIOD();
 			const float halfIOD = 0.5f * (iodOrError.isValid() ? iodOrError.getValue() : 0.064f);
@@ -428,23 +1037,9 @@ try
 			Fove::Result<Fove::Stereo<Fove::Matrix44>> projectionsOrError = headset.getProjectionMatricesLH(0.01f, 1000.0f);
 			if (projectionsOrError.isValid())
 			{
-				// Helper function to render the scene
-				const auto RenderScene = [&](bool isLeft) {
-					// Setup the viewport such that we only render to the right/left half of the texture
-					glViewport(isLeft ? 0 : renderSurfaceSize.x, 0, renderSurfaceSize.x, renderSurfaceSize.y);
-
-					// Update clip matrix
-					Fove::Matrix44 mvp = transpose(isLeft ? projectionsOrError->l : projectionsOrError->r) * (translationMatrix(isLeft ? halfIOD : -halfIOD, 0, 0) * modelview);
-					glCall(glUniformMatrix4fv, mvpLoc, 1, true, (const float*)mvp.mat);
-
-					// Issue draw command
-					static constexpr size_t numVerts = sizeof(levelModelVerts) / (sizeof(float) * floatsPerVert);
-					glCall(glDrawArrays, GL_TRIANGLES, 0, (GLsizei)numVerts);
-				};
-
-				// Render the scene twice, once for the left, once for the right
-				RenderScene(true);
-				RenderScene(false);
+				gpuTimer.begin();
+				renderScene(scene, renderSurface, renderSurfaceSize, eyeViewport, pose, projectionsOrError.getValue(), halfIOD, selection, gazeRay ? &*gazeRay : nullptr);
+				gpuTimer.end();
 			}
 		}
 
@@ -459,39 +1054,65 @@ try
 			submitInfo.left.texInfo = &tex;
 			submitInfo.right.texInfo = &tex;
 
-			Fove::TextureBounds bounds;
-			bounds.top = 0;
-			bounds.bottom = 1;
-			bounds.left = 0;
-			bounds.right = 0.5f;
-			submitInfo.left.bounds = bounds;
-			bounds.left = 0.5f;
-			bounds.right = 1;
-			submitInfo.right.bounds = bounds;
+			// Only submit the part of each half that we rendered to
+			submitInfo.left.bounds = eyeTextureBounds(eyeViewport, renderSurfaceSize, true);
+			submitInfo.right.bounds = eyeTextureBounds(eyeViewport, renderSurfaceSize, false);
 
 			compositor.submit(submitInfo); // Error ignored, just continue rendering to the window when we're disconnected
+
+			// The FOVE API may use our GL context to read the texture, so the state cache can't assume the state is unchanged
+			glStateCache().invalidate();
 		}
 
 		// Present the rendered image to the screen
+		if (mirrorPacer.shouldPresent(chrono::steady_clock::now()))
 		{
+			const GlDebugGroup debugGroup("Mirror blit");
+
 			// Bind the default framebuffer (index 0, that of the window)
 			// No glClear is needed since we will fill the whole view
-			glCall(glBindFramebuffer, GL_FRAMEBUFFER, 0);
+			glStateCache().bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 			// Bind the various state we need to
-			applyWindowViewport(nativeWindow, nativeOpenGLContext);
-			glCall(glDisable, GL_DEPTH_TEST);
+			glStateCache().disable(GL_DEPTH_TEST);
 			texCopyShader.bind();
 			fullscreenQuadVao.bind();
+			glStateCache().activeTexture(GL_TEXTURE0);
 			renderSurface.fboTexture.bind(GL_TEXTURE_2D);
 
-			// Draw 2 triangles forming a full screen quad
-			glCall(glDrawArrays, GL_TRIANGLES, 0, 6);
+			// Copy each eye to its half of the window
+			// The viewport is stretched so that only the rendered part of the eye lands in the window half, and the scissor cuts off the rest
+			const Fove::Vec2i windowSize = getWindowViewportSize(nativeWindow);
+			glStateCache().enable(GL_SCISSOR_TEST);
+			for (const bool isLeft : {true, false})
+			{
+				const Fove::TextureBounds bounds = eyeTextureBounds(eyeViewport, renderSurfaceSize, isLeft);
+				const ViewportRect uvRect{bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top};
+				const ViewportRect destRect{isLeft ? 0.0f : windowSize.x / 2.0f, 0.0f, windowSize.x / 2.0f, static_cast<float>(windowSize.y)};
+				const ViewportRect viewport = uvRectToViewport(uvRect, destRect);
+				glStateCache().viewport(lround(viewport.x), lround(viewport.y), lround(viewport.width), lround(viewport.height));
+				glCall(glScissor, lround(destRect.x), 0, lround(destRect.width), windowSize.y);
+
+				// Draw 2 triangles forming a full screen quad
+				glCall(glDrawArrays, GL_TRIANGLES, 0, 6);
+			}
+			glStateCache().disable(GL_SCISSOR_TEST);
 
 			// Swap buffers to display our new frame to the main window
+			const auto presentStart = chrono::steady_clock::now();
 			swapBuffers(nativeWindow, nativeOpenGLContext);
+			mirrorPacer.presented(presentStart, chrono::steady_clock::now());
 		}
 
+		// The render surface is no longer used by this frame
+		renderSurfaces.release();
+
+		// Delete any old render surfaces that the GPU is done with
+		retiredRenderSurfaces.erase(remove_if(retiredRenderSurfaces.begin(), retiredRenderSurfaces.end(), [](const FencedRenderSurface& retired) { return retired.fence.isSignaled(); }), retiredRenderSurfaces.end());
+
+		// Check the GL errors of the whole frame at once, when glCall doesn't check every call (see GlCheckPolicy in OpenGLUtil.h)
+		glCheckFrameErrors();
+
 		// Update camera position used by FOVE gaze detection
 		Fove::ObjectPose camPose;
 		camPose.position = pose.position;
@@ -504,5 +1125,5 @@ try
 catch (...)
 {
 	// Display any error as a popup box then exit the program
-	showErrorBox("Error: " + currentExceptionMessage());
+	showErrorBox(currentExceptionMessage());
 }
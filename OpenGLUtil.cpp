@@ -1,12 +1,268 @@
 #include "OpenGLUtil.h"
 #include "NativeUtil.h"
 #include "Util.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
-void glCheckError(const char* function)
+namespace
+{
+
+// Failures reported by the KHR_debug callback since the last glCheckDeferredErrors()
+// The callback is synchronous, so it runs on the thread of the failing call, which is also the one checking
+constexpr size_t maxRecordedGlErrors = 16;
+thread_local vector<string> recordedGlErrors;
+
+// Whether GlDebugGroup should push debug groups, which is only once a debug callback is installed
+atomic<bool> debugGroupsEnabled{false};
+
+// Message of the KHR_debug callback, copied into fixed size buffers so that the callback never allocates
+struct GlDebugMessage
+{
+	GLenum type = 0;
+	GLenum severity = 0;
+	array<char, 128> groups{}; // Debug groups open when the message was emitted, outermost first, separated by '/'
+	array<char, 384> text{};
+};
+
+// Bounded multi-producer multi-consumer queue, where each slot has a sequence number telling whether it's free or full
+// Pushing and popping are lock-free, and never wait: push() fails when the queue is full, pop() when it's empty
+// Drivers may run the callback from several threads, hence multiple producers
+class GlDebugMessageQueue
+{
+public:
+	GlDebugMessageQueue()
+	{
+		for (size_t i = 0; i < capacity; ++i)
+			slots_[i].sequence.store(i, memory_order_relaxed);
+	}
+
+	bool push(const GlDebugMessage& message)
+	{
+		size_t pos = tail_.load(memory_order_relaxed);
+		while (true)
+		{
+			Slot& slot = slots_[pos % capacity];
+			const intptr_t diff = (intptr_t)slot.sequence.load(memory_order_acquire) - (intptr_t)pos;
+			if (diff == 0 && tail_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+			{
+				slot.message = message;
+				slot.sequence.store(pos + 1, memory_order_release);
+				return true;
+			}
+			if (diff < 0)
+				return false; // The slot still holds the message of the previous lap
+			if (diff > 0)
+				pos = tail_.load(memory_order_relaxed); // Another producer took the slot
+		}
+	}
+
+	bool pop(GlDebugMessage& message)
+	{
+		size_t pos = head_.load(memory_order_relaxed);
+		while (true)
+		{
+			Slot& slot = slots_[pos % capacity];
+			const intptr_t diff = (intptr_t)slot.sequence.load(memory_order_acquire) - (intptr_t)(pos + 1);
+			if (diff == 0 && head_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+			{
+				message = slot.message;
+				slot.sequence.store(pos + capacity, memory_order_release);
+				return true;
+			}
+			if (diff < 0)
+				return false;
+			if (diff > 0)
+				pos = head_.load(memory_order_relaxed);
+		}
+	}
+
+private:
+	static constexpr size_t capacity = 256;
+
+	struct Slot
+	{
+		atomic<size_t> sequence{0};
+		GlDebugMessage message;
+	};
+
+	array<Slot, capacity> slots_;
+	alignas(64) atomic<size_t> tail_{0};
+	alignas(64) atomic<size_t> head_{0};
+};
+
+// State of the asynchronous debug log, see installGlDebugLog()
+// The log thread is stopped and joined at exit, after printing the messages left in the queue
+class GlDebugLog
+{
+public:
+	GlDebugLog()
+		: thread_([this] { run(); })
+	{
+	}
+
+	~GlDebugLog()
+	{
+		stop_ = true;
+		thread_.join();
+	}
+
+	void post(const GlDebugMessage& message)
+	{
+		if (queue_.push(message))
+		{
+			++messages;
+			if (message.type == GL_DEBUG_TYPE_ERROR)
+				++errors;
+		}
+		else
+		{
+			++dropped;
+		}
+	}
+
+	atomic<uint64_t> messages{0};
+	atomic<uint64_t> errors{0};
+	atomic<uint64_t> dropped{0};
+
+private:
+	static const char* typeName(const GLenum type)
+	{
+		switch (type)
+		{
+		case GL_DEBUG_TYPE_ERROR:
+			return "error";
+		case 0x824D: // GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR
+			return "deprecated behavior";
+		case 0x824E: // GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR
+			return "undefined behavior";
+		case 0x824F: // GL_DEBUG_TYPE_PORTABILITY
+			return "portability";
+		case 0x8250: // GL_DEBUG_TYPE_PERFORMANCE
+			return "performance";
+		default:
+			return "message";
+		}
+	}
+
+	void run()
+	{
+		// Polling keeps the callback wait-free: waking a sleeping thread from it would need a lock or a system call
+		GlDebugMessage message;
+		for (bool stopping = false; !stopping;)
+		{
+			stopping = stop_;
+			while (queue_.pop(message))
+			{
+				const char* const severity = message.severity == GL_DEBUG_SEVERITY_HIGH ? "high" : message.severity == GL_DEBUG_SEVERITY_MEDIUM ? "medium" : "low";
+				cerr << "GL " << typeName(message.type) << " (" << severity << " severity)" << (message.groups[0] ? " in "s + message.groups.data() : ""s) << ": " << message.text.data() << endl;
+			}
+			if (!stopping)
+				this_thread::sleep_for(chrono::milliseconds{10});
+		}
+	}
+
+	GlDebugMessageQueue queue_;
+	atomic<bool> stop_{false};
+	thread thread_;
+};
+
+unique_ptr<GlDebugLog> debugLog;
+
+// Copies a string into a fixed size buffer, truncating it if needed
+template <size_t Size>
+void copyTruncated(array<char, Size>& out, size_t offset, const char* str)
+{
+	for (; offset + 1 < Size && *str; ++offset)
+		out[offset] = *str++;
+	out[min(offset, Size - 1)] = '\0';
+}
+
+#ifdef GL_DEBUG_OUTPUT
+// Debug groups currently open, as reported by the push/pop group messages
+// Asynchronous output may run the callback on several driver threads at once, so each thread keeps the groups of the messages it delivers,
+// which is the thread of the GL calls with synchronous output, and otherwise shares nothing that could race with the other threads
+constexpr int maxDebugGroupDepth = 8;
+thread_local array<array<char, 32>, maxDebugGroupDepth> debugGroups{};
+thread_local int debugGroupDepth = 0;
+
+void APIENTRY onGlDebugMessage(GLenum, const GLenum type, GLuint, const GLenum severity, GLsizei, const GLchar* const message, const void*)
+{
+	// The message is only valid during the callback, so the group names are copied
+	if (type == GL_DEBUG_TYPE_PUSH_GROUP)
+	{
+		if (debugGroupDepth < maxDebugGroupDepth)
+			copyTruncated(debugGroups[debugGroupDepth], 0, message);
+		++debugGroupDepth;
+		return;
+	}
+	if (type == GL_DEBUG_TYPE_POP_GROUP)
+	{
+		debugGroupDepth = max(debugGroupDepth - 1, 0);
+		return;
+	}
+
+	GlDebugMessage copy;
+	copy.type = type;
+	copy.severity = severity;
+	for (int i = 0; i < min(debugGroupDepth, maxDebugGroupDepth); ++i)
+	{
+		if (i > 0)
+			copyTruncated(copy.groups, strlen(copy.groups.data()), "/");
+		copyTruncated(copy.groups, strlen(copy.groups.data()), debugGroups[i].data());
+	}
+
+	if (debugLog)
+	{
+		copyTruncated(copy.text, 0, message);
+		debugLog->post(copy);
+	}
+	else if (recordedGlErrors.size() < maxRecordedGlErrors)
+	{
+		// Synchronous output runs the callback from within the failing call, so glCurrentCall is that call
+		recordedGlErrors.push_back(glFuncToString(glCurrentCall) + (copy.groups[0] ? " in "s + copy.groups.data() : ""s) + ": " + message);
+	}
+}
+
+// Enables the push/pop group messages, so that the callback knows the debug groups of the other messages
+void enableDebugGroupMessages()
+{
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+}
+#endif
+
+// Sets up the error reporting of the new context
+void setupGlErrorChecks()
+{
+	if constexpr (glCheckPolicy == GlCheckPolicy::PerFrame)
+	{
+		if (installGlErrorCallback())
+			cout << "GL errors are checked once per frame, and located with KHR_debug" << endl;
+		else
+			cout << "GL errors are checked once per frame, KHR_debug is unavailable to locate them" << endl;
+	}
+	else if constexpr (glCheckPolicy == GlCheckPolicy::Async)
+	{
+		if (installGlDebugLog())
+			cout << "GL errors are reported asynchronously with KHR_debug" << endl;
+		else
+			cout << "GL errors are not checked, KHR_debug is unavailable" << endl;
+	}
+}
+
+// Reads and clears the current GL errors, and returns their names, or an empty string if there are none
+string drainGlErrors()
 {
 	string errorStr;
 	const auto append = [&errorStr](string str) {
@@ -44,61 +300,253 @@ void glCheckError(const char* function)
 			break;
 		};
 	}
+	return errorStr;
+}
 
+} // namespace
+
+bool hasGlExtensions(const initializer_list<const char*> names)
+{
+	// GL 3.0+ (and ES 3.0+) list the extensions one by one, which core contexts require since they no longer have the whole list in one string
+	// The version string is always available, so the query is picked from it instead of trying glGetString(GL_EXTENSIONS) and clearing the error,
+	// which would also clear the errors of earlier calls that the PerFrame policy has yet to report
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (!version)
+		return false;
+	while (*version && (*version < '0' || *version > '9')) // Skip the "OpenGL ES " prefix of ES contexts
+		++version;
+	vector<string> extensions;
+	if (atoi(version) >= 3)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i)
+			if (const char* const extension = (const char*)glGetStringi(GL_EXTENSIONS, i))
+				extensions.emplace_back(extension);
+	}
+	else if (const char* all = (const char*)glGetString(GL_EXTENSIONS))
+	{
+		while (*all)
+		{
+			const size_t length = strcspn(all, " ");
+			if (length > 0)
+				extensions.emplace_back(all, length);
+			all += length + (all[length] == ' ');
+		}
+	}
+
+	return all_of(names.begin(), names.end(), [&](const char* const name) { return find(extensions.begin(), extensions.end(), name) != extensions.end(); });
+}
+
+bool hasGlExtension(const char* const name)
+{
+	return hasGlExtensions({name});
+}
+
+void glCheckError(const char* function)
+{
+	const string errorStr = drainGlErrors();
 	if (!errorStr.empty())
 		throw "Error in "s + function + ": " + errorStr;
 }
 
+void glCheckCallError(const void* const func)
+{
+	const string errorStr = drainGlErrors();
+	if (!errorStr.empty())
+		throw "Error in "s + glFuncToString(func) + ": " + errorStr;
+}
+
+void glCheckDeferredErrors()
+{
+	const string errorStr = drainGlErrors();
+	if (errorStr.empty() && recordedGlErrors.empty())
+		return;
+
+	string message = "GL errors since the last check: " + (errorStr.empty() ? "(already cleared)"s : errorStr);
+	for (const string& recorded : recordedGlErrors)
+		message += "\n- " + recorded;
+	recordedGlErrors.clear();
+	throw message;
+}
+
+bool installGlErrorCallback()
+{
+#ifdef GL_DEBUG_OUTPUT
+	if (!hasGlExtension("GL_KHR_debug"))
+		return false;
+
+	// Synchronous output runs the callback from within the failing call, so glCurrentCall is that call
+	// Only errors are reported, the other messages (performance hints, etc.) are disabled
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+	enableDebugGroupMessages();
+	glDebugMessageCallback(&onGlDebugMessage, nullptr);
+	glCheckError("installGlErrorCallback");
+	debugGroupsEnabled = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool installGlDebugLog()
+{
+#ifdef GL_DEBUG_OUTPUT
+	if (!hasGlExtension("GL_KHR_debug"))
+		return false;
+
+	// The log thread is started before the callback can post anything
+	if (!debugLog)
+		debugLog = make_unique<GlDebugLog>();
+
+	// Without GL_DEBUG_OUTPUT_SYNCHRONOUS, the driver doesn't have to report messages from within the call causing them,
+	// which would force it to validate calls right away, rather than on its own threads
+	glEnable(GL_DEBUG_OUTPUT);
+	glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_HIGH, 0, nullptr, GL_TRUE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_MEDIUM, 0, nullptr, GL_TRUE);
+	enableDebugGroupMessages();
+	glDebugMessageCallback(&onGlDebugMessage, nullptr);
+	glCheckError("installGlDebugLog");
+	debugGroupsEnabled = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+GlDebugLogStats glDebugLogStats()
+{
+	GlDebugLogStats stats;
+	if (debugLog)
+	{
+		stats.messages = debugLog->messages;
+		stats.errors = debugLog->errors;
+		stats.dropped = debugLog->dropped;
+	}
+	return stats;
+}
+
+GlDebugGroup::GlDebugGroup(const char* const name)
+{
+#ifdef GL_DEBUG_OUTPUT
+	if (debugGroupsEnabled.load(memory_order_relaxed))
+	{
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+		pushed_ = true;
+	}
+#endif
+}
+
+GlDebugGroup::~GlDebugGroup()
+{
+#ifdef GL_DEBUG_OUTPUT
+	if (pushed_)
+		glPopDebugGroup();
+#endif
+}
+
 const char* glFuncToString(const void* const func)
 {
 	static const map<const void*, const char*> functions = {
 		{(const void*)&delAdapter<&glDeleteBuffers>, "glDeleteBuffers"},
 		{(const void*)&delAdapter<&glDeleteFramebuffers>, "glDeleteFramebuffers"},
+		{(const void*)&delAdapter<&glDeleteQueries>, "glDeleteQueries"},
 		{(const void*)&delAdapter<&glDeleteRenderbuffers>, "glDeleteRenderbuffers"},
 		{(const void*)&delAdapter<&glDeleteTextures>, "glDeleteTextures"},
 		{(const void*)&delAdapter<&glDeleteVertexArrays>, "glDeleteVertexArrays"},
 		{(const void*)&genAdapter<&glGenBuffers>, "glGenBuffers"},
 		{(const void*)&genAdapter<&glGenFramebuffers>, "glGenFramebuffers"},
+		{(const void*)&genAdapter<&glGenQueries>, "glGenQueries"},
 		{(const void*)&genAdapter<&glGenRenderbuffers>, "glGenRenderbuffers"},
 		{(const void*)&genAdapter<&glGenTextures>, "glGenTextures"},
 		{(const void*)&genAdapter<&glGenVertexArrays>, "glGenVertexArrays"},
+		{(const void*)&glActiveTexture, "glActiveTexture"},
 		{(const void*)&glAttachShader, "glAttachShader"},
+		{(const void*)&glBeginQuery, "glBeginQuery"},
 		{(const void*)&glBindBuffer, "glBindBuffer"},
+		{(const void*)&glBindBufferBase, "glBindBufferBase"},
+		{(const void*)&glBindBufferRange, "glBindBufferRange"},
 		{(const void*)&glBindFramebuffer, "glBindFramebuffer"},
+#ifdef GL_DRAW_INDIRECT_BUFFER
+		{(const void*)&glBindImageTexture, "glBindImageTexture"},
+#endif
 		{(const void*)&glBindRenderbuffer, "glBindRenderbuffer"},
 		{(const void*)&glBindTexture, "glBindTexture"},
 		{(const void*)&glBindVertexArray, "glBindVertexArray"},
+		{(const void*)&glBlitFramebuffer, "glBlitFramebuffer"},
 		{(const void*)&glBufferData, "glBufferData"},
+#ifdef GL_MAP_PERSISTENT_BIT
+		{(const void*)&glBufferStorage, "glBufferStorage"},
+#endif
+		{(const void*)&glBufferSubData, "glBufferSubData"},
 		{(const void*)&glCheckFramebufferStatus, "glCheckFramebufferStatus"},
 		{(const void*)&glClear, "glClear"},
+#ifdef GL_DRAW_INDIRECT_BUFFER
+		{(const void*)&glClearBufferSubData, "glClearBufferSubData"},
+#endif
 		{(const void*)&glClearColor, "glClearColor"},
+		{(const void*)&glClientWaitSync, "glClientWaitSync"},
 		{(const void*)&glCompileShader, "glCompileShader"},
 		{(const void*)&glCreateProgram, "glCreateProgram"},
 		{(const void*)&glCreateShader, "glCreateShader"},
 		{(const void*)&glDeleteProgram, "glDeleteProgram"},
 		{(const void*)&glDeleteShader, "glDeleteShader"},
+		{(const void*)&glDebugMessageCallback, "glDebugMessageCallback"},
+		{(const void*)&glDebugMessageControl, "glDebugMessageControl"},
+		{(const void*)&glDeleteSync, "glDeleteSync"},
 		{(const void*)&glDetachShader, "glDetachShader"},
 		{(const void*)&glDisable, "glDisable"},
+#ifdef GL_DRAW_INDIRECT_BUFFER
+		{(const void*)&glDispatchCompute, "glDispatchCompute"},
+#endif
 		{(const void*)&glDrawArrays, "glDrawArrays"},
 		{(const void*)&glEnable, "glEnable"},
 		{(const void*)&glEnableVertexAttribArray, "glEnableVertexAttribArray"},
+		{(const void*)&glEndQuery, "glEndQuery"},
+		{(const void*)&glFenceSync, "glFenceSync"},
+		{(const void*)&glFinish, "glFinish"},
 		{(const void*)&glFramebufferRenderbuffer, "glFramebufferRenderbuffer"},
 		{(const void*)&glFramebufferTexture, "glFramebufferTexture"},
 		{(const void*)&glGenVertexArrays, "glGenVertexArrays"},
 		{(const void*)&glGetAttribLocation, "glGetAttribLocation"},
+		{(const void*)&glGetBufferSubData, "glGetBufferSubData"},
+		{(const void*)&glGetIntegerv, "glGetIntegerv"},
 		{(const void*)&glGetProgramInfoLog, "glGetProgramInfoLog"},
 		{(const void*)&glGetProgramiv, "glGetProgramiv"},
+		{(const void*)&glGetQueryObjectiv, "glGetQueryObjectiv"},
+		{(const void*)&glGetQueryObjectui64v, "glGetQueryObjectui64v"},
 		{(const void*)&glGetShaderInfoLog, "glGetShaderInfoLog"},
 		{(const void*)&glGetShaderiv, "glGetShaderiv"},
 		{(const void*)&glGetString, "glGetString"},
+		{(const void*)&glGetUniformBlockIndex, "glGetUniformBlockIndex"},
 		{(const void*)&glGetUniformLocation, "glGetUniformLocation"},
 		{(const void*)&glLinkProgram, "glLinkProgram"},
+		{(const void*)&glMapBufferRange, "glMapBufferRange"},
+#ifdef GL_DRAW_INDIRECT_BUFFER
+		{(const void*)&glMemoryBarrier, "glMemoryBarrier"},
+		{(const void*)&glMultiDrawArraysIndirect, "glMultiDrawArraysIndirect"},
+		{(const void*)&glMultiDrawArraysIndirectCountARB, "glMultiDrawArraysIndirectCountARB"},
+#endif
+		{(const void*)&glReadPixels, "glReadPixels"},
+		{(const void*)&glScissor, "glScissor"},
 		{(const void*)&glShaderSource, "glShaderSource"},
 		{(const void*)&glTexImage2D, "glTexImage2D"},
 		{(const void*)&glTexParameteri, "glTexParameteri"},
+#ifdef GL_DRAW_INDIRECT_BUFFER
+		{(const void*)&glTexStorage2D, "glTexStorage2D"},
+#endif
 		{(const void*)&glUniform1f, "glUniform1f"},
+		{(const void*)&glUniformBlockBinding, "glUniformBlockBinding"},
 		{(const void*)&glUniformMatrix4fv, "glUniformMatrix4fv"},
 		{(const void*)&glUseProgram, "glUseProgram"},
+		{(const void*)&glVertexAttribDivisor, "glVertexAttribDivisor"},
+		{(const void*)&glVertexAttribIPointer, "glVertexAttribIPointer"},
 		{(const void*)&glVertexAttribPointer, "glVertexAttribPointer"},
 		{(const void*)&glViewport, "glViewport"},
 	};
@@ -188,10 +636,16 @@ try
 
 	// Make the context active and connect it with the surface
 	eglMakeCurrent(eglDisplay, eglSurface, eglSurface, egl_context);
+
+	ret.display = eglDisplay;
+	ret.surface = eglSurface;
+	ret.context = egl_context;
 #endif
 
 	// Check that our initial OpenGL state has no error
 	glCheckError("InitialGLState");
+	setupGlErrorChecks();
+	glStateCache().invalidate(); // In case this thread had another context before
 
 	// Log the GL version
 	const char* const version = (const char*)glCall(glGetString, GL_VERSION);
@@ -203,11 +657,127 @@ catch (...)
 	throw "Unable to create GL context: " + currentExceptionMessage();
 }
 
-void applyWindowViewport(NativeWindow& window, NativeOpenGLContext& context)
+NativeOpenGLContext createHeadlessOpenGLContext()
+try
+{
+	NativeOpenGLContext ret;
+
+#ifdef _WIN32
+	// WGL always needs a window (even a hidden one) to create a context, which is out of the scope of this example
+	throw "Headless OpenGL is not implemented on Windows";
+#else
+	// Prefer the Mesa surfaceless platform, which works without any X11 or Wayland server (eg. llvmpipe on a build machine)
+	// The platform extensions are client extensions, so they are queried without a display
+	const char* const clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+	{
+		const auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			ret.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+
+	// Otherwise fall back on whatever the default display of this system is
+	if (ret.display == EGL_NO_DISPLAY)
+		ret.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (ret.display == EGL_NO_DISPLAY)
+		throw "eglGetDisplay failed";
+	if (eglInitialize(ret.display, nullptr, nullptr) != EGL_TRUE)
+		throw "eglInitialize failed:" + to_string(eglGetError());
+
+	// Our shaders are desktop GLSL, so ask for desktop GL rather than GLES
+	if (eglBindAPI(EGL_OPENGL_API) != EGL_TRUE)
+		throw "eglBindAPI failed:" + to_string(eglGetError());
+
+	// If the display lets us make a context current without any surface, we don't need a pbuffer at all
+	const char* const displayExtensions = eglQueryString(ret.display, EGL_EXTENSIONS);
+	const bool surfaceless = displayExtensions && strstr(displayExtensions, "EGL_KHR_surfaceless_context");
+
+	// Specify our requirements for an EGL config
+	const EGLint eglAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, surfaceless ? EGL_DONT_CARE : EGL_PBUFFER_BIT,
+		EGL_NONE};
+
+	// Choose an EGL config, we simply pick the first one
+	EGLConfig eglConfig;
+	EGLint configCount = 0;
+	if (eglChooseConfig(ret.display, eglAttribs, &eglConfig, 1, &configCount) != EGL_TRUE)
+		throw "eglChooseConfig failed:" + to_string(eglGetError());
+	if (configCount != 1)
+		throw "egl wrong number of configs "s + to_string(configCount);
+
+	// Create a tiny pbuffer to satisfy eglMakeCurrent if needed
+	// Nothing is ever drawn to it, all rendering goes to our own framebuffer objects
+	if (!surfaceless)
+	{
+		const EGLint pbufferAttribs[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE};
+		ret.surface = eglCreatePbufferSurface(ret.display, eglConfig, pbufferAttribs);
+		if (ret.surface == EGL_NO_SURFACE)
+			throw "eglCreatePbufferSurface failed:" + to_string(eglGetError());
+	}
+
+	// Create our EGL context
+	const EGLint eglContextAttribs[] = {EGL_NONE};
+	ret.context = eglCreateContext(ret.display, eglConfig, EGL_NO_CONTEXT, eglContextAttribs);
+	if (ret.context == EGL_NO_CONTEXT)
+		throw "eglCreateContext:" + to_string(eglGetError());
+
+	// Make the context active, with no default framebuffer in the surfaceless case
+	if (eglMakeCurrent(ret.display, ret.surface, ret.surface, ret.context) != EGL_TRUE)
+		throw "eglMakeCurrent failed:" + to_string(eglGetError());
+	cout << "Created headless EGL context (" << (surfaceless ? "surfaceless" : "pbuffer") << ")" << endl;
+#endif
+
+	// Check that our initial OpenGL state has no error
+	glCheckError("InitialGLState");
+	setupGlErrorChecks();
+	glStateCache().invalidate(); // In case this thread had another context before
+
+	// Log the GL renderer, so benchmark results can be tied to a driver (eg. llvmpipe)
+	const char* const version = (const char*)glCall(glGetString, GL_VERSION);
+	const char* const renderer = (const char*)glCall(glGetString, GL_RENDERER);
+	cout << "GL Version is: " << (version ? version : "unknown") << endl;
+	cout << "GL Renderer is: " << (renderer ? renderer : "unknown") << endl;
+	return ret;
+}
+catch (...)
+{
+	throw "Unable to create headless GL context: " + currentExceptionMessage();
+}
+
+Fove::Vec2i getWindowViewportSize(NativeWindow& window)
 {
 #ifdef _WIN32
-	// Todo: update this as the window resizes
-	glViewport(0, 0, windowSizeX, windowSizeY);
+	RECT rect;
+	if (!GetClientRect(window.window, &rect))
+		throw "GetClientRect: " + getLastErrorAsString();
+	return Fove::Vec2i{rect.right - rect.left, rect.bottom - rect.top};
+#elif defined(__APPLE__)
+	return Fove::Vec2i{0, 0};
+#else
+	// The size tracked by the event thread is the latest one, while the EGL surface only catches up on the next swap
+	// The default framebuffer is resized with the window, so rendering to the new size right away is fine
+	const XWindowSize size = window.windowSize();
+	return Fove::Vec2i{static_cast<int>(size.width), static_cast<int>(size.height)};
+#endif
+}
+
+void setSwapInterval(NativeOpenGLContext& context, const int interval)
+{
+#ifdef _WIN32
+	const auto wglSwapIntervalEXT = (BOOL(WINAPI*)(int))wglGetProcAddress("wglSwapIntervalEXT");
+	if (!wglSwapIntervalEXT)
+		throw "WGL_EXT_swap_control is not supported";
+	if (!wglSwapIntervalEXT(interval))
+		throw "wglSwapIntervalEXT: " + getLastErrorAsString();
+#elif defined(__APPLE__)
+#else
+	// EGL silently clamps the interval to the range supported by the config (EGL_MIN_SWAP_INTERVAL to EGL_MAX_SWAP_INTERVAL)
+	if (eglSwapInterval(context.display, interval) != EGL_TRUE)
+		throw "eglSwapInterval failed:" + to_string(eglGetError());
 #endif
 }
 
@@ -222,5 +792,382 @@ void swapBuffers(NativeWindow& window, NativeOpenGLContext& context)
 	// Tell windows to swap buffers
 	if (!::SwapBuffers(deviceContext))
 		throw "SwapBuffers: " + getLastErrorAsString();
+#elif defined(__APPLE__)
+#else
+	// Headless contexts have no window surface to present (only a pbuffer, or nothing at all)
+	if (context.surface != EGL_NO_SURFACE && eglSwapBuffers(context.display, context.surface) != EGL_TRUE)
+		throw "eglSwapBuffers failed:" + to_string(eglGetError());
 #endif
 }
+
+GlFence::GlFence(GlFence&& other)
+	: sync_(other.sync_)
+{
+	other.sync_ = nullptr;
+}
+
+GlFence::~GlFence()
+{
+	clear();
+}
+
+GlFence& GlFence::operator=(GlFence&& other)
+{
+	if (&other != this)
+	{
+		clear();
+		sync_ = other.sync_;
+		other.sync_ = nullptr;
+	}
+	return *this;
+}
+
+void GlFence::insert()
+{
+	clear();
+	sync_ = glCall(glFenceSync, GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool GlFence::isSignaled() const
+{
+	if (!sync_)
+		return true;
+
+	// A zero timeout only polls the fence
+	// The flush bit makes sure the fence itself reaches the GPU, otherwise we could poll it forever
+	const GLenum status = glCall(glClientWaitSync, sync_, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_WAIT_FAILED)
+		throw "glClientWaitSync failed";
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void GlFence::wait() const
+{
+	if (!sync_)
+		return;
+
+	// Wait by steps of a second, so that a lost GPU shows up as an error rather than a hang
+	for (int seconds = 0; seconds < 10; ++seconds)
+	{
+		const GLenum status = glCall(glClientWaitSync, sync_, GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+			return;
+		if (status == GL_WAIT_FAILED)
+			throw "glClientWaitSync failed";
+	}
+	throw "Timed out waiting for a GL fence";
+}
+
+void GlFence::clear()
+try
+{
+	if (!sync_)
+		return;
+
+	const GLsync sync = sync_;
+	sync_ = nullptr;
+
+	glCall(glDeleteSync, sync);
+}
+catch (...)
+{
+	// Same policy as GlResource::clear(), failing to delete is logged but not fatal
+	std::cerr << "GlFence error: " << currentExceptionMessage() << std::endl;
+}
+
+void GlGpuTimer::begin()
+{
+	// If all queries are in flight, give up on the oldest result rather than waiting for it
+	if (pending_ == numQueries)
+		--pending_;
+
+	queries_[next_].createAndBind(GL_TIME_ELAPSED);
+}
+
+void GlGpuTimer::end()
+{
+	glCall(glEndQuery, GL_TIME_ELAPSED);
+	next_ = (next_ + 1) % numQueries;
+	++pending_;
+}
+
+bool GlGpuTimer::poll(float& gpuTimeMs)
+{
+	bool found = false;
+	while (pending_ > 0)
+	{
+		// Queries complete in order, so only the oldest one needs to be checked
+		const GLuint query = queries_[(next_ - pending_ + numQueries) % numQueries];
+		GLint available = GL_FALSE;
+		glCall(glGetQueryObjectiv, query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 nanoseconds = 0;
+		glCall(glGetQueryObjectui64v, query, GL_QUERY_RESULT, &nanoseconds);
+		gpuTimeMs = static_cast<float>(nanoseconds / 1e6);
+		found = true;
+		--pending_;
+	}
+	return found;
+}
+
+GlStreamBuffer::GlStreamBuffer(const GLenum target, const GLsizeiptr regionSize, const int regionCount)
+	: target_(target)
+	, regionSize_(regionSize)
+	, fences_(regionCount)
+{
+	// Uniform and shader storage buffer ranges have to start at a multiple of an implementation defined alignment (often 256 bytes)
+	// Other uses are aligned on 16 bytes, enough for any vertex attribute
+	alignment_ = 16;
+	GLenum alignmentQuery = target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT : 0;
+#ifdef GL_SHADER_STORAGE_BUFFER
+	if (target == GL_SHADER_STORAGE_BUFFER)
+		alignmentQuery = GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT;
+#endif
+	if (alignmentQuery != 0)
+	{
+		GLint alignment = 0;
+		glCall(glGetIntegerv, alignmentQuery, &alignment);
+		alignment_ = max<GLsizeiptr>(alignment_, alignment);
+	}
+	regionSize_ = (regionSize + alignment_ - 1) / alignment_ * alignment_;
+
+	buffer_.createAndBind(target);
+#ifdef GL_MAP_PERSISTENT_BIT
+	if (hasGlExtension("GL_ARB_buffer_storage") || hasGlExtension("GL_EXT_buffer_storage"))
+	{
+		// Coherent mapping makes our writes visible to the GPU without any flush, as long as they're done before the commands reading them are issued
+		constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr size = regionSize_ * regionCount;
+		glCall(glBufferStorage, target, size, nullptr, flags);
+		mapped_ = static_cast<unsigned char*>(glCall(glMapBufferRange, target, 0, size, flags));
+		if (!mapped_)
+			throw "glMapBufferRange failed"s;
+		return;
+	}
+#endif
+
+	// Without persistent mapping, there's a single region, which is orphaned every frame
+	fences_.clear();
+	glCall(glBufferData, target, regionSize_, nullptr, GL_STREAM_DRAW);
+}
+
+void GlStreamBuffer::beginRegion()
+{
+	used_ = 0;
+	if (isPersistent())
+	{
+		region_ = (region_ + 1) % static_cast<int>(fences_.size());
+		GlFence& fence = fences_[region_];
+		if (!fence.isSignaled())
+		{
+			fence.wait();
+			++waits_;
+		}
+	}
+	else
+	{
+		buffer_.bind(target_);
+		glCall(glBufferData, target_, regionSize_, nullptr, GL_STREAM_DRAW);
+	}
+}
+
+GLintptr GlStreamBuffer::write(const void* const data, const GLsizeiptr size)
+{
+	const GLsizeiptr offset = (used_ + alignment_ - 1) / alignment_ * alignment_;
+	if (offset + size > regionSize_)
+		throw "GlStreamBuffer region is full ("s + to_string(regionSize_) + " bytes)";
+	used_ = offset + size;
+
+	const GLintptr bufferOffset = region_ * regionSize_ + offset;
+	if (isPersistent())
+	{
+		memcpy(mapped_ + bufferOffset, data, size);
+	}
+	else
+	{
+		buffer_.bind(target_);
+		glCall(glBufferSubData, target_, bufferOffset, size, data);
+	}
+	return bufferOffset;
+}
+
+void GlStreamBuffer::endRegion()
+{
+	if (isPersistent())
+		fences_[region_].insert();
+}
+
+void GlStreamBuffer::bindRange(const GLuint index, const GLintptr offset, const GLsizeiptr size) const
+{
+	glCall(glBindBufferRange, target_, index, (GLuint)buffer_, offset, size);
+}
+
+GlStateCacheStats::Counts GlStateCacheStats::total() const
+{
+	Counts ret;
+	for (const Counts& counts : {programs, vertexArrays, framebuffers, textures, viewports, capabilities})
+	{
+		ret.issued += counts.issued;
+		ret.skipped += counts.skipped;
+	}
+	return ret;
+}
+
+void GlStateCache::useProgram(const GLuint program)
+{
+	if (program_ == program)
+	{
+		++stats_.programs.skipped;
+		return;
+	}
+	glCall(glUseProgram, program);
+	program_ = program;
+	++stats_.programs.issued;
+}
+
+void GlStateCache::bindVertexArray(const GLuint vertexArray)
+{
+	if (vertexArray_ == vertexArray)
+	{
+		++stats_.vertexArrays.skipped;
+		return;
+	}
+	glCall(glBindVertexArray, vertexArray);
+	vertexArray_ = vertexArray;
+	++stats_.vertexArrays.issued;
+}
+
+void GlStateCache::bindFramebuffer(const GLenum target, const GLuint framebuffer)
+{
+	const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	if ((!read || readFramebuffer_ == framebuffer) && (!draw || drawFramebuffer_ == framebuffer))
+	{
+		++stats_.framebuffers.skipped;
+		return;
+	}
+	glCall(glBindFramebuffer, target, framebuffer);
+	if (read)
+		readFramebuffer_ = framebuffer;
+	if (draw)
+		drawFramebuffer_ = framebuffer;
+	++stats_.framebuffers.issued;
+}
+
+void GlStateCache::activeTexture(const GLenum unit)
+{
+	if (activeTexture_ == unit)
+	{
+		++stats_.textures.skipped;
+		return;
+	}
+	glCall(glActiveTexture, unit);
+	activeTexture_ = unit;
+	++stats_.textures.issued;
+}
+
+void GlStateCache::bindTexture(const GLenum target, const GLuint texture)
+{
+	// Bindings are per texture unit, so they can only be tracked once the active unit is known
+	const auto binding = find_if(textures_.begin(), textures_.end(), [&](const TextureBinding& b) { return b.unit == activeTexture_ && b.target == target; });
+	if (activeTexture_ != 0 && binding != textures_.end() && binding->texture == texture)
+	{
+		++stats_.textures.skipped;
+		return;
+	}
+	glCall(glBindTexture, target, texture);
+	if (activeTexture_ != 0)
+	{
+		if (binding != textures_.end())
+			binding->texture = texture;
+		else
+			textures_.push_back(TextureBinding{activeTexture_, target, texture});
+	}
+	++stats_.textures.issued;
+}
+
+void GlStateCache::viewport(const GLint x, const GLint y, const GLsizei width, const GLsizei height)
+{
+	if (viewportKnown_ && viewport_[0] == x && viewport_[1] == y && viewport_[2] == width && viewport_[3] == height)
+	{
+		++stats_.viewports.skipped;
+		return;
+	}
+	glCall(glViewport, x, y, width, height);
+	viewport_[0] = x;
+	viewport_[1] = y;
+	viewport_[2] = width;
+	viewport_[3] = height;
+	viewportKnown_ = true;
+	++stats_.viewports.issued;
+}
+
+void GlStateCache::setEnabled(const GLenum capability, const bool enabled)
+{
+	const auto known = find_if(capabilities_.begin(), capabilities_.end(), [capability](const pair<GLenum, bool>& c) { return c.first == capability; });
+	if (known != capabilities_.end() && known->second == enabled)
+	{
+		++stats_.capabilities.skipped;
+		return;
+	}
+	if (enabled)
+		glCall(glEnable, capability);
+	else
+		glCall(glDisable, capability);
+	if (known != capabilities_.end())
+		known->second = enabled;
+	else
+		capabilities_.emplace_back(capability, enabled);
+	++stats_.capabilities.issued;
+}
+
+void GlStateCache::forget(const GlResourceType type, const GLuint name)
+{
+	// Deleting a bound VAO, framebuffer or texture reverts its bindings to 0
+	// A deleted program stays in use until another one is, so it's the one binding that becomes unknown
+	switch (type)
+	{
+	case GlResourceType::Program:
+		if (program_ == name)
+			program_ = unknown;
+		break;
+	case GlResourceType::Vao:
+		if (vertexArray_ == name)
+			vertexArray_ = 0;
+		break;
+	case GlResourceType::Fbo:
+		if (readFramebuffer_ == name)
+			readFramebuffer_ = 0;
+		if (drawFramebuffer_ == name)
+			drawFramebuffer_ = 0;
+		break;
+	case GlResourceType::Texture:
+		for (TextureBinding& binding : textures_)
+			if (binding.texture == name)
+				binding.texture = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+void GlStateCache::invalidate()
+{
+	program_ = unknown;
+	vertexArray_ = unknown;
+	readFramebuffer_ = unknown;
+	drawFramebuffer_ = unknown;
+	activeTexture_ = 0;
+	textures_.clear();
+	viewportKnown_ = false;
+	capabilities_.clear();
+}
+
+GlStateCache& glStateCache()
+{
+	// GL contexts are current on one thread at a time, so each thread keeps its own cache
+	thread_local GlStateCache cache;
+	return cache;
+}
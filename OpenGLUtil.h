@@ -2,11 +2,15 @@
 #include "FoveAPI.h"
 #include "NativeUtil.h"
 #include "Util.h"
+#include <cstdint>
+#include <initializer_list>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
 // This header defines a bunch of utility functions for using OpenGL
 // These functions makes the implementation of the GL example itself much cleaner, shorter, and safer
@@ -15,14 +19,16 @@
 #ifdef _WIN32
 #include <Windows.h>
 #include <gl/GL.h>
-#include <map>
 #elif defined(__APPLE__)
 #define GL_SILENCE_DEPRECATION
 #include <OpenGL/gl3.h>
 #else
 #define GL_GLEXT_PROTOTYPES
+#define glMultiDrawArraysIndirectCountARB glMultiDrawArraysIndirectCountARBPrototype // Fetched at runtime instead, see the end of the GL API below
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GL/glcorearb.h> // Note: Once we include GL/glcorearb.h, we no longer are allowed to include GL/gl.h nor GL/glext.h
+#undef glMultiDrawArraysIndirectCountARB
 #undef GL_GLEXT_PROTOTYPES
 #endif
 
@@ -31,18 +37,23 @@
 // Normally you would use a library that ships the GL3.h header and fetches the functions automatically
 // However this example demonstrates how to do it without dependencies
 // We only need a small subset of the GL API anyway
-#ifdef _WIN32
+// On Linux, libOpenGL (GLVND) only exports the functions of the GL versions, so the few extension functions we use are fetched the same way
+#ifndef __APPLE__
 
 // This template is instances once per gl function below, generating the needed code to find, check, and call the given GL function
 template <typename Return = void, typename... Args>
 Return getGLFunc(const char* const funcName, Args... args)
 {
 	// Query the location of the function on the first call
-	static map<const char*, const void*> procLocations;
+	static std::map<const char*, const void*> procLocations;
 	const void*& location = procLocations[funcName];
 	if (!location)
 	{
+#ifdef _WIN32
 		location = reinterpret_cast<void*>(wglGetProcAddress(funcName));
+#else
+		location = reinterpret_cast<void*>(eglGetProcAddress(funcName));
+#endif
 		if (!location)
 			throw std::runtime_error(std::string("Unable to find ") + funcName);
 	}
@@ -54,62 +65,148 @@ Return getGLFunc(const char* const funcName, Args... args)
 	return func(args...);
 }
 
+#endif
+
+#ifdef _WIN32
+
 typedef char GLchar;
 typedef long GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+typedef unsigned __int64 GLuint64;
+typedef struct __GLsync* GLsync;
+typedef void(APIENTRY* GLDEBUGPROC)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
 
 #define GL_ARRAY_BUFFER 0x8892
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
 #define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_COMMAND_BARRIER_BIT 0x00000040
 #define GL_COMPILE_STATUS 0x8B81
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_DEBUG_OUTPUT 0x92E0
+#define GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#define GL_DEBUG_SEVERITY_HIGH 0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+#define GL_DEBUG_SEVERITY_NOTIFICATION 0x826B
+#define GL_DEBUG_SOURCE_APPLICATION 0x824A
+#define GL_DEBUG_TYPE_ERROR 0x824C
+#define GL_DEBUG_TYPE_POP_GROUP 0x826A
+#define GL_DEBUG_TYPE_PUSH_GROUP 0x8269
 #define GL_DEPTH_ATTACHMENT 0x8D00
+#define GL_DEPTH_COMPONENT24 0x81A6
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_DYNAMIC_DRAW 0x88E8
 #define GL_FRAGMENT_SHADER 0x8B30
 #define GL_FRAMEBUFFER 0x8D40
 #define GL_FRAMEBUFFER_COMPLETE 0x8CD5
 #define GL_INFO_LOG_LENGTH 0x8B84
 #define GL_INVALID_FRAMEBUFFER_OPERATION 0x0506
+#define GL_INVALID_INDEX 0xFFFFFFFFu
 #define GL_LINK_STATUS 0x8B82
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_NUM_EXTENSIONS 0x821D
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#define GL_QUERY_RESULT 0x8866
+#define GL_R32F 0x822E
+#define GL_R32UI 0x8236
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_READ_ONLY 0x88B8
+#define GL_RED_INTEGER 0x8D94
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
 #define GL_RENDERBUFFER 0x8D41
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
 #define GL_STATIC_DRAW 0x88E4
+#define GL_STREAM_DRAW 0x88E0
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_TEXTURE0 0x84C0
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_TIME_ELAPSED 0x88BF
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 0x8A34
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
 #define GL_VERTEX_SHADER 0x8B31
+#define GL_WRITE_ONLY 0x88B9
 
+inline void glActiveTexture(GLenum texture) { getGLFunc("glActiveTexture", texture); }
 inline void glAttachShader(GLuint program, GLuint shader)
 {
 	getGLFunc("glAttachShader", program, shader);
 }
+inline void glBeginQuery(GLenum target, GLuint id) { getGLFunc("glBeginQuery", target, id); }
 inline void glBindBuffer(GLenum target, GLuint buffer) { getGLFunc("glBindBuffer", target, buffer); }
+inline void glBindBufferBase(GLenum target, GLuint index, GLuint buffer) { getGLFunc("glBindBufferBase", target, index, buffer); }
+inline void glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) { getGLFunc("glBindBufferRange", target, index, buffer, offset, size); }
 inline void glBindFramebuffer(GLenum target, GLuint framebuffer) { getGLFunc("glBindFramebuffer", target, framebuffer); }
+inline void glBindImageTexture(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format) { getGLFunc("glBindImageTexture", unit, texture, level, layered, layer, access, format); }
 inline void glBindRenderbuffer(GLenum target, GLuint renderbuffer) { getGLFunc("glBindRenderbuffer", target, renderbuffer); }
 inline void glBindVertexArray(GLuint array) { getGLFunc("glBindVertexArray", array); }
+inline GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) { return getGLFunc<GLenum>("glClientWaitSync", sync, flags, timeout); }
+inline void glBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) { getGLFunc("glBlitFramebuffer", srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter); }
 inline void glBufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage) { getGLFunc("glBufferData", target, size, data, usage); }
+inline void glBufferStorage(GLenum target, GLsizeiptr size, const GLvoid* data, GLbitfield flags) { getGLFunc("glBufferStorage", target, size, data, flags); }
+inline void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data) { getGLFunc("glBufferSubData", target, offset, size, data); }
 inline GLenum glCheckFramebufferStatus(GLenum target) { return getGLFunc<GLenum>("glCheckFramebufferStatus", target); }
+inline void glClearBufferSubData(GLenum target, GLenum internalformat, GLintptr offset, GLsizeiptr size, GLenum format, GLenum type, const void* data) { getGLFunc("glClearBufferSubData", target, internalformat, offset, size, format, type, data); }
 inline void glCompileShader(GLuint shader) { getGLFunc("glCompileShader", shader); }
+inline void glDebugMessageCallback(GLDEBUGPROC callback, const void* userParam) { getGLFunc("glDebugMessageCallback", callback, userParam); }
+inline void glDebugMessageControl(GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint* ids, GLboolean enabled) { getGLFunc("glDebugMessageControl", source, type, severity, count, ids, enabled); }
 inline GLuint glCreateProgram() { return getGLFunc<GLuint>("glCreateProgram"); }
 inline GLuint glCreateShader(GLenum shaderType) { return getGLFunc<GLuint>("glCreateShader", shaderType); }
 inline void glDeleteBuffers(GLsizei n, const GLuint* buffers) { getGLFunc("glDeleteBuffers", n, buffers); }
 inline void glDeleteFramebuffers(GLsizei n, const GLuint* framebuffers) { getGLFunc("glDeleteFramebuffers", n, framebuffers); }
 inline void glDeleteProgram(GLuint program) { getGLFunc("glDeleteProgram", program); }
+inline void glDeleteQueries(GLsizei n, const GLuint* ids) { getGLFunc("glDeleteQueries", n, ids); }
 inline void glDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers) { getGLFunc("glDeleteRenderbuffers", n, renderbuffers); }
+inline void glDeleteSync(GLsync sync) { getGLFunc("glDeleteSync", sync); }
 inline void glDeleteShader(GLuint shader) { getGLFunc("glDeleteShader", shader); }
 inline void glDeleteVertexArrays(GLsizei n, const GLuint* arrays) { getGLFunc("glDeleteVertexArrays", n, arrays); }
 inline void glDetachShader(GLuint program, GLuint shader) { getGLFunc("glDetachShader", program, shader); }
+inline void glDispatchCompute(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ) { getGLFunc("glDispatchCompute", numGroupsX, numGroupsY, numGroupsZ); }
 inline void glEnableVertexAttribArray(GLuint index) { getGLFunc("glEnableVertexAttribArray", index); }
+inline GLsync glFenceSync(GLenum condition, GLbitfield flags) { return getGLFunc<GLsync>("glFenceSync", condition, flags); }
+inline void glEndQuery(GLenum target) { getGLFunc("glEndQuery", target); }
 inline void glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) { getGLFunc("glFramebufferRenderbuffer", target, attachment, renderbuffertarget, renderbuffer); }
 inline void glFramebufferTexture(GLenum target, GLenum attachment, GLuint texture, GLint level) { getGLFunc("glFramebufferTexture", target, attachment, texture, level); }
 inline void glGenBuffers(GLsizei n, GLuint* buffers) { getGLFunc("glGenBuffers", n, buffers); }
 inline void glGenFramebuffers(GLsizei n, GLuint* framebuffers) { getGLFunc("glGenFramebuffers", n, framebuffers); }
+inline void glGenQueries(GLsizei n, GLuint* ids) { getGLFunc("glGenQueries", n, ids); }
 inline void glGenRenderbuffers(GLsizei n, GLuint* renderbuffers) { getGLFunc("glGenRenderbuffers", n, renderbuffers); }
 inline void glGenVertexArrays(GLsizei n, GLuint* arrays) { getGLFunc("glGenVertexArrays", n, arrays); }
 inline GLint glGetAttribLocation(GLuint program, const GLchar* name) { return getGLFunc<GLint>("glGetAttribLocation", program, name); }
+inline void glGetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void* data) { getGLFunc("glGetBufferSubData", target, offset, size, data); }
 inline void glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog) { getGLFunc("glGetProgramInfoLog", program, bufSize, length, infoLog); }
 inline void glGetProgramiv(GLuint program, GLenum pname, GLint* params) { getGLFunc("glGetProgramiv", program, pname, params); }
+inline void glGetQueryObjectiv(GLuint id, GLenum pname, GLint* params) { getGLFunc("glGetQueryObjectiv", id, pname, params); }
+inline void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params) { getGLFunc("glGetQueryObjectui64v", id, pname, params); }
 inline void glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog) { getGLFunc("glGetShaderInfoLog", shader, bufSize, length, infoLog); }
 inline void glGetShaderiv(GLuint shader, GLenum pname, GLint* params) { getGLFunc("glGetShaderiv", shader, pname, params); }
+inline void glPopDebugGroup() { getGLFunc("glPopDebugGroup"); }
+inline void glPushDebugGroup(GLenum source, GLuint id, GLsizei length, const GLchar* message) { getGLFunc("glPushDebugGroup", source, id, length, message); }
+inline const GLubyte* glGetStringi(GLenum name, GLuint index) { return getGLFunc<const GLubyte*>("glGetStringi", name, index); }
+inline GLuint glGetUniformBlockIndex(GLuint program, const GLchar* uniformBlockName) { return getGLFunc<GLuint>("glGetUniformBlockIndex", program, uniformBlockName); }
 inline GLint glGetUniformLocation(GLuint program, const GLchar* name) { return getGLFunc<GLint>("glGetUniformLocation", program, name); }
 inline void glLinkProgram(GLuint program) { getGLFunc("glLinkProgram", program); }
+inline void* glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) { return getGLFunc<void*>("glMapBufferRange", target, offset, length, access); }
+inline void glMemoryBarrier(GLbitfield barriers) { getGLFunc("glMemoryBarrier", barriers); }
+inline void glMultiDrawArraysIndirect(GLenum mode, const void* indirect, GLsizei drawcount, GLsizei stride) { getGLFunc("glMultiDrawArraysIndirect", mode, indirect, drawcount, stride); }
+inline void glMultiDrawArraysIndirectCountARB(GLenum mode, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride) { getGLFunc("glMultiDrawArraysIndirectCountARB", mode, indirect, drawcount, maxdrawcount, stride); }
 inline void glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) { getGLFunc("glRenderbufferStorage", target, internalformat, width, height); }
 inline void glShaderSource(GLuint shader, GLsizei count, const GLchar** string, const GLint* length) { getGLFunc("glShaderSource", shader, count, string, length); }
+inline void glTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height) { getGLFunc("glTexStorage2D", target, levels, internalformat, width, height); }
 inline void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { getGLFunc("glUniformMatrix4fv", location, count, transpose, value); }
 inline void glUniform1f(GLint location, GLfloat v0) { getGLFunc("glUniform1f", location, v0); }
+inline void glUniformBlockBinding(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding) { getGLFunc("glUniformBlockBinding", program, uniformBlockIndex, uniformBlockBinding); }
 inline void glUseProgram(GLuint program) { getGLFunc("glUseProgram", program); }
+inline void glVertexAttribDivisor(GLuint index, GLuint divisor) { getGLFunc("glVertexAttribDivisor", index, divisor); }
+inline void glVertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid* pointer) { getGLFunc("glVertexAttribIPointer", index, size, type, stride, pointer); }
 inline void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer) { getGLFunc("glVertexAttribPointer", index, size, type, normalized, stride, pointer); }
 
 // WGL
@@ -121,50 +218,150 @@ inline BOOL wglDXUnregisterObjectNV(HANDLE hDevice, HANDLE hObject) { return get
 inline BOOL wglDXLockObjectsNV(HANDLE hDevice, GLint count, HANDLE* hObjects) { return getGLFunc<BOOL>("wglDXLockObjectsNV", hDevice, count, hObjects); }
 inline BOOL wglDXUnlockObjectsNV(HANDLE hDevice, GLint count, HANDLE* hObjects) { return getGLFunc<BOOL>("wglDXUnlockObjectsNV", hDevice, count, hObjects); }
 #define WGL_ACCESS_READ_WRITE_NV 0x0001
+#elif !defined(__APPLE__)
+// Extension functions that libOpenGL doesn't export (see getGLFunc)
+inline void glMultiDrawArraysIndirectCountARB(GLenum mode, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride) { getGLFunc("glMultiDrawArraysIndirectCountARB", mode, indirect, drawcount, maxdrawcount, stride); }
 #endif
 
 // Returns a c-string to the name of the GL function whos pointer is passed in
 // This is used for error display purposes only
 const char* glFuncToString(const void* func);
 
+// Returns whether the current context supports the given extension (eg. "GL_KHR_debug")
+bool hasGlExtension(const char* name);
+
+// Returns whether the current context supports all the given extensions, reading the extension list once
+bool hasGlExtensions(std::initializer_list<const char*> names);
+
 // Checks the current GL error, and throws an exception if it's not GL_NO_ERROR
-// Every call into a GL function should be followed by this, so as to easily locate causes of errors
-// In production code, this should be a no-op in the release configuration, but for our purposes, we always validate
 void glCheckError(const char* function);
 
-// Invokes a GL function, then calls glCheckError (thus throwing if there's an error)
-template <typename GlFunc, typename... Args>
-auto glCall(const GlFunc func, Args&&... args)
+// Same as glCheckError, but only looks up the name of the function (see glFuncToString) if there is an error
+void glCheckCallError(const void* func);
+
+// How glCall checks for errors, picked at compile time by defining FOVE_GL_CHECKS (see FOVE_OPENGL_CHECKS in CMakeLists.txt)
+// - Full: glGetError after every call, which throws right from the failing call, but may force the driver to synchronize on each check
+// - PerFrame: a single glGetError sweep per frame, in glCheckFrameErrors(), while the KHR_debug callback, if available, records which calls failed
+// - Async: no checks in glCall, the KHR_debug callback reports errors and other serious driver messages to a logging thread (see installGlDebugLog())
+// - None: no checks at all, for the lowest overhead
+enum class GlCheckPolicy
+{
+	None,
+	Async,
+	PerFrame,
+	Full,
+};
+
+#ifndef FOVE_GL_CHECKS
+#define FOVE_GL_CHECKS Full
+#endif
+constexpr GlCheckPolicy glCheckPolicy = GlCheckPolicy::FOVE_GL_CHECKS;
+
+// The last function invoked through glCall with the PerFrame policy, which the KHR_debug callback blames for the errors it reports
+inline thread_local const void* glCurrentCall = nullptr;
+
+// Invokes a GL function, then checks for errors according to the given policy
+template <GlCheckPolicy Policy, typename GlFunc, typename... Args>
+auto glCallWithPolicy(const GlFunc func, Args&&... args)
 {
-	// Use RAII to invoke glCheckError after the func() is invoked below
-	// Otherwise we must assign the result of func() to a temporary, check, then return the temporary
-	// Doing so would not work for return types, necessatating a void-return specialization of this function
-	struct Helper
+	if constexpr (Policy == GlCheckPolicy::Full)
 	{
-		Helper(GlFunc func)
-			: f(func)
-		{
-		}
-		~Helper() noexcept(false)
+		// Use RAII to invoke glCheckCallError after the func() is invoked below
+		// Otherwise we must assign the result of func() to a temporary, check, then return the temporary
+		// Doing so would not work for return types, necessatating a void-return specialization of this function
+		struct Helper
 		{
-			// It's slightly wasteful to look the function name in the success case,
-			// but we're more concerned with useful error messages than performance in this example
-			glCheckError(glFuncToString((const void*)f));
-		}
-		const GlFunc f;
-	} helper(func);
+			Helper(GlFunc func)
+				: f(func)
+			{
+			}
+			~Helper() noexcept(false)
+			{
+				glCheckCallError((const void*)f);
+			}
+			const GlFunc f;
+		} helper(func);
+
+		return func(std::forward<Args>(args)...);
+	}
+	else
+	{
+		if constexpr (Policy == GlCheckPolicy::PerFrame)
+			glCurrentCall = (const void*)func;
+		return func(std::forward<Args>(args)...);
+	}
+}
 
-	return func(std::forward<Args>(args)...);
+// Invokes a GL function, then checks for errors according to glCheckPolicy (with the Full policy, this throws if there's an error)
+template <typename GlFunc, typename... Args>
+auto glCall(const GlFunc func, Args&&... args)
+{
+	return glCallWithPolicy<glCheckPolicy>(func, std::forward<Args>(args)...);
 }
 
+// Throws if any GL call failed since the last check, listing the failing calls recorded by the KHR_debug callback, if it's installed
+void glCheckDeferredErrors();
+
+// Installs a KHR_debug callback which records the failing GL calls for glCheckDeferredErrors()
+// Returns false if the context doesn't support KHR_debug, in which case errors are still caught, but not located
+bool installGlErrorCallback();
+
+// To be called once per frame, which checks the errors of the whole frame with the PerFrame policy
+inline void glCheckFrameErrors()
+{
+	if constexpr (glCheckPolicy == GlCheckPolicy::PerFrame)
+		glCheckDeferredErrors();
+}
+
+// Counters of the messages received by the debug log of installGlDebugLog()
+struct GlDebugLogStats
+{
+	uint64_t messages = 0; // Messages queued for the logging thread
+	uint64_t errors = 0;   // Among them, the GL errors (GL_DEBUG_TYPE_ERROR)
+	uint64_t dropped = 0;  // Messages lost because the logging thread fell behind
+};
+
+// Installs an asynchronous KHR_debug callback, which reports GL errors and the high and medium severity driver messages
+// (undefined behavior, performance warnings, etc.) without ever stalling the GL pipeline:
+// the driver calls it whenever it's convenient (possibly from its own threads), and it only copies the message into a lock-free queue,
+// which a logging thread drains to stderr, tagged with the debug groups (see GlDebugGroup) that were open when the message was emitted
+// Returns false if the context doesn't support KHR_debug
+bool installGlDebugLog();
+GlDebugLogStats glDebugLogStats();
+
+// RAII debug group, which labels the GL commands issued during its lifetime (glPushDebugGroup/glPopDebugGroup)
+// The messages of the debug callbacks name the groups they come from, and so do GPU debuggers like RenderDoc
+// This does nothing unless a debug callback was installed, since glPushDebugGroup needs KHR_debug
+class GlDebugGroup
+{
+public:
+	explicit GlDebugGroup(const char* name);
+	~GlDebugGroup();
+	GlDebugGroup(const GlDebugGroup&) = delete;
+	GlDebugGroup& operator=(const GlDebugGroup&) = delete;
+
+private:
+	bool pushed_ = false;
+};
+
 // Creates an opengl contex with the associated window
 struct NativeOpenGLContext;
 NativeOpenGLContext createOpenGLContext(NativeWindow&);
 
-// Returns the required viewport size to fill the given window
-void applyWindowViewport(NativeWindow&, NativeOpenGLContext&);
+// Creates an opengl context that is not associated with any window
+// Only offscreen framebuffers can be rendered to, which is all we need to render for the headset
+// On linux this uses EGL on the Mesa surfaceless platform when available (no display server needed), or a pbuffer otherwise
+NativeOpenGLContext createHeadlessOpenGLContext();
+
+// Returns the size of the drawable area of the window, in pixels
+Fove::Vec2i getWindowViewportSize(NativeWindow&);
+
+// Sets how many vertical blanks swapBuffers waits for, 0 presenting right away (no vsync, possibly tearing)
+// Throws if the platform doesn't let us pick (eg. no WGL_EXT_swap_control)
+void setSwapInterval(NativeOpenGLContext&, int interval);
 
 // Swaps buffers on the given window
+// This also flushes the GL commands issued so far
 void swapBuffers(NativeWindow&, NativeOpenGLContext&);
 
 // Resource type used by the below GlResource class
@@ -177,8 +374,78 @@ enum class GlResourceType
 	Shader,
 	Program,
 	RenderBuffer,
+	Query,
+};
+
+// Number of state changes of each kind that reached the driver, and that were skipped since the state was already set
+struct GlStateCacheStats
+{
+	struct Counts
+	{
+		uint64_t issued = 0;
+		uint64_t skipped = 0;
+	};
+
+	Counts programs;
+	Counts vertexArrays;
+	Counts framebuffers;
+	Counts textures; // Including texture unit changes
+	Counts viewports;
+	Counts capabilities;
+
+	Counts total() const;
 };
 
+// Shadow copy of the GL state that changes the most while drawing: bound program, VAO, framebuffers and textures, viewport, and enabled capabilities
+// Changes going through the cache skip the driver call when the state is already set, which the driver doesn't always do cheaply,
+// so that drawing many objects doesn't pay for rebinding the state they share
+// The state starts unknown, so that the first change of each kind always reaches the driver
+// GlResource::bind() goes through the cache of the current thread. State changed without the cache (eg. by a library using the context) must be followed by invalidate()
+class GlStateCache
+{
+public:
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+	void bindFramebuffer(GLenum target, GLuint framebuffer); // GL_FRAMEBUFFER binds both the read and the draw framebuffer
+	void activeTexture(GLenum unit);
+	void bindTexture(GLenum target, GLuint texture); // Binds to the active texture unit
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void setEnabled(GLenum capability, bool enabled);
+	void enable(GLenum capability) { setEnabled(capability, true); }
+	void disable(GLenum capability) { setEnabled(capability, false); }
+
+	// To be called before deleting an object, since GL unbinds deleted objects, and reuses their names
+	void forget(GlResourceType type, GLuint name);
+
+	// Forgets the whole state, so that the next change of each kind reaches the driver
+	void invalidate();
+
+	const GlStateCacheStats& stats() const { return stats_; }
+
+private:
+	static constexpr GLuint unknown = ~0u; // Name of an unknown binding
+	struct TextureBinding
+	{
+		GLenum unit;
+		GLenum target;
+		GLuint texture;
+	};
+
+	GLuint program_ = unknown;
+	GLuint vertexArray_ = unknown;
+	GLuint readFramebuffer_ = unknown;
+	GLuint drawFramebuffer_ = unknown;
+	GLenum activeTexture_ = 0; // 0 when unknown
+	std::vector<TextureBinding> textures_; // Known bindings only
+	GLint viewport_[4] = {};
+	bool viewportKnown_ = false;
+	std::vector<std::pair<GLenum, bool>> capabilities_; // Known capabilities only
+	GlStateCacheStats stats_;
+};
+
+// Returns the state cache of the GL context current on the calling thread
+GlStateCache& glStateCache();
+
 // Simple RAII wrapper for any GL resource
 template <GlResourceType ResourceType>
 struct GlResource
@@ -227,7 +494,7 @@ public:
 			name_ = std::make_unique<GLuint>(name);
 		}
 
-		glCall(GlResourceInfo::BindFunc, std::forward<BindArgs>(bindArgs)..., *name_);
+		bindName(std::forward<BindArgs>(bindArgs)..., *name_);
 	}
 
 	template <typename... BindArgs>
@@ -236,7 +503,7 @@ public:
 		if (!name_)
 			throw std::runtime_error(std::string("null id"));
 
-		glCall(GlResourceInfo::BindFunc, std::forward<BindArgs>(bindArgs)..., *name_);
+		bindName(std::forward<BindArgs>(bindArgs)..., *name_);
 	}
 
 	void clear()
@@ -248,6 +515,7 @@ public:
 		const GLuint name = *name_;
 		name_.reset();
 
+		glStateCache().forget(ResourceType, name);
 		glCall(GlResourceInfo::DelFunc, name);
 	}
 	catch (...)
@@ -266,6 +534,22 @@ public:
 	}
 
 private:
+	// The bindings tracked by GlStateCache go through it, so that rebinding a bound object is skipped
+	template <typename... BindArgs>
+	static void bindName(BindArgs&&... bindArgs)
+	{
+		if constexpr (ResourceType == GlResourceType::Program)
+			glStateCache().useProgram(bindArgs...);
+		else if constexpr (ResourceType == GlResourceType::Vao)
+			glStateCache().bindVertexArray(bindArgs...);
+		else if constexpr (ResourceType == GlResourceType::Fbo)
+			glStateCache().bindFramebuffer(bindArgs...);
+		else if constexpr (ResourceType == GlResourceType::Texture)
+			glStateCache().bindTexture(bindArgs...);
+		else
+			glCall(GlResourceInfo::BindFunc, std::forward<BindArgs>(bindArgs)...);
+	}
+
 	std::unique_ptr<GLuint> name_; // Can be an std::optional if using C++17
 
 	struct GlResourceInfo;
@@ -365,6 +649,107 @@ struct GlResource<GlResourceType::RenderBuffer>::GlResourceInfo
 	static constexpr auto BindFunc = &glBindRenderbuffer;
 };
 
+template <>
+struct GlResource<GlResourceType::Query>::GlResourceInfo
+{
+	static constexpr auto GenFunc = &genAdapter<&glGenQueries>;
+	static constexpr auto DelFunc = &delAdapter<&glDeleteQueries>;
+	static constexpr auto BindFunc = &glBeginQuery; // For queries, "binding" starts the query
+};
+
+// Measures the time the GPU spends on the commands issued between begin() and end()
+// Results only become available a few frames later, so several queries are kept in flight,
+// and read back once ready, so that the CPU never waits on the GPU
+class GlGpuTimer
+{
+public:
+	void begin();
+	void end();
+
+	// Returns true and sets gpuTimeMs to the most recent measurement if any new one is available
+	bool poll(float& gpuTimeMs);
+
+private:
+	static constexpr int numQueries = 4;
+	GlResource<GlResourceType::Query> queries_[numQueries];
+	int next_ = 0;    // Index of the query used by the next begin()
+	int pending_ = 0; // Number of ended queries whose result hasn't been read yet
+};
+
+// RAII wrapper for a GL fence sync object
+// This lets us know when the GPU is done with all commands issued before the fence, without stalling on it
+class GlFence
+{
+public:
+	GlFence() {}
+	GlFence(GlFence&& other);
+	~GlFence();
+	GlFence& operator=(GlFence&& other);
+	GlFence(const GlFence&) = delete;
+	GlFence& operator=(const GlFence&) = delete;
+
+	// Inserts a new fence after all commands issued so far, replacing any previous fence
+	void insert();
+
+	// Returns true if the GPU has passed the fence (or if no fence was inserted), without blocking
+	bool isSignaled() const;
+
+	// Blocks until the GPU has passed the fence (returns right away if no fence was inserted)
+	void wait() const;
+
+	// Deletes the fence, if any
+	void clear();
+
+private:
+	GLsync sync_ = nullptr;
+};
+
+// Buffer that is rewritten every frame, for per-frame uniforms and dynamic geometry, without the CPU ever waiting on the GPU or reallocating
+// The buffer is split into regions, used in turn, one per frame: beginRegion() moves on to the next region, write() appends data to it,
+// and endRegion() fences it, so that a region is only rewritten once the GPU is done with the frame that read it
+// With ARB_buffer_storage (GL 4.4), the buffer is mapped once, persistently and coherently, and written to with a plain memcpy
+// Otherwise (eg. GLES, macOS), beginRegion() orphans the buffer (glBufferData without data, which gets fresh storage from the driver
+// while the GPU keeps reading the old one), and write() uses glBufferSubData
+class GlStreamBuffer
+{
+public:
+	GlStreamBuffer() {}
+	GlStreamBuffer(GLenum target, GLsizeiptr regionSize, int regionCount = 3);
+	GlStreamBuffer(GlStreamBuffer&&) = default;
+	GlStreamBuffer& operator=(GlStreamBuffer&&) = default;
+
+	// Moves on to the next region, waiting for the GPU to be done with it if needed (which it normally is)
+	void beginRegion();
+
+	// Copies the data into the current region, and returns its offset in the buffer, aligned as needed by the target
+	// Throws if the region is full
+	GLintptr write(const void* data, GLsizeiptr size);
+
+	// Fences the current region, to be called once all the commands reading it were issued
+	void endRegion();
+
+	// Binds the given range of the buffer to an indexed binding point of the target (eg. a uniform block binding)
+	void bindRange(GLuint index, GLintptr offset, GLsizeiptr size) const;
+
+	// Whether the buffer is persistently mapped, rather than orphaned
+	bool isPersistent() const { return mapped_ != nullptr; }
+
+	GLuint buffer() const { return buffer_; }
+
+	int waits() const { return waits_; } // Number of times beginRegion() had to wait for the GPU
+
+private:
+	GlResource<GlResourceType::Buffer> buffer_; // Deleting the buffer also unmaps it
+	GLenum target_ = 0;
+	GLsizeiptr regionSize_ = 0;
+	GLsizeiptr alignment_ = 1;
+	unsigned char* mapped_ = nullptr;
+	std::vector<GlFence> fences_; // One per region
+	int region_ = 0;
+	GLsizeiptr used_ = 0; // Bytes written to the current region
+	int waits_ = 0;
+};
+
 // Implementation of NativeOpenGLContext struct
 #ifdef _WIN32
 struct NativeOpenGLContext
@@ -374,5 +759,8 @@ struct NativeOpenGLContext
 #else
 struct NativeOpenGLContext
 {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface = EGL_NO_SURFACE; // Stays EGL_NO_SURFACE for a surfaceless headless context
+	EGLContext context = EGL_NO_CONTEXT;
 };
 #endif
@@ -0,0 +1,102 @@
+#include "PosePrediction.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+
+// Returns the rotation by the given rotation vector (axis times angle in radians)
+Fove::Quaternion rotationVectorToQuat(const Fove::Vec3 v)
+{
+	const float angle = magnitude(v);
+	if (angle < 1e-6f)
+		return Fove::Quaternion{};
+	const Fove::Vec3 axis = v / angle;
+	return axisAngleToQuat(axis.x, axis.y, axis.z, angle);
+}
+
+Fove::Vec3 lerp(const Fove::Vec3 a, const Fove::Vec3 b, const float t)
+{
+	return a + (b - a) * t;
+}
+
+} // namespace
+
+PredictionModel parsePredictionModel(const string& name)
+{
+	if (name == "none")
+		return PredictionModel::None;
+	if (name == "velocity")
+		return PredictionModel::ConstantVelocity;
+	if (name == "acceleration")
+		return PredictionModel::ConstantAcceleration;
+	throw "Unknown prediction model: " + name + " (expected none, velocity or acceleration)";
+}
+
+Fove::Pose extrapolatePose(const Fove::Pose& pose, const float horizonSeconds, const PredictionModel model)
+{
+	if (model == PredictionModel::None || horizonSeconds <= 0)
+		return pose;
+
+	const float t = horizonSeconds;
+	Fove::Vec3 translation = pose.velocity * t;
+	Fove::Vec3 rotation = pose.angularVelocity * t;
+	if (model == PredictionModel::ConstantAcceleration)
+	{
+		translation = translation + pose.acceleration * (t * t / 2);
+		rotation = rotation + pose.angularAcceleration * (t * t / 2);
+	}
+
+	Fove::Pose ret = pose;
+	ret.position = pose.position + translation;
+	ret.standingPosition = pose.standingPosition + translation;
+	ret.orientation = normalize(rotationVectorToQuat(rotation) * pose.orientation); // World space rotation, so it's applied last
+	if (model == PredictionModel::ConstantAcceleration)
+	{
+		ret.velocity = pose.velocity + pose.acceleration * t;
+		ret.angularVelocity = pose.angularVelocity + pose.angularAcceleration * t;
+	}
+	ret.timestamp = pose.timestamp + static_cast<uint64_t>(llround(t * 1e6));
+	return ret;
+}
+
+float angleBetween(const Fove::Quaternion q1, const Fove::Quaternion q2)
+{
+	// q and -q are the same rotation, hence the absolute value
+	const float d = abs(q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w);
+	return 2 * acos(min(d, 1.0f));
+}
+
+void PosePredictor::addLatencySample(const float seconds)
+{
+	m_latency = m_hasLatency ? m_latency + (seconds - m_latency) * m_settings.latencyWeight : seconds;
+	m_hasLatency = true;
+}
+
+Fove::Pose PosePredictor::predict(const Fove::Pose& pose, const float horizonSeconds)
+{
+	// The same pose may be passed several times if the service didn't update it, it's only filtered once
+	if (m_settings.smoothingSeconds <= 0 || !m_hasFiltered || pose.timestamp <= m_filtered.timestamp)
+	{
+		if (!m_hasFiltered || pose.id != m_filtered.id)
+			m_filtered = pose;
+		m_hasFiltered = true;
+	}
+	else
+	{
+		// Exponential smoothing, with the weight depending on the time step so that irregular updates filter the same way
+		const float dt = (pose.timestamp - m_filtered.timestamp) / 1e6f;
+		const float alpha = 1 - exp(-dt / m_settings.smoothingSeconds);
+		Fove::Pose filtered = pose;
+		filtered.velocity = lerp(m_filtered.velocity, pose.velocity, alpha);
+		filtered.acceleration = lerp(m_filtered.acceleration, pose.acceleration, alpha);
+		filtered.angularVelocity = lerp(m_filtered.angularVelocity, pose.angularVelocity, alpha);
+		filtered.angularAcceleration = lerp(m_filtered.angularAcceleration, pose.angularAcceleration, alpha);
+		m_filtered = filtered;
+	}
+
+	return extrapolatePose(m_filtered, clamp(horizonSeconds, 0.0f, m_settings.maxHorizonSeconds), m_settings.model);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "FoveAPI.h"
+#include <string>
+
+// This header implements head pose prediction, shared by the graphical examples
+// A frame is displayed some time after the pose it was rendered with was captured
+// Extrapolating the pose to when the frame is expected to reach the display (the photon time) hides most of that latency when the head moves
+
+// How the motion is extrapolated
+enum class PredictionModel
+{
+	None,                 // Use the pose as-is
+	ConstantVelocity,     // Uses the velocity and angular velocity of the pose
+	ConstantAcceleration, // Additionally uses the acceleration and angular acceleration of the pose
+};
+
+// Parses the name of a model as used on the command line: none, velocity or acceleration
+// Throws if the name is unknown
+PredictionModel parsePredictionModel(const std::string& name);
+
+// Extrapolates a pose by the given time in seconds
+// The angular velocity & acceleration are expected in world space, in radians per second (per second)
+Fove::Pose extrapolatePose(const Fove::Pose& pose, float horizonSeconds, PredictionModel model);
+
+// Returns the angle of the rotation between two orientations, in radians
+float angleBetween(Fove::Quaternion q1, Fove::Quaternion q2);
+
+// Predicts each new pose to the expected photon time, as measured by the app
+//
+// The velocities and accelerations from the service can be noisy, which gets amplified with the prediction horizon.
+// An optional low pass filter smooths them over time, at the cost of reacting a bit later to changes of motion.
+class PosePredictor
+{
+public:
+	struct Settings
+	{
+		PredictionModel model = PredictionModel::ConstantVelocity;
+		float smoothingSeconds = 0;     // Time constant of the low pass filter on the motion, or 0 to disable it
+		float maxHorizonSeconds = 0.1f; // Predictions further than this are too inaccurate to be useful
+		float latencyWeight = 0.1f;     // Weight of each new latency measurement in the average
+	};
+
+	PosePredictor() = default;
+	explicit PosePredictor(const Settings& settings) : m_settings(settings) {}
+
+	const Settings& settings() const { return m_settings; }
+
+	// Adds a measurement of the time between the capture of a pose and the display of the frame rendered with it
+	void addLatencySample(float seconds);
+
+	// Average latency so far, in seconds, which is how far predict() extrapolates
+	float latency() const { return m_latency; }
+
+	// Filters the motion of a new pose, and returns it extrapolated by the average latency
+	Fove::Pose predict(const Fove::Pose& pose) { return predict(pose, m_latency); }
+
+	// Same, but to an explicit horizon in seconds
+	Fove::Pose predict(const Fove::Pose& pose, float horizonSeconds);
+
+private:
+	Settings m_settings;
+	float m_latency = 0;
+	bool m_hasLatency = false;
+	Fove::Pose m_filtered{}; // Last pose, with filtered motion
+	bool m_hasFiltered = false;
+};
@@ -0,0 +1,266 @@
+// FOVE Pose Prediction Evaluation
+// This records head poses from the FOVE service, and evaluates the pose prediction models of PosePrediction.h offline against such recordings
+//
+// Usage:
+//   FovePosePredictionEval record <file.csv> [seconds]
+//   FovePosePredictionEval evaluate <file.csv>
+//
+// Recording just needs the service running and the headset on someone's head, moving naturally.
+// Evaluation predicts from each recorded pose to a range of horizons, and compares with the pose actually recorded at that time.
+
+#include "FoveAPI.h"
+#include "PosePrediction.h"
+#include "Util.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Use std namespace for convenience
+using namespace std;
+
+namespace
+{
+
+constexpr float pi = 3.14159265f;
+constexpr const char* csvHeader = "timestamp_us,qx,qy,qz,qw,px,py,pz,vx,vy,vz,avx,avy,avz,ax,ay,az,aax,aay,aaz";
+
+void writePose(ostream& out, const Fove::Pose& pose)
+{
+	const auto WriteVec3 = [&out](const Fove::Vec3 v) { out << ',' << v.x << ',' << v.y << ',' << v.z; };
+	out << pose.timestamp << ',' << pose.orientation.x << ',' << pose.orientation.y << ',' << pose.orientation.z << ',' << pose.orientation.w;
+	WriteVec3(pose.position);
+	WriteVec3(pose.velocity);
+	WriteVec3(pose.angularVelocity);
+	WriteVec3(pose.acceleration);
+	WriteVec3(pose.angularAcceleration);
+	out << '\n';
+}
+
+Fove::Pose readPose(const string& line, const uint64_t id)
+{
+	array<float, 19> values{};
+	uint64_t timestamp = 0;
+	istringstream in(line);
+	char comma = 0;
+	in >> timestamp;
+	for (float& value : values)
+		in >> comma >> value;
+	if (!in)
+		throw "Invalid pose line: " + line;
+
+	Fove::Pose pose;
+	pose.id = id;
+	pose.timestamp = timestamp;
+	pose.orientation = Fove::Quaternion{values[0], values[1], values[2], values[3]};
+	pose.position = Fove::Vec3{values[4], values[5], values[6]};
+	pose.standingPosition = pose.position;
+	pose.velocity = Fove::Vec3{values[7], values[8], values[9]};
+	pose.angularVelocity = Fove::Vec3{values[10], values[11], values[12]};
+	pose.acceleration = Fove::Vec3{values[13], values[14], values[15]};
+	pose.angularAcceleration = Fove::Vec3{values[16], values[17], values[18]};
+	return pose;
+}
+
+int record(const string& path, const float seconds)
+{
+	ofstream out(path);
+	if (!out)
+		throw "Unable to open " + path;
+	out << csvHeader << '\n'
+		<< setprecision(9);
+
+	Fove::Headset headset = Fove::Headset::create(Fove::ClientCapabilities::OrientationTracking | Fove::ClientCapabilities::PositionTracking).getValue();
+
+	// The pose is updated much faster than the display, so poll often and only keep new poses
+	cout << "Recording poses for " << seconds << " seconds..." << endl;
+	uint64_t lastId = 0;
+	size_t count = 0;
+	const auto end = chrono::steady_clock::now() + chrono::duration<float>(seconds);
+	while (chrono::steady_clock::now() < end)
+	{
+		headset.fetchPoseData();
+		const Fove::Result<Fove::Pose> poseOrError = headset.getPose();
+		if (poseOrError.isValid() && poseOrError->id != lastId)
+		{
+			lastId = poseOrError->id;
+			writePose(out, poseOrError.getValue());
+			++count;
+		}
+		this_thread::sleep_for(chrono::microseconds(500));
+	}
+
+	cout << "Recorded " << count << " poses to " << path << endl;
+	return EXIT_SUCCESS;
+}
+
+// Returns the recorded pose at the given time, interpolating between the samples around it
+// The samples must be sorted by timestamp, and the time within their range
+Fove::Pose poseAt(const vector<Fove::Pose>& poses, const uint64_t timestamp)
+{
+	const auto next = lower_bound(poses.begin(), poses.end(), timestamp, [](const Fove::Pose& pose, const uint64_t t) { return pose.timestamp < t; });
+	if (next == poses.begin() || next->timestamp == timestamp)
+		return *next;
+
+	const Fove::Pose& a = *(next - 1);
+	const Fove::Pose& b = *next;
+	const float t = static_cast<float>(timestamp - a.timestamp) / (b.timestamp - a.timestamp);
+
+	// Normalized lerp is accurate enough between samples a few milliseconds apart
+	// b is flipped if needed to go the short way around
+	Fove::Quaternion qb = b.orientation;
+	if (a.orientation.x * qb.x + a.orientation.y * qb.y + a.orientation.z * qb.z + a.orientation.w * qb.w < 0)
+		qb = Fove::Quaternion{-qb.x, -qb.y, -qb.z, -qb.w};
+	Fove::Pose ret = a;
+	ret.timestamp = timestamp;
+	ret.position = a.position + (b.position - a.position) * t;
+	ret.orientation = normalize(Fove::Quaternion{
+		a.orientation.x + (qb.x - a.orientation.x) * t,
+		a.orientation.y + (qb.y - a.orientation.y) * t,
+		a.orientation.z + (qb.z - a.orientation.z) * t,
+		a.orientation.w + (qb.w - a.orientation.w) * t,
+	});
+	return ret;
+}
+
+struct Errors
+{
+	vector<float> angles;    // Degrees
+	vector<float> distances; // Millimeters
+};
+
+float mean(const vector<float>& values)
+{
+	double sum = 0;
+	for (const float v : values)
+		sum += v;
+	return values.empty() ? 0.0f : static_cast<float>(sum / values.size());
+}
+
+float percentile95(vector<float> values)
+{
+	if (values.empty())
+		return 0;
+	const size_t index = values.size() * 95 / 100;
+	nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+int evaluate(const string& path)
+{
+	ifstream in(path);
+	if (!in)
+		throw "Unable to open " + path;
+
+	vector<Fove::Pose> poses;
+	string line;
+	getline(in, line); // Header
+	while (getline(in, line))
+	{
+		if (!line.empty())
+			poses.push_back(readPose(line, poses.size() + 1));
+	}
+	if (poses.size() < 2)
+		throw "Not enough poses in " + path;
+	sort(poses.begin(), poses.end(), [](const Fove::Pose& a, const Fove::Pose& b) { return a.timestamp < b.timestamp; });
+
+	// Each predictor configuration to compare
+	struct Candidate
+	{
+		string name;
+		PosePredictor::Settings settings;
+	};
+	const auto Make = [](const PredictionModel model, const float smoothingSeconds) {
+		PosePredictor::Settings settings;
+		settings.model = model;
+		settings.smoothingSeconds = smoothingSeconds;
+		settings.maxHorizonSeconds = 1.0f; // The horizon is controlled by the evaluation
+		return settings;
+	};
+	const vector<Candidate> candidates{
+		{"none", Make(PredictionModel::None, 0)},
+		{"velocity", Make(PredictionModel::ConstantVelocity, 0)},
+		{"velocity+filter", Make(PredictionModel::ConstantVelocity, 0.02f)},
+		{"acceleration", Make(PredictionModel::ConstantAcceleration, 0)},
+		{"acceleration+filter", Make(PredictionModel::ConstantAcceleration, 0.02f)},
+	};
+	constexpr array<int, 8> horizonsMs{0, 10, 20, 30, 40, 50, 75, 100};
+
+	// errors[horizon][candidate]
+	vector<vector<Errors>> errors(horizonsMs.size(), vector<Errors>(candidates.size()));
+	for (size_t c = 0; c < candidates.size(); ++c)
+	{
+		for (size_t h = 0; h < horizonsMs.size(); ++h)
+		{
+			// Each horizon gets its own predictor, so the filter sees every pose in order, like it would at runtime
+			PosePredictor predictor(candidates[c].settings);
+			const uint64_t horizonUs = horizonsMs[h] * 1000ULL;
+			for (const Fove::Pose& pose : poses)
+			{
+				const Fove::Pose predicted = predictor.predict(pose, horizonsMs[h] / 1000.0f);
+				if (pose.timestamp + horizonUs > poses.back().timestamp)
+					break;
+				const Fove::Pose actual = poseAt(poses, pose.timestamp + horizonUs);
+				errors[h][c].angles.push_back(angleBetween(predicted.orientation, actual.orientation) * 180 / pi);
+				errors[h][c].distances.push_back(magnitude(predicted.position - actual.position) * 1000);
+			}
+		}
+	}
+
+	const float durationSeconds = (poses.back().timestamp - poses.front().timestamp) / 1e6f;
+	cout << poses.size() << " poses over " << fixed << setprecision(1) << durationSeconds << "s (" << poses.size() / max(durationSeconds, 1e-3f) << "Hz)\n";
+
+	const auto PrintTable = [&](const char* const title, vector<float> Errors::*member) {
+		cout << '\n'
+			 << title << ", mean / 95th percentile\n"
+			 << setw(8) << "Horizon";
+		for (const Candidate& candidate : candidates)
+			cout << setw(22) << candidate.name;
+		cout << '\n';
+		for (size_t h = 0; h < horizonsMs.size(); ++h)
+		{
+			cout << setw(6) << horizonsMs[h] << "ms";
+			for (size_t c = 0; c < candidates.size(); ++c)
+			{
+				const vector<float>& values = errors[h][c].*member;
+				ostringstream cell;
+				cell << fixed << setprecision(2) << mean(values) << " / " << percentile95(values);
+				cout << setw(22) << cell.str();
+			}
+			cout << '\n';
+		}
+	};
+	PrintTable("Orientation error (degrees)", &Errors::angles);
+	PrintTable("Position error (mm)", &Errors::distances);
+	return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(const int argc, char** const argv)
+try
+{
+	const string mode = argc >= 3 ? argv[1] : "";
+	if (mode == "record" && argc <= 4)
+		return record(argv[2], argc == 4 ? stof(argv[3]) : 60.0f);
+	if (mode == "evaluate" && argc == 3)
+		return evaluate(argv[2]);
+
+	cerr << "Usage:\n"
+		 << "  " << argv[0] << " record <file.csv> [seconds]\n"
+		 << "  " << argv[0] << " evaluate <file.csv>\n";
+	return EXIT_FAILURE;
+}
+catch (...)
+{
+	// If an exception is thrown for any reason, log it and exit
+	cerr << "Error: " << currentExceptionMessage() << endl;
+	return EXIT_FAILURE;
+}
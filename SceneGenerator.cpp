@@ -0,0 +1,239 @@
+#include "SceneGenerator.h"
+#include "FoveAPI.h"
+#include "Model.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
+
+using namespace std;
+
+namespace
+{
+
+// Color of the ground, the same as the ground of the demo level
+const Fove::Vec3 groundColor{0.0f, 0.25f, 0.25f};
+
+// Corners of a hexagon of radius 1 around the vertical axis, written out so that no trigonometry depends on the math library
+constexpr float hexagon[6][2] = {{1.0f, 0.0f}, {0.5f, 0.8660254f}, {-0.5f, 0.8660254f}, {-1.0f, 0.0f}, {-0.5f, -0.8660254f}, {0.5f, -0.8660254f}};
+
+Fove::Vec3 cross(const Fove::Vec3 v1, const Fove::Vec3 v2)
+{
+	return {v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x};
+}
+
+// Returns a uniform float in [min, max)
+// The output of mt19937 is the same everywhere, and so is this, unlike uniform_real_distribution
+float uniformFloat(mt19937& random, const float min, const float max)
+{
+	return min + (max - min) * static_cast<float>(random() >> 8) * (1.0f / 16777216.0f);
+}
+
+// Appends the triangles of one object to a scene
+class ObjectWriter
+{
+public:
+	// Every shape is convex, and inside is given by a point within the object, which is how the triangles are turned to face outwards
+	ObjectWriter(SceneModel& scene, const int id, const Fove::Vec3 color, const Fove::Vec3 inside)
+		: scene_(scene), id_(id), color_(color), inside_(inside), firstFloat_(scene.verts.size())
+	{
+	}
+
+	// Appends a triangle facing away from the inside, whose vertices are then counter-clockwise from the outside, like those of Model.h
+	void triangle(const Fove::Vec3 a, Fove::Vec3 b, Fove::Vec3 c)
+	{
+		Fove::Vec3 normal = cross(b - a, c - a);
+		if (dot(normal, (a + b + c) / 3.0f - inside_) < 0)
+		{
+			swap(b, c);
+			normal = normal * -1.0f;
+		}
+
+		// There is no lighting in the shaders, so the faces are shaded by their orientation to make the shapes readable
+		normal = normalize(normal);
+		const float shade = 0.75f + 0.25f * normal.y + 0.1f * normal.x;
+		for (const Fove::Vec3& v : {a, b, c})
+		{
+			const Fove::Vec3 color = color_ * shade;
+			scene_.verts.insert(scene_.verts.end(), {v.x, v.y, v.z, static_cast<float>(id_), color.x, color.y, color.z});
+		}
+	}
+
+	// Appends a planar quad, whose corners go around it
+	void quad(const Fove::Vec3 a, const Fove::Vec3 b, const Fove::Vec3 c, const Fove::Vec3 d)
+	{
+		triangle(a, b, c);
+		triangle(a, c, d);
+	}
+
+	// Appends the collision sphere of the object, around the bounding box of its vertices
+	void collisionSphere() const
+	{
+		Fove::Vec3 lo{INFINITY, INFINITY, INFINITY}, hi{-INFINITY, -INFINITY, -INFINITY};
+		for (size_t i = firstFloat_; i < scene_.verts.size(); i += sceneFloatsPerVert)
+		{
+			lo = Fove::Vec3{min(lo.x, scene_.verts[i]), min(lo.y, scene_.verts[i + 1]), min(lo.z, scene_.verts[i + 2])};
+			hi = Fove::Vec3{max(hi.x, scene_.verts[i]), max(hi.y, scene_.verts[i + 1]), max(hi.z, scene_.verts[i + 2])};
+		}
+		const Fove::Vec3 center = (lo + hi) * 0.5f;
+		float radiusSquared = 0;
+		for (size_t i = firstFloat_; i < scene_.verts.size(); i += sceneFloatsPerVert)
+			radiusSquared = max(radiusSquared, distanceSquared(Fove::Vec3{scene_.verts[i], scene_.verts[i + 1], scene_.verts[i + 2]}, center));
+		scene_.spheres.insert(scene_.spheres.end(), {static_cast<float>(id_), sqrt(radiusSquared), center.x, center.y, center.z});
+	}
+
+private:
+	SceneModel& scene_;
+	int id_;
+	Fove::Vec3 color_;
+	Fove::Vec3 inside_;
+	size_t firstFloat_;
+};
+
+// Box standing on the ground, base is the center of its bottom
+void writeBox(ObjectWriter& writer, const Fove::Vec3 base, const float halfWidth, const float halfDepth, const float height)
+{
+	const auto Corner = [&](const int x, const int y, const int z) { return base + Fove::Vec3{x ? halfWidth : -halfWidth, y ? height : 0.0f, z ? halfDepth : -halfDepth}; };
+	writer.quad(Corner(0, 0, 0), Corner(1, 0, 0), Corner(1, 0, 1), Corner(0, 0, 1));
+	writer.quad(Corner(0, 1, 0), Corner(1, 1, 0), Corner(1, 1, 1), Corner(0, 1, 1));
+	writer.quad(Corner(0, 0, 0), Corner(1, 0, 0), Corner(1, 1, 0), Corner(0, 1, 0));
+	writer.quad(Corner(0, 0, 1), Corner(1, 0, 1), Corner(1, 1, 1), Corner(0, 1, 1));
+	writer.quad(Corner(0, 0, 0), Corner(0, 0, 1), Corner(0, 1, 1), Corner(0, 1, 0));
+	writer.quad(Corner(1, 0, 0), Corner(1, 0, 1), Corner(1, 1, 1), Corner(1, 1, 0));
+}
+
+// Pyramid with a rectangular base on the ground
+void writePyramid(ObjectWriter& writer, const Fove::Vec3 base, const float halfWidth, const float halfDepth, const float height)
+{
+	const Fove::Vec3 corners[4] = {base + Fove::Vec3{-halfWidth, 0, -halfDepth}, base + Fove::Vec3{halfWidth, 0, -halfDepth}, base + Fove::Vec3{halfWidth, 0, halfDepth},
+								   base + Fove::Vec3{-halfWidth, 0, halfDepth}};
+	const Fove::Vec3 apex = base + Fove::Vec3{0, height, 0};
+	writer.quad(corners[0], corners[1], corners[2], corners[3]);
+	for (int i = 0; i < 4; ++i)
+		writer.triangle(corners[i], corners[(i + 1) % 4], apex);
+}
+
+// Hexagonal column standing on the ground
+void writeColumn(ObjectWriter& writer, const Fove::Vec3 base, const float radius, const float height)
+{
+	const auto Corner = [&](const int i, const float y) { return base + Fove::Vec3{hexagon[i % 6][0] * radius, y, hexagon[i % 6][1] * radius}; };
+	for (int i = 0; i < 6; ++i)
+		writer.quad(Corner(i, 0), Corner(i + 1, 0), Corner(i + 1, height), Corner(i, height));
+	for (const float y : {0.0f, height})
+	{
+		for (int i = 1; i < 5; ++i)
+			writer.triangle(Corner(0, y), Corner(i, y), Corner(i + 1, y));
+	}
+}
+
+// Octahedron floating above the ground, around center
+void writeGem(ObjectWriter& writer, const Fove::Vec3 center, const float radius, const float halfHeight)
+{
+	const Fove::Vec3 top = center + Fove::Vec3{0, halfHeight, 0};
+	const Fove::Vec3 bottom = center - Fove::Vec3{0, halfHeight, 0};
+	const Fove::Vec3 corners[4] = {center + Fove::Vec3{radius, 0, 0}, center + Fove::Vec3{0, 0, radius}, center - Fove::Vec3{radius, 0, 0}, center - Fove::Vec3{0, 0, radius}};
+	for (int i = 0; i < 4; ++i)
+	{
+		writer.triangle(corners[i], corners[(i + 1) % 4], top);
+		writer.triangle(corners[i], corners[(i + 1) % 4], bottom);
+	}
+}
+
+} // namespace
+
+int SceneModel::maxObjectId() const
+{
+	int ret = 0;
+	for (size_t i = 0; i < sphereCount(); ++i)
+		ret = max(ret, static_cast<int>(spheres[i * sceneFloatsPerSphere]));
+	return ret;
+}
+
+SceneModel levelSceneModel()
+{
+	SceneModel ret;
+	ret.verts.assign(begin(levelModelVerts), end(levelModelVerts));
+	ret.spheres.assign(begin(collisionSpheres), end(collisionSpheres));
+	return ret;
+}
+
+SceneModel generateScene(const SceneGeneratorSettings& settings)
+{
+	// The cells of the grid are taken by distance from the origin, so the scene is round, and the cells around the origin are skipped
+	// The grid is made wide enough for the disc of cells to fit in it
+	constexpr int clearCells = 5; // The cell of the origin and its 4 neighbours
+	const int gridRadius = static_cast<int>(ceil(sqrt((settings.objectCount + clearCells) / 3.14159f))) + 1;
+	vector<tuple<int, int, int>> cells; // Squared distance (in cells), then x and z of each cell
+	cells.reserve(static_cast<size_t>(2 * gridRadius + 1) * (2 * gridRadius + 1));
+	for (int z = -gridRadius; z <= gridRadius; ++z)
+	{
+		for (int x = -gridRadius; x <= gridRadius; ++x)
+			cells.emplace_back(x * x + z * z, x, z);
+	}
+	sort(cells.begin(), cells.end());
+
+	SceneModel ret;
+	mt19937 random(settings.seed);
+
+	// Ground, under the whole grid
+	{
+		const float extent = (gridRadius + 1) * settings.cellSize;
+		ObjectWriter ground(ret, 0, groundColor, Fove::Vec3{0, -1, 0});
+		ground.quad(Fove::Vec3{-extent, 0, -extent}, Fove::Vec3{extent, 0, -extent}, Fove::Vec3{extent, 0, extent}, Fove::Vec3{-extent, 0, extent});
+	}
+
+	// Objects, one per cell, placed randomly within their cell
+	// The random numbers are drawn one statement at a time, since the evaluation order of function arguments differs between compilers
+	const float maxOffset = settings.cellSize * 0.5f - 0.8f; // Keeps the widest objects within their cell
+	for (size_t i = 0; i < settings.objectCount; ++i)
+	{
+		const tuple<int, int, int>& cell = cells[i + clearCells];
+		const float x = get<1>(cell) * settings.cellSize + uniformFloat(random, -maxOffset, maxOffset);
+		const float z = get<2>(cell) * settings.cellSize + uniformFloat(random, -maxOffset, maxOffset);
+		const Fove::Vec3 base{x, 0, z};
+		const Fove::Vec3 color{uniformFloat(random, 0.2f, 0.9f), uniformFloat(random, 0.2f, 0.9f), uniformFloat(random, 0.2f, 0.9f)}; // Braced lists are evaluated in order
+		const uint32_t shape = random() % 4;
+		const float width = uniformFloat(random, 0.2f, 0.7f);
+		const float depth = uniformFloat(random, 0.2f, 0.7f);
+		const float height = uniformFloat(random, 0.3f, 2.5f);
+		const int id = static_cast<int>(i + 1);
+		if (shape == 0)
+		{
+			ObjectWriter writer(ret, id, color, base + Fove::Vec3{0, height / 2, 0});
+			writeBox(writer, base, width, depth, height);
+			writer.collisionSphere();
+		}
+		else if (shape == 1)
+		{
+			ObjectWriter writer(ret, id, color, base + Fove::Vec3{0, height / 4, 0});
+			writePyramid(writer, base, width, depth, height);
+			writer.collisionSphere();
+		}
+		else if (shape == 2)
+		{
+			ObjectWriter writer(ret, id, color, base + Fove::Vec3{0, height, 0});
+			writeColumn(writer, base, width * 0.7f, height * 1.6f);
+			writer.collisionSphere();
+		}
+		else
+		{
+			const Fove::Vec3 center = base + Fove::Vec3{0, 0.8f + height * 0.5f, 0};
+			ObjectWriter writer(ret, id, color, center);
+			writeGem(writer, center, width * 0.4f, depth * 0.5f);
+			writer.collisionSphere();
+		}
+	}
+	return ret;
+}
+
+SceneModel sceneModelAtScale(const float scale, const uint32_t seed)
+{
+	if (scale <= 0)
+		return levelSceneModel();
+
+	SceneGeneratorSettings settings;
+	settings.objectCount = max<size_t>(1, static_cast<size_t>(lround(scale * (size(collisionSpheres) / sceneFloatsPerSphere))));
+	settings.seed = seed;
+	return generateScene(settings);
+}
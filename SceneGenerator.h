@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// This header generates large procedural scenes, to benchmark the examples and the gaze detection at the scale of real levels,
+// which are much bigger than the demo level of Model.h
+// The scenes are in the same layouts as Model.h, so the examples draw them with the same shaders, split them into objects (see SceneObjects.h),
+// and register their collision spheres with FOVE SceneAware, exactly as they do the demo level
+
+// Floats per vertex (x, y, z, object id, r, g, b) and per collision sphere (object id, radius, x, y, z), as in Model.h
+constexpr size_t sceneFloatsPerVert = 7;
+constexpr size_t sceneFloatsPerSphere = 5;
+
+// Vertices and collision spheres of a scene
+struct SceneModel
+{
+	std::vector<float> verts;   // Triangle list, the vertices of each object being contiguous
+	std::vector<float> spheres; // Collision spheres of the gazable objects
+
+	size_t vertexCount() const { return verts.size() / sceneFloatsPerVert; }
+	size_t sphereCount() const { return spheres.size() / sceneFloatsPerSphere; }
+	int maxObjectId() const; // Highest object id of the collision spheres, 0 (the ground) if there are none
+};
+
+// Returns a copy of the demo level of Model.h
+SceneModel levelSceneModel();
+
+struct SceneGeneratorSettings
+{
+	size_t objectCount = 71; // Number of gazable objects, 71 being as many as the demo level
+	uint32_t seed = 1;
+	float cellSize = 3.5f; // Each object stands in its own cell of a grid, this many meters wide, about as dense as the demo level
+};
+
+// Returns objectCount random objects (boxes, pyramids, columns and floating gems) scattered on a ground around the origin,
+// filling the grid outwards from the origin, whose surroundings are left clear for the player
+// The ground has the object id 0, and the objects the ids 1 to objectCount, each with a collision sphere enclosing it
+// The same settings give the same scene on every platform (the distributions of <random> are implementation-defined, so they're not used)
+SceneModel generateScene(const SceneGeneratorSettings& settings);
+
+// Returns the generated scene with scale times as many objects as the demo level (see generateScene), or the demo level itself if scale is 0
+SceneModel sceneModelAtScale(float scale, uint32_t seed);
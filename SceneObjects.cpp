@@ -0,0 +1,127 @@
+#include "SceneObjects.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+vector<SceneObject> findSceneObjects(const float* const verts, const size_t vertexCount, const size_t floatsPerVert)
+{
+	vector<SceneObject> ret;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const int id = static_cast<int>(verts[i * floatsPerVert + 3]);
+		if (ret.empty() || ret.back().id != id)
+		{
+			SceneObject object;
+			object.id = id;
+			object.firstVertex = static_cast<uint32_t>(i);
+			ret.push_back(object);
+		}
+		++ret.back().vertexCount;
+	}
+	return ret;
+}
+
+void computeSceneObjectBounds(vector<SceneObject>& objects, const float* const verts, const size_t floatsPerVert, const float* const spheres, const size_t sphereCount)
+{
+	for (SceneObject& object : objects)
+	{
+		const auto Vertex = [&](const uint32_t i) {
+			const float* const vert = verts + (object.firstVertex + i) * floatsPerVert;
+			return Fove::Vec3{vert[0], vert[1], vert[2]};
+		};
+
+		// Start from the collision sphere of the object, or the center of its bounding box
+		const float* sphere = nullptr;
+		for (size_t i = 0; i < sphereCount && !sphere; ++i)
+		{
+			if (static_cast<int>(spheres[i * 5]) == object.id)
+				sphere = spheres + i * 5;
+		}
+		if (sphere)
+		{
+			object.bounds.center = Fove::Vec3{sphere[2], sphere[3], sphere[4]};
+			object.bounds.radius = sphere[1];
+		}
+		else if (object.vertexCount > 0)
+		{
+			Fove::Vec3 lo = Vertex(0), hi = Vertex(0);
+			for (uint32_t i = 1; i < object.vertexCount; ++i)
+			{
+				const Fove::Vec3 v = Vertex(i);
+				lo = Fove::Vec3{min(lo.x, v.x), min(lo.y, v.y), min(lo.z, v.z)};
+				hi = Fove::Vec3{max(hi.x, v.x), max(hi.y, v.y), max(hi.z, v.z)};
+			}
+			object.bounds.center = (lo + hi) * 0.5f;
+			object.bounds.radius = 0;
+		}
+
+		// Grow the sphere to enclose every vertex
+		float radiusSquared = object.bounds.radius * object.bounds.radius;
+		for (uint32_t i = 0; i < object.vertexCount; ++i)
+			radiusSquared = std::max(radiusSquared, distanceSquared(Vertex(i), object.bounds.center));
+		object.bounds.radius = sqrt(radiusSquared);
+	}
+}
+
+vector<DrawArraysIndirectCommand> sceneDrawCommands(const vector<SceneObject>& objects)
+{
+	vector<DrawArraysIndirectCommand> ret;
+	ret.reserve(objects.size());
+	for (const SceneObject& object : objects)
+		ret.push_back(DrawArraysIndirectCommand{object.vertexCount, 1, object.firstVertex, static_cast<uint32_t>(ret.size())});
+	return ret;
+}
+
+float sceneObjectHighlight(const int id, const float selection)
+{
+	return max(0.0f, 0.5f - abs(selection - static_cast<float>(id)));
+}
+
+BoundingSphere transformBoundingSphere(const BoundingSphere& sphere, const float model[16])
+{
+	// The radius scales by the longest axis of the matrix, which is exact for uniform scales, and conservative otherwise
+	float scaleSquared = 0;
+	for (int column = 0; column < 3; ++column)
+		scaleSquared = max(scaleSquared, model[column] * model[column] + model[4 + column] * model[4 + column] + model[8 + column] * model[8 + column]);
+
+	const Fove::Vec3 c = sphere.center;
+	BoundingSphere ret;
+	ret.center = Fove::Vec3{model[0] * c.x + model[1] * c.y + model[2] * c.z + model[3],
+							model[4] * c.x + model[5] * c.y + model[6] * c.z + model[7],
+							model[8] * c.x + model[9] * c.y + model[10] * c.z + model[11]};
+	ret.radius = sphere.radius * sqrt(scaleSquared);
+	return ret;
+}
+
+Frustum frustumFromClipMatrix(const Fove::Matrix44& clip)
+{
+	// A point is inside when -w <= x, y, z <= w in clip space, and each of these is a plane: (row 3 +/- row i) . point >= 0
+	const float(&m)[4][4] = clip.mat;
+	Frustum ret;
+	for (int i = 0; i < 6; ++i)
+	{
+		const int row = i / 2;
+		const float sign = i % 2 == 0 ? 1.0f : -1.0f;
+		float* const plane = ret.planes[i];
+		for (int j = 0; j < 4; ++j)
+			plane[j] = m[3][j] + sign * m[row][j];
+
+		// Normalize the plane so that it gives distances, which can be compared with the radius of spheres
+		const float length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		for (int j = 0; j < 4; ++j)
+			plane[j] /= length;
+	}
+	return ret;
+}
+
+bool isSphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere)
+{
+	for (const float(&plane)[4] : frustum.planes)
+	{
+		if (plane[0] * sphere.center.x + plane[1] * sphere.center.y + plane[2] * sphere.center.z + plane[3] < -sphere.radius)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "FoveAPI.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// This header splits the level model into its objects, shared by the graphical examples, so that each object can be moved and highlighted on its own
+// The vertices of each object are contiguous in the model, with the object id in pos.w (see Model.h), so an object is a range of vertices
+// The whole scene is drawn by one indirect multi-draw (glMultiDrawArraysIndirect, vkCmdDrawIndirect), with one draw command per object,
+// whose first instance is the index of the object, which the vertex shader uses to read the data of the object (transform and highlight)
+// Each object also has a bounding sphere, so that the objects nobody can see can be skipped (see GlCulling.h)
+
+// Sphere enclosing every vertex of an object
+struct BoundingSphere
+{
+	Fove::Vec3 center;
+	float radius = 0;
+};
+
+// Range of vertices of one object of the model
+struct SceneObject
+{
+	int id = 0; // Object id of the vertices, which is also the id of the gazable object
+	uint32_t firstVertex = 0;
+	uint32_t vertexCount = 0;
+	BoundingSphere bounds; // In the space of the vertices, before the model matrix of the object (see computeSceneObjectBounds)
+};
+
+// Splits the model into its objects, one per run of vertices with the same object id (so an id can have several objects)
+std::vector<SceneObject> findSceneObjects(const float* verts, size_t vertexCount, size_t floatsPerVert);
+
+// Sets the bounding sphere of each object, from the collision spheres of the model (id, radius, x, y, z, see Model.h) when it has one
+// The collision spheres are meant for gaze detection, and don't always enclose the whole object, so they're grown as needed
+// Objects without a collision sphere (eg. the ground) get the sphere around the bounding box of their vertices
+void computeSceneObjectBounds(std::vector<SceneObject>& objects, const float* verts, size_t floatsPerVert, const float* spheres, size_t sphereCount);
+
+// Draw command of glMultiDrawArraysIndirect and vkCmdDrawIndirect, which share this layout
+struct DrawArraysIndirectCommand
+{
+	uint32_t vertexCount;
+	uint32_t instanceCount;
+	uint32_t firstVertex;
+	uint32_t firstInstance;
+};
+
+// Returns one draw command per object, each drawing a single instance, whose index is that of the object
+std::vector<DrawArraysIndirectCommand> sceneDrawCommands(const std::vector<SceneObject>& objects);
+
+// Data of an object, as read by the vertex shader (std430 layout)
+struct SceneObjectData
+{
+	float model[16]; // Model matrix, row-major like Fove::Matrix44
+	float highlight; // Added to the color of the object
+	float padding[3];
+};
+
+// Returns how much an object is highlighted given the selected object id, the same as the per-vertex highlight of the original shaders
+float sceneObjectHighlight(int id, float selection);
+
+// Returns the bounding sphere of an object once moved by its model matrix, which may scale it
+BoundingSphere transformBoundingSphere(const BoundingSphere& sphere, const float model[16]);
+
+// Planes of a view frustum, each (a, b, c, d) such that ax + by + cz + d is the distance to the plane, positive inside
+struct Frustum
+{
+	float planes[6][4];
+};
+
+// Returns the frustum of a clip matrix (projection * view, row-major like Fove::Matrix44, transforming column vectors)
+// The near plane is taken at a clip z of -w, which is conservative when the projection maps the near plane to 0 instead (D3D conventions)
+Frustum frustumFromClipMatrix(const Fove::Matrix44& clip);
+
+// Whether any part of the sphere may be inside the frustum
+// Spheres near a corner of the frustum can pass while being outside, the test is exact for the planes, not the edges
+bool isSphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere);
@@ -0,0 +1,59 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// A slot holding one value written by a single writer and read by any number of readers, protected by a sequence lock
+// The writer never waits, and readers never write, so they don't slow each other down. Readers copy the value out, and check that it wasn't rewritten meanwhile.
+//
+// Each value written is tagged with a sequence number, which must increase, and readers ask for a specific sequence number.
+// This lets rings of slots (see EyeFrameChannel.h) tell a value apart from the one that overwrote it.
+//
+// The value is stored in atomic words, so the racing copies are well defined C++, and the slot has no pointer,
+// so it also works in memory shared between processes, as long as they agree on the layout of T.
+
+template <typename T>
+struct alignas(64) SeqlockSlot // Aligned so that neighboring slots don't share cache lines
+{
+	static_assert(std::is_trivially_copyable_v<T>, "SeqlockSlot copies values word by word");
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "SeqlockSlot needs lock free atomics");
+
+	static constexpr size_t wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<uint64_t> lock{0}; // 2 * sequence once the value is written, odd while being written
+	std::array<std::atomic<uint64_t>, wordCount> words{};
+
+	void write(const uint64_t sequence, const T& value)
+	{
+		std::array<uint64_t, wordCount> copy{};
+		std::memcpy(copy.data(), static_cast<const void*>(&value), sizeof(T));
+
+		// Mark the slot as being written before touching the value, so readers copying it notice
+		lock.store(2 * sequence - 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < wordCount; ++i)
+			words[i].store(copy[i], std::memory_order_relaxed);
+		lock.store(2 * sequence, std::memory_order_release);
+	}
+
+	// Returns false if the slot doesn't hold the given sequence number, or if it was rewritten during the copy
+	bool read(const uint64_t sequence, T& value) const
+	{
+		const uint64_t before = lock.load(std::memory_order_acquire);
+		if (before != 2 * sequence)
+			return false;
+
+		std::array<uint64_t, wordCount> copy;
+		for (size_t i = 0; i < wordCount; ++i)
+			copy[i] = words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (lock.load(std::memory_order_relaxed) != before)
+			return false;
+
+		std::memcpy(static_cast<void*>(&value), copy.data(), sizeof(T));
+		return true;
+	}
+};
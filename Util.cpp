@@ -182,6 +182,22 @@ Fove::Quaternion conjugate(const Fove::Quaternion q)
 	return ret;
 }
 
+Fove::Quaternion operator*(const Fove::Quaternion q1, const Fove::Quaternion q2)
+{
+	Fove::Quaternion ret;
+	ret.x = q1.w * q2.x + q1.x * q2.w + q1.y * q2.z - q1.z * q2.y;
+	ret.y = q1.w * q2.y - q1.x * q2.z + q1.y * q2.w + q1.z * q2.x;
+	ret.z = q1.w * q2.z + q1.x * q2.y - q1.y * q2.x + q1.z * q2.w;
+	ret.w = q1.w * q2.w - q1.x * q2.x - q1.y * q2.y - q1.z * q2.z;
+	return ret;
+}
+
+Fove::Quaternion normalize(const Fove::Quaternion q)
+{
+	const float length = sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	return Fove::Quaternion{q.x / length, q.y / length, q.z / length, q.w / length};
+}
+
 Fove::Matrix44 quatToMatrix(const Fove::Quaternion q)
 {
 	Fove::Matrix44 ret;
@@ -258,6 +274,19 @@ Fove::Matrix44 translationMatrix(const float x, const float y, const float z)
 	return ret;
 }
 
+Fove::Matrix44 perspectiveMatrixLH(const float fovY, const float aspect, const float zNear, const float zFar)
+{
+	// Left handed (+z forward), with the -1 to 1 clip space depth range of OpenGL, like Headset::getProjectionMatricesLH
+	const float yScale = 1 / tan(fovY / 2);
+	Fove::Matrix44 ret;
+	ret.mat[0][0] = yScale / aspect;
+	ret.mat[1][1] = yScale;
+	ret.mat[2][2] = (zFar + zNear) / (zFar - zNear);
+	ret.mat[2][3] = -2 * zFar * zNear / (zFar - zNear);
+	ret.mat[3][2] = 1;
+	return ret;
+}
+
 Fove::Matrix44 operator*(const Fove::Matrix44& m1, const Fove::Matrix44& m2)
 {
 	Fove::Matrix44 ret;
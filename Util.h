@@ -43,9 +43,12 @@ std::wstring toUtf16(const std::string& str);
 // Math utilities
 Fove::Quaternion axisAngleToQuat(float vx, float vy, float vz, float angle);
 Fove::Quaternion conjugate(Fove::Quaternion);
+Fove::Quaternion operator*(Fove::Quaternion q1, Fove::Quaternion q2); // Applies q2, then q1
+Fove::Quaternion normalize(Fove::Quaternion q);
 Fove::Matrix44 quatToMatrix(Fove::Quaternion q);
 Fove::Matrix44 transpose(const Fove::Matrix44& m);
 Fove::Matrix44 translationMatrix(float x, float y, float z);
+Fove::Matrix44 perspectiveMatrixLH(float fovY, float aspect, float zNear, float zFar); // Same conventions as translationMatrix (not transposed like the FOVE projections)
 Fove::Vec3 transformPoint(const Fove::Matrix44& transform, Fove::Vec3 point, float w);
 Fove::Matrix44 operator*(const Fove::Matrix44& m1, const Fove::Matrix44& m2);
 inline Fove::Vec3 operator*(Fove::Vec3 v, float scalar) { return {v.x * scalar, v.y * scalar, v.z * scalar}; }
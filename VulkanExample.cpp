@@ -1,7 +1,12 @@
 // FOVE Vulkan Example
 // This shows how to display content in a FOVE HMD via the FOVE SDK & Vulkan
-#include "Model.h" // import levelModelVerts
+#include "DynamicResolution.h"
+#include "Foveation.h"
+#include "GazeHeatmap.h"
 #include "NativeUtil.h"
+#include "PosePrediction.h"
+#include "SceneGenerator.h" // import the level, or a generated scene
+#include "SceneObjects.h"
 #include "Util.h"
 #include <FoveAPI.h>
 #include <algorithm>
@@ -11,8 +16,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <optional>
 #include <string>
 #include <thread>
@@ -80,6 +87,12 @@ constexpr auto requiredDeviceExtensions = array<const char* const, 3>{
 	VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME // FIXME Linux specific
 };
 
+// Optional extensions, used for foveated rendering with a shading rate image when available (see FoveationMode)
+constexpr auto shadingRateDeviceExtensions = array<const char* const, 2>{
+	VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+	VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME,
+};
+
 // Debug settings
 constexpr auto disableValidationLayers = false;
 constexpr auto disableDebugUtils = false;
@@ -115,6 +128,14 @@ struct QueueFamily
 	uint32_t index;
 };
 
+// How foveated rendering (the --foveated option) is implemented, see Foveation.h
+enum class FoveationMode
+{
+	Off,
+	ShadingRate, // VK_KHR_fragment_shading_rate, with a shading rate image following the gaze
+	Inset,       // Fallback for other devices: low resolution periphery, upscaled, with a full resolution inset around the gaze
+};
+
 // Make it match the alignment of the data from Model.h (float levelModelVerts[]) (pos: 4 floats, color: 3 floats).
 // But note that the pos.w is 0.0F in the data, so we need to set it to 1.0F in the shader.
 struct RenderTextureVertex
@@ -153,7 +174,7 @@ struct RenderTextureVertex
 		return attributeDescriptions;
 	}
 };
-static_assert(sizeof(RenderTextureVertex) == 7 * sizeof(float));
+static_assert(sizeof(RenderTextureVertex) == sceneFloatsPerVert * sizeof(float)); // The vertices of a Scene are read in place as RenderTextureVertex
 
 struct RenderTextureUbo
 {
@@ -253,6 +274,11 @@ public:
 	{
 	}
 
+	Span(T* data, size_t size)
+		: m_data{data}, m_size{size}
+	{
+	}
+
 	~Span() = default;
 
 	const T* data() const { return m_data; }
@@ -325,13 +351,26 @@ public:
 	void createRenderTextureRenderPass();
 	void createRenderTextureDescriptorSetLayout();
 	void createRenderTextureGraphicsPipeline();
+	void createFoveationPipeline();
+	void createPeripheryDescriptorSets(); // Part of createFoveationPipeline(), one set per image
 	void createRenderTextureFramebuffers();
 	void createRenderTextureVertexBuffer(const Span<const RenderTextureVertex>);
+	void createRenderTextureDrawBuffer(const Span<const RenderTextureVertex>); // One indirect draw command per object of the scene
 	void createRenderTextureIndexBuffer(const Span<const RenderTextureVertex::IndexType>); // not used
 	void createRenderTextureUniformBuffers();
+	void createRenderTextureObjectBuffers(); // Data of each object of the scene (SceneObjectData), read by DemoScene.vert
 	void createRenderTextureDescriptorPool();
 	void createRenderTextureDescriptorSets();
 
+	// Foveated rendering
+	// requestFoveation() must be called before createLogicalDevice(), which picks the technique based on what the device supports
+	void requestFoveation() { m_foveationMode = FoveationMode::Inset; }
+	void setGaze(const Fove::Stereo<Fove::Vec2>& gaze) { m_gaze = gaze; }
+
+	// Requests a new render texture size
+	// Each image is reallocated lazily in drawFrame(), once the GPU is done with it, so resizing never stalls
+	void resizeRenderTextures(const uint32_t width, const uint32_t height);
+
 	// Swapchains for the host display.
 	// This is not necessary for rendering to the headset through Fove runtime,
 	// but this example renders the same content on the host display as well.
@@ -351,30 +390,58 @@ public:
 
 	void createCommandPool();
 	void createCommandBuffers(const uint32_t nImages);
+	void createTimestampQueryPool(const uint32_t nImages);
 	void createSyncObjects(const uint32_t nImages, const uint32_t nMaxFramesInFlight);
 
 	// Helpers
 	void cleanupSwapchain();
 	void recreateSwapchain(NativeWindow&);
+	void recreateImageResources(); // After the swapchain image count changed, see drawFrame()
 
 	// Main rendering logic
 	// First renders the scene to a render texture and shows the result to the host screen quad for monitoring.
 	// The same texture is then submitted to Fove runtime by Fove::Compositor::submit() API.
-	void recordCommandBuffers(const Span<const RenderTextureVertex> sceneVerts, const Span<const SwapchainVertex::IndexType> quadInds);
+	void recordCommandBuffers(const Span<const SwapchainVertex::IndexType> quadInds);
+	void recordCommandBuffer(const size_t index, const Span<const SwapchainVertex::IndexType> quadInds);
 
 	// App interface
-	uint32_t drawFrame(NativeWindow&, const RenderTextureUboLR&);
+	// latchUbo is called right before the queue submission, once everything else is ready, so it can use the newest pose (late latching)
+	uint32_t drawFrame(NativeWindow&, const function<RenderTextureUboLR()>& latchUbo);
 
 private:
 	// Each image uses two descriptor sets, one for left, another for right
 	void updateRenderTextureUniformBuffer(const uint32_t descriptorIndex, const RenderTextureUbo&);
+	void updateRenderTextureObjectBuffer(const uint32_t index, const float selection); // Shared by both eyes
 	void updateSwapchainUniformBuffer();
+	void updateSwapchainDescriptorSet(const uint32_t index);
+
+	// Replaces the render texture (and everything referencing it) of one image with one of size m_renderTextureExtent
+	// The caller must make sure the GPU is no longer using that image, and re-record its command buffer
+	void recreateRenderTexture(const uint32_t index);
+
+	// Feeds the GPU time of the last frame rendered with this image to the dynamic resolution controller, if available
+	void readRenderTextureGpuTime(const uint32_t index);
+
+	// Creates the framebuffer of one render texture, along with its foveated rendering resources which depend on its size
+	void createRenderTextureFramebuffer(const uint32_t index);
+	void createFoveationTargets(const uint32_t index);
+
+	// Updates the foveation of one image from the latest gaze, and returns whether its command buffer needs to be re-recorded
+	// The caller must make sure the GPU is no longer using that image
+	bool updateFoveation(const uint32_t index);
+
+	// Parts of recordCommandBuffer()
+	void recordSceneDraws(const vk::CommandBuffer, const size_t index, const uint32_t eyeWidth, const EyeViewport& viewport, const array<EyeViewport, 2>& scissors);
+	void recordShadingRateUpload(const vk::CommandBuffer, const size_t index);
+	void recordPeripheryPass(const vk::CommandBuffer, const size_t index);
+	void recordPeripheryUpscale(const vk::CommandBuffer, const size_t index, const size_t quadIndexCount);
 
 private:
 	friend class VulkanExample;
 	bool m_enableValidationLayers{false};
 	bool m_enableDebugUtils{false};
 	vk::UniqueInstance m_instance{};
+	uint32_t m_instanceApiVersion{VK_API_VERSION_1_0}; // Version of the instance level functions, may be lower than appInfo.apiVersion
 	vk::UniqueDebugUtilsMessengerEXT m_debugUtilsMessenger{};
 	vk::UniqueSurfaceKHR m_surface{};
 
@@ -387,7 +454,8 @@ private:
 	////////////////////////////////
 	// Render to texture for submission to Fove runtime
 	vk::Format m_renderTextureImageFormat{};
-	vk::Extent2D m_renderTextureExtent{};
+	vk::Extent2D m_renderTextureExtent{};          // Size requested for all render textures
+	vector<vk::Extent2D> m_renderTextureExtents{}; // Actual size of each render texture, lags behind while resizing
 	vector<vk::UniqueDeviceMemory> m_renderTextureDeviceMemories{};
 	vector<vk::UniqueImage> m_renderTextureImages{};
 	vector<vk::UniqueImageView> m_renderTextureImageViews{};
@@ -402,9 +470,21 @@ private:
 	vk::UniqueDeviceMemory m_renderTextureVertexBufferMemory{};
 	vk::UniqueBuffer m_renderTextureIndexBuffer{};
 	vk::UniqueDeviceMemory m_renderTextureIndexBufferMemory{};
+	vk::UniqueBuffer m_renderTextureDrawBuffer{};
+	vk::UniqueDeviceMemory m_renderTextureDrawBufferMemory{};
+	uint32_t m_renderTextureDrawCount{0};
+	vector<DrawArraysIndirectCommand> m_renderTextureDrawCommands{}; // Drawn one by one without drawIndirectFirstInstance
+	bool m_multiDrawIndirect{false};         // Whether all the draw commands can be issued by one vkCmdDrawIndirect
+	bool m_drawIndirectFirstInstance{false}; // Whether the draw commands can start at another instance than 0
+	vector<SceneObject> m_sceneObjects{};
+
+	vector<vk::UniqueBuffer> m_renderTextureObjectBuffers{};
+	vector<vk::UniqueDeviceMemory> m_renderTextureObjectBufferMemories{};
+	vector<SceneObjectData*> m_renderTextureObjectBufferData{}; // Persistently mapped, like the uniform buffers
 
 	vector<vk::UniqueBuffer> m_renderTextureUniformBuffers{};
 	vector<vk::UniqueDeviceMemory> m_renderTextureUniformBufferMemories{};
+	vector<RenderTextureUbo*> m_renderTextureUniformBufferData{}; // Persistently mapped, so latching a pose is just a copy
 	vk::UniqueDescriptorPool m_renderTextureDescriptorPool{};
 	vector<vk::UniqueDescriptorSet> m_renderTextureDescriptorSets{};
 
@@ -440,6 +520,42 @@ private:
 	vk::UniqueCommandPool m_commandPool{};
 	vector<vk::UniqueCommandBuffer> m_commandBuffers{};
 
+	// Dynamic resolution (see DynamicResolution.h)
+	// The GPU time of the render texture pass is measured with two timestamps per image
+	DynamicResolution m_dynamicResolution{};
+	vector<EyeViewport> m_renderTextureViewports{}; // Eye viewport each command buffer was recorded with
+	vk::UniqueQueryPool m_timestampQueryPool{};     // Null if the queue doesn't support timestamps
+	float m_timestampPeriodNs{0};
+	vector<bool> m_timestampsPending{}; // Whether each image has been submitted since its timestamps were last read
+
+	// Foveated rendering (see Foveation.h)
+	FoveationMode m_foveationMode{FoveationMode::Off};
+	FoveationSettings m_foveationSettings{};
+	Fove::Stereo<Fove::Vec2> m_gaze{}; // Latest gaze of each eye, in screen space (see Headset::getGazeScreenPosition)
+
+	// Shading rate mode: each image has a shading rate image, which its command buffer fills from a host visible buffer
+	vk::Extent2D m_shadingRateTexelSize{}; // Pixels covered by each texel of the shading rate images
+	int m_maxFragmentSize{2};
+	vector<ImageAndMemory> m_shadingRateImages{};
+	vector<vk::UniqueImageView> m_shadingRateImageViews{};
+	vector<vk::Extent2D> m_shadingRateExtents{};
+	vector<BufferAndMemory> m_shadingRateBuffers{};
+	vector<uint8_t*> m_shadingRateBufferData{}; // Persistently mapped
+
+	// Inset mode: each image has a low resolution target for the periphery, which is upscaled with the TextureCopy shaders
+	// The insets are part of the scissors, so each image remembers the ones its command buffer was recorded with
+	vk::UniqueSampler m_peripherySampler{};
+	vk::UniqueDescriptorSetLayout m_peripheryDescriptorSetLayout{};
+	vk::UniquePipelineLayout m_peripheryPipelineLayout{};
+	vk::UniquePipeline m_peripheryGraphicsPipeline{};
+	vk::UniqueDescriptorPool m_peripheryDescriptorPool{};
+	vector<vk::UniqueDescriptorSet> m_peripheryDescriptorSets{};
+	vector<ImageAndMemory> m_peripheryImages{};
+	vector<vk::UniqueImageView> m_peripheryImageViews{};
+	vector<vk::UniqueFramebuffer> m_peripheryFramebuffers{};
+	vector<vk::Extent2D> m_peripheryExtents{};
+	vector<array<EyeViewport, 2>> m_foveaInsets{};
+
 	vector<vk::UniqueSemaphore> m_imageAvailableSemaphores{};
 	vector<vk::UniqueSemaphore> m_renderFinishedSemaphores{};
 	vector<vk::UniqueFence> m_inFlightFences{};
@@ -557,6 +673,12 @@ struct BufferAndMemory
 	vk::UniqueDeviceMemory deviceMemory;
 };
 
+struct ImageAndMemory
+{
+	vk::UniqueImage image;
+	vk::UniqueDeviceMemory deviceMemory;
+};
+
 uint32_t findMemoryTypeIndex(const vk::MemoryRequirements reqs, const vk::PhysicalDeviceMemoryProperties props, const vk::MemoryPropertyFlags flags)
 {
 	for (auto i = 0u; i < props.memoryTypeCount; ++i)
@@ -599,6 +721,41 @@ optional<QueueFamily> findQueueFamilies(const vk::PhysicalDevice physicalDevice,
 	return {};
 }
 
+// Returns whether the device can take the shading rate from an image, the preferred way to implement foveated rendering
+bool supportsShadingRateImage(const vk::PhysicalDevice physicalDevice, const uint32_t instanceApiVersion)
+{
+	// The features of the extension are only reachable through vkGetPhysicalDeviceFeatures2 (core in Vulkan 1.1),
+	// which needs both the instance and the device to be 1.1, as VK_KHR_get_physical_device_properties2 isn't enabled
+	if (instanceApiVersion < VK_API_VERSION_1_1 || physicalDevice.getProperties().apiVersion < VK_API_VERSION_1_1)
+		return false;
+
+	const vector<vk::ExtensionProperties> extensions = physicalDevice.enumerateDeviceExtensionProperties();
+	for (const char* const name : shadingRateDeviceExtensions)
+	{
+		const auto isNamed = [name](const vk::ExtensionProperties& extension) { return strcmp(name, extension.extensionName) == 0; };
+		if (none_of(extensions.begin(), extensions.end(), isNamed))
+			return false;
+	}
+
+	const auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceFragmentShadingRateFeaturesKHR>();
+	return features.get<vk::PhysicalDeviceFragmentShadingRateFeaturesKHR>().attachmentFragmentShadingRate == VK_TRUE;
+}
+
+// Returns the largest square fragment size (1, 2 or 4) that the device can shade single-sampled render targets with
+// The rates written to the shading rate image must be among those listed by vkGetPhysicalDeviceFragmentShadingRatesKHR,
+// which always has 2x2 when the extension is supported, but not necessarily 4x4 (maxFragmentSize alone doesn't say so)
+int maxSquareFragmentSize(const vk::PhysicalDevice physicalDevice)
+{
+	int ret = 1;
+	for (const vk::PhysicalDeviceFragmentShadingRateKHR& rate : physicalDevice.getFragmentShadingRatesKHR())
+	{
+		const bool isSquare = rate.fragmentSize.width == rate.fragmentSize.height;
+		if (isSquare && rate.fragmentSize.width <= 4 && (rate.sampleCounts & vk::SampleCountFlagBits::e1))
+			ret = max(ret, static_cast<int>(rate.fragmentSize.width));
+	}
+	return ret;
+}
+
 vk::UniqueImage createTextureImage(const vk::Device device,
 								   const vk::Extent2D extent,
 								   const uint32_t numLayers,
@@ -723,6 +880,38 @@ BufferAndMemory createBufferAndMemory(
 	return BufferAndMemory{std::move(buffer), std::move(bufferMemory)};
 }
 
+// Creates an image used only within this app
+// Unlike createTextureImage, the memory isn't exportable, since it's never submitted to the FOVE runtime
+ImageAndMemory createImageAndMemory(
+	const vk::PhysicalDevice physicalDevice,
+	const vk::Device device,
+	const vk::Extent2D extent,
+	const vk::Format format,
+	const vk::ImageUsageFlags usage)
+{
+	vk::ImageCreateInfo imageInfo{};
+	imageInfo.imageType = vk::ImageType::e2D;
+	imageInfo.extent = vk::Extent3D{extent.width, extent.height, 1U};
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = format;
+	imageInfo.tiling = vk::ImageTiling::eOptimal;
+	imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = vk::SharingMode::eExclusive;
+	imageInfo.samples = vk::SampleCountFlagBits::e1;
+	auto image = device.createImageUnique(imageInfo);
+
+	const vk::MemoryRequirements memRequirements = device.getImageMemoryRequirements(image.get());
+	vk::MemoryAllocateInfo allocInfo;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	auto imageMemory = device.allocateMemoryUnique(allocInfo);
+
+	device.bindImageMemory(image.get(), imageMemory.get(), 0);
+	return ImageAndMemory{std::move(image), std::move(imageMemory)};
+}
+
 struct BuffersAndMemories
 {
 	vector<vk::UniqueBuffer> buffers;
@@ -878,11 +1067,97 @@ vk::UniqueRenderPass createSimpleRenderPass(
 	return device.createRenderPassUnique(renderPassInfo);
 }
 
+// Same as createSimpleRenderPass, with a shading rate image as second attachment
+// Render passes referencing a shading rate image can only be created with the newer vkCreateRenderPass2
+vk::UniqueRenderPass createShadingRateRenderPass(
+	const vk::Device device,
+	const vk::Format imageFormat,
+	const vk::ImageLayout finalLayout,
+	const vk::Extent2D shadingRateTexelSize)
+{
+	const array<vk::AttachmentDescription2, 2> attachments = [imageFormat, finalLayout] {
+		vk::AttachmentDescription2 colorAttachment;
+		colorAttachment.format = imageFormat;
+		colorAttachment.samples = vk::SampleCountFlagBits::e1;
+		colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+		colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+		colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+		colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+		colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
+		colorAttachment.finalLayout = finalLayout;
+
+		// The shading rate image is filled before the render pass begins, see VulkanResources::recordShadingRateUpload()
+		vk::AttachmentDescription2 shadingRateAttachment;
+		shadingRateAttachment.format = vk::Format::eR8Uint;
+		shadingRateAttachment.samples = vk::SampleCountFlagBits::e1;
+		shadingRateAttachment.loadOp = vk::AttachmentLoadOp::eLoad;
+		shadingRateAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+		shadingRateAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+		shadingRateAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+		shadingRateAttachment.initialLayout = vk::ImageLayout::eFragmentShadingRateAttachmentOptimalKHR;
+		shadingRateAttachment.finalLayout = vk::ImageLayout::eFragmentShadingRateAttachmentOptimalKHR;
+
+		return array{colorAttachment, shadingRateAttachment};
+	}();
+
+	vk::AttachmentReference2 colorAttachmentRef;
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = vk::ImageLayout::eColorAttachmentOptimal;
+	colorAttachmentRef.aspectMask = vk::ImageAspectFlagBits::eColor;
+
+	vk::AttachmentReference2 shadingRateAttachmentRef;
+	shadingRateAttachmentRef.attachment = 1;
+	shadingRateAttachmentRef.layout = vk::ImageLayout::eFragmentShadingRateAttachmentOptimalKHR;
+
+	vk::FragmentShadingRateAttachmentInfoKHR shadingRateInfo;
+	shadingRateInfo.pFragmentShadingRateAttachment = &shadingRateAttachmentRef;
+	shadingRateInfo.shadingRateAttachmentTexelSize = shadingRateTexelSize;
+
+	vk::SubpassDescription2 subpass;
+	subpass.pNext = &shadingRateInfo;
+	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	// Same dependencies as createSimpleRenderPass
+	const array<vk::SubpassDependency2, 2> dependencies = [] {
+		vk::SubpassDependency2 dependencyIn;
+		dependencyIn.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencyIn.dstSubpass = {};
+		dependencyIn.srcStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+		dependencyIn.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		dependencyIn.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+		dependencyIn.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+		dependencyIn.dependencyFlags = vk::DependencyFlagBits::eByRegion;
+
+		vk::SubpassDependency2 dependencyOut;
+		dependencyOut.srcSubpass = {};
+		dependencyOut.dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencyOut.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		dependencyOut.dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+		dependencyOut.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+		dependencyOut.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		dependencyOut.dependencyFlags = vk::DependencyFlagBits::eByRegion;
+
+		return array{dependencyIn, dependencyOut};
+	}();
+
+	vk::RenderPassCreateInfo2 renderPassInfo;
+	renderPassInfo.attachmentCount = attachments.size();
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = dependencies.size();
+	renderPassInfo.pDependencies = dependencies.data();
+
+	return device.createRenderPass2KHRUnique(renderPassInfo);
+}
+
 vk::UniqueDescriptorSetLayout createDescriptorSetLayout(const vk::Device device, const uint32_t uboDescriptorCount,
-														const uint32_t samplerDescriptorCount)
+														const uint32_t samplerDescriptorCount, const uint32_t storageBufferDescriptorCount = 0)
 {
 	vector<vk::DescriptorSetLayoutBinding> bindings;
-	bindings.reserve(uboDescriptorCount + samplerDescriptorCount);
+	bindings.reserve(uboDescriptorCount + samplerDescriptorCount + storageBufferDescriptorCount);
 
 	// create layout for uniorm buffer objects and samplers.
 	// Assume that all ubos have earlier binding number than samplers
@@ -911,6 +1186,18 @@ vk::UniqueDescriptorSetLayout createDescriptorSetLayout(const vk::Device device,
 		bindings.emplace_back(std::move(samplerLayoutBinding));
 	}
 
+	// for storage buffers read by the vertex shader, after the ubos and samplers
+	for (auto i = 0U; i < storageBufferDescriptorCount; ++i)
+	{
+		vk::DescriptorSetLayoutBinding storageBufferLayoutBinding{};
+		storageBufferLayoutBinding.binding = uboDescriptorCount + samplerDescriptorCount + i;
+		storageBufferLayoutBinding.descriptorType = vk::DescriptorType::eStorageBuffer;
+		storageBufferLayoutBinding.descriptorCount = 1;
+		storageBufferLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
+		storageBufferLayoutBinding.pImmutableSamplers = nullptr;
+		bindings.emplace_back(std::move(storageBufferLayoutBinding));
+	}
+
 	vk::DescriptorSetLayoutCreateInfo createInfo{};
 	createInfo.pBindings = bindings.data();
 	createInfo.bindingCount = bindings.size();
@@ -947,7 +1234,8 @@ vk::UniquePipeline createSimpleGraphicsPipeline(const vk::Device device,
 												const vk::Extent2D extent,
 												const vk::PipelineLayout pipelineLayout,
 												const vk::RenderPass renderPass,
-												const vk::PipelineVertexInputStateCreateInfo& vertexInputState)
+												const vk::PipelineVertexInputStateCreateInfo& vertexInputState,
+												const void* const pNext = nullptr)
 {
 	const vk::UniqueShaderModule vertShaderModule = createShaderModule(device, vertShaderCode);
 	const vk::UniqueShaderModule fragShaderModule = createShaderModule(device, fragShaderCode);
@@ -1038,8 +1326,9 @@ vk::UniquePipeline createSimpleGraphicsPipeline(const vk::Device device,
 		return colorBlendState;
 	}();
 
-	const vk::GraphicsPipelineCreateInfo pipelineInfo = [&shaderStages, &vertexInputState, &inputAssemblyState, &viewportState, &rasterizationState, &multisampleState, &colorBlendState, &dynamicState, &pipelineLayout, &renderPass] {
+	const vk::GraphicsPipelineCreateInfo pipelineInfo = [&shaderStages, &vertexInputState, &inputAssemblyState, &viewportState, &rasterizationState, &multisampleState, &colorBlendState, &dynamicState, &pipelineLayout, &renderPass, pNext] {
 		vk::GraphicsPipelineCreateInfo pipelineInfo;
+		pipelineInfo.pNext = pNext;
 		pipelineInfo.flags = {};
 		pipelineInfo.stageCount = shaderStages.size();
 		pipelineInfo.pStages = shaderStages.data();
@@ -1063,6 +1352,34 @@ vk::UniquePipeline createSimpleGraphicsPipeline(const vk::Device device,
 	return checkAndGetResult(device.createGraphicsPipelineUnique({}, pipelineInfo));
 }
 
+// Size of one eye in a render texture holding both eyes side by side
+Fove::Vec2i singleEyeSize(const vk::Extent2D renderTextureExtent)
+{
+	return Fove::Vec2i{static_cast<int>(renderTextureExtent.width / 2), static_cast<int>(renderTextureExtent.height)};
+}
+
+vk::UniqueFramebuffer createFramebuffer(const vk::Device device,
+										const vk::ImageView imageView,
+										const vk::RenderPass renderPass,
+										const vk::Extent2D extent,
+										const vk::ImageView shadingRateView = {})
+{
+	vector<vk::ImageView> views = {imageView};
+	if (shadingRateView)
+		views.push_back(shadingRateView);
+
+	vk::FramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.flags = {};
+	framebufferInfo.renderPass = renderPass;
+	framebufferInfo.attachmentCount = views.size();
+	framebufferInfo.pAttachments = views.data();
+	framebufferInfo.width = extent.width;
+	framebufferInfo.height = extent.height;
+	framebufferInfo.layers = 1;
+
+	return device.createFramebufferUnique(framebufferInfo);
+}
+
 vector<vk::UniqueFramebuffer> createFramebuffers(const vk::Device device,
 												 const vector<vk::UniqueImageView>& imageViews,
 												 const vk::RenderPass renderPass,
@@ -1072,18 +1389,7 @@ vector<vk::UniqueFramebuffer> createFramebuffers(const vk::Device device,
 	framebuffers.reserve(imageViews.size());
 	for (auto const& view : imageViews)
 	{
-		const array<vk::ImageView, 1> views = {view.get()};
-
-		vk::FramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.flags = {};
-		framebufferInfo.renderPass = renderPass;
-		framebufferInfo.attachmentCount = views.size();
-		framebufferInfo.pAttachments = views.data();
-		framebufferInfo.width = extent.width;
-		framebufferInfo.height = extent.height;
-		framebufferInfo.layers = 1;
-
-		framebuffers.emplace_back(device.createFramebufferUnique(framebufferInfo));
+		framebuffers.emplace_back(createFramebuffer(device, view.get(), renderPass, extent));
 	}
 	return framebuffers;
 }
@@ -1188,6 +1494,56 @@ BufferAndMemory createIndexBuffer(
 	return bufAndMem;
 }
 
+template <typename Command, typename = enable_if_t<is_trivially_copyable_v<Command>>>
+BufferAndMemory createIndirectBuffer(
+	const vk::PhysicalDevice physicalDevice,
+	const vk::Device device,
+	const vk::CommandPool commandPool,
+	const uint32_t queueFamilyIndex,
+	const vk::Queue queue,
+	const Span<const Command> commands)
+{
+	const vk::DeviceSize bufferSize = sizeof(Command) * commands.size();
+	auto staging = createBufferAndMemory(
+		physicalDevice,
+		device,
+		bufferSize,
+		vk::BufferUsageFlagBits::eTransferSrc,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		queueFamilyIndex);
+
+	void* data;
+	const vk::DeviceSize offset{0};
+	const auto res = device.mapMemory(
+		staging.deviceMemory.get(), offset, bufferSize, vk::MemoryMapFlagBits{}, &data);
+	if (res != vk::Result::eSuccess)
+	{
+		throw "Failed to map indirect buffer";
+	}
+	memcpy(data, commands.data(), static_cast<size_t>(bufferSize));
+	device.unmapMemory(staging.deviceMemory.get());
+
+	auto bufAndMem = createBufferAndMemory(
+		physicalDevice,
+		device,
+		bufferSize,
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		queueFamilyIndex);
+
+	copyBuffer(
+		device,
+		commandPool,
+		queue,
+		staging.buffer.get(),
+		bufAndMem.buffer.get(),
+		bufferSize);
+
+	device.destroyBuffer(staging.buffer.release());
+	device.freeMemory(staging.deviceMemory.release());
+	return bufAndMem;
+}
+
 struct SwapchainSupportDetails
 {
 	vk::SurfaceCapabilitiesKHR capabilities;
@@ -1271,6 +1627,10 @@ void VulkanResources::createInstance()
 	appInfo.engineVersion = MAKE_VERSION(0, 1, 0);
 	appInfo.apiVersion = VK_API_VERSION_1_1;
 
+	// A Vulkan 1.0 loader has no vkEnumerateInstanceVersion, and its instances stay 1.0 whatever we ask for
+	const uint32_t loaderApiVersion = VULKAN_HPP_DEFAULT_DISPATCHER.vkEnumerateInstanceVersion ? vk::enumerateInstanceVersion() : VK_API_VERSION_1_0;
+	m_instanceApiVersion = min(loaderApiVersion, appInfo.apiVersion);
+
 	m_enableDebugUtils = !disableDebugUtils && checkDebugUtilsSupport();
 	m_enableValidationLayers = !disableValidationLayers && checkValidationLayerSupport();
 
@@ -1369,15 +1729,43 @@ void VulkanResources::createLogicalDevice()
 		}
 	}
 
-	const vk::PhysicalDeviceFeatures deviceFeatures{};
+	// If foveated rendering was requested, use a shading rate image if possible, otherwise keep the inset fallback
+	vector<const char*> enabledExtensions{requiredDeviceExtensions.begin(), requiredDeviceExtensions.end()};
+	vk::PhysicalDeviceFragmentShadingRateFeaturesKHR shadingRateFeatures{};
+	if (m_foveationMode != FoveationMode::Off && supportsShadingRateImage(m_physicalDevice, m_instanceApiVersion))
+	{
+		m_foveationMode = FoveationMode::ShadingRate;
+		enabledExtensions.insert(enabledExtensions.end(), shadingRateDeviceExtensions.begin(), shadingRateDeviceExtensions.end());
+		shadingRateFeatures.attachmentFragmentShadingRate = VK_TRUE;
+
+		// Prefer 16x16 pixel tiles, which keeps the shading rate image tiny while following the gaze closely enough
+		// The limits are powers of two, so the result is one as well
+		const auto properties = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceFragmentShadingRatePropertiesKHR>();
+		const auto& shadingRateProperties = properties.get<vk::PhysicalDeviceFragmentShadingRatePropertiesKHR>();
+		const vk::Extent2D minTexelSize = shadingRateProperties.minFragmentShadingRateAttachmentTexelSize;
+		const vk::Extent2D maxTexelSize = shadingRateProperties.maxFragmentShadingRateAttachmentTexelSize;
+		m_shadingRateTexelSize = vk::Extent2D{clamp(16U, minTexelSize.width, maxTexelSize.width), clamp(16U, minTexelSize.height, maxTexelSize.height)};
+		m_maxFragmentSize = maxSquareFragmentSize(m_physicalDevice);
+	}
+	if (m_foveationMode != FoveationMode::Off)
+		cout << "Foveated rendering: " << (m_foveationMode == FoveationMode::ShadingRate ? "shading rate image" : "multi-resolution inset") << '\n';
+
+	// The scene is drawn with one indirect draw command per object, all issued at once when multiDrawIndirect is supported
+	const vk::PhysicalDeviceFeatures supportedFeatures = m_physicalDevice.getFeatures();
+	vk::PhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	m_multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	m_drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
 	const auto validationLayers = m_enableValidationLayers ? vector<const char*>{validationLayerName}
 														   : vector<const char*>{};
-	const vk::DeviceCreateInfo createInfo = [&deviceFeatures, &queueCreateInfos, &validationLayers] {
+	const vk::DeviceCreateInfo createInfo = [this, &deviceFeatures, &queueCreateInfos, &validationLayers, &enabledExtensions, &shadingRateFeatures] {
 		vk::DeviceCreateInfo createInfo;
+		createInfo.pNext = m_foveationMode == FoveationMode::ShadingRate ? &shadingRateFeatures : nullptr;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = queueCreateInfos.size();
-		createInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
-		createInfo.enabledExtensionCount = requiredDeviceExtensions.size();
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
+		createInfo.enabledExtensionCount = enabledExtensions.size();
 		createInfo.pEnabledFeatures = &deviceFeatures;
 		createInfo.ppEnabledLayerNames = validationLayers.data();
 		createInfo.enabledLayerCount = validationLayers.size();
@@ -1386,6 +1774,9 @@ void VulkanResources::createLogicalDevice()
 
 	m_device = m_physicalDevice.createDeviceUnique(createInfo);
 	m_deviceWaitIdle.device = m_device.get();
+
+	// Load the device level functions, including those of the optional extensions
+	VULKAN_HPP_DEFAULT_DISPATCHER.init(m_device.get());
 	m_queue = m_device->getQueue(m_queueFamily.index, 0);
 }
 
@@ -1400,6 +1791,8 @@ void VulkanResources::createRenderTextureImages(const uint32_t nImages, const ui
 
 	m_renderTextureImageFormat = format;
 	m_renderTextureExtent = extent;
+	m_renderTextureExtents.assign(nImages, extent);
+	m_renderTextureViewports.assign(nImages, scaledEyeViewport(singleEyeSize(extent), m_dynamicResolution.scale()));
 	m_renderTextureImages.reserve(nImages);
 
 	for (auto i = 0U; i < nImages; ++i)
@@ -1442,14 +1835,19 @@ void VulkanResources::createRenderTextureImageViews()
 
 void VulkanResources::createRenderTextureRenderPass()
 {
-	m_renderTextureRenderPass = createSimpleRenderPass(m_device.get(), m_renderTextureImageFormat, vk::ImageLayout::eShaderReadOnlyOptimal);
+	// The periphery targets of the inset mode use this render pass as well
+	if (m_foveationMode == FoveationMode::ShadingRate)
+		m_renderTextureRenderPass = createShadingRateRenderPass(m_device.get(), m_renderTextureImageFormat, vk::ImageLayout::eShaderReadOnlyOptimal, m_shadingRateTexelSize);
+	else
+		m_renderTextureRenderPass = createSimpleRenderPass(m_device.get(), m_renderTextureImageFormat, vk::ImageLayout::eShaderReadOnlyOptimal);
 }
 
 void VulkanResources::createRenderTextureDescriptorSetLayout()
 {
 	const uint32_t uboCount{1};
 	const uint32_t samplerCount{0};
-	m_renderTextureDescriptorSetLayout = createDescriptorSetLayout(m_device.get(), uboCount, samplerCount);
+	const uint32_t storageBufferCount{1}; // Data of the objects
+	m_renderTextureDescriptorSetLayout = createDescriptorSetLayout(m_device.get(), uboCount, samplerCount, storageBufferCount);
 }
 
 void VulkanResources::createRenderTextureGraphicsPipeline()
@@ -1470,6 +1868,13 @@ void VulkanResources::createRenderTextureGraphicsPipeline()
 		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 		return vertexInputInfo;
 	}();
+
+	// With a shading rate image, the pipeline's own rate (1x1) is replaced by the rate of the image
+	vk::PipelineFragmentShadingRateStateCreateInfoKHR shadingRateState{};
+	shadingRateState.fragmentSize = vk::Extent2D{1, 1};
+	shadingRateState.combinerOps[0] = vk::FragmentShadingRateCombinerOpKHR::eKeep;
+	shadingRateState.combinerOps[1] = vk::FragmentShadingRateCombinerOpKHR::eReplace;
+
 	m_renderTextureGraphicsPipeline = createSimpleGraphicsPipeline(
 		m_device.get(),
 		vertShaderCode,
@@ -1477,12 +1882,198 @@ void VulkanResources::createRenderTextureGraphicsPipeline()
 		m_renderTextureExtent,
 		m_renderTexturePipelineLayout.get(),
 		m_renderTextureRenderPass.get(),
+		vertexInputState,
+		m_foveationMode == FoveationMode::ShadingRate ? &shadingRateState : nullptr);
+}
+
+void VulkanResources::createFoveationPipeline()
+{
+	// Only the inset mode needs a pipeline, to upscale the periphery into the render texture
+	// This is the same as the window copy, but drawing to the render texture
+	if (m_foveationMode != FoveationMode::Inset)
+		return;
+
+	const vector<unsigned char> vertShaderCode = {begin(vlk_shaderTextureCopyVert), end(vlk_shaderTextureCopyVert)};
+	const vector<unsigned char> fragShaderCode = {begin(vlk_shaderTextureCopyFrag), end(vlk_shaderTextureCopyFrag)};
+	const uint32_t uboCount{0};
+	const uint32_t samplerCount{1};
+	m_peripheryDescriptorSetLayout = createDescriptorSetLayout(m_device.get(), uboCount, samplerCount);
+	const vector<vk::DescriptorSetLayout> setLayouts = {m_peripheryDescriptorSetLayout.get()};
+	m_peripheryPipelineLayout = createSimpleGraphicsPipelineLayout(m_device.get(), setLayouts);
+
+	const auto bindingDescription = SwapchainVertex::getBindingDescription();
+	const auto attributeDescriptions = SwapchainVertex::getAttributeDescriptions();
+	const vk::PipelineVertexInputStateCreateInfo vertexInputState = [&bindingDescription, &attributeDescriptions] {
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
+		vertexInputInfo.flags = {};
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
+		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+		return vertexInputInfo;
+	}();
+	m_peripheryGraphicsPipeline = createSimpleGraphicsPipeline(
+		m_device.get(),
+		vertShaderCode,
+		fragShaderCode,
+		m_renderTextureExtent,
+		m_peripheryPipelineLayout.get(),
+		m_renderTextureRenderPass.get(),
 		vertexInputState);
+
+	m_peripherySampler = createTextureSampler(m_device.get());
+	createPeripheryDescriptorSets();
+}
+
+void VulkanResources::createPeripheryDescriptorSets()
+{
+	// One descriptor set per image, pointing at its periphery target (see createFoveationTargets)
+	const uint32_t nImages = m_renderTextureImages.size();
+	array<vk::DescriptorPoolSize, 1> poolSizes{};
+	poolSizes[0].type = vk::DescriptorType::eCombinedImageSampler;
+	poolSizes[0].descriptorCount = nImages;
+
+	vk::DescriptorPoolCreateInfo poolInfo{};
+	poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = nImages;
+	m_peripheryDescriptorPool = m_device->createDescriptorPoolUnique(poolInfo);
+
+	const vector<vk::DescriptorSetLayout> layouts(nImages, m_peripheryDescriptorSetLayout.get());
+	vk::DescriptorSetAllocateInfo allocInfo{};
+	allocInfo.descriptorPool = m_peripheryDescriptorPool.get();
+	allocInfo.descriptorSetCount = nImages;
+	allocInfo.pSetLayouts = layouts.data();
+	m_peripheryDescriptorSets = m_device->allocateDescriptorSetsUnique(allocInfo);
 }
 
 void VulkanResources::createRenderTextureFramebuffers()
 {
-	m_renderTextureFramebuffers = createFramebuffers(m_device.get(), m_renderTextureImageViews, m_renderTextureRenderPass.get(), m_renderTextureExtent);
+	m_renderTextureFramebuffers.resize(m_renderTextureImageViews.size());
+	for (uint32_t i = 0; i < m_renderTextureFramebuffers.size(); ++i)
+	{
+		createRenderTextureFramebuffer(i);
+	}
+}
+
+void VulkanResources::createRenderTextureFramebuffer(const uint32_t index)
+{
+	createFoveationTargets(index);
+	const vk::ImageView shadingRateView = m_foveationMode == FoveationMode::ShadingRate ? m_shadingRateImageViews[index].get() : vk::ImageView{};
+	m_renderTextureFramebuffers[index] = createFramebuffer(m_device.get(), m_renderTextureImageViews[index].get(), m_renderTextureRenderPass.get(), m_renderTextureExtents[index], shadingRateView);
+}
+
+void VulkanResources::createFoveationTargets(const uint32_t index)
+{
+	const size_t nImages = m_renderTextureImages.size();
+	const vk::Extent2D extent = m_renderTextureExtents[index];
+	if (m_foveationMode == FoveationMode::ShadingRate)
+	{
+		// One texel per tile of pixels, covering both eyes
+		const vk::Extent2D shadingRateExtent{
+			(extent.width + m_shadingRateTexelSize.width - 1) / m_shadingRateTexelSize.width,
+			(extent.height + m_shadingRateTexelSize.height - 1) / m_shadingRateTexelSize.height,
+		};
+		const vk::DeviceSize bufferSize = shadingRateExtent.width * shadingRateExtent.height;
+
+		m_shadingRateImages.resize(nImages);
+		m_shadingRateImageViews.resize(nImages);
+		m_shadingRateExtents.resize(nImages);
+		m_shadingRateBuffers.resize(nImages);
+		m_shadingRateBufferData.resize(nImages);
+
+		m_shadingRateImageViews[index].reset();
+		m_shadingRateImages[index] = createImageAndMemory(m_physicalDevice, m_device.get(), shadingRateExtent, vk::Format::eR8Uint, vk::ImageUsageFlagBits::eFragmentShadingRateAttachmentKHR | vk::ImageUsageFlagBits::eTransferDst);
+		m_shadingRateImageViews[index] = createTextureImageView(m_device.get(), m_shadingRateImages[index].image.get(), 1, vk::ImageViewType::e2D, vk::Format::eR8Uint);
+		m_shadingRateExtents[index] = shadingRateExtent;
+
+		m_shadingRateBuffers[index] = createBufferAndMemory(m_physicalDevice, m_device.get(), bufferSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, m_queueFamily.index);
+		m_shadingRateBufferData[index] = static_cast<uint8_t*>(m_device->mapMemory(m_shadingRateBuffers[index].deviceMemory.get(), 0, bufferSize));
+		memset(m_shadingRateBufferData[index], 0, bufferSize); // Full rate until the first update
+	}
+	else if (m_foveationMode == FoveationMode::Inset)
+	{
+		const Fove::Vec2i eyeSize = peripheryEyeSize(singleEyeSize(extent), m_foveationSettings);
+		const vk::Extent2D peripheryExtent{2 * static_cast<uint32_t>(eyeSize.x), static_cast<uint32_t>(eyeSize.y)};
+
+		m_peripheryImages.resize(nImages);
+		m_peripheryImageViews.resize(nImages);
+		m_peripheryFramebuffers.resize(nImages);
+		m_peripheryExtents.resize(nImages);
+		m_foveaInsets.resize(nImages);
+
+		m_peripheryFramebuffers[index].reset();
+		m_peripheryImageViews[index].reset();
+		m_peripheryImages[index] = createImageAndMemory(m_physicalDevice, m_device.get(), peripheryExtent, m_renderTextureImageFormat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
+		m_peripheryImageViews[index] = createTextureImageView(m_device.get(), m_peripheryImages[index].image.get(), 1, vk::ImageViewType::e2D, m_renderTextureImageFormat);
+		m_peripheryFramebuffers[index] = createFramebuffer(m_device.get(), m_peripheryImageViews[index].get(), m_renderTextureRenderPass.get(), peripheryExtent);
+		m_peripheryExtents[index] = peripheryExtent;
+
+		vk::DescriptorImageInfo imgInfo{};
+		imgInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		imgInfo.imageView = m_peripheryImageViews[index].get();
+		imgInfo.sampler = m_peripherySampler.get();
+
+		vk::WriteDescriptorSet descriptorWrite{};
+		descriptorWrite.dstSet = m_peripheryDescriptorSets[index].get();
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imgInfo;
+		m_device->updateDescriptorSets(descriptorWrite, nullptr);
+	}
+}
+
+void VulkanResources::resizeRenderTextures(const uint32_t width, const uint32_t height)
+{
+	m_renderTextureExtent = vk::Extent2D{width, height};
+}
+
+void VulkanResources::recreateRenderTexture(const uint32_t index)
+{
+	// Release the old objects first, in reverse order of creation
+	m_renderTextureFramebuffers[index].reset();
+	m_renderTextureImageViews[index].reset();
+	m_renderTextureImages[index].reset();
+	m_renderTextureDeviceMemories[index].reset();
+
+	// Same steps as createRenderTextureImages/DeviceMemories/ImageViews/Framebuffers, but for a single image
+	const int numLayers{1};
+	const vk::ImageUsageFlags usage{vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled};
+	const vk::Extent2D extent = m_renderTextureExtent;
+	m_renderTextureImages[index] = createTextureImage(m_device.get(), extent, numLayers, m_renderTextureImageFormat, vk::ImageTiling::eOptimal, usage);
+
+	const vk::Image image = m_renderTextureImages[index].get();
+	const auto memReqs = m_device->getImageMemoryRequirements(image);
+	m_renderTextureDeviceMemories[index] = createTextureDeviceMemory(m_device.get(), image, memReqs, m_physicalDevice.getMemoryProperties(), vk::MemoryPropertyFlagBits::eDeviceLocal);
+	m_device->bindImageMemory(image, m_renderTextureDeviceMemories[index].get(), 0);
+
+	m_renderTextureImageViews[index] = createTextureImageView(m_device.get(), image, numLayers, vk::ImageViewType::e2D, m_renderTextureImageFormat);
+	m_renderTextureExtents[index] = extent;
+	createRenderTextureFramebuffer(index);
+
+	// The window copy samples the render texture
+	updateSwapchainDescriptorSet(index);
+}
+
+void VulkanResources::readRenderTextureGpuTime(const uint32_t index)
+{
+	if (!m_timestampQueryPool || !m_timestampsPending[index])
+		return;
+	m_timestampsPending[index] = false;
+
+	// The caller waited for this image's fence, so the results are ready and this doesn't block
+	array<uint64_t, 2> timestamps{};
+	const vk::Result res = m_device->getQueryPoolResults(m_timestampQueryPool.get(), 2 * index, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+	if (res != vk::Result::eSuccess)
+		return;
+
+	const float previousScale = m_dynamicResolution.scale();
+	const float gpuTimeMs = static_cast<float>((timestamps[1] - timestamps[0]) * m_timestampPeriodNs / 1e6);
+	if (m_dynamicResolution.update(gpuTimeMs) != previousScale)
+		cout << "Resolution scale: " << m_dynamicResolution.scale() << " (GPU time " << m_dynamicResolution.smoothedGpuTimeMs() << "ms)\n";
 }
 
 void VulkanResources::createRenderTextureVertexBuffer(const Span<const RenderTextureVertex> verts)
@@ -1492,6 +2083,23 @@ void VulkanResources::createRenderTextureVertexBuffer(const Span<const RenderTex
 	m_renderTextureVertexBufferMemory = std::move(bufAndMem.deviceMemory);
 }
 
+void VulkanResources::createRenderTextureDrawBuffer(const Span<const RenderTextureVertex> verts)
+{
+	m_sceneObjects = findSceneObjects(reinterpret_cast<const float*>(verts.data()), verts.size(), sizeof(RenderTextureVertex) / sizeof(float));
+	const vector<DrawArraysIndirectCommand> commands = sceneDrawCommands(m_sceneObjects);
+
+	// The first instance of each command is the index of its object, which DemoScene.vert uses to read the data of the object (see SceneObjects.h)
+	// Without drawIndirectFirstInstance, indirect draws must start at instance 0, so the commands are drawn directly instead (see recordSceneDraws)
+	m_renderTextureDrawCommands = commands;
+
+	auto bufAndMem = createIndirectBuffer(m_physicalDevice, m_device.get(), m_commandPool.get(), m_queueFamily.index, m_queue, Span<const DrawArraysIndirectCommand>{commands});
+	m_renderTextureDrawBuffer = std::move(bufAndMem.buffer);
+	m_renderTextureDrawBufferMemory = std::move(bufAndMem.deviceMemory);
+	m_renderTextureDrawCount = static_cast<uint32_t>(commands.size());
+	const char* const draws = !m_drawIndirectFirstInstance ? "one vkCmdDraw per object" : m_multiDrawIndirect ? "one vkCmdDrawIndirect" : "one vkCmdDrawIndirect per object";
+	cout << "Drawing " << commands.size() << " objects with " << draws << " per eye\n";
+}
+
 void VulkanResources::createRenderTextureIndexBuffer(const Span<const RenderTextureVertex::IndexType> inds)
 {
 	auto bufAndMem = createIndexBuffer(m_physicalDevice, m_device.get(), m_commandPool.get(), m_queueFamily.index, m_queue, inds);
@@ -1502,9 +2110,11 @@ void VulkanResources::createRenderTextureIndexBuffer(const Span<const RenderText
 void VulkanResources::createRenderTextureDescriptorPool()
 {
 	const uint32_t nImages = 2U * m_renderTextureImages.size();
-	array<vk::DescriptorPoolSize, 1> poolSizes{};
+	array<vk::DescriptorPoolSize, 2> poolSizes{};
 	poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
 	poolSizes[0].descriptorCount = nImages;
+	poolSizes[1].type = vk::DescriptorType::eStorageBuffer;
+	poolSizes[1].descriptorCount = nImages;
 
 	vk::DescriptorPoolCreateInfo poolInfo{};
 	poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
@@ -1533,13 +2143,24 @@ void VulkanResources::createRenderTextureDescriptorSets()
 		bufInfo[0].offset = 0;
 		bufInfo[0].range = sizeof(RenderTextureUbo);
 
-		array<vk::WriteDescriptorSet, 1> descriptorWrites;
+		array<vk::DescriptorBufferInfo, 1> objectBufInfo;
+		objectBufInfo[0].buffer = m_renderTextureObjectBuffers[i / 2].get(); // left/right share the objects of their image
+		objectBufInfo[0].offset = 0;
+		objectBufInfo[0].range = VK_WHOLE_SIZE;
+
+		array<vk::WriteDescriptorSet, 2> descriptorWrites;
 		descriptorWrites[0].dstSet = m_renderTextureDescriptorSets[i].get();
 		descriptorWrites[0].dstBinding = 0;
 		descriptorWrites[0].dstArrayElement = 0;
 		descriptorWrites[0].descriptorType = vk::DescriptorType::eUniformBuffer;
 		descriptorWrites[0].descriptorCount = bufInfo.size();
 		descriptorWrites[0].pBufferInfo = bufInfo.data();
+		descriptorWrites[1].dstSet = m_renderTextureDescriptorSets[i].get();
+		descriptorWrites[1].dstBinding = 1;
+		descriptorWrites[1].dstArrayElement = 0;
+		descriptorWrites[1].descriptorType = vk::DescriptorType::eStorageBuffer;
+		descriptorWrites[1].descriptorCount = objectBufInfo.size();
+		descriptorWrites[1].pBufferInfo = objectBufInfo.data();
 		m_device->updateDescriptorSets(descriptorWrites, nullptr);
 	}
 }
@@ -1574,7 +2195,7 @@ void VulkanResources::createSwapchain(const uint32_t width, const uint32_t heigh
 			createInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
 			createInfo.presentMode = presentMode;
 			createInfo.clipped = VK_TRUE;
-			createInfo.oldSwapchain = nullptr;
+			createInfo.oldSwapchain = m_swapchain.get(); // Lets the driver reuse resources when resizing, null on first creation
 			const auto queueFamilyIndices = array<uint32_t, 1>{
 				m_queueFamily.index};
 			createInfo.pQueueFamilyIndices = queueFamilyIndices.data();
@@ -1716,6 +2337,40 @@ void VulkanResources::createRenderTextureUniformBuffers()
 		m_queueFamily.index);
 	m_renderTextureUniformBuffers = std::move(res.buffers);
 	m_renderTextureUniformBufferMemories = std::move(res.deviceMemories);
+
+	// The memory is host coherent, so writes are visible to the GPU without flushing, and it stays mapped until it's freed
+	m_renderTextureUniformBufferData.resize(nImages2);
+	for (size_t i = 0; i < nImages2; ++i)
+		m_renderTextureUniformBufferData[i] = static_cast<RenderTextureUbo*>(m_device->mapMemory(m_renderTextureUniformBufferMemories[i].get(), 0, bufferSize));
+}
+
+void VulkanResources::createRenderTextureObjectBuffers()
+{
+	const auto nImages = m_renderTextureImages.size(); // Both eyes share the data of the objects
+	const vk::DeviceSize bufferSize = sizeof(SceneObjectData) * m_sceneObjects.size();
+
+	auto res = createBuffersAndMemories(
+		m_physicalDevice,
+		m_device.get(),
+		nImages,
+		bufferSize,
+		vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		m_queueFamily.index);
+	m_renderTextureObjectBuffers = std::move(res.buffers);
+	m_renderTextureObjectBufferMemories = std::move(res.deviceMemories);
+
+	// The level is static, so the model matrices are set once here, but each object could move on its own by updating its matrix every frame
+	// The highlights are set every frame (see updateRenderTextureObjectBuffer)
+	SceneObjectData object{};
+	const Fove::Matrix44 identity = translationMatrix(0, 0, 0);
+	memcpy(object.model, identity.mat, sizeof(object.model));
+	m_renderTextureObjectBufferData.resize(nImages);
+	for (size_t i = 0; i < nImages; ++i)
+	{
+		m_renderTextureObjectBufferData[i] = static_cast<SceneObjectData*>(m_device->mapMemory(m_renderTextureObjectBufferMemories[i].get(), 0, bufferSize));
+		fill_n(m_renderTextureObjectBufferData[i], m_sceneObjects.size(), object);
+	}
 }
 
 void VulkanResources::createSwapchainDescriptorPool()
@@ -1748,29 +2403,34 @@ void VulkanResources::createSwapchainDescriptorSets()
 
 	for (auto i = 0u; i < nImages; ++i)
 	{
-		vector<vk::WriteDescriptorSet> descriptorWrites(1);
+		updateSwapchainDescriptorSet(i);
+	}
+}
 
-		vk::DescriptorImageInfo imgInfo{};
-		imgInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-		imgInfo.imageView = m_renderTextureImageViews[i].get(); // texture from render texture pass
-		imgInfo.sampler = m_swapchainTextureSampler.get();
+void VulkanResources::updateSwapchainDescriptorSet(const uint32_t index)
+{
+	vector<vk::WriteDescriptorSet> descriptorWrites(1);
 
-		descriptorWrites[0].dstSet = m_swapchainDescriptorSets[i].get();
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pImageInfo = &imgInfo;
+	vk::DescriptorImageInfo imgInfo{};
+	imgInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	imgInfo.imageView = m_renderTextureImageViews[index].get(); // texture from render texture pass
+	imgInfo.sampler = m_swapchainTextureSampler.get();
 
-		m_device->updateDescriptorSets(descriptorWrites, nullptr);
-	}
+	descriptorWrites[0].dstSet = m_swapchainDescriptorSets[index].get();
+	descriptorWrites[0].dstBinding = 0;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].pImageInfo = &imgInfo;
+
+	m_device->updateDescriptorSets(descriptorWrites, nullptr);
 }
 
 ////////////////////////////////
 void VulkanResources::createCommandPool()
 {
 	vk::CommandPoolCreateInfo poolInfo{};
-	poolInfo.flags = {};
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer; // Allows re-recording the command buffers in place on resize
 	poolInfo.queueFamilyIndex = m_queueFamily.index;
 	m_commandPool = m_device->createCommandPoolUnique(poolInfo);
 }
@@ -1785,6 +2445,25 @@ void VulkanResources::createCommandBuffers(const uint32_t nImages)
 	m_commandBuffers = m_device->allocateCommandBuffersUnique(allocInfo);
 }
 
+void VulkanResources::createTimestampQueryPool(const uint32_t nImages)
+{
+	m_timestampsPending.assign(nImages, false);
+
+	// Without timestamp support we simply never change the resolution
+	const auto queueFamilies = m_physicalDevice.getQueueFamilyProperties();
+	if (queueFamilies[m_queueFamily.index].timestampValidBits == 0)
+	{
+		cerr << "Timestamps not supported by the queue, dynamic resolution disabled\n";
+		return;
+	}
+	m_timestampPeriodNs = m_physicalDevice.getProperties().limits.timestampPeriod;
+
+	vk::QueryPoolCreateInfo createInfo{};
+	createInfo.queryType = vk::QueryType::eTimestamp;
+	createInfo.queryCount = 2 * nImages;
+	m_timestampQueryPool = m_device->createQueryPoolUnique(createInfo);
+}
+
 void VulkanResources::createSyncObjects(const uint32_t nImages, const uint32_t nMaxFramesInFlight)
 {
 	m_imageAvailableSemaphores.reserve(nMaxFramesInFlight);
@@ -1813,67 +2492,133 @@ void VulkanResources::createSyncObjects(const uint32_t nImages, const uint32_t n
 
 void VulkanResources::cleanupSwapchain()
 {
-	const vk::Device device = m_device.get();
+	// Only the objects that depend on the swapchain images are released here
+	// The swapchain itself is kept alive until its replacement is created, so it can be passed as oldSwapchain
 	m_swapchainFramebuffers.clear();
-	m_commandBuffers.clear();
-	m_swapchainGraphicsPipeline.reset();
-	m_swapchainPipelineLayout.reset();
-	m_swapchainRenderPass.reset();
 	m_swapchainImageViews.clear();
 	m_swapchainImages.clear();
-	m_swapchain.reset();
-
-	for (auto i = 0u; i < m_swapchainImages.size(); ++i)
-	{
-		device.destroyBuffer(m_swapchainUniformBuffers[i].release());
-		device.freeMemory(m_swapchainUniformBufferMemories[i].release());
-	}
-	m_swapchainUniformBuffers.clear();
-	m_swapchainUniformBufferMemories.clear();
-
-	m_swapchainDescriptorSets.clear();
-	m_swapchainDescriptorPool.reset();
 }
 
 void VulkanResources::recreateSwapchain(NativeWindow& nativeWindow)
 {
 	const auto windowSize = nativeWindow.windowSize();
+	if (windowSize.width == 0 || windowSize.height == 0)
+	{
+		// Minimized, a zero sized swapchain is not allowed so try again once we have a real size
+		m_swapchainFramebufferResized = true;
+		return;
+	}
 	cout << "Next window size: " << windowSize.width << "x" << windowSize.height << '\n'
 		 << flush;
 
+	const auto start = chrono::steady_clock::now();
 	m_device->waitIdle();
 
+	const vk::Format oldFormat = m_swapchainImageFormat;
+	const size_t oldImageCount = m_swapchainImages.size();
 	cleanupSwapchain();
 
 	createSwapchain(windowSize.width, windowSize.height);
 	createSwapchainImages();
 	createSwapchainImageViews();
-	createSwapchainRenderPass();
-	createSwapchainGraphicsPipeline();
+
+	// The pipelines use a dynamic viewport & scissor, so they don't depend on the window size and are kept as is
+	// The render pass only depends on the format, which in practice never changes for the same surface
+	if (m_swapchainImageFormat != oldFormat)
+	{
+		createSwapchainRenderPass();
+		createSwapchainGraphicsPipeline();
+	}
 	createSwapchainFramebuffers();
+
+	// Render textures, descriptor sets and command buffers are all allocated per swapchain image
+	// If the image count changed, they are reallocated at the start of the next frame instead (see drawFrame)
+	if (m_swapchainImages.size() != oldImageCount)
+		cout << "Swapchain image count changed from " << oldImageCount << " to " << m_swapchainImages.size() << '\n';
+	else
+	{
+		// Re-record in place, the viewport, scissor & framebuffer of the swapchain pass are baked into the command buffers
+		recordCommandBuffers(Span<const SwapchainVertex::IndexType>{g_indices2});
+	}
+
+	const auto hitch = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "Swapchain recreated in " << hitch << "ms\n"
+		 << flush;
+}
+
+void VulkanResources::recreateImageResources()
+{
+	const auto start = chrono::steady_clock::now();
+	m_device->waitIdle();
+	const uint32_t nImages = m_swapchainImages.size();
+
+	// Release everything allocated per image, the descriptor sets before their pools
+	m_commandBuffers.clear();
+	m_swapchainDescriptorSets.clear();
+	m_swapchainDescriptorPool.reset();
+	m_swapchainUniformBuffers.clear();
+	m_swapchainUniformBufferMemories.clear();
+	m_peripheryDescriptorSets.clear();
+	m_peripheryDescriptorPool.reset();
+	m_renderTextureDescriptorSets.clear();
+	m_renderTextureDescriptorPool.reset();
+	m_renderTextureObjectBufferData.clear();
+	m_renderTextureObjectBuffers.clear();
+	m_renderTextureObjectBufferMemories.clear();
+	m_renderTextureUniformBufferData.clear();
+	m_renderTextureUniformBuffers.clear();
+	m_renderTextureUniformBufferMemories.clear();
+	m_renderTextureFramebuffers.clear();
+	m_peripheryFramebuffers.clear();
+	m_peripheryImageViews.clear();
+	m_peripheryImages.clear();
+	m_shadingRateImageViews.clear();
+	m_shadingRateImages.clear();
+	m_shadingRateBufferData.clear();
+	m_shadingRateBuffers.clear();
+	m_renderTextureImageViews.clear();
+	m_renderTextureImages.clear();
+	m_renderTextureDeviceMemories.clear();
+	m_timestampQueryPool.reset();
+
+	// Then allocate them again for the new count, in the same order as the VulkanExample::init* functions
+	// The render textures are created at the requested size, which completes any pending resize as well
+	createRenderTextureImages(nImages, m_renderTextureExtent.width, m_renderTextureExtent.height);
+	createRenderTextureDeviceMemories();
+	createRenderTextureImageViews();
+	if (m_foveationMode == FoveationMode::Inset)
+		createPeripheryDescriptorSets();
+	createRenderTextureFramebuffers(); // The foveation targets of each image are resized along
+	createRenderTextureUniformBuffers();
+	createRenderTextureObjectBuffers();
+	createRenderTextureDescriptorPool();
+	createRenderTextureDescriptorSets();
 	createSwapchainUniformBuffers();
 	createSwapchainDescriptorPool();
 	createSwapchainDescriptorSets();
-
-	const uint32_t nImages = m_swapchainImages.size();
 	createCommandBuffers(nImages);
-	recordCommandBuffers(Span<const RenderTextureVertex>{levelModelVerts}, Span<const SwapchainVertex::IndexType>{g_indices2});
+	createTimestampQueryPool(nImages);
+
+	// No image is in use anymore, and the fences of the frames in flight are kept as they are
+	m_imageInUseFences.assign(nImages, nullptr);
+
+	recordCommandBuffers(Span<const SwapchainVertex::IndexType>{g_indices2});
+
+	const auto hitch = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "Resources of " << nImages << " images recreated in " << hitch << "ms\n"
+		 << flush;
 }
 
 void VulkanResources::updateRenderTextureUniformBuffer(const uint32_t index, const RenderTextureUbo& ubo)
 {
-	void* data;
-	const vk::Device device{m_device.get()};
-	const vk::DeviceSize offset{0};
-	const vk::DeviceSize size{sizeof(ubo)};
-	const auto ret = device.mapMemory(
-		m_renderTextureUniformBufferMemories[index].get(), offset, size, vk::MemoryMapFlags{}, &data);
-	if (ret != vk::Result::eSuccess)
-	{
-		throw "Map uniform buffer";
-	}
-	memcpy(data, &ubo, sizeof(ubo));
-	device.unmapMemory(m_renderTextureUniformBufferMemories[index].get());
+	memcpy(m_renderTextureUniformBufferData[index], &ubo, sizeof(ubo));
+}
+
+void VulkanResources::updateRenderTextureObjectBuffer(const uint32_t index, const float selection)
+{
+	SceneObjectData* const objects = m_renderTextureObjectBufferData[index];
+	for (size_t i = 0; i < m_sceneObjects.size(); ++i)
+		objects[i].highlight = sceneObjectHighlight(m_sceneObjects[i].id, selection);
 }
 
 void VulkanResources::updateSwapchainUniformBuffer()
@@ -1881,86 +2626,288 @@ void VulkanResources::updateSwapchainUniformBuffer()
 	// empty
 }
 ////////////////////////////////
-void VulkanResources::recordCommandBuffers(const Span<const RenderTextureVertex> sceneVerts, const Span<const SwapchainVertex::IndexType> quadInds)
+bool VulkanResources::updateFoveation(const uint32_t index)
 {
-	for (size_t i = 0; i < m_commandBuffers.size(); ++i)
-	{
-		const vk::CommandBuffer commandBuffer = m_commandBuffers[i].get();
-		vk::CommandBufferBeginInfo beginInfo{};
-		beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
-		commandBuffer.begin(beginInfo);
+	if (m_foveationMode == FoveationMode::Off)
+		return false;
+
+	const EyeViewport& viewport = m_renderTextureViewports[index];
+	const array<Fove::Vec2, 2> gazePixels{gazeToViewportPixel(m_gaze.l, viewport), gazeToViewportPixel(m_gaze.r, viewport)};
 
-		// render texture pass
+	if (m_foveationMode == FoveationMode::ShadingRate)
+	{
+		// The command buffer copies the buffer into the shading rate image each time it runs, so it doesn't need to be re-recorded
+		const vk::Extent2D shadingRateExtent = m_shadingRateExtents[index];
+		const float eyeWidth = static_cast<float>(singleEyeSize(m_renderTextureExtents[index]).x);
+		uint8_t* const data = m_shadingRateBufferData[index];
+		for (uint32_t y = 0; y < shadingRateExtent.height; ++y)
 		{
-			const uint32_t halfWidth = m_renderTextureExtent.width / 2;
-			const uint32_t height = m_renderTextureExtent.height;
-
-			const vk::ClearColorValue clearColorValue{array<float, 4>{0.3F, 0.3F, 0.8F, 0.3F}};
-			const vk::ClearValue clearColor{clearColorValue};
-
-			vk::RenderPassBeginInfo renderPassInfo;
-			renderPassInfo.renderPass = m_renderTextureRenderPass.get();
-			renderPassInfo.framebuffer = m_renderTextureFramebuffers[i].get();
-			renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
-			renderPassInfo.renderArea.extent = m_renderTextureExtent;
-			renderPassInfo.clearValueCount = 1;
-			renderPassInfo.pClearValues = &clearColor;
-			commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-			// For each left/right eyes
-			for (int32_t j = 0; j < 2; ++j)
+			for (uint32_t x = 0; x < shadingRateExtent.width; ++x)
 			{
-				const vk::Viewport currentViewport{static_cast<float>(halfWidth * j), 0, static_cast<float>(halfWidth), static_cast<float>(height), 0.0F, 1.0F};
-				const vk::Rect2D currentScissor{{static_cast<int32_t>(halfWidth * j), 0}, {halfWidth, height}};
-
-				const array<vk::Buffer, 1> vertexBuffers = {m_renderTextureVertexBuffer.get()};
-				vk::DeviceSize offsets[] = {0};
-
-				commandBuffer.setViewport(0, currentViewport);
-				commandBuffer.setScissor(0, currentScissor);
-				commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_renderTexturePipelineLayout.get(), 0, m_renderTextureDescriptorSets[2 * i + j].get(), nullptr);
-				commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_renderTextureGraphicsPipeline.get());
-				commandBuffer.bindVertexBuffers(0, vertexBuffers.size(), vertexBuffers.data(), offsets);
-				commandBuffer.draw(sceneVerts.size(), 1, 0, 0);
+				// Use the rate at the center of the tile, relative to the eye that tile belongs to
+				Fove::Vec2 pixel{(x + 0.5f) * m_shadingRateTexelSize.width, (y + 0.5f) * m_shadingRateTexelSize.height};
+				const size_t eye = pixel.x < eyeWidth ? 0 : 1;
+				pixel.x -= eye * eyeWidth;
+				const int fragmentSize = foveatedFragmentSize(pixel, gazePixels[eye], viewport, m_foveationSettings, m_maxFragmentSize);
+
+				// Vulkan encodes the rate as log2(width) << 2 | log2(height)
+				const uint8_t log2Size = fragmentSize == 4 ? 2 : fragmentSize == 2 ? 1 : 0;
+				data[y * shadingRateExtent.width + x] = static_cast<uint8_t>(log2Size << 2 | log2Size);
 			}
-			commandBuffer.endRenderPass();
 		}
+		return false;
+	}
+
+	const array<EyeViewport, 2> insets{foveaInset(gazePixels[0], viewport, m_foveationSettings), foveaInset(gazePixels[1], viewport, m_foveationSettings)};
+	if (insets == m_foveaInsets[index])
+		return false;
+	m_foveaInsets[index] = insets;
+	return true;
+}
+
+void VulkanResources::recordSceneDraws(const vk::CommandBuffer commandBuffer, const size_t i, const uint32_t eyeWidth, const EyeViewport& viewport, const array<EyeViewport, 2>& scissors)
+{
+	// For each left/right eyes
+	for (int32_t j = 0; j < 2; ++j)
+	{
+		const int32_t eyeX = static_cast<int32_t>(eyeWidth * j);
+		const vk::Viewport currentViewport{static_cast<float>(eyeX + viewport.offset.x), static_cast<float>(viewport.offset.y), static_cast<float>(viewport.size.x), static_cast<float>(viewport.size.y), 0.0F, 1.0F};
+		const vk::Rect2D currentScissor{{eyeX + scissors[j].offset.x, scissors[j].offset.y}, {static_cast<uint32_t>(scissors[j].size.x), static_cast<uint32_t>(scissors[j].size.y)}};
+
+		const array<vk::Buffer, 1> vertexBuffers = {m_renderTextureVertexBuffer.get()};
+		vk::DeviceSize offsets[] = {0};
+
+		commandBuffer.setViewport(0, currentViewport);
+		commandBuffer.setScissor(0, currentScissor);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_renderTexturePipelineLayout.get(), 0, m_renderTextureDescriptorSets[2 * i + j].get(), nullptr);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_renderTextureGraphicsPipeline.get());
+		commandBuffer.bindVertexBuffers(0, vertexBuffers.size(), vertexBuffers.data(), offsets);
+
+		// Draw every object of the scene
+		constexpr uint32_t stride = sizeof(DrawArraysIndirectCommand);
+		if (!m_drawIndirectFirstInstance)
+			for (const DrawArraysIndirectCommand& command : m_renderTextureDrawCommands)
+				commandBuffer.draw(command.vertexCount, command.instanceCount, command.firstVertex, command.firstInstance);
+		else if (m_multiDrawIndirect)
+			commandBuffer.drawIndirect(m_renderTextureDrawBuffer.get(), 0, m_renderTextureDrawCount, stride);
+		else
+			for (uint32_t command = 0; command < m_renderTextureDrawCount; ++command)
+				commandBuffer.drawIndirect(m_renderTextureDrawBuffer.get(), command * stride, 1, stride);
+	}
+}
+
+void VulkanResources::recordShadingRateUpload(const vk::CommandBuffer commandBuffer, const size_t i)
+{
+	// Copy the rates written by updateFoveation() into the shading rate image, then hand the image over to the rasterizer
+	// Host writes are made visible to the GPU by the queue submission, so no barrier is needed for the buffer
+	const vk::Image image = m_shadingRateImages[i].image.get();
+	const vk::ImageSubresourceRange subresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+
+	vk::ImageMemoryBarrier toTransfer{};
+	toTransfer.srcAccessMask = {};
+	toTransfer.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+	toTransfer.oldLayout = vk::ImageLayout::eUndefined; // The previous rates are overwritten anyway
+	toTransfer.newLayout = vk::ImageLayout::eTransferDstOptimal;
+	toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.image = image;
+	toTransfer.subresourceRange = subresourceRange;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, toTransfer);
+
+	vk::BufferImageCopy region{};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0; // Tightly packed
+	region.bufferImageHeight = 0;
+	region.imageSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+	region.imageOffset = vk::Offset3D{0, 0, 0};
+	region.imageExtent = vk::Extent3D{m_shadingRateExtents[i].width, m_shadingRateExtents[i].height, 1U};
+	commandBuffer.copyBufferToImage(m_shadingRateBuffers[i].buffer.get(), image, vk::ImageLayout::eTransferDstOptimal, region);
+
+	vk::ImageMemoryBarrier toAttachment{};
+	toAttachment.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	toAttachment.dstAccessMask = vk::AccessFlagBits::eFragmentShadingRateAttachmentReadKHR;
+	toAttachment.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+	toAttachment.newLayout = vk::ImageLayout::eFragmentShadingRateAttachmentOptimalKHR;
+	toAttachment.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toAttachment.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toAttachment.image = image;
+	toAttachment.subresourceRange = subresourceRange;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShadingRateAttachmentKHR, {}, nullptr, nullptr, toAttachment);
+}
+
+void VulkanResources::recordPeripheryPass(const vk::CommandBuffer commandBuffer, const size_t i)
+{
+	// Render both eyes at low resolution
+	// The render pass ends with the image ready to be sampled, like the render texture
+	const vk::ClearColorValue clearColorValue{array<float, 4>{0.3F, 0.3F, 0.8F, 0.3F}};
+	const vk::ClearValue clearColor{clearColorValue};
+
+	vk::RenderPassBeginInfo renderPassInfo;
+	renderPassInfo.renderPass = m_renderTextureRenderPass.get();
+	renderPassInfo.framebuffer = m_peripheryFramebuffers[i].get();
+	renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
+	renderPassInfo.renderArea.extent = m_peripheryExtents[i];
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearColor;
+
+	const EyeViewport viewport = peripheryViewport(m_renderTextureViewports[i], m_foveationSettings);
+	commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+	recordSceneDraws(commandBuffer, i, m_peripheryExtents[i].width / 2, viewport, {viewport, viewport});
+	commandBuffer.endRenderPass();
+}
+
+void VulkanResources::recordPeripheryUpscale(const vk::CommandBuffer commandBuffer, const size_t i, const size_t quadIndexCount)
+{
+	const array<vk::Buffer, 1> vertexBuffers = {m_swapchainVertexBuffer.get()};
+	vk::DeviceSize offsets[] = {0};
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_peripheryPipelineLayout.get(), 0, m_peripheryDescriptorSets[i].get(), nullptr);
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_peripheryGraphicsPipeline.get());
+	commandBuffer.bindVertexBuffers(0, vertexBuffers.size(), vertexBuffers.data(), offsets);
+	commandBuffer.bindIndexBuffer(m_swapchainIndexBuffer.get(), 0, vk::IndexType::eUint16);
+
+	// Stretch the low resolution viewport of each eye over its full resolution viewport, the same way the window copy works
+	const EyeViewport& viewport = m_renderTextureViewports[i];
+	const EyeViewport lowResViewport = peripheryViewport(viewport, m_foveationSettings);
+	const vk::Extent2D lowResExtent = m_peripheryExtents[i];
+	const uint32_t halfWidth = m_renderTextureExtents[i].width / 2;
+	for (uint32_t j = 0; j < 2; ++j)
+	{
+		const float lowResEyeX = static_cast<float>(lowResExtent.width / 2 * j);
+		const ViewportRect uvRect{
+			(lowResEyeX + lowResViewport.offset.x) / lowResExtent.width,
+			static_cast<float>(lowResViewport.offset.y) / lowResExtent.height,
+			static_cast<float>(lowResViewport.size.x) / lowResExtent.width,
+			static_cast<float>(lowResViewport.size.y) / lowResExtent.height,
+		};
+		const int32_t eyeX = static_cast<int32_t>(halfWidth * j);
+		const ViewportRect destRect{static_cast<float>(eyeX + viewport.offset.x), static_cast<float>(viewport.offset.y), static_cast<float>(viewport.size.x), static_cast<float>(viewport.size.y)};
+		const ViewportRect quadViewport = uvRectToViewport(uvRect, destRect);
+
+		const vk::Viewport currentViewport{quadViewport.x, quadViewport.y, quadViewport.width, quadViewport.height, 0.0F, 1.0F};
+		const vk::Rect2D currentScissor{{eyeX + viewport.offset.x, viewport.offset.y}, {static_cast<uint32_t>(viewport.size.x), static_cast<uint32_t>(viewport.size.y)}};
+		commandBuffer.setViewport(0, currentViewport);
+		commandBuffer.setScissor(0, currentScissor);
+		commandBuffer.drawIndexed(quadIndexCount, 1, 0, 0, 0);
+	}
+}
 
-		// render to debug screen
+void VulkanResources::recordCommandBuffers(const Span<const SwapchainVertex::IndexType> quadInds)
+{
+	for (size_t i = 0; i < m_commandBuffers.size(); ++i)
+	{
+		recordCommandBuffer(i, quadInds);
+	}
+}
+
+void VulkanResources::recordCommandBuffer(const size_t i, const Span<const SwapchainVertex::IndexType> quadInds)
+{
+	const vk::CommandBuffer commandBuffer = m_commandBuffers[i].get();
+	vk::CommandBufferBeginInfo beginInfo{};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+	commandBuffer.begin(beginInfo);
+
+	// Measure the GPU time of the render texture pass, for dynamic resolution
+	const uint32_t firstTimestamp = static_cast<uint32_t>(2 * i);
+	if (m_timestampQueryPool)
+	{
+		commandBuffer.resetQueryPool(m_timestampQueryPool.get(), firstTimestamp, 2);
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_timestampQueryPool.get(), firstTimestamp);
+	}
+
+	// Foveated rendering needs some work before the render texture pass
+	if (m_foveationMode == FoveationMode::ShadingRate)
+		recordShadingRateUpload(commandBuffer, i);
+	else if (m_foveationMode == FoveationMode::Inset)
+		recordPeripheryPass(commandBuffer, i);
+
+	// render texture pass
+	{
+		// Only the part of each eye covered by the (dynamic resolution) viewport is rendered to
+		const uint32_t halfWidth = m_renderTextureExtents[i].width / 2;
+		const EyeViewport& eyeViewport = m_renderTextureViewports[i];
+
+		const vk::ClearColorValue clearColorValue{array<float, 4>{0.3F, 0.3F, 0.8F, 0.3F}};
+		const vk::ClearValue clearColor{clearColorValue};
+
+		vk::RenderPassBeginInfo renderPassInfo;
+		renderPassInfo.renderPass = m_renderTextureRenderPass.get();
+		renderPassInfo.framebuffer = m_renderTextureFramebuffers[i].get();
+		renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
+		renderPassInfo.renderArea.extent = m_renderTextureExtents[i];
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearColor;
+		commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+		if (m_foveationMode == FoveationMode::Inset)
+		{
+			// Upscale the periphery, then render the scene over it at full resolution, but only within the insets
+			recordPeripheryUpscale(commandBuffer, i, quadInds.size());
+			recordSceneDraws(commandBuffer, i, halfWidth, eyeViewport, m_foveaInsets[i]);
+		}
+		else
+		{
+			recordSceneDraws(commandBuffer, i, halfWidth, eyeViewport, {eyeViewport, eyeViewport});
+		}
+		commandBuffer.endRenderPass();
+	}
+	if (m_timestampQueryPool)
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_timestampQueryPool.get(), firstTimestamp + 1);
+
+	// render to debug screen
+	{
+		const vk::ClearColorValue clearColorValue{array<float, 4>{0.0f, 0.0f, 1.0f, 1.0f}};
+		const vk::ClearValue clearColor{clearColorValue};
+		vk::RenderPassBeginInfo renderPassInfo;
+		renderPassInfo.renderPass = m_swapchainRenderPass.get();
+		renderPassInfo.framebuffer = m_swapchainFramebuffers[i].get();
+		renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
+		renderPassInfo.renderArea.extent = m_swapchainExtent;
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearColor;
+
+		const array<vk::Buffer, 1> vertexBuffers = {m_swapchainVertexBuffer.get()};
+		const vk::Buffer indexBuffer = m_swapchainIndexBuffer.get();
+		vk::DeviceSize offsets[] = {0};
+
+		commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_swapchainPipelineLayout.get(), 0, m_swapchainDescriptorSets[i].get(), nullptr);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_swapchainGraphicsPipeline.get());
+		commandBuffer.bindVertexBuffers(0, vertexBuffers.size(), vertexBuffers.data(), offsets);
+		commandBuffer.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
+
+		// Copy each eye to its half of the window
+		// The viewport is stretched so that only the rendered part of the eye lands in the window half, and the scissor cuts off the rest
+		const Fove::Vec2i eyeSize = singleEyeSize(m_renderTextureExtents[i]);
+		const uint32_t halfWindowWidth = m_swapchainExtent.width / 2;
+		for (int32_t j = 0; j < 2; ++j)
 		{
-			const vk::ClearColorValue clearColorValue{array<float, 4>{0.0f, 0.0f, 1.0f, 1.0f}};
-			const vk::ClearValue clearColor{clearColorValue};
-			vk::RenderPassBeginInfo renderPassInfo;
-			renderPassInfo.renderPass = m_swapchainRenderPass.get();
-			renderPassInfo.framebuffer = m_swapchainFramebuffers[i].get();
-			renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
-			renderPassInfo.renderArea.extent = m_swapchainExtent;
-			renderPassInfo.clearValueCount = 1;
-			renderPassInfo.pClearValues = &clearColor;
-
-			const vk::Viewport currentViewport{0, 0, static_cast<float>(m_swapchainExtent.width), static_cast<float>(m_swapchainExtent.height), 0.0F, 1.0F};
-			const vk::Rect2D currentScissor{{0, 0}, {m_swapchainExtent.width, m_swapchainExtent.height}};
-
-			const array<vk::Buffer, 1> vertexBuffers = {m_swapchainVertexBuffer.get()};
-			const vk::Buffer indexBuffer = m_swapchainIndexBuffer.get();
-			vk::DeviceSize offsets[] = {0};
-
-			commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+			const Fove::TextureBounds bounds = eyeTextureBounds(m_renderTextureViewports[i], eyeSize, j == 0);
+			const ViewportRect uvRect{bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top};
+			const ViewportRect destRect{static_cast<float>(halfWindowWidth * j), 0.0F, static_cast<float>(halfWindowWidth), static_cast<float>(m_swapchainExtent.height)};
+			const ViewportRect viewport = uvRectToViewport(uvRect, destRect);
+
+			const vk::Viewport currentViewport{viewport.x, viewport.y, viewport.width, viewport.height, 0.0F, 1.0F};
+			const vk::Rect2D currentScissor{{static_cast<int32_t>(halfWindowWidth * j), 0}, {halfWindowWidth, m_swapchainExtent.height}};
 			commandBuffer.setViewport(0, currentViewport);
 			commandBuffer.setScissor(0, currentScissor);
-			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_swapchainPipelineLayout.get(), 0, m_swapchainDescriptorSets[i].get(), nullptr);
-			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_swapchainGraphicsPipeline.get());
-			commandBuffer.bindVertexBuffers(0, vertexBuffers.size(), vertexBuffers.data(), offsets);
-			commandBuffer.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
 			commandBuffer.drawIndexed(quadInds.size(), 1, 0, 0, 0);
-			commandBuffer.endRenderPass();
 		}
-
-		commandBuffer.end();
+		commandBuffer.endRenderPass();
 	}
+
+	commandBuffer.end();
 }
 
-uint32_t VulkanResources::drawFrame(NativeWindow& nativeWindow, const RenderTextureUboLR& ubo)
+uint32_t VulkanResources::drawFrame(NativeWindow& nativeWindow, const function<RenderTextureUboLR()>& latchUbo)
 {
+	// Pick up resizes from the window event thread
+	if (nativeWindow.consumeResize())
+		m_swapchainFramebufferResized = true;
+
+	// The swapchain was recreated with another image count at the end of the previous frame
+	// Its render texture was submitted to the compositor since, so the resources of every image can now be replaced
+	if (m_commandBuffers.size() != m_swapchainImages.size())
+		recreateImageResources();
+
 	const auto currentFrame = m_currentFrame;
 	if (const auto res = m_device->waitForFences(m_inFlightFences[currentFrame].get(), true, UINT64_MAX); res != vk::Result::eSuccess)
 	{
@@ -1979,9 +2926,6 @@ uint32_t VulkanResources::drawFrame(NativeWindow& nativeWindow, const RenderText
 	}
 
 	const uint32_t imageIndex = result.value;
-	updateRenderTextureUniformBuffer(2U * imageIndex + 0U, ubo.uboL); // left
-	updateRenderTextureUniformBuffer(2U * imageIndex + 1U, ubo.uboR); // right
-
 	if (m_imageInUseFences[imageIndex] != vk::Fence{nullptr})
 	{
 		const auto res = m_device->waitForFences(m_imageInUseFences[imageIndex], true, UINT64_MAX);
@@ -1992,6 +2936,31 @@ uint32_t VulkanResources::drawFrame(NativeWindow& nativeWindow, const RenderText
 	}
 	m_imageInUseFences[imageIndex] = m_inFlightFences[currentFrame].get();
 
+	// Now that the GPU is done with this image, we can reallocate its render texture if a resize is pending
+	// The other images keep their old size until their own turn comes, so no frame ever waits for the resize
+	bool needsRecording = false;
+	if (m_renderTextureExtents[imageIndex] != m_renderTextureExtent)
+	{
+		recreateRenderTexture(imageIndex);
+		needsRecording = true;
+	}
+
+	// Likewise, the GPU time of the last frame rendered with this image can now be read without waiting
+	// The viewport is baked into the command buffer, so it's re-recorded whenever the resolution scale changes
+	readRenderTextureGpuTime(imageIndex);
+	const EyeViewport eyeViewport = scaledEyeViewport(singleEyeSize(m_renderTextureExtents[imageIndex]), m_dynamicResolution.scale());
+	if (eyeViewport != m_renderTextureViewports[imageIndex])
+	{
+		m_renderTextureViewports[imageIndex] = eyeViewport;
+		needsRecording = true;
+	}
+
+	// Foveated rendering follows the latest gaze
+	if (updateFoveation(imageIndex))
+		needsRecording = true;
+	if (needsRecording)
+		recordCommandBuffer(imageIndex, Span<const SwapchainVertex::IndexType>{g_indices2});
+
 	vk::PipelineStageFlags waitStages{vk::PipelineStageFlagBits::eColorAttachmentOutput};
 
 	vk::SubmitInfo submitInfo;
@@ -2003,8 +2972,16 @@ uint32_t VulkanResources::drawFrame(NativeWindow& nativeWindow, const RenderText
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &m_commandBuffers[imageIndex].get();
 
+	// Late latch: the uniforms are written last, so the pose is as recent as possible when the GPU starts on the frame
+	// The GPU is done with this image (see m_imageInUseFences above), so its uniform buffers can be overwritten
+	const RenderTextureUboLR ubo = latchUbo();
+	updateRenderTextureUniformBuffer(2U * imageIndex + 0U, ubo.uboL); // left
+	updateRenderTextureUniformBuffer(2U * imageIndex + 1U, ubo.uboR); // right
+	updateRenderTextureObjectBuffer(imageIndex, ubo.uboL.selection);
+
 	m_device->resetFences(m_inFlightFences[currentFrame].get());
 	m_queue.submit(submitInfo, m_inFlightFences[currentFrame].get());
+	m_timestampsPending[imageIndex] = true;
 
 	vk::PresentInfoKHR presentInfo;
 	presentInfo.waitSemaphoreCount = 1;
@@ -2053,21 +3030,29 @@ public:
 	VulkanExample(const VulkanExample&) = delete;
 	VulkanExample& operator=(const VulkanExample&) = delete;
 
-	void initVulkan(NativeWindow&);
+	void initVulkan(NativeWindow&, bool foveated);
 	void initRenderTexturePipeline(const uint32_t nImages, const uint32_t width, const uint32_t height, Span<const RenderTextureVertex>);
 	void initSwapchainPipeline(const uint32_t nImages, Span<const SwapchainVertex>, Span<const SwapchainVertex::IndexType>);
 	void initCommandBuffers(const uint32_t nImages, const uint32_t nMaxFramesInFlight);
 
 	uint32_t nSwapchainImages() const; // valid after initVulkan()
-	uint32_t draw(const RenderTextureUboLR&);
+	uint32_t draw(const function<RenderTextureUboLR()>& latchUbo);
+	void resizeRenderTextures(const uint32_t width, const uint32_t height) { m_vulkan.resizeRenderTextures(width, height); }
+	void setGaze(const Fove::Stereo<Fove::Vec2>& gaze) { m_vulkan.setGaze(gaze); }
+
+	// Part of the texture of the given image to submit for each eye, which shrinks under dynamic resolution
+	Fove::TextureBounds textureBounds(const uint32_t index, const bool isLeft) const
+	{
+		return eyeTextureBounds(m_vulkan.m_renderTextureViewports[index], singleEyeSize(m_vulkan.m_renderTextureExtents[index]), isLeft);
+	}
 
 	const Fove::VulkanTexture texture(const uint32_t index) const
 	{
 		Fove::VulkanTexture tex{
 			textureContext(),
 			textureResources(index),
-			m_vulkan.m_renderTextureExtent.width,
-			m_vulkan.m_renderTextureExtent.height,
+			m_vulkan.m_renderTextureExtents[index].width,
+			m_vulkan.m_renderTextureExtents[index].height,
 		};
 		return tex;
 	}
@@ -2116,7 +3101,7 @@ private:
 };
 
 // Need to setup your own Vulkan context, apart from the one that Fove SDK uses.
-void VulkanExample::initVulkan(NativeWindow& nativeWindow)
+void VulkanExample::initVulkan(NativeWindow& nativeWindow, const bool foveated)
 {
 	m_nativeWindow = &nativeWindow;
 	// get the instance independent function pointers
@@ -2133,6 +3118,8 @@ void VulkanExample::initVulkan(NativeWindow& nativeWindow)
 	m_vulkan.createXlibSurface(nativeWindow.xDisplay(), nativeWindow.xWindow());
 	m_vulkan.pickPhysicalDevice();
 	m_vulkan.pickQueue();
+	if (foveated)
+		m_vulkan.requestFoveation();
 	m_vulkan.createLogicalDevice();
 
 	const auto size = nativeWindow.windowSize();
@@ -2164,9 +3151,12 @@ void VulkanExample::initRenderTexturePipeline(const uint32_t nImages, const uint
 	m_vulkan.createRenderTextureRenderPass();
 	m_vulkan.createRenderTextureDescriptorSetLayout();
 	m_vulkan.createRenderTextureGraphicsPipeline();
+	m_vulkan.createFoveationPipeline();
 	m_vulkan.createRenderTextureFramebuffers();
 	m_vulkan.createRenderTextureVertexBuffer(verts);
+	m_vulkan.createRenderTextureDrawBuffer(verts);
 	m_vulkan.createRenderTextureUniformBuffers();
+	m_vulkan.createRenderTextureObjectBuffers();
 	m_vulkan.createRenderTextureDescriptorPool();
 	m_vulkan.createRenderTextureDescriptorSets();
 }
@@ -2189,8 +3179,9 @@ void VulkanExample::initCommandBuffers(const uint32_t nImages, const uint32_t nM
 {
 	m_vulkan.createCommandBuffers(nImages);
 	m_vulkan.createSyncObjects(nImages, nMaxFramesInFlight);
+	m_vulkan.createTimestampQueryPool(nImages);
 
-	m_vulkan.recordCommandBuffers(Span<const RenderTextureVertex>{levelModelVerts}, Span<const SwapchainVertex::IndexType>{g_indices2});
+	m_vulkan.recordCommandBuffers(Span<const SwapchainVertex::IndexType>{g_indices2});
 }
 
 uint32_t VulkanExample::nSwapchainImages() const
@@ -2198,9 +3189,9 @@ uint32_t VulkanExample::nSwapchainImages() const
 	return static_cast<uint32_t>(m_vulkan.m_swapchainImages.size());
 }
 
-uint32_t VulkanExample::draw(const RenderTextureUboLR& ubo)
+uint32_t VulkanExample::draw(const function<RenderTextureUboLR()>& latchUbo)
 {
-	return m_vulkan.drawFrame(*m_nativeWindow, ubo);
+	return m_vulkan.drawFrame(*m_nativeWindow, latchUbo);
 }
 
 int run(NativeLaunchInfo info)
@@ -2212,10 +3203,55 @@ try
 	// In real applications, you probably wants to do more proper error handling.
 	Fove::Headset headset = Fove::Headset::create(Fove::ClientCapabilities::OrientationTracking | Fove::ClientCapabilities::PositionTracking | Fove::ClientCapabilities::EyeTracking | Fove::ClientCapabilities::GazedObjectDetection).getValue();
 
+	// Usage: FoveVulkanExample [--foveated] [--predict none|velocity|acceleration] [--predict-smoothing seconds] [--heatmap prefix] [--scene-scale S] [--scene-seed N]
+	// With --foveated, the scene is rendered with less detail away from the gaze point of each eye
+	// With --predict, the head pose is extrapolated to the expected display time (see PosePrediction.h)
+	// With --heatmap, where the gaze dwells is accumulated (see GazeHeatmap.h), and written to prefix.ppm and prefix_objects.csv on exit
+	// With --scene-scale, the level is replaced by a generated scene with S times as many objects (see SceneGenerator.h), whose layout is picked by --scene-seed
+	const vector<string> args = getCommandLineArgs(info);
+	bool foveated = false;
+	string heatmapPrefix;
+	float sceneScale = 0;
+	uint32_t sceneSeed = 1;
+	PosePredictor::Settings predictionSettings;
+	predictionSettings.model = PredictionModel::None;
+	for (size_t i = 0; i < args.size(); ++i)
+	{
+		const bool hasValue = i + 1 < args.size();
+		if (args[i] == "--foveated")
+			foveated = true;
+		else if (args[i] == "--predict" && hasValue)
+			predictionSettings.model = parsePredictionModel(args[++i]);
+		else if (args[i] == "--predict-smoothing" && hasValue)
+			predictionSettings.smoothingSeconds = stof(args[++i]);
+		else if (args[i] == "--heatmap" && hasValue)
+			heatmapPrefix = args[++i];
+		else if (args[i] == "--scene-scale" && hasValue)
+			sceneScale = stof(args[++i]);
+		else if (args[i] == "--scene-seed" && hasValue)
+			sceneSeed = static_cast<uint32_t>(stoul(args[++i]));
+	}
+	if (sceneScale < 0)
+		throw "Invalid scene scale";
+	const SceneModel model = sceneModelAtScale(sceneScale, sceneSeed);
+	if (sceneScale > 0)
+		cout << "Generated a scene of " << model.sphereCount() << " objects (" << model.vertexCount() << " vertices)\n";
+	PosePredictor posePredictor(predictionSettings);
+	unique_ptr<GazeHeatmap> heatmap;
+	unique_ptr<GazeHeatmap::Producer> heatmapProducer;
+	if (!heatmapPrefix.empty())
+	{
+		// Track the dwell time of every object of the scene, which can have many more than the default id range
+		GazeHeatmapSettings heatmapSettings;
+		heatmapSettings.maxObjectId = model.maxObjectId();
+		heatmap = make_unique<GazeHeatmap>(heatmapSettings);
+		heatmapProducer = make_unique<GazeHeatmap::Producer>(*heatmap);
+	}
+
 	// Create a window and setup a Vulkan instance associated with it
 	NativeWindow nativeWindow = createNativeWindow(info, appName);
 	VulkanExample app{};
-	app.initVulkan(nativeWindow);
+	app.initVulkan(nativeWindow, foveated);
 
 	// Connect to compositor
 	// The compositor uses the vulkan context so it should be killed before (and thus created after)
@@ -2235,7 +3271,7 @@ try
 
 	// Prepare gpu resources needed for rendering
 	const uint32_t nImages = app.nSwapchainImages();
-	app.initRenderTexturePipeline(nImages, 2 * resolutionPerEye.x, resolutionPerEye.y, Span<const RenderTextureVertex>{levelModelVerts});
+	app.initRenderTexturePipeline(nImages, 2 * resolutionPerEye.x, resolutionPerEye.y, Span<const RenderTextureVertex>{reinterpret_cast<const RenderTextureVertex*>(model.verts.data()), model.vertexCount()});
 	app.initSwapchainPipeline(nImages, Span<const SwapchainVertex>{g_vertices2}, Span<const SwapchainVertex::IndexType>{g_indices2});
 	// Define the rendering logic by pre-recording to command buffers
 	app.initCommandBuffers(nImages, N_MAX_FRAMES_IN_FLIGHT);
@@ -2254,25 +3290,29 @@ try
 
 		// This can also be done manually if needed, using the gaze vectors,
 		// but we recommend using the FOVE API, as the additional scene info can increase the accuracy of ET
-		constexpr size_t numSphereFloats = sizeof(collisionSpheres) / sizeof(float);
-		static_assert(numSphereFloats % 5 == 0, "Invalid collision sphere format");
-		constexpr size_t numSpheres = numSphereFloats / 5;
-		for (size_t i = 0; i < numSpheres; ++i)
+		for (size_t i = 0; i < model.sphereCount(); ++i)
 		{
+			const float* const sphere = &model.spheres[i * sceneFloatsPerSphere];
+
 			Fove::ObjectCollider collider;
-			collider.center = Fove::Vec3{collisionSpheres[i * 5 + 2], collisionSpheres[i * 5 + 3], collisionSpheres[i * 5 + 4]};
+			collider.center = Fove::Vec3{sphere[2], sphere[3], sphere[4]};
 			collider.shapeType = Fove::ColliderType::Sphere;
-			collider.shapeDefinition.sphere.radius = collisionSpheres[i * 5 + 1];
+			collider.shapeDefinition.sphere.radius = sphere[1];
 
 			Fove::GazableObject object;
 			object.colliderCount = 1;
 			object.colliders = &collider;
 			object.group = Fove::ObjectGroup::Group0; // Groups allows masking of different objects to difference cameras (not needed here)
-			object.id = static_cast<int>(collisionSpheres[i * 5 + 0]);
+			object.id = static_cast<int>(sphere[0]);
 			checkError(headset.registerGazableObject(object), "registerGazableObject");
 		}
 	}
 
+	Fove::Stereo<Fove::Vec2> gaze{}; // Start looking at the center
+	constexpr int lateLatchReportFrames = 900; // About 10 seconds at the HMD frame rate
+	uint64_t lateLatchSavedUs = 0;
+	int lateLatchFrames = 0;
+	uint64_t previousRenderPoseTimestamp = 0;
 	while (true)
 	{
 		// Update ubo and selected model
@@ -2291,13 +3331,42 @@ try
 				{
 					if ((layerOrError = compositor.createLayer(layerCreateInfo)).isValid())
 					{
-						// TODO resize rendering surface
+						// We were rendering at the default size so far, switch to the resolution the compositor wants
+						app.resizeRenderTextures(2 * layerOrError->idealResolutionPerEye.x, layerOrError->idealResolutionPerEye.y);
 					}
 				}
 			}
 
 			// Determine the selection object based on what's being gazed at
-			headset.fetchEyeTrackingData();
+			const Fove::Result<Fove::FrameTimestamp> eyeFrameOrError = headset.fetchEyeTrackingData();
+
+			// Accumulate the gaze of each new eye frame
+			// We render slower than the eye camera runs, so some frames are missed, and the samples we get stand in for them
+			if (heatmapProducer && eyeFrameOrError)
+			{
+				EyeFrame frame;
+				frame.id = eyeFrameOrError->id;
+				frame.timestamp = eyeFrameOrError->timestamp;
+				if (const Fove::Result<Fove::Vec2> positionOrError = headset.getGazeScreenPositionCombined())
+				{
+					frame.gazeValid = true;
+					frame.screenPosition = positionOrError.getValue();
+				}
+				if (const Fove::Result<int> idOrError = headset.getGazedObjectId())
+					frame.gazedObjectId = idOrError.getValue();
+				heatmapProducer->addFrame(frame);
+			}
+
+			// Move the foveated area along with the gaze
+			// If an eye isn't tracked (eg. blinking), its previous gaze is kept
+			if (foveated)
+			{
+				if (const Fove::Result<Fove::Vec2> gazeOrError = headset.getGazeScreenPosition(Fove::Eye::Left))
+					gaze.l = gazeOrError.getValue();
+				if (const Fove::Result<Fove::Vec2> gazeOrError = headset.getGazeScreenPosition(Fove::Eye::Right))
+					gaze.r = gazeOrError.getValue();
+				app.setGaze(gaze);
+			}
 			if (const Fove::Result<int> gazeOrError = headset.getGazedObjectId(); gazeOrError && gazeOrError.getValue() != fove_ObjectIdInvalid)
 			{
 				ubo.uboL.selection = static_cast<float>(gazeOrError.getValue());
@@ -2311,7 +3380,7 @@ try
 		// This is to ensure the quickest possible turnaround time from being signaled to presenting a frame,
 		// such that we reduce the risk of missing a frame due to time spent during update
 		const Fove::Result<Fove::Pose> poseOrError = compositor.waitForRenderPose();
-		const Fove::Pose pose = poseOrError.isValid() ? poseOrError.getValue() : Fove::Pose();
+		const Fove::Pose renderPose = poseOrError.isValid() ? poseOrError.getValue() : Fove::Pose();
 		if (poseOrError.isValid())
 		{
 			// If there was an error waiting, it's possible that WaitForRenderPose returned immediately
@@ -2319,37 +3388,61 @@ try
 			this_thread::sleep_for(10ms);
 		}
 
-		// Prepare uniforms
-		{
+		// Prepare the parts of the uniforms that don't depend on the pose
+		// Adjust clipspace coordinates
+		const Fove::Matrix44 glToVk = {{
+			{1.0F, 0.0F, 0.0F, 0.0F},
+			{0.0F, -1.0F, 0.0F, 0.0F}, // y to -y
+			{0.0F, 0.0F, 0.5F, 0.5F},  // adjust z clip
+			{0.0F, 0.0F, 0.0F, 1.0F},
+		}};
+
+		// Get distance between eyes to shift camera for stereo effect
+		const Fove::Result<float> iodOrError = headset.getRenderIOD();
+		const float halfIOD = 0.5f * (iodOrError.isValid() ? iodOrError.getValue() : 0.064f);
+
+		// Fetch the projection matrices
+		const Fove::Result<Fove::Stereo<Fove::Matrix44>> projectionsOrError = headset.getProjectionMatricesLH(0.01f, 1000.0f);
+
+		// Render the scene to the texture and present it to the host screen
+		// The pose is latched at the last moment: by the time recording & resource updates are done, the headset has usually moved on from the render pose
+		// The latched pose is the one submitted to the compositor below, so its reprojection corrects for exactly what we rendered
+		Fove::Pose measuredPose = renderPose;
+		Fove::Pose pose = renderPose;
+		chrono::steady_clock::time_point latchTime;
+		const auto index = app.draw([&] {
+			headset.fetchPoseData();
+			if (const Fove::Result<Fove::Pose> latestOrError = headset.getPose(); latestOrError && latestOrError->timestamp > measuredPose.timestamp)
+				measuredPose = latestOrError.getValue();
+			latchTime = chrono::steady_clock::now();
+			pose = posePredictor.predict(measuredPose);
+
 			// Compute the modelview matrix
 			// Everything here is reverse since we are moving the world we are going to draw, not the camera
 			const Fove::Matrix44 modelView = quatToMatrix(conjugate(pose.orientation))                                 // Apply the HMD orientation
 											 * translationMatrix(-pose.position.x, -pose.position.y, -pose.position.z) // Apply the position tracking offset
 											 * translationMatrix(0, -playerHeight, 0);                                 // Move ground downwards to compensate for player height
-			// Adjust clipspace coordinates
-			const Fove::Matrix44 glToVk = {{
-				{1.0F, 0.0F, 0.0F, 0.0F},
-				{0.0F, -1.0F, 0.0F, 0.0F}, // y to -y
-				{0.0F, 0.0F, 0.5F, 0.5F},  // adjust z clip
-				{0.0F, 0.0F, 0.0F, 1.0F},
-			}};
-
-			// Get distance between eyes to shift camera for stereo effect
-			const Fove::Result<float> iodOrError = headset.getRenderIOD();
-			const float halfIOD = 0.5f * (iodOrError.isValid() ? iodOrError.getValue() : 0.064f);
-
-			// Fetch the projection matrices
-			Fove::Result<Fove::Stereo<Fove::Matrix44>> projectionsOrError = headset.getProjectionMatricesLH(0.01f, 1000.0f);
 			if (projectionsOrError.isValid())
 			{
+				// Render the scene twice, once for the left, once for the right
 				ubo.uboL.mvp = glToVk * transpose(projectionsOrError->l) * translationMatrix(+halfIOD, 0, 0) * modelView;
 				ubo.uboR.mvp = glToVk * transpose(projectionsOrError->r) * translationMatrix(-halfIOD, 0, 0) * modelView;
-				// Render the scene twice, once for the left, once for the right
 			}
-		}
+			return ubo;
+		});
 
-		// Render the scene to the texture and present it to the host screen
-		const auto index = app.draw(ubo);
+		// Report how much more recent the latched poses were, on average, than the render poses
+		if (renderPose.timestamp != 0 && measuredPose.timestamp > renderPose.timestamp)
+			lateLatchSavedUs += measuredPose.timestamp - renderPose.timestamp;
+		if (++lateLatchFrames == lateLatchReportFrames)
+		{
+			cout << "Late latching: pose " << lateLatchSavedUs / 1000.0 / lateLatchFrames << "ms newer than the render pose on average\n";
+			if (predictionSettings.model != PredictionModel::None)
+				cout << "Pose prediction: " << posePredictor.latency() * 1000 << "ms ahead\n";
+			cout << flush;
+			lateLatchSavedUs = 0;
+			lateLatchFrames = 0;
+		}
 
 		// Present rendered results to compositor
 		if (layerOrError)
@@ -2362,33 +3455,47 @@ try
 			submitInfo.left.texInfo = &tex;
 			submitInfo.right.texInfo = &tex;
 
-			Fove::TextureBounds bounds{};
-			bounds.top = 0.0F;
-			bounds.bottom = 1.0F;
-			bounds.left = 0.0F;
-			bounds.right = 0.5F;
-			submitInfo.left.bounds = bounds;
-			bounds.left = 0.5F;
-			bounds.right = 1.0F;
-			submitInfo.right.bounds = bounds;
+			// Only submit the part of each half that was rendered to
+			submitInfo.left.bounds = app.textureBounds(index, true);
+			submitInfo.right.bounds = app.textureBounds(index, false);
 
 			compositor.submit(submitInfo); // Error ignored, just continue rendering to the window when we're disconnected
 		}
 
+		// Measure how far ahead to predict the next poses
+		// The frame reaches the display about one compositor frame after it's submitted, and the render poses are one compositor frame apart
+		if (renderPose.timestamp > previousRenderPoseTimestamp && previousRenderPoseTimestamp != 0)
+		{
+			const float submitSeconds = chrono::duration<float>(chrono::steady_clock::now() - latchTime).count();
+			const float compositorFrameSeconds = (renderPose.timestamp - previousRenderPoseTimestamp) / 1e6f;
+			posePredictor.addLatencySample(submitSeconds + compositorFrameSeconds);
+		}
+		previousRenderPoseTimestamp = renderPose.timestamp;
+
 		// Update camera position used by FOVE gaze detection
+		// Gaze detection happens now, not at display time, so use the measured pose rather than the predicted one
 		Fove::ObjectPose camPose;
-		camPose.position = pose.position;
+		camPose.position = measuredPose.position;
 		camPose.position.y += playerHeight;
-		camPose.velocity = pose.velocity;
-		camPose.rotation = pose.orientation;
+		camPose.velocity = measuredPose.velocity;
+		camPose.rotation = measuredPose.orientation;
 		checkError(headset.updateCameraObject(cameraId, camPose), "updateCameraObject");
 	}
 
+	if (heatmap)
+	{
+		heatmapProducer->finish();
+		const GazeHeatmapSnapshot snapshot = heatmap->snapshot();
+		writeHeatmapPpm(snapshot, heatmapPrefix + ".ppm");
+		writeObjectDwellCsv(snapshot, heatmapPrefix + "_objects.csv");
+		cout << "Heatmap written to " << heatmapPrefix << ".ppm and " << heatmapPrefix << "_objects.csv" << endl;
+	}
+
 	return 0;
 }
 catch (...)
 {
-	showErrorBox("Error: " + currentExceptionMessage());
+	showErrorBox(currentExceptionMessage());
 	return -1;
 }
 
@@ -1,5 +1,6 @@
 #include "NativeUtil.h"
 #include "Util.h"
+#include <shellapi.h>
 
 using namespace std;
 
@@ -15,6 +16,21 @@ LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lPa
 	return DefWindowProc(window, message, wParam, lParam);
 }
 
+vector<string> getCommandLineArgs(const NativeLaunchInfo&)
+{
+	// wWinMain doesn't give us argv, so split the command line ourselves
+	int argc = 0;
+	LPWSTR* const argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	if (!argv)
+		throw "CommandLineToArgvW: " + getLastErrorAsString();
+
+	vector<string> args;
+	for (int i = 1; i < argc; ++i)
+		args.emplace_back(toUtf8(argv[i]));
+	LocalFree(argv);
+	return args;
+}
+
 NativeWindow createNativeWindow(NativeLaunchInfo& nativeLaunchInfo, const string& windowTitle)
 {
 	// Register class
@@ -0,0 +1,111 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+
+// Range of tasks left to a worker. The owner takes from the front, thieves take from the back
+// Aligned so that the queues of different workers don't share cache lines
+struct alignas(64) TaskQueue
+{
+	mutex lock;
+	size_t begin = 0;
+	size_t end = 0;
+};
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(const size_t threadCount)
+	: m_threadCount(threadCount > 0 ? threadCount : max<size_t>(thread::hardware_concurrency(), 1))
+{
+}
+
+void WorkStealingPool::run(const size_t taskCount, const function<void(size_t, size_t)>& task)
+{
+	const size_t workerCount = max<size_t>(min(m_threadCount, taskCount), 1);
+	m_stats.assign(m_threadCount, WorkerStats{});
+
+	const unique_ptr<TaskQueue[]> queues(new TaskQueue[workerCount]);
+	for (size_t w = 0; w < workerCount; ++w)
+	{
+		queues[w].begin = taskCount * w / workerCount;
+		queues[w].end = taskCount * (w + 1) / workerCount;
+	}
+
+	mutex errorLock;
+	exception_ptr error;
+
+	const auto Worker = [&](const size_t worker) {
+		TaskQueue& own = queues[worker];
+		WorkerStats& stats = m_stats[worker];
+		while (true)
+		{
+			// Take the next task of our own range
+			size_t index = 0;
+			bool found = false;
+			{
+				const lock_guard<mutex> lock(own.lock);
+				if (own.begin < own.end)
+				{
+					index = own.begin++;
+					found = true;
+				}
+			}
+
+			// Otherwise steal half of the range of the first worker that still has some, starting with our neighbour
+			// Tasks are never added during a run, so finding every range empty means we're done
+			for (size_t i = 1; !found && i < workerCount; ++i)
+			{
+				TaskQueue& victim = queues[(worker + i) % workerCount];
+				size_t begin = 0;
+				size_t end = 0;
+				{
+					const lock_guard<mutex> lock(victim.lock);
+					if (victim.begin >= victim.end)
+						continue;
+					end = victim.end;
+					begin = victim.end - (victim.end - victim.begin + 1) / 2;
+					victim.end = begin;
+				}
+				++stats.steals;
+				index = begin;
+				found = true;
+				const lock_guard<mutex> lock(own.lock);
+				own.begin = begin + 1;
+				own.end = end;
+			}
+			if (!found)
+				return;
+
+			++stats.tasks;
+			try
+			{
+				task(index, worker);
+			}
+			catch (...)
+			{
+				const lock_guard<mutex> lock(errorLock);
+				if (!error)
+					error = current_exception();
+			}
+		}
+	};
+
+	// The calling thread is one of the workers
+	vector<thread> threads;
+	threads.reserve(workerCount - 1);
+	for (size_t w = 1; w < workerCount; ++w)
+		threads.emplace_back(Worker, w);
+	Worker(0);
+	for (thread& t : threads)
+		t.join();
+
+	if (error)
+		rethrow_exception(error);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// This header implements a work stealing thread pool, to run many independent tasks of uneven size in parallel
+//
+// Each worker starts with its own contiguous share of the tasks, and goes through it in order.
+// A worker that runs out steals the second half of the remaining tasks of another worker, so the load balances itself
+// whatever the task sizes are, while the workers only touch each other's state when stealing.
+
+class WorkStealingPool
+{
+public:
+	// Counters of the last run, per worker
+	struct WorkerStats
+	{
+		size_t tasks = 0;  // Tasks run by this worker
+		size_t steals = 0; // Successful steals by this worker
+	};
+
+	// A thread count of 0 uses one thread per hardware thread
+	explicit WorkStealingPool(size_t threadCount = 0);
+
+	size_t threadCount() const { return m_threadCount; }
+
+	// Runs task(index, worker) for every index from 0 to taskCount - 1, and returns once they're all done
+	// The worker index, from 0 to threadCount() - 1, lets tasks use per-worker state without locking
+	// If tasks throw, the remaining tasks still run, and the first exception is rethrown once they are done
+	void run(size_t taskCount, const std::function<void(size_t index, size_t worker)>& task);
+
+	const std::vector<WorkerStats>& lastRunStats() const { return m_stats; }
+
+private:
+	size_t m_threadCount = 1;
+	std::vector<WorkerStats> m_stats;
+};
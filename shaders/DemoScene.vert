@@ -15,12 +15,22 @@ layout(location = 0) out vec3 fragColor;
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 mvp;
-    float selection;
+    float selection; // Unused, the highlight is per object
 } ubo;
 
+// Per-object data (SceneObjectData in SceneObjects.h)
+struct Object {
+    mat4 model;
+    float highlight;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    Object objects[];
+};
+
 void main() {
+    // The first instance of the draw command of each object is the index of the object (see SceneObjects.h)
     // Fove::Matrix44 is stored in a row-major format
-    gl_Position = vec4(inPosition.xyz, 1.0) * ubo.mvp;
-	const float selection = max(0.0, 0.5 - abs(ubo.selection - inPosition.w));
-    fragColor = inColor + vec3(selection);
+    gl_Position = vec4(inPosition.xyz, 1.0) * objects[gl_InstanceIndex].model * ubo.mvp;
+    fragColor = inColor + vec3(objects[gl_InstanceIndex].highlight);
 }